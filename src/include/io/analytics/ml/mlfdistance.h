@@ -57,5 +57,24 @@ int32_t vh_mlf_distance_vectordot(void **cache,
 								  TypeVarSlot **instance, 
 								  int32_t n_datas);
 
+/*
+ * Packed Distance Functions
+ *
+ * Models that pack their training set into a contiguous matrix of float64 or
+ * float32 features can skip the TypeVar machinery entirely.  The packed
+ * functions take two rows of |n| features and return the distance as a double.
+ *
+ * vh_mlf_distance_packed returns the packed equivalent of one of the distance
+ * functions above, or null if there isn't one.  AVX2 kernels are used when the
+ * CPU supports them, then SSE2 and finally a scalar loop.
+ */
+
+typedef double (*vh_mlf_pdistance_func)(const void *lhs, 
+										const void *rhs,
+										int32_t n);
+
+vh_mlf_pdistance_func vh_mlf_distance_packed(vh_mlf_distance_func distance,
+											 bool f32);
+
 #endif
 
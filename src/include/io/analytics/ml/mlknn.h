@@ -39,5 +39,30 @@ void* vh_ml_knn_create(SearchPath *paths, int32_t n_paths,
 					   vh_mlf_distance_func distance,
 					   ML_KNN_Mode mode);
 
+/*
+ * Packed Training Sets
+ *
+ * By default the training set is kept as a list of HeapTuplePtr and every
+ * prediction reads each training tuple back thru the search paths.  Packing
+ * converts the input fields to float64 or float32 at train time and stores
+ * them in one contiguous feature matrix, which the packed distance kernels
+ * in mlfdistance.h run over directly.  Only the k nearest neighbors are read
+ * back from the HeapTuplePtr to vote on the class.
+ *
+ * vh_ml_knn_pack must be called before the first training tuple.  It returns
+ * false if training has started or the distance function has no packed
+ * equivalent.  Each input path is expected to resolve to the same type for
+ * every training tuple and every instance.
+ */
+
+typedef enum
+{
+	KNN_PackNone,
+	KNN_PackFloat64,
+	KNN_PackFloat32
+} ML_KNN_Pack;
+
+bool vh_ml_knn_pack(void *knn, ML_KNN_Pack pack);
+
 #endif
 
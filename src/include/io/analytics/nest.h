@@ -60,5 +60,25 @@ Nest vh_nest_create(void);
 int32_t vh_nest_level_add(Nest nest, NestLevel nl);
 int32_t vh_nest_input_htp(Nest nest, HeapTuplePtr htp);
 
+/*
+ * vh_nest_input_htp_parallel
+ *
+ * Splits |htps| into |n_workers| contiguous partitions and runs each on its
+ * own thread.  Every worker attaches a CatalogContext, builds a partial Nest
+ * with thread local NestIdx and TypeVarAcm states and inputs its partition.
+ * Once all of the workers are done, the calling thread merges the partials
+ * into |nest| with vh_acms_merge before letting the workers detach.
+ *
+ * The HeapBuffer isn't thread safe, so the calling thread resolves every
+ * HeapTuple before the workers start and the workers never touch it.
+ *
+ * The PrepCol and SearchPath attached to the NestLevels are shared by the
+ * workers and must be safe to call from several threads at once.  If a
+ * worker can't attach, the calling thread inputs that partition itself.
+ */
+int32_t vh_nest_input_htp_parallel(Nest nest, 
+								   HeapTuplePtr *htps, int32_t n_htps,
+								   int32_t n_workers);
+
 #endif
 
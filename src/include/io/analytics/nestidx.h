@@ -10,7 +10,13 @@
 #include "io/catalog/TypeVarSlot.h"
 
 #define VH_NESTIDX_METH_BTREE 	0x01
-#define VH_NESTIDX_METH_MAX		1
+#define VH_NESTIDX_METH_HASH	0x02
+#define VH_NESTIDX_METH_MAX		2
+
+/*
+ * Size of the NestIdxValue on each index leaf.
+ */
+#define VH_NESTIDX_LEAF_SZ		2000
 
 typedef struct NestIdxAccessData *NestIdxAccess;
 
@@ -27,6 +33,12 @@ struct NestIdxFuncTable
 {
 	int32_t (*access)(NestIdx idx, TypeVarSlot **keys, int32_t am, NestIdxAccess nia);
 
+	/*
+	 * Orders the index for scans, left null when the index is always in
+	 * key order.
+	 */
+	int32_t (*sort)(NestIdx idx);
+
 	/*
 	 * Scan Functionality
 	 */
@@ -120,6 +132,12 @@ int32_t vh_nestidx_scan_all(NestIdx idx,
 
 int32_t vh_nl_scan_all(NestLevel nl, vh_nestidx_scan_cb cb, void *user, bool fwd);
 
+/*
+ * Unordered indexes (i.e. VH_NESTIDX_METH_HASH) scan in insertion order until
+ * vh_nestidx_sort puts them in key order.  Inserting after the sort undoes it.
+ */
+int32_t vh_nestidx_sort(NestIdx idx);
+
 /*
  * ============================================================================
  * Leaf "Pages"
@@ -175,6 +193,7 @@ void vh_nestidxv_remove(NestIdxValue niv, int8_t nl_idx, int8_t item_idx);
  * ============================================================================
  */
 extern const struct NestIdxFuncTable vh_nestidx_func_btree;
+extern const struct NestIdxFuncTable vh_nestidx_func_hash;
 
 #endif
 
@@ -34,6 +34,7 @@ struct NestLevelData
 	int32_t idx;
 
 	bool acm_created;
+	bool ordered;				/* Requires ordered scans, see vh_nl_ordered */
 };
 
 struct NestAggColData
@@ -42,11 +43,12 @@ struct NestAggColData
 	SearchPath sp_field;
 	PrepCol pc;
 
-	union
-	{
-		TypeVarAcm acm;
-		vh_acm_tys_create acm_create;
-	};
+	/*
+	 * Keep the factory around after the ACM is created, partial NestLevels
+	 * for a parallel nest need it to create their own ACM.
+	 */
+	TypeVarAcm acm;
+	vh_acm_tys_create acm_create;
 
 	size_t acms_sz;
 
@@ -66,6 +68,13 @@ struct NestAggColData
 
 NestLevel vh_nl_create(void);
 
+/*
+ * Levels are indexed with a hash table unless they need ordered scans (i.e.
+ * LAG style access), call vh_nl_ordered before vh_nest_level_add to get a
+ * BTree instead.  Output routines can still sort a hash index on demand.
+ */
+void vh_nl_ordered(NestLevel nl, bool ordered);
+
 
 
 /*
@@ -120,6 +129,26 @@ int32_t vh_nl_input_ht(NestLevel nl, NestIdx nidx,
 	   				   HeapTuple ht, HeapTuplePtr htp,
 					   TypeVarSlot **akeys, TypeVarSlot **keys,
 					   bool must_initialize);
+
+/*
+ * ============================================================================
+ * Partial NestLevels
+ * ============================================================================
+ *
+ * A parallel nest gives each worker thread a partial copy of every NestLevel.
+ * The partial shares the Group By columns and the aggregate column definitions
+ * but creates its own TypeVarAcm on the first input, so no operator caches
+ * are shared between threads.
+ *
+ * vh_nl_merge folds the aggregate states on |src_niv| for the partial
+ * |src_nl| into |niv| for |nl|, creating the ACM on |nl| and initializing the
+ * leaf if neither has happened yet.
+ */
+
+NestLevel vh_nl_partial_create(NestLevel nl);
+int32_t vh_nl_merge(NestLevel nl, NestIdxValue niv,
+					NestLevel src_nl, NestIdxValue src_niv);
+
 /*
 int32_t vh_nl_input_json(NestLevel nl, NestIdx nidx,
 						 NestIdxValue niv,
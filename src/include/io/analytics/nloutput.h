@@ -16,6 +16,8 @@
  * ============================================================================
  */
 
+/* Sort unordered indexes before producing the output */
+#define VH_NLO_FLAG_SORT		0x01
 
 Json vh_nlo_json(NestLevel nl, int32_t flags);
 
@@ -12,6 +12,13 @@
 #include "io/executor/param.h"
 
 
+/*
+ * Statements allowed in the pipeline before we sync and collect results.  The
+ * connection stays in blocking mode, so this keeps the server's responses
+ * well under what the socket buffers hold while we're still sending.
+ */
+#define PGRES_PIPELINE_MAX			256
+
 typedef struct PostgresConnectionData
 {
 	struct BackEndConnectionData bec;
@@ -19,6 +26,24 @@ typedef struct PostgresConnectionData
 	PGresult *pgres;
 	ConnStatusType connStatus;
 	PGTransactionStatusType xactStatus;
+
+	/*
+	 * PlanCache prepare_id of every statement prepared on the server for
+	 * this session.  Cleared whenever the session goes away.
+	 */
+	KeySet prepared;
+
+	/*
+	 * Pipeline state.  |pipeline| is set between pipeline_begin and
+	 * pipeline_end; libpq only enters pipeline mode once a statement is
+	 * actually sent.  |pipeline_tags| holds the BackEndConnection tag of each
+	 * statement waiting on its result.
+	 */
+	bool pipeline;
+	bool pipeline_failed;
+	uint64_t pipeline_failed_tag;
+	int32_t pipeline_pending;
+	uint64_t pipeline_tags[PGRES_PIPELINE_MAX];
 } PostgresConnectionData, *PostgresConnection;
 
 typedef struct PgresParameterData
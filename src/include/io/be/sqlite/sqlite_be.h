@@ -10,5 +10,15 @@ extern struct BackEndData vh_be_sqlite;
 
 void vh_be_sqlite3_register(CatalogContext ctx);
 
+/*
+ * vh_be_sqlite3_typed_io
+ *
+ * Integer and floating point parameters are bound with their native SQLite
+ * types and result columns are read without a round trip thru text.  Turning
+ * this off sends everything thru the CStr TAM, which is only useful for
+ * comparing the two paths.
+ */
+void vh_be_sqlite3_typed_io(bool enabled);
+
 #endif
 
@@ -12,12 +12,29 @@
  * When a buffer is requested, the buffer manager finds an open slot and
  * initializes the buffer by calling vh_hb_open.  When a caller is done with
  * the buffer (i.e. XAct is destroyed), the caller will call vh_hb_close.
+ *
+ * The registry is sized once by vh_hbmgr_startup.  A HeapTuplePtr stores the
+ * HeapBufferNo in a single byte, so we can never exceed VH_HB_MAXBUFFERS.  The
+ * slots below VH_HB_FIRSTBUFFER are reserved, HeapBufferNo 0 in particular is
+ * used throughout to mean "no buffer".
  */
 
-bool vh_hbmgr_startup(MemoryContext mctx);
+#define VH_HB_MAXBUFFERS			256
+#define VH_HB_DEFAULT_BUFFERS		64
+#define VH_HB_FIRSTBUFFER			5
+
+bool vh_hbmgr_startup(MemoryContext mctx, uint32_t nbuffers);
+uint32_t vh_hbmgr_nbuffers(void);
 HeapBufferNo vh_hb_open(MemoryContext mctx);
 bool vh_hb_close(HeapBufferNo buffno);
 bool vh_hb_isopen(HeapBufferNo buffno);
 
+/*
+ * HeapBuffers in a shared memory MemoryContext, so a single copy of read
+ * only tuples can be mapped by every worker process.  See sharedctx.h.
+ */
+HeapBufferNo vh_hb_open_shared(MemoryContext shared);
+HeapBufferNo vh_hb_attach_shared(MemoryContext shared);
+
 #endif
 
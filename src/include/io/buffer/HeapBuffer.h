@@ -16,24 +16,54 @@ typedef uint64_t HeapTuplePtr;
 
 /*
  * |blocks|
- * 		Lookup table by blockno.  Contains all blocks that are
- * 		available on the heap.
+ * 		Block directory indexed directly by blockno.  Block numbers are
+ * 		handed out densely by the buffer, so rather than hashing we use a
+ * 		two level radix array: the top level holds |nleaves| pointers to
+ * 		leaves of VH_HB_BLKDIR_LEAFSZ Block pointers each.  Leaves are
+ * 		only allocated once a block lands in them and the top level doubles
+ * 		as it runs out of room.
  *
  * |nblocks|
  * 		Total number of blocks managed by the buffer, on disk and
  * 		in memory.
+ *
+ * |pax|
+ * 		The block currently being filled for each HeapTupleDef using the PAX
+ * 		layout.  PAX pages only hold a single HeapTupleDef, so they can't
+ * 		share the LRU head with row pages.  When more than VH_HB_PAX_PAGES
+ * 		HeapTupleDef are active, the slots are recycled round robin.
+ *
+ * |shared|
+ * 		The HeapBuffer and all of its blocks live in a shared memory
+ * 		MemoryContext (see vh_hb_open_shared).  Other processes read it
+ * 		concurrently, so reads never touch the LRU list.
  */
 
+#define VH_HB_BLKDIR_LEAFSHIFT		10
+#define VH_HB_BLKDIR_LEAFSZ			(1u << VH_HB_BLKDIR_LEAFSHIFT)
+#define VH_HB_BLKDIR_LEAFMASK		(VH_HB_BLKDIR_LEAFSZ - 1)
+
+#define VH_HB_PAX_PAGES				4
+
 typedef struct HeapBufferData
 {
-	KeyValueMap blocks;
+	struct BlockData ***blocks;
+	uint32_t nleaves;
 	MemoryContext mctx;
 	struct BlockData *lru_first, *lru_last, *free_list;
 
+	struct
+	{
+		HeapTupleDef htd;
+		struct BlockData *blk;
+	} pax[VH_HB_PAX_PAGES];
+	uint32_t pax_next;
+
 	BufferBlockNo nblocks;
 	uint16_t allocfactor;
 	uint16_t xid;
 	HeapBufferNo idx;
+	bool shared;
 } *HeapBuffer;
 
 
@@ -53,6 +83,11 @@ HeapTuple vh_hb_heaptuple(HeapBuffer hb, HeapTuplePtr htp, uint16_t flags);
 HeapTuplePtr vh_hb_allocht(HeapBuffer hb,
 		   				   HeapTupleDef htd,
 						   HeapTuple *ht);
+uint32_t vh_hb_allocht_n(HeapBuffer hb,
+						 HeapTupleDef htd,
+						 uint32_t n,
+						 HeapTuplePtr *out,
+						 HeapTuple *hts);
 HeapTuplePtr vh_hb_allocht_nearby(HeapTuplePtr htp,
 								  HeapTupleDef htd,
 								  HeapTuple *ht);
@@ -70,7 +105,33 @@ void vh_hb_prealloc(HeapBuffer hb,
 					HeapTupleDef htd,
 					uint32_t tups);
 
+/*
+ * HeapBufferBatch
+ *
+ * Pre-allocates HeapTuple with vh_hb_allocht_n and hands them out one at a
+ * time.  Used by row at a time loops which don't know the number of rows up
+ * front.  Any tuples left over are freed by vh_hb_batch_release.
+ */
+#define VH_HB_BATCH_DEFAULT			64
+
+typedef struct HeapBufferBatchData
+{
+	HeapBuffer hb;
+	HeapTupleDef htd;
+	HeapTuplePtr *htps;
+	struct HeapPageData **pages;
+	uint32_t size;
+	uint32_t next;
+	uint32_t navail;
+} HeapBufferBatchData, *HeapBufferBatch;
+
+void vh_hb_batch_init(HeapBufferBatch batch, HeapBuffer hb, HeapTupleDef htd,
+					  uint32_t size, MemoryContext mctx);
+HeapTuplePtr vh_hb_batch_next(HeapBufferBatch batch, HeapTuple *ht);
+void vh_hb_batch_release(HeapBufferBatch batch);
+
 void vh_hb_printstats(HeapBuffer hb);
+void vh_hb_destroyblktbl(HeapBuffer hb);
 
 
 #define vh_HTP_BLOCKNO_MASK	0xffffffff00000000ULL
@@ -92,26 +153,42 @@ void vh_hb_printstats(HeapBuffer hb);
 									   (vh_HTP_BLOCKNO(htp)), \
 									   (vh_HTP_ITEMNO(htp)))
 
-#define vh_htp_flags(htp, flags) ( \
-	vh_hb(vh_HTP_BUFF(htp)) ? vh_hb(vh_HTP_BUFF(htp))->xid == \
-	vh_HTP_XID(htp) ? \
-	vh_hb_heaptuple(vh_hb(vh_HTP_BUFF(htp)), \
-					 htp, \
-					 (flags)) : \
+/*
+ * vh_htp_flags
+ *
+ * Resolves the HeapBuffer with a single acquire load of its slot, so the
+ * lookup is wait-free regardless of how many threads are opening and closing
+ * buffers.  The xid check catches HeapTuplePtr that outlived their buffer,
+ * even when the slot has since been recycled by another thread.
+ */
+#define vh_htp_flags(htp, flags) ( { \
+	HeapBuffer vh_htp_hb = vh_hb(vh_HTP_BUFF(htp)); \
+	vh_htp_hb ? vh_htp_hb->xid == vh_HTP_XID(htp) ? \
+	vh_hb_heaptuple(vh_htp_hb, \
+					htp, \
+					(flags)) : \
 	 ( { elog(ERROR2, emsg("XID %d Buffer %d mismatch, unable to locate " \
 					   "requested heap tuple.\n\nBlockNo: %d\n", \
 					   vh_HTP_XID(htp), \
 					   vh_HTP_BUFF(htp), \
 					   vh_HTP_BLOCKNO(htp))); \
-				  (HeapTuple)0; }) : (HeapTuple)0)
+				  (HeapTuple)0; }) : (HeapTuple)0; } )
 
 
-#define vh_hb(hbno)		(vh_buffers[hbno])
+#define vh_hb(hbno)		(__atomic_load_n(&vh_buffers[(hbno)], __ATOMIC_ACQUIRE))
 #define vh_hb_memoryctx(hbno) 	(vh_hb(hbno) ? vh_hb(hbno)->mctx : 0)
 
 
 #define vh_htp(htp)		(vh_htp_flags(htp, VH_HT_FLAG_MUTABLE | VH_HB_HT_FLAG_COMPARE))
 #define vh_htp_immutable(htp)	(vh_htp_flags(htp, 0))
+
+/*
+ * vh_htp_read
+ *
+ * Returns the current version of the tuple without creating a mutable copy.
+ * Use it anywhere the HeapTuple is only read: exports, COPY and comparisons.
+ */
+#define vh_htp_read(htp)		(vh_htp_flags(htp, VH_HB_HT_FLAG_FORREAD))
 #define vh_htp_free(htp)		vh_hb_free(vh_hb(vh_HTP_BUFF(htp)), \
 										   vh_HTP_BLOCKNO(htp), \
 										   vh_HTP_ITEMNO(htp))
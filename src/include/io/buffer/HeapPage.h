@@ -11,6 +11,11 @@
 
 #define VH_HEAPPAGE_SIZE 8192
 
+/*
+ * HeapItemSlot is a single byte and so is the item number in a HeapTuplePtr.
+ */
+#define VH_HP_MAXITEMS	256
+
 typedef struct HeapPageData
 {
 	uint16_t pins;
@@ -24,11 +29,14 @@ typedef struct HeapPageData
 } HeapPageData, *HeapPage;
 
 #define VH_HP_FLAGDIRTY			((uint8_t)0x1)
+#define VH_HP_FLAGPAX			((uint8_t)0x2)
 
 #define vh_hp_isdirty(hp)		(hp->flags & VH_HP_FLAGDIRTY)
 #define vh_hp_cleardirty(hp)	(hp->flags &= ~VH_HP_FLAGDIRTY)
 #define vh_hp_setdirty(hp)		(hp->flags |= VH_HP_FLAGDIRTY)
 
+#define vh_hp_ispax(hp)			(hp->flags & VH_HP_FLAGPAX)
+
 #define VH_HP_TUPLE(hp, hip)	(hp->items[hip].empty ? 0 : \
 								 (((char*)hp) + (hp->items[hip].offset)))
 
@@ -40,9 +48,31 @@ typedef struct HeapPageData
 
 void vh_hp_init(HeapPage hp);
 HeapItemSlot vh_hp_construct_tup(HeapBuffer hb, HeapPage hp, HeapTupleDef htd);
+uint32_t vh_hp_construct_tup_n(HeapBuffer hb, HeapPage hp, HeapTupleDef htd,
+							   uint32_t n, HeapItemSlot *slots, HeapTuple *hts);
 void vh_hp_freetup(HeapPage hp, HeapItemSlot hidx);
 void vh_hp_collapse_empty(HeapPage hp);
 
+/*
+ * PAX pages
+ *
+ * A PAX page is dedicated to a single HeapTupleDef and stores each field in
+ * its own minipage, see htd_pax_layout for how the page is carved up.  The
+ * item pointers still reference the tuple headers, so HeapTuplePtr resolve
+ * the same way they do on a row page.  Slots are never reused or moved once
+ * a tuple has been freed, there is nothing to collapse.
+ *
+ * vh_hp_pax_column returns the start of |hf|'s minipage and sets |nbm| to its
+ * null bitmap.  Values are |hf->paxwidth| apart for the first n_items slots,
+ * freed slots are flagged null in the bitmap.  Mutable copies are formed on
+ * PAX pages too, scans that can run while tuples are being edited need to
+ * check VH_HT_FLAG_MUTABLE on the header.
+ */
+#define vh_hp_pax_full(hp, htd)	(hp->n_items >= (htd)->paxcap)
+
+void vh_hp_pax_init(HeapPage hp, HeapTupleDef htd);
+void* vh_hp_pax_column(HeapPage hp, HeapField hf, unsigned char **nbm);
+
 
 
 #endif
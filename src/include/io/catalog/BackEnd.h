@@ -43,6 +43,35 @@ typedef bool (*vh_beat_ping)(BackEndConnection);
 
 typedef void (*vh_beat_exec)(BackEndExecPlan);
 
+/*
+ * vh_beat_exec_send and vh_beat_exec_poll
+ *
+ * Optional asynchronous execution, allowing the executor to have statements
+ * in flight on many connections at once.  exec_send dispatches the command
+ * without waiting on the result and returns the socket to wait on.  It
+ * returns -1 on failure and -2 when the statement already ran to completion.
+ *
+ * exec_poll is called whenever the socket becomes readable and consumes
+ * whatever has arrived without blocking.  It returns 1 once the result set
+ * is complete, 0 when more is expected and -1 on an error.  The back end may
+ * keep its state on BackEndExecPlan->be_state between calls.
+ */
+typedef int (*vh_beat_exec_send)(BackEndExecPlan);
+typedef int32_t (*vh_beat_exec_poll)(BackEndExecPlan);
+
+/*
+ * vh_beat_pipeline_begin and vh_beat_pipeline_end
+ *
+ * Optional statement pipelining.  Between the two calls the back end may send
+ * statements whose results are discarded back to back, without waiting on the
+ * server, and collect their results at pipeline_end.  Each statement is
+ * remembered with the connection's |pipeline_tag| at the time it was sent.
+ * pipeline_end returns false when a statement failed and sets |failed_tag| to
+ * the tag of the first statement that failed.
+ */
+typedef bool (*vh_beat_pipeline_begin)(BackEndConnection);
+typedef bool (*vh_beat_pipeline_end)(BackEndConnection, uint64_t *failed_tag);
+
 /*
  * vh_beat_command		Forms a command (i.e. SELECT * FROM a WHERE a.id = $1)
  * vh_beat_param		Creates a parameter and gets the value to transfer
@@ -109,6 +138,10 @@ struct BackEndData
 
 		/* Execution */
 		vh_beat_exec exec;
+		vh_beat_exec_send exec_send;
+		vh_beat_exec_poll exec_poll;
+		vh_beat_pipeline_begin pipeline_begin;
+		vh_beat_pipeline_end pipeline_end;
 
 		/* Command */
 		vh_beat_command command;
@@ -129,6 +162,8 @@ struct BackEndData
 };
 
 #define vh_be_has_schema_op(be)		(be->at.schemaget != 0)
+#define vh_be_has_exec_async(be)	(be->at.exec_send != 0 && be->at.exec_poll != 0)
+#define vh_be_has_pipeline(be)		(be->at.pipeline_begin != 0 && be->at.pipeline_end != 0)
 
 /*
  * BackEndConnectionData
@@ -150,6 +185,8 @@ struct BackEndConnectionData
 
 	bool intx;
 	bool in2pc;
+
+	uint64_t pipeline_tag;		/* Set by the caller before each statement */
 };
 
 void* vh_be_conn_create(BackEnd be, size_t sz);
@@ -300,6 +337,10 @@ bool vh_be_disconnect(BackEndConnection bec);
  */
 
 bool vh_be_exec(BackEndConnection bec, BackEndExecPlan beep);
+int vh_be_exec_send(BackEndConnection bec, BackEndExecPlan beep);
+int32_t vh_be_exec_poll(BackEndConnection bec, BackEndExecPlan beep);
+bool vh_be_pipeline_begin(BackEndConnection bec);
+bool vh_be_pipeline_end(BackEndConnection bec, uint64_t *failed_tag);
 bool vh_be_xact_begin(BackEndConnection bec);
 bool vh_be_xact_commit(BackEndConnection bec);
 bool vh_be_xact_rollback(BackEndConnection bec);
@@ -28,17 +28,28 @@ typedef struct CatalogContextData
 
 	/* Default Shard */
 	Shard shard_general;
+
+	/* Planner */
+	struct PlanCacheData *planCache;
 } CatalogContextData, *CatalogContext;
 
 /*
  * Startup and Shutdown (in catalog/CatalogContext.c)
  */
 CatalogContext vh_start(void);
+CatalogContext vh_start_nbuffers(uint32_t nbuffers);
 void vh_shutdown(void);
 void vh_ctx_attach(CatalogContext context);
 void vh_ctx_init(CatalogContext context);
 void vh_ctx_destroy(CatalogContext context);
 
+/*
+ * Worker threads attach their own CatalogContext which shares the catalogs
+ * of |shared| but has a private top level MemoryContext and HeapBuffer.
+ */
+CatalogContext vh_ctx_thread_attach(CatalogContext shared);
+void vh_ctx_thread_detach(void);
+
 
 CatalogContext vh_ctx(void);
 
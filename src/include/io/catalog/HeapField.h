@@ -29,6 +29,9 @@ typedef struct HeapFieldData
 	uint32_t padding;
 	uint32_t dord;
 	uint32_t heapord;
+	uint32_t paxoffset;		/* Start of the minipage on a PAX page */
+	uint32_t paxnbm;		/* Start of the null bitmap on a PAX page */
+	uint32_t paxwidth;		/* Aligned width of each value in the minipage */
 	uint8_t maxalign;
 	uint8_t type_depth;
 
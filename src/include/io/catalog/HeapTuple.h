@@ -54,6 +54,11 @@ typedef struct HeapTupleData
  *
  * RELFETCHED
  * 	Indicates atleast one relationship has been fetched.
+ *
+ * PAX
+ * 	The HeapTuple lives on a PAX page.  Only the header and flags are stored
+ * 	here, the field values are in the page's per field minipages.  Set by
+ * 	the HeapPage when the tuple is formed and preserved by the constructor.
  */
 
 #define VH_HT_FLAG_CONSTRUCTED		0x01
@@ -62,6 +67,7 @@ typedef struct HeapTupleData
 #define VH_HT_FLAG_MUTABLE			0x08
 #define VH_HT_FLAG_FETCHED			0x10
 #define VH_HT_FLAG_RELFETCHED		0x20
+#define VH_HT_FLAG_PAX				0x40
 
 
 /*
@@ -77,6 +83,8 @@ typedef struct HeapTupleData
 bool vh_ht_commit(HeapTuple ht_m, HeapTuple ht_im);
 int32_t vh_ht_compare(HeapTuple lhs, HeapTuple rhs, bool track);
 HeapTuple vh_ht_construct(HeapTupleDef htd, HeapTuple ht, HeapBufferNo hbno);
+void vh_ht_construct_n(HeapTupleDef htd, HeapTuple *hts, uint32_t n,
+					   HeapBufferNo hbno);
 bool vh_ht_copy(HeapTuple source, HeapTuple target, HeapBufferNo hbno);
 HeapTuple vh_ht_create(HeapTupleDef def);
 void vh_ht_destruct(HeapTuple ht);
@@ -87,8 +95,26 @@ void vh_ht_destruct(HeapTuple ht);
 #define vh_ht_tuple(ht) 	((void*)vh_ht_tuple_ptr(ht))
 #define vh_ht_tuple_ptr(ht)	(((char*)ht) + ht->htd->tupoffset)
 
-#define vh_ht_field(ht, hf) ((vh_ht_tuple_ptr(ht)) + \
-							((HeapField)hf)->offset)
+#define vh_ht_field(ht, hf) ((vh_ht_flags(ht) & VH_HT_FLAG_PAX) ? 			\
+							 vh_ht_pax_field(ht, hf) :							\
+							 ((vh_ht_tuple_ptr(ht)) + ((HeapField)hf)->offset))
+
+/*
+ * PAX HeapTuple
+ *
+ * The tuple data area of a PAX HeapTuple only holds its slot number on the
+ * page, which is enough to find the page and the value's position in each
+ * field's minipage and null bitmap.  Use vh_ht_field rather than these
+ * directly, they assume the tuple has VH_HT_FLAG_PAX set.
+ */
+#define vh_ht_pax_slot(ht)		(*((uint16_t*)vh_ht_tuple_ptr(ht)))
+#define vh_ht_pax_page(ht)		(((char*)(ht)) - (ht)->htd->paxhdrbase - 		\
+								 (vh_ht_pax_slot(ht) * (ht)->htd->paxhdrsz))
+#define vh_ht_pax_field(ht, hf)	(vh_ht_pax_page(ht) + 							\
+								 ((HeapField)hf)->paxoffset +					\
+								 (vh_ht_pax_slot(ht) * ((HeapField)hf)->paxwidth))
+#define vh_ht_pax_nbm(ht, hf)	((unsigned char*)vh_ht_pax_page(ht) + 			\
+								 ((HeapField)hf)->paxnbm)
 
 /*
  * Field manipulation functions, users should always attempt to access fields
@@ -132,8 +158,20 @@ void vh_ht_set(HeapTuple ht, HeapField hf, void *value);
 #define vh_htf_isconstructed(ht, hf)	(vh_htf_flags(ht, hf) & VH_HTF_FLAG_CONSTRUCTED)
 
 #define vh_htf_isnull(ht, hf)		(vh_htf_flags(ht, hf) & VH_HTF_FLAG_NULL)
-#define vh_htf_clearnull(ht, hf)	(vh_htf_flags(ht, hf) &= ~VH_HTF_FLAG_NULL)
-#define vh_htf_setnull(ht, hf)		(vh_htf_flags(ht, hf) |= VH_HTF_FLAG_NULL)
+
+/*
+ * PAX pages keep a null bitmap next to each field's minipage so column scans
+ * don't have to touch the tuple headers.  The bitmap is kept in sync here, so
+ * the NULL flag should only be changed thru these two macros.
+ */
+#define vh_htf_clearnull(ht, hf)	((vh_htf_flags(ht, hf) &= ~VH_HTF_FLAG_NULL), \
+									 ((vh_ht_flags(ht) & VH_HT_FLAG_PAX) ?			\
+									  vh_ht_nbm_clearnull(vh_ht_pax_nbm(ht, hf),	\
+									  					  vh_ht_pax_slot(ht)) : 0))
+#define vh_htf_setnull(ht, hf)		((vh_htf_flags(ht, hf) |= VH_HTF_FLAG_NULL),	\
+									 ((vh_ht_flags(ht) & VH_HT_FLAG_PAX) ?			\
+									  vh_ht_nbm_setnull(vh_ht_pax_nbm(ht, hf),		\
+									  					vh_ht_pax_slot(ht)) : 0))
 
 #define vh_htf_ischanged(ht, hf)	(vh_htf_flags(ht, hf) & VH_HTF_FLAG_CHANGED)
 #define vh_htf_clearchanged(ht, hf)	(vh_htf_flags(ht, hf) &= ~VH_HTF_FLAG_NULL)
@@ -22,6 +22,19 @@
  * 					1) tupasize
  * 					2) nfields * sizeof(char)
  * 					3) padding
+ *
+ * When the HeapTupleDef has been switched to the PAX layout with
+ * vh_htd_set_pax, HeapBuffer pages hold a single HeapTupleDef and store each
+ * field in its own minipage rather than row-wise:
+ *
+ * |paxcap|		number of HeapTuple a PAX page holds, zero when the
+ * 				HeapTupleDef uses the row layout
+ * |paxhdrsz|	size of the per tuple header slot, the HeapTupleData header
+ * 				and flags followed by the slot number on the page
+ * |paxhdrbase|	offset from the start of the page to the first header slot
+ *
+ * Each HeapField records where its null bitmap and minipage begin on the
+ * page.
  */
 
 typedef struct HeapTupleDefData
@@ -36,6 +49,10 @@ typedef struct HeapTupleDefData
 
 	uint32_t tupoffset;				/* Where the tuple begins, after the standard header and flags */
 
+	uint32_t paxhdrsz;
+	uint32_t paxhdrbase;
+	uint16_t paxcap;
+
 	uint32_t extraoffset;			/* Start of the extra data, this is mostly likely to be the Relations, but there's nothing stopping what can be put here.  When it's 0, then no extra has been provided. */
 	SList fields;
 	SList type_stack;				/* Array of pointers to Type (i.e. HeapField->types[0]) */
@@ -58,6 +75,9 @@ void vh_htd_init(HeapTupleDef htd);
 void vh_htd_finalize(HeapTupleDef htd, void (*for_each_field)(HeapTupleDef, void*));
 bool vh_htd_add_field(HeapTupleDef htd, HeapField hf);
 uint32_t vh_htd_add_extra(HeapTupleDef htd, uint32_t bytes);
+bool vh_htd_set_pax(HeapTupleDef htd, bool pax);
+
+#define vh_htd_ispax(htd)			((htd)->paxcap)
 
 Type** vh_htd_type_stack(HeapTupleDef htd);
 
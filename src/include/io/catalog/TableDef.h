@@ -282,7 +282,7 @@ void vh_tdr_fetch_hts(SList hts, TableRel *rels, uint32_t nrels);
 
 #define vh_CompareFieldNm(htpl, htpr, fname) ( \
 	( { \
-	  	HeapTuple l = vh_htp(htpl), r = vh_htp(htpr); \
+	  	HeapTuple l = vh_htp_read(htpl), r = vh_htp_read(htpr); \
 	  	HeapField hf = (HeapField)(l && r ? vh_tdv_tf_name((TableDefVer)l->htd, fname) : 0); \
 		hf ? vh_ht_CompareField(l, r, hf) : 0; \
  	  } ))
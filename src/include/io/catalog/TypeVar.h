@@ -387,5 +387,84 @@ TypeVarOpExec vh_typevar_op_init_tys(const char *op,
 void vh_typevar_op_destroy(TypeVarOpExec tvope);
 void *vh_typevar_op_fp(TypeVarOpExec tvope, ...);
 
+
+/*
+ * Specialized Operators
+ *
+ * The fast path operators still walk their flags and type stacks and go thru
+ * op_exec on every call.  vh_typevar_op_spec resolves an operator for a
+ * concrete pair of type stacks once and leaves a direct function pointer on
+ * the TypeVarOpSpec.  Calls thru the specialization take data pointers only:
+ * there's no variadic parsing, no pinning and no formatters to clean up.
+ *
+ * Arithmetic operators (+, -, *, /) write to |ret|, which must be of the LHS
+ * type.  The compound operators (+=, -=, *=, /=) write back to the LHS.  The
+ * comparison operators (<, <=, ==, !=, >, >=) require matching type stacks.
+ *
+ * When both sides are the same primitive numeric type, the operator also gets
+ * a kernel that runs over contiguous arrays in a single loop.  Integer
+ * division doesn't get a kernel so divide by zero is still caught by the type.
+ *
+ * vh_typevar_op_batch
+ * 		Applies the operator across arrays of TypeVarSlot.  A null on either
+ * 		side sets the |ret| slot null.  When |ret| is null the result is
+ * 		written back to the LHS slots.  Comparisons write to |res| instead,
+ * 		nulls compare false.
+ *
+ * vh_typevar_op_array
+ * 		Applies the operator across contiguous arrays of values, |ret| is a
+ * 		bool array for comparisons.  Uses the kernel when there is one.
+ */
+
+typedef void (*vh_typevar_op_kernel)(const void *lhs, const void *rhs,
+									 void *ret, uint32_t n);
+
+typedef struct TypeVarOpSpecData
+{
+	union
+	{
+		vh_tom_oper oper;
+		vh_tom_comp comp;
+	} func;
+
+	vh_typevar_op_kernel kernel;
+
+	TomOperStack oper_stack;
+	struct TomCompStack comp_stack;
+
+	Type tys_lhs[VH_TAMS_MAX_DEPTH];
+	Type tys_rhs[VH_TAMS_MAX_DEPTH];
+
+	union
+	{
+		vh_tom_oper oper[VH_TAMS_MAX_DEPTH];
+		vh_tom_comp comp[VH_TAMS_MAX_DEPTH];
+	} funcs;
+
+	uint32_t lhs_width;
+	uint32_t rhs_width;
+	uint16_t opi;
+	uint8_t comp_mask;				/* Bit set for <, ==, > outcomes */
+	bool comp;
+	bool self;						/* Compound operator, LHS is the return */
+} TypeVarOpSpecData, *TypeVarOpSpec;
+
+bool vh_typevar_op_spec(TypeVarOpSpec spec, const char *op,
+						Type *tys_lhs, Type *tys_rhs);
+
+#define vh_typevar_spec_op(spec, lhs, rhs, ret)								\
+	( (spec)->func.oper(&(spec)->oper_stack, (lhs), (rhs),					\
+						(spec)->self ? (lhs) : (ret)) )
+
+#define vh_typevar_spec_comp(spec, lhs, rhs)									\
+	( { int32_t c = (spec)->func.comp(&(spec)->comp_stack, (lhs), (rhs));		\
+		(bool)(((spec)->comp_mask >> ((c > 0) - (c < 0) + 1)) & 1); } )
+
+void vh_typevar_op_batch(TypeVarOpSpec spec, TypeVarSlot *lhs,
+						 TypeVarSlot *rhs, TypeVarSlot *ret, 
+						 bool *res, uint32_t n);
+void vh_typevar_op_array(TypeVarOpSpec spec, const void *lhs,
+						 const void *rhs, void *ret, uint32_t n);
+
 #endif
 
@@ -51,6 +51,17 @@ void vh_acm_destroy(TypeVarAcm);
 int32_t vh_acms_input(TypeVarAcm, TypeVarAcmState, ...);
 int32_t vh_acms_result(TypeVarAcm, TypeVarAcmState, TypeVarSlot*);
 
+/*
+ * vh_acms_merge combines the partial state |source| into |target|, as if every
+ * input fed to |source| had been fed to |target| instead.  Both states must
+ * come from accumulators of the same kind over the same Type stack, which lets
+ * a caller build partial states on worker threads with their own TypeVarAcm
+ * and fold them together with a single TypeVarAcm afterwards.  |source| is
+ * left untouched.
+ */
+int32_t vh_acms_merge(TypeVarAcm, TypeVarAcmState target, 
+					  TypeVarAcmState source);
+
 
 /*
  * ============================================================================
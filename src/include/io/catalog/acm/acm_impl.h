@@ -18,6 +18,8 @@ typedef void (*vh_acms_finalize_func)(TypeVarAcm, TypeVarAcmState);
 
 typedef int32_t (*vh_acms_input_func)(TypeVarAcm, TypeVarAcmState, va_list);
 typedef int32_t (*vh_acms_result_func)(TypeVarAcm, TypeVarAcmState, TypeVarSlot *slot);
+typedef int32_t (*vh_acms_merge_func)(TypeVarAcm, TypeVarAcmState target, 
+									  TypeVarAcmState source);
 
 typedef void (*vh_acm_finalize_func)(TypeVarAcm);
 
@@ -30,6 +32,7 @@ struct TypeVarAcmFuncs
 	/* Calculation Functions */
 	vh_acms_input_func input;
 	vh_acms_result_func result;
+	vh_acms_merge_func merge;
 	
 	/* ACM */
 	vh_acm_finalize_func finalize;
@@ -135,6 +135,13 @@ bool vh_json_obj_add_pair(Json jobj, Json jpair);
 String vh_json_stringify(Json root);
 int32_t vh_json_stringify_to(Json root, String str);
 
+/*
+ * vh_json_stringify_fmt
+ *
+ * Returns the cstr format pattern used to emit a Type as a JSON value.
+ */
+const char* vh_json_stringify_fmt(Type ty);
+
 
 /*
  * HeapTuple facilitators
@@ -7,17 +7,18 @@
 #ifndef vh_catalog_types_njson_parse_H
 #define vh_catalog_types_njson_parse_H
 
-#include "io/catalog/types/njson_scan.h"
-
-typedef struct
-{
-	JsonScanExtraData scanner_yy_extra;
-
-	Json root;
-} JsonParserExtraData;
+#include "io/catalog/types/njson_sax.h"
 
 Json vh_json_strp_parser(const char *str);
 Json vh_json_strp_parsern(const char *str, size_t len);
 
+/*
+ * Parses a JSON object directly into a new HeapTuple, matching the object's
+ * keys to field names.  No Json tree is built.
+ */
+int32_t vh_json_strp_htp_tdv(TableDefVer tdv,
+							 const char *str, size_t len,
+							 HeapTuplePtr *htp);
+
 #endif
 
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2011-2017, Kyle A. Gearhart
+ */
+
+
+
+#ifndef vh_catalog_types_njson_plan_H
+#define vh_catalog_types_njson_plan_H
+
+/*
+ * JSON Serialization Plans
+ *
+ * A JsonHtpPlan is compiled once for a TableDefVer and then used to write any
+ * number of HeapTuples as JSON objects without building Json nodes.  The plan
+ * holds each field's key already escaped and quoted, the function that writes
+ * the field's value and an estimate of the size of a row so the output buffer
+ * can be reserved up front.
+ *
+ * Types with a native representation (integers, floating point, bool and
+ * String) are written directly.  Everything else goes through the Type's
+ * cstr_get TAM with the formatters from vh_json_stringify_fmt, which are
+ * created when the plan is compiled rather than per value.
+ *
+ * Each HeapTuplePtr must belong to the plan's TableDefVer.  A HeapTuplePtr
+ * that no longer resolves is written as null.
+ */
+
+typedef struct JsonHtpPlanData *JsonHtpPlan;
+
+/*
+ * vh_json_htp_plan_create
+ *
+ * Compiles a plan for |tdv|.  |field_list| and |mode_exclude| work the same as
+ * vh_tdv_tf_filter: pass a null field_list to include every field.
+ */
+JsonHtpPlan vh_json_htp_plan_create(TableDefVer tdv,
+									TableField *field_list,
+									int32_t nfields,
+									bool mode_exclude);
+void vh_json_htp_plan_destroy(JsonHtpPlan plan);
+
+/*
+ * vh_json_htp_plan_str
+ *
+ * Appends a JSON array with one object per HeapTuplePtr to |str|.
+ */
+int32_t vh_json_htp_plan_str(JsonHtpPlan plan,
+							 HeapTuplePtr *htps, int32_t nhtps,
+							 String str);
+
+/*
+ * vh_json_htp_plan_obj_str
+ *
+ * Appends a single JSON object for |htp| to |str|.
+ */
+int32_t vh_json_htp_plan_obj_str(JsonHtpPlan plan,
+								 HeapTuplePtr htp,
+								 String str);
+
+/*
+ * vh_json_htp_plan_fd
+ *
+ * Writes a JSON array with one object per HeapTuplePtr to the file
+ * descriptor |fd| through a fixed size buffer.  Returns -1 when the array
+ * couldn't be written.
+ */
+int32_t vh_json_htp_plan_fd(JsonHtpPlan plan,
+							HeapTuplePtr *htps, int32_t nhtps,
+							int fd);
+
+#endif
+
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2011-2017, Kyle A. Gearhart
+ */
+
+
+
+#ifndef vh_catalog_types_njson_sax_H
+#define vh_catalog_types_njson_sax_H
+
+/*
+ * Streaming JSON Parser
+ *
+ * vh_json_sax_parse validates and tokenizes a JSON document in a single pass
+ * and fires a callback for every token.  Nothing is allocated for the
+ * document itself: keys and strings without escape sequences point directly
+ * into the source buffer, so they are not null terminated and are only
+ * valid for the duration of the callback.  Strings with escape sequences are
+ * decoded into a scratch buffer owned by the parser.
+ *
+ * Integers that fit in an int64 fire number_i, everything else fires
+ * number_f with a double.  Both carry the original token text so callers can
+ * hand it to a Type's cstr_set without formatting the value again.
+ *
+ * Any callback may be null.  A callback returning false stops the parse.
+ *
+ * Single quoted strings are accepted for compatibility with the old flex
+ * scanner.
+ */
+
+#define VH_JSON_SAX_MAXDEPTH			256
+
+typedef struct JsonSaxCallbacks
+{
+	bool (*object_start)(void *user);
+	bool (*object_end)(void *user);
+	bool (*array_start)(void *user);
+	bool (*array_end)(void *user);
+
+	bool (*key)(void *user, const char *key, size_t len);
+	bool (*string)(void *user, const char *str, size_t len);
+	bool (*number_i)(void *user, int64_t value, const char *text, size_t len);
+	bool (*number_f)(void *user, double value, const char *text, size_t len);
+	bool (*boolean)(void *user, bool value);
+	bool (*null)(void *user);
+} JsonSaxCallbacks;
+
+/*
+ * Returns zero on success, -1 when the document is not valid JSON and -2
+ * when a callback stopped the parse.  Syntax errors are reported with their
+ * byte offset as a WARNING.
+ */
+int32_t vh_json_sax_parse(const char *str, size_t len,
+						  const JsonSaxCallbacks *callbacks,
+						  void *user);
+
+#endif
+
@@ -92,6 +92,8 @@ typedef struct BackEndExecPlanData
 	uint32_t stat_qexec;
 	int64_t stat_wait_count;
 
+	void *be_state;			/* Back end portal between exec_send and exec_poll */
+
 	bool discard;
 } *BackEndExecPlan;
 
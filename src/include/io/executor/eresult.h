@@ -8,6 +8,25 @@
 
 #include "io/buffer/slot.h"
 
+typedef struct ShardData *Shard;
+
+/*
+ * ExecResultShardStat
+ *
+ * Timing for each fetch the executor ran.  |stat_qexec| is the wall time
+ * from dispatching the statement to the last row arriving, so when shards
+ * are fetched concurrently the slowest shard bounds the query rather than
+ * the sum of all of them.
+ */
+typedef struct ExecResultShardStat
+{
+	Shard shard;
+	uint32_t stat_qexec;
+	uint32_t stat_htform;
+	int32_t nrows;
+	bool error;
+} ExecResultShardStat;
+
 typedef struct ExecResultData
 {
 	SList tups;
@@ -16,6 +35,9 @@ typedef struct ExecResultData
 
 	uint32_t iter_idx;
 
+	ExecResultShardStat *shard_stats;
+	int32_t nshard_stats;
+
 	bool er_shouldreltups;
 
 	TableDefSlot slots[1];
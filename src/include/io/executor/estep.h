@@ -89,6 +89,7 @@ struct ExecStepFetchData
 
 	bool indexed;
 	bool returning;
+	bool dispatched;	/* Already run concurrently by the parent Funnel */
 };
 
 void vh_est_fetch_idx_init(struct ExecStepFetchData *esf, uint32_t rtups);
@@ -103,6 +104,8 @@ void vh_est_fetch_idx_push(struct ExecStepFetchData *esf, uint32_t rtup,
  *
  * Absorbs all results from the ExecStepFetch child and it's siblings into a
  * list of HeapTuplePtr.  Does not make any attempt to eliminate duplicates.
+ * The children are fetched concurrently when their back ends allow it, so
+ * the order of |tups| follows the order the shards completed in.
  */
 struct ExecStepFunnelData
 {
@@ -28,6 +28,12 @@
  *
  * After all invocations of vh_es_runtree have been called, the user
  * may call vh_es_close. 
+ *
+ * Fetch steps under a Funnel are dispatched concurrently when their back
+ * end supports asynchronous execution (see vh_beat_exec_send).  Each shard's
+ * results are collected into the Funnel as they arrive, so a fan out costs
+ * the latency of the slowest shard rather than the sum of every shard.
+ * Timing for each fetch is reported on ExecResult->shard_stats.
  */
 
 typedef struct ExecStateData
@@ -37,6 +43,10 @@ typedef struct ExecStateData
 	MemoryContext mctx_work;
 	MemoryContext mctx_result;
 	ExecResult er;
+
+	struct ExecResultShardStat *shard_stats;
+	int32_t nshard_stats;
+	int32_t shard_stats_sz;
 } *ExecState;
 
 ExecState vh_es_open(void);
@@ -8,6 +8,21 @@
 
 #include "io/nodes/NodeQuery.h"
 
+/*
+ * SelectFetchMode
+ *
+ * Tells the planner how the result set should come back from the back end.
+ * With SFM_Auto the planner streams full table extracts in bulk (no quals,
+ * joins or LIMIT) and fetches everything else row by row.  Back ends without
+ * a bulk path ignore the hint.
+ */
+typedef enum SelectFetchMode
+{
+	SFM_Auto,
+	SFM_Row,
+	SFM_Bulk
+} SelectFetchMode;
+
 typedef struct NodeQuerySelectData
 {
 	struct NodeQueryData query;
@@ -20,6 +35,7 @@ typedef struct NodeQuerySelectData
 	int32_t offset;
 	uint16_t nfields;
 	uint16_t result_table_selections;
+	SelectFetchMode fetch_mode;
 } *NodeQuerySelect;
 
 NodeQuerySelect vh_sqlq_sel_create(void);
@@ -50,6 +66,8 @@ void vh_sqlq_sel_limit_clear(NodeQuerySelect nq);
 int32_t vh_sqlq_sel_offset_set(NodeQuerySelect nq, int32_t offset);
 void vh_sqlq_sel_offset_clear(NodeQuerySelect nq);
 
+#define vh_sqlq_sel_fetchmode_set(nq, mode)	((nq)->fetch_mode = (mode))
+
 
 #define vh_sqlq_sel_query_td(td)												\
 	( td ? ( {																	\
@@ -17,8 +17,16 @@ typedef struct NodeQueryUpdateData
 	Node nquals;
 
 	HeapTuplePtr htp;
+	SList htps;
 } *NodeQueryUpdate;
 
+/*
+ * When |htps| is set the query updates every HeapTuplePtr in the list with
+ * the same statement.  Each tuple must share the TableDefVer of |nfrom| and
+ * have the same set of changed fields, which are given by |nfields|.  Rows
+ * are matched on the primary key, |nquals| is ignored.
+ */
+
 NodeQueryUpdate vh_sqlq_upd_create(void);
 
 NodeFrom vh_sqlq_upd_from(NodeQueryUpdate nqupd, TableDef td);
@@ -27,5 +35,31 @@ void vh_sqlq_upd_field_add(NodeQueryUpdate nqupd, NodeUpdateField nuf);
 void vh_sqlq_upd_htp(NodeQueryUpdate nqupd, HeapTuplePtr htp);
 void vh_sqlq_upd_htpl(NodeQueryUpdate nqupd, SList htps);
 
+/*
+ * vh_sqlq_upd_values_cmd
+ *
+ * Forms the SQL command for a NodeQueryUpdate with |htps| as a single join
+ * against a VALUES list keyed on the primary key:
+ *
+ * 	UPDATE t SET a = vh_v.a FROM (VALUES (?, ?), (?, ?)) AS vh_v (id, a)
+ * 	WHERE t.id = vh_v.id
+ *
+ * Back ends that can't infer the type of a placeholder in a VALUES list pass
+ * |cast|, which is called after each placeholder in the first row.
+ */
+typedef void (*vh_sqlq_upd_cast_cb)(String cmd, NodeSqlCmdContext ctx, 
+									TableField tf);
+
+bool vh_sqlq_upd_values_cmd(String cmd, NodeQueryUpdate nqupd,
+							NodeSqlCmdContext ctx, vh_sqlq_upd_cast_cb cast);
+
+/*
+ * vh_sqlq_upd_fields
+ *
+ * Fills |tfs| with the TableField of each NodeUpdateField on |nqupd|, up to
+ * |sz|.  Returns the number of fields on the query.
+ */
+int32_t vh_sqlq_upd_fields(NodeQueryUpdate nqupd, TableField *tfs, int32_t sz);
+
 #endif
 
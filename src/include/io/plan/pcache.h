@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2011-2017, Kyle A. Gearhart
+ */
+
+
+#ifndef vh_datacatalog_plan_pcache_H
+#define vh_datacatalog_plan_pcache_H
+
+#include "io/plan/pstmt.h"
+
+/*
+ * PlanCache
+ *
+ * Planning a NodeQuery means generating the SQL command, building the
+ * ParameterList and forming the query result projections (QRP).  For point
+ * lookups that's often more work than the back end spends running the
+ * statement.  The PlanCache remembers the command and projections for each
+ * query shape it has planned so only the parameters have to be built when
+ * the same shape comes around again.
+ *
+ * The shape of a query is everything that ends up in the SQL command: the
+ * tables, fields, aliases, join and qual structure, operators, the Type of
+ * each parameter and the LIMIT/OFFSET.  Parameter values are left out.  The
+ * shape is serialized to a byte string, so two queries only share an entry
+ * when their shapes match exactly, not just their hash.
+ *
+ * Each entry is given a process wide |prepare_id|.  The planner copies it to
+ * the PlannedStmtShard so back ends may keep a server side prepared statement
+ * per connection (see vh_pcache_prepname).  A PlannedStmtShard with a zero
+ * |prepare_id| must be sent as a one off statement.
+ *
+ * Only SELECT queries are cached.  INSERT and UPDATE shapes are decided by
+ * the null bitmaps and changed fields of the HeapTuple being written, which
+ * the planner rewrites on every call.
+ *
+ * Each CatalogContext has its own PlanCache, created on first use, so worker
+ * threads never share one.  The QRP arrays belong to the cache: a PlannedStmt
+ * planned from the cache has |qrp_shared| set and vh_pstmt_finalize leaves
+ * them alone.
+ */
+
+typedef struct PlanCacheData *PlanCache;
+
+typedef struct PlanCacheStats
+{
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t bypass;		/* Query shape can't be cached or cache is full */
+	uint32_t entries;
+} PlanCacheStats;
+
+#define VH_PCACHE_MAX_ENTRIES		1024
+#define VH_PCACHE_PREPNAME_SZ		24
+
+PlanCache vh_pcache_create(MemoryContext mctx_parent, uint32_t max_entries);
+void vh_pcache_destroy(PlanCache pc);
+
+/*
+ * vh_pcache
+ *
+ * Returns the PlanCache for the current CatalogContext, creating it on the
+ * first call.
+ */
+PlanCache vh_pcache(void);
+
+/*
+ * vh_pcache_reset
+ *
+ * Drops every entry.  Must not be called while an ExecPlan formed from the
+ * cache is still running, the projections are released with the entries.
+ */
+void vh_pcache_reset(PlanCache pc);
+
+void vh_pcache_stats(PlanCache pc, PlanCacheStats *stats);
+
+/*
+ * vh_pcache_pstmtshd
+ *
+ * Replaces the vh_pstmtshd_generate and vh_pstmt_qrp pair in the planner.
+ * On a hit the command and projections come from the cache and only the
+ * ParameterList is built.  On a miss the statement is planned as usual and
+ * the result is remembered.  Returns null when the QRP could not be formed.
+ */
+PlannedStmtShard vh_pcache_pstmtshd(PlannedStmt pstmt,
+									Shard shd, ShardAccess shda);
+
+/*
+ * vh_pcache_prepname
+ *
+ * Writes the server side statement name for |prepare_id| to |buffer|, which
+ * should be at least VH_PCACHE_PREPNAME_SZ bytes.
+ */
+void vh_pcache_prepname(uint32_t prepare_id, char *buffer, size_t len);
+
+#endif
+
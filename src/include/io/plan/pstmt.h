@@ -47,6 +47,12 @@ struct PlannedStmtShardData
 	ParameterList parameters;
 	int32_t paramcount;
 
+	/*
+	 * Non-zero when the command came from the PlanCache and may be kept
+	 * as a server side prepared statement (see io/plan/pcache.h).
+	 */
+	uint32_t prepare_id;
+
 	BackEndConnection nconn;
 };
 
@@ -69,8 +75,10 @@ struct PlannedStmtData
 	QrpBackEndProjection qrp_backend;
 
 	bool finalize_qrp;
+	bool qrp_shared;		/* QRP belongs to the PlanCache */
 	bool latebinding;
 	bool latebindingset;
+	bool bulk;				/* Stream the result in bulk, see plan_select */
 
 	SList shards;
 
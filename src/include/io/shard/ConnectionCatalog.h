@@ -11,6 +11,61 @@ typedef struct ConnectionCatalogData ConnectionCatalogData, *ConnectionCatalog;
 typedef struct ShardData *Shard;
 typedef struct ShardAccessData ShardAccessData, *ShardAccess;
 
+/*
+ * ConnectionCatalog
+ *
+ * Pools BackEndConnections for each ShardAccess.  The catalog is shared by
+ * every thread attached to the CatalogContext, so checkout and return take
+ * the catalog lock.  Connecting, pinging and disconnecting happen outside the
+ * lock; only the bookkeeping is serialized.
+ *
+ * Each pool grows on demand up to |max| connections (zero means no limit).
+ * When the pool is exhausted vh_ConnectionGet waits for a connection to be
+ * returned, up to |checkout_timeout_ms|.  Idle connections above |min| are
+ * closed once they have sat for |idle_timeout_ms|.  A connection that has
+ * been idle for |validate_after_ms| is checked with the back end's ping
+ * action before it's handed out and replaced when the ping fails.
+ *
+ * Each connection gets its own MemoryContext, so back end allocations made
+ * while a thread holds the connection never touch memory shared with other
+ * threads.
+ */
+
+typedef struct ConnectionPoolOpts
+{
+	uint32_t min;
+	uint32_t max;					/* 0 for no limit */
+	int64_t checkout_timeout_ms;	/* -1 waits forever, 0 never waits */
+	int64_t idle_timeout_ms;		/* -1 never closes idle connections */
+	int64_t validate_after_ms;		/* -1 never validates */
+} ConnectionPoolOpts;
+
+#define VH_CONNPOOL_DEFAULT_CHECKOUT_MS		-1
+#define VH_CONNPOOL_DEFAULT_IDLE_MS			(5 * 60 * 1000)
+#define VH_CONNPOOL_DEFAULT_VALIDATE_MS		(30 * 1000)
+#define VH_CONNPOOL_REAP_INTERVAL_MS		1000
+
+typedef struct ConnectionPoolStats
+{
+	uint64_t checkouts;
+	uint64_t returns;
+	uint64_t spawned;
+	uint64_t spawn_failed;
+	uint64_t reaped;
+	uint64_t validated;
+	uint64_t validate_failed;
+
+	uint64_t waits;				/* Checkouts that had to wait */
+	uint64_t timeouts;			/* Waits that gave up */
+	uint64_t wait_ns;			/* Total time spent waiting */
+	uint64_t wait_ns_max;
+
+	double spawn_rate;			/* Connections spawned per second */
+
+	uint32_t total;
+	uint32_t idle;
+	uint32_t waiting;
+} ConnectionPoolStats;
 
 ConnectionCatalog vh_ConnectionCatalogCreate(void);
 Shard vh_ConnectionCatalogGetDefault(ConnectionCatalog);
@@ -18,7 +73,55 @@ void vh_ConnectionCatalogSetDefault(ConnectionCatalog, Shard);
 void vh_ConnectionCatalogShutDown(ConnectionCatalog cc);
 void vh_ConnectionCatalogDestroy(ConnectionCatalog catalog);
 
+/*
+ * vh_ConnectionCatalogSetOpts
+ *
+ * Sets the pool options for |shardam|.  A null |shardam| sets the options
+ * used by pools created after the call.
+ */
+void vh_ConnectionCatalogSetOpts(ConnectionCatalog catalog, ShardAccess shardam,
+								 const ConnectionPoolOpts *opts);
+void vh_ConnectionCatalogGetOpts(ConnectionCatalog catalog, ShardAccess shardam,
+								 ConnectionPoolOpts *opts);
+
+/*
+ * vh_ConnectionCatalogWarm
+ *
+ * Opens connections for |shardam| until the pool holds |min|.  Returns the
+ * number of connections opened.
+ */
+int32_t vh_ConnectionCatalogWarm(ConnectionCatalog catalog, ShardAccess shardam);
+
+/*
+ * vh_ConnectionCatalogReap
+ *
+ * Closes idle connections past their |idle_timeout_ms|, never shrinking a
+ * pool below |min|.  vh_ConnectionReturn does this on its own at most every
+ * VH_CONNPOOL_REAP_INTERVAL_MS.  Returns the number of connections closed.
+ */
+int32_t vh_ConnectionCatalogReap(ConnectionCatalog catalog);
+
+/*
+ * vh_ConnectionCatalogStats
+ *
+ * Fills |stats| for the pool serving |shardam|, or for every pool when
+ * |shardam| is null.
+ */
+void vh_ConnectionCatalogStats(ConnectionCatalog catalog, ShardAccess shardam,
+							   ConnectionPoolStats *stats);
+
+/*
+ * vh_ConnectionGet
+ *
+ * Checks out a connection for |shardam|, waiting according to the pool's
+ * |checkout_timeout_ms|.  vh_ConnectionGetWait overrides the timeout for a
+ * single call.  Both return null when the wait timed out and throw an
+ * ERROR2 when a new connection could not be established.
+ */
 BackEndConnection vh_ConnectionGet(ConnectionCatalog catalog, ShardAccess shardam);
+BackEndConnection vh_ConnectionGetWait(ConnectionCatalog catalog,
+									   ShardAccess shardam,
+									   int64_t timeout_ms);
 void vh_ConnectionReturn(ConnectionCatalog catalog, BackEndConnection nconn);
 
 #endif
@@ -103,7 +103,17 @@ void vh_err_queue(ErrorQueue queue,
 				  const char *filepath, double lineno, 
 				  const char *message);
 
-extern sigjmp_buf *vh_exception_stack;
+/*
+ * Each thread unwinds to its own VH_TRY block, the parallel operators run
+ * VH_TRY and elog on worker threads.
+ */
+#ifdef _MSC_VER
+#define VH_ERR_TLS __declspec(thread)
+#else
+#define VH_ERR_TLS __thread
+#endif
+
+extern VH_ERR_TLS sigjmp_buf *vh_exception_stack;
 
 #define VH_TRY() 																\
 	do {																		\
@@ -128,7 +138,7 @@ extern sigjmp_buf *vh_exception_stack;
 		vh_exception_stack = copy_stack; 										\
 	} while(0)
 
-void vh_err_rethrow();
+void vh_rethrow();
 
 #endif
 
@@ -39,6 +39,21 @@ struct btScanKeyData
 btRoot vh_bt_create(MemoryContext mctx, bool unique);
 void vh_bt_destroy(btRoot root);
 
+/*
+ * vh_bt_create_capped
+ *
+ * Creates a BTree that never holds more than |cap| entries.  When the tree
+ * is full, an insert is first checked against the boundary key (the smallest
+ * key when |keep_largest| is set, otherwise the largest).  Keys that wouldn't
+ * make the cut are rejected without descending the tree; the rest evict the
+ * boundary entry before being inserted.
+ *
+ * A rejected insert returns false with a null value pointer.
+ */
+btRoot vh_bt_create_capped(MemoryContext mctx, bool unique,
+						   int32_t cap, bool keep_largest);
+int32_t vh_bt_count(btRoot root);
+
 bool vh_bt_add_column(btRoot root, TableDefVer tdv,
 					  TableField tf, bool allow_nulls);
 bool vh_bt_add_column_tys(btRoot root, Type *tys, bool allow_nulls);
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2011-2017, Kyle A. Gearhart
+ */
+
+
+#ifndef vh_datacatalog_utils_mmgr_Arena_H
+#define vh_datacatalog_utils_mmgr_Arena_H
+
+/*
+ * Arena
+ *
+ * A bump allocator for scratch memory that is thrown away all at once, like
+ * a plan or the working memory of a single query.  vhfree on an arena chunk
+ * only gives the space back if it was the last chunk handed out.  Everything
+ * else is reclaimed by vh_mctx_reset, which keeps the first block around so
+ * the next round doesn't go back to malloc, or by vh_mctx_destroy.
+ */
+
+MemoryContext vh_MemoryArenaCreate(MemoryContext parent, uint32_t blockSize,
+								   const char *name);
+
+#endif
+
@@ -9,5 +9,7 @@
 #include "io/utils/mmgr/MemoryContext.h"
 #include "io/utils/mmgr/Alloc.h"
 #include "io/utils/mmgr/Pool.h"
+#include "io/utils/mmgr/Arena.h"
+#include "io/utils/mmgr/Slab.h"
 
 #endif
@@ -11,7 +11,9 @@ typedef struct MemoryContextData *MemoryContext;
 typedef enum
 {
 	MT_Pool,
-	MT_ObjectPool
+	MT_ObjectPool,
+	MT_Arena,
+	MT_Slab
 } MemoryTag;
 
 typedef struct MemoryContextOpsTable
@@ -25,6 +27,11 @@ typedef struct MemoryContextOpsTable
 	void* (* const realloc)(void*, void*, size_t);
 	void (* const free)(void*, void*);
 	void (* const destroy)(void*);
+
+	/*
+	 * Optional, releases every chunk but leaves the context usable.
+	 */
+	void (* const reset)(void*);
 } MemoryContextOpsTable, *MemoryContextOps;
 
 /*
@@ -59,7 +66,9 @@ typedef struct MemoryContextData
  * the number of bytes that must be walked backwards (traversing over the entire
  * MemoryChunkHeader structure) to reach a superblock.
  *
- * The superblock strategy is typically used by shared memory contexts.
+ * The superblock strategy is typically used by shared memory contexts.  The
+ * offset is measured from the start of the MemoryChunkHeader, since the same
+ * chunk lives at a different address in each process mapping the region.
  */
 #define VH_MCHDR_FLAG_SUPERBLOCK		( 1ll << ((sizeof(uintptr_t) * 8) - 1))
 
@@ -68,8 +77,8 @@ typedef struct MemoryContextData
 #define vh_mchdr_size(mchdr)			((mchdr)->size & ~VH_MCHDR_FLAG_SUPERBLOCK)
 #define vh_mchdr_set_size(mchdr, sz)	((mchdr)->size = (sz))
 
-#define vh_mchdr_superblock(ptr)		( vh_mchdr_is_superblock(ptr) 			?	\
-	((void*)(((unsigned char*)ptr) - ((((MemoryChunkHeader)ptr) - 1)->offset))) : 0 )
+#define vh_mchdr_superblock(mchdr)		( vh_mchdr_is_superblock(mchdr)		?	\
+	((void*)(((unsigned char*)(mchdr)) - (mchdr)->offset)) : 0 )
 
 
 typedef struct MemoryChunkHeaderData
@@ -93,10 +102,11 @@ void vh_mctx_destroy(MemoryContext context);
 void vh_mctx_destroy_children(MemoryContext context);
 
 /*
- * Clear a MemoryContext but don't make it unusable.
+ * Clear a MemoryContext but don't make it unusable.  Child contexts are
+ * destroyed, since they may hold pointers into the memory we're releasing.
+ * Only contexts with a reset op support this (i.e. vh_MemoryArenaCreate).
  */
-void vh_mctx_clear(MemoryContext context);
-void vh_mctx_clear_children(MemoryContext context);
+void vh_mctx_reset(MemoryContext context);
 
 /* Scope functions for standard allocations */
 MemoryContext vh_mctx_current(void);
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2011-2017, Kyle A. Gearhart
+ */
+
+
+#ifndef vh_datacatalog_utils_mmgr_Slab_H
+#define vh_datacatalog_utils_mmgr_Slab_H
+
+/*
+ * Slab
+ *
+ * A MemoryContext for workloads that allocate and free lots of small
+ * objects of just a few sizes, like the TypeVars behind accumulators or
+ * HeapTuples of a single HeapTupleDef.  Requests are rounded up to a 16 byte
+ * size class and served out of contiguous slabs holding only that class, so
+ * alloc and free never walk a list.  Requests larger than
+ * VH_SLAB_MAXCHUNK go straight to malloc.
+ *
+ * |slabSize| must be a power of two no smaller than VH_SLAB_MINSIZE, zero
+ * takes VH_SLAB_DEFAULTSIZE.
+ */
+
+#define VH_SLAB_MAXCHUNK		1024
+#define VH_SLAB_MINSIZE			(16 * 1024)
+#define VH_SLAB_DEFAULTSIZE		(64 * 1024)
+
+MemoryContext vh_MemorySlabCreate(MemoryContext parent, uint32_t slabSize,
+								  const char *name);
+
+#endif
+
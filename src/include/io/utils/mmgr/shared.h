@@ -11,20 +11,46 @@
 /*
  * This is our shared memory allocator that works within the existing
  * MemoryContext framework.  We require no locks in the SharedMemoryBlock,
- * as all "locking" is done within the freespace B+Tree on a "page" by
- * "page" basis.  A page user defined by block_size.
+ * every field a process may change after creation is updated with an atomic
+ * instruction.
+ *
+ * The segment is carved up by bumping |cursor|.  Chunks are handed out in
+ * size classes, four per power of two starting at 32 bytes, so a chunk never
+ * wastes more than a quarter of its space.  Freed chunks are pushed on a
+ * lock-free stack per size class in |freelists| and handed back out before
+ * we bump the cursor again.
+ *
+ * Each |freelists| head packs a generation tag in the upper 32 bits and the
+ * chunk offset divided by eight in the lower 32 bits.  The tag is bumped on
+ * every push and pop so a stale compare-and-swap can never succeed.  This
+ * caps a segment at VH_SHM_MAXSIZE.
+ *
+ * |base| is the address the creator mapped the segment at.  Anything stored
+ * in the segment with a raw pointer (e.g. a HeapBuffer's block directory) is
+ * only valid in processes that map the segment at |base|.
+ *
+ * |root| is the single object the creator wants to hand to attachers, for
+ * a HeapBuffer it's the HeapBufferData itself.
  */
 
+#define VH_SHM_FREELISTS				128
+#define VH_SHM_MAXSIZE					(((size_t)UINT32_MAX) << 3)
+
 struct SharedMemoryBlock
 {
 	struct MemorySuperBlockData super;
 
 	size_t block_size;
 	size_t min_size;
+	size_t size;
+	size_t cursor;
+
+	uintptr_t base;
+	void *root;
 
 	int32_t ref_count;
 
-	size_t root_freespace;
+	uint64_t freelists[VH_SHM_FREELISTS];
 };
 
 #endif
@@ -7,33 +7,56 @@
 #define vh_mctx_sharedctx_H
 
 #include "io/utils/mmgr/MemoryContext.h"
+#include "io/utils/mmgr/shared.h"
 
 
 /*
  * SharedMemoryContext
  *
- * The process local handle for a shared memory region.
+ * The process local handle for a shared memory region.  Every process that
+ * maps the region gets its own handle, the handle is found from any chunk
+ * in the region by walking the chunk back to its SharedMemoryBlock and
+ * looking up the identifier in a process local registry.
+ *
+ * The creator of a region owns the name, it should call
+ * vh_mctx_shared_unlink once every process that needs the region has
+ * attached.  The mapping stays valid until the last process destroys its
+ * handle.
  */
 
+typedef struct SharedMemoryContextData *SharedMemoryContext;
+
 struct SharedMemoryContextData
 {
 	struct MemoryContextData mctx;
 	struct MemorySuperBlockId ident;
 
 	char *mapped_address_space;
-	void *free_root;
+	size_t mapped_sz;
 
 	int32_t fd;
+	bool creator;
 };
 
 
-MemoryContext vh_mctx_shared_attach(MemorySuperBlockId ident);
+MemoryContext vh_mctx_shared_attach(struct MemorySuperBlockId ident);
 MemoryContext vh_mctx_shared_create(struct MemorySuperBlockId ident,
 									size_t block_size,
 					  				size_t minimum_size,
 				  					bool allow_growth,
 				  					const char *name);
+bool vh_mctx_shared_unlink(struct MemorySuperBlockId ident);
+
+/*
+ * The root object is published by the creator with release semantics, so
+ * an attacher that sees it also sees everything written to the region
+ * before it was published.
+ */
+void* vh_mctx_shared_root(MemoryContext mctx);
+void vh_mctx_shared_set_root(MemoryContext mctx, void *root);
+bool vh_mctx_shared_samebase(MemoryContext mctx);
 
+MemoryContext vh_mctx_shared_from_superblock(void *super);
 
 #endif
 
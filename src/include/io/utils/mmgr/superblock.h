@@ -29,6 +29,12 @@
 #define VH_MCTX_SUPERBLOCK_MAGIC 		(0xf391d9ae)
 #define VH_MCTX_SUPERBLOCK_ID_SZ		(16)
 
+/*
+ * Super block tags, one per MemoryOps table that knows how to resolve a
+ * super block to its local handle.
+ */
+#define VH_MCTX_SUPERBLOCK_TAG_SHARED	(1)
+
 struct MemorySuperBlockId
 {
 	char id[VH_MCTX_SUPERBLOCK_ID_SZ];
@@ -38,7 +44,7 @@ struct MemorySuperBlockData
 {
 	int32_t magic;
 	int32_t tag;
-	char identifier[16];
+	char identifier[VH_MCTX_SUPERBLOCK_ID_SZ];
 };
 
 
@@ -142,7 +142,7 @@ vh_ml_test_classification(MachLearn ml, SList training, SList test,
 	for (i = 0; i < htp_sz; i++)
 	{
 		htp = htp_head[i];
-		ht = vh_htp(htp);
+		ht = vh_htp_read(htp);
 
 		/*
 		 * Get the classification on the test set.
@@ -5,6 +5,12 @@
 
 
 #include <assert.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VH_MLF_X86
+#endif
 
 #include "vh.h"
 #include "io/catalog/TypeVar.h"
@@ -651,3 +657,184 @@ vectordot_cache(Type *tys)
 	return cache;
 }
 
+/*
+ * ============================================================================
+ * Packed Implementation
+ * ============================================================================
+ *
+ * Each metric is described by a vector step and a scalar step.  The kernels
+ * run the vector step across as many full lanes as they can, fold the lanes
+ * and then pick up the tail with the scalar step.  Everything is summed into a
+ * double once it leaves the vector registers.
+ *
+ * The AVX2 kernels are built with a target attribute so we don't need the
+ * whole tree compiled with -mavx2, vh_mlf_distance_packed checks the CPU
+ * before handing them out.
+ */
+
+#define MLF_EUC_VEC(acc, a, b, vadd, vsub, vmul, vandn, vset1)				\
+	do { a = vsub(a, b); acc = vadd(acc, vmul(a, a)); } while (0)
+#define MLF_EUC_SCALAR(sum, x, y)											\
+	do { double d = (double)(x) - (double)(y); sum += d * d; } while (0)
+
+#define MLF_MAN_VEC(acc, a, b, vadd, vsub, vmul, vandn, vset1)				\
+	do { acc = vadd(acc, vandn(vset1(-0.0), vsub(a, b))); } while (0)
+#define MLF_MAN_SCALAR(sum, x, y)											\
+	do { sum += fabs((double)(x) - (double)(y)); } while (0)
+
+#define MLF_DOT_VEC(acc, a, b, vadd, vsub, vmul, vandn, vset1)				\
+	do { acc = vadd(acc, vmul(a, b)); } while (0)
+#define MLF_DOT_SCALAR(sum, x, y)											\
+	do { sum += (double)(x) * (double)(y); } while (0)
+
+#define MLF_FIN_NONE(sum)		(sum)
+
+#define MLF_PD_SCALAR(name, ctype, step, fin)								\
+	static double name(const void *lhs, const void *rhs, int32_t n)			\
+	{																		\
+		const ctype *l = lhs, *r = rhs;										\
+		double sum = 0.0;													\
+		int32_t i;															\
+																			\
+		for (i = 0; i < n; i++)												\
+			step##_SCALAR(sum, l[i], r[i]);									\
+																			\
+		return fin(sum);													\
+	}
+
+#define MLF_PD_VECTOR(name, attr, ctype, vtype, lanes, vload, vstore,		\
+					  vzero, vadd, vsub, vmul, vandn, vset1, step, fin)		\
+	attr static double name(const void *lhs, const void *rhs, int32_t n)	\
+	{																		\
+		const ctype *l = lhs, *r = rhs;										\
+		vtype acc = vzero(), a, b;											\
+		ctype lane[lanes];													\
+		double sum = 0.0;													\
+		int32_t i, j;														\
+																			\
+		for (i = 0; i + (lanes) <= n; i += (lanes))							\
+		{																	\
+			a = vload(l + i);												\
+			b = vload(r + i);												\
+			step##_VEC(acc, a, b, vadd, vsub, vmul, vandn, vset1);			\
+		}																	\
+																			\
+		vstore(lane, acc);													\
+																			\
+		for (j = 0; j < (lanes); j++)										\
+			sum += lane[j];													\
+																			\
+		for (; i < n; i++)													\
+			step##_SCALAR(sum, l[i], r[i]);									\
+																			\
+		return fin(sum);													\
+	}
+
+#if !(defined(VH_MLF_X86) && defined(__SSE2__))
+
+/*
+ * Only reached when there's no SSE2 kernel to fall back on; the vector
+ * kernels carry their own scalar tail.
+ */
+MLF_PD_SCALAR(pd_euclidean_dbl, double, MLF_EUC, sqrt)
+MLF_PD_SCALAR(pd_euclidean_flt, float, MLF_EUC, sqrt)
+MLF_PD_SCALAR(pd_manhattan_dbl, double, MLF_MAN, MLF_FIN_NONE)
+MLF_PD_SCALAR(pd_manhattan_flt, float, MLF_MAN, MLF_FIN_NONE)
+MLF_PD_SCALAR(pd_vectordot_dbl, double, MLF_DOT, MLF_FIN_NONE)
+MLF_PD_SCALAR(pd_vectordot_flt, float, MLF_DOT, MLF_FIN_NONE)
+
+static const vh_mlf_pdistance_func pd_scalar[3][2] = {
+	{ pd_euclidean_dbl, pd_euclidean_flt },
+	{ pd_manhattan_dbl, pd_manhattan_flt },
+	{ pd_vectordot_dbl, pd_vectordot_flt }
+};
+
+#endif
+
+#if defined(VH_MLF_X86) && defined(__SSE2__)
+
+#define MLF_SSE2_DBL(name, step, fin)										\
+	MLF_PD_VECTOR(name, , double, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd,	\
+				  _mm_setzero_pd, _mm_add_pd, _mm_sub_pd, _mm_mul_pd,		\
+				  _mm_andnot_pd, _mm_set1_pd, step, fin)
+#define MLF_SSE2_FLT(name, step, fin)										\
+	MLF_PD_VECTOR(name, , float, __m128, 4, _mm_loadu_ps, _mm_storeu_ps,	\
+				  _mm_setzero_ps, _mm_add_ps, _mm_sub_ps, _mm_mul_ps,		\
+				  _mm_andnot_ps, _mm_set1_ps, step, fin)
+
+MLF_SSE2_DBL(pd_euclidean_dbl_sse2, MLF_EUC, sqrt)
+MLF_SSE2_FLT(pd_euclidean_flt_sse2, MLF_EUC, sqrt)
+MLF_SSE2_DBL(pd_manhattan_dbl_sse2, MLF_MAN, MLF_FIN_NONE)
+MLF_SSE2_FLT(pd_manhattan_flt_sse2, MLF_MAN, MLF_FIN_NONE)
+MLF_SSE2_DBL(pd_vectordot_dbl_sse2, MLF_DOT, MLF_FIN_NONE)
+MLF_SSE2_FLT(pd_vectordot_flt_sse2, MLF_DOT, MLF_FIN_NONE)
+
+static const vh_mlf_pdistance_func pd_sse2[3][2] = {
+	{ pd_euclidean_dbl_sse2, pd_euclidean_flt_sse2 },
+	{ pd_manhattan_dbl_sse2, pd_manhattan_flt_sse2 },
+	{ pd_vectordot_dbl_sse2, pd_vectordot_flt_sse2 }
+};
+
+#endif
+
+#if defined(VH_MLF_X86) && defined(__GNUC__)
+
+#define MLF_AVX2_ATTR		__attribute__((target("avx2")))
+
+#define MLF_AVX2_DBL(name, step, fin)										\
+	MLF_PD_VECTOR(name, MLF_AVX2_ATTR, double, __m256d, 4,					\
+				  _mm256_loadu_pd, _mm256_storeu_pd, _mm256_setzero_pd,		\
+				  _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd,				\
+				  _mm256_andnot_pd, _mm256_set1_pd, step, fin)
+#define MLF_AVX2_FLT(name, step, fin)										\
+	MLF_PD_VECTOR(name, MLF_AVX2_ATTR, float, __m256, 8,					\
+				  _mm256_loadu_ps, _mm256_storeu_ps, _mm256_setzero_ps,		\
+				  _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps,				\
+				  _mm256_andnot_ps, _mm256_set1_ps, step, fin)
+
+MLF_AVX2_DBL(pd_euclidean_dbl_avx2, MLF_EUC, sqrt)
+MLF_AVX2_FLT(pd_euclidean_flt_avx2, MLF_EUC, sqrt)
+MLF_AVX2_DBL(pd_manhattan_dbl_avx2, MLF_MAN, MLF_FIN_NONE)
+MLF_AVX2_FLT(pd_manhattan_flt_avx2, MLF_MAN, MLF_FIN_NONE)
+MLF_AVX2_DBL(pd_vectordot_dbl_avx2, MLF_DOT, MLF_FIN_NONE)
+MLF_AVX2_FLT(pd_vectordot_flt_avx2, MLF_DOT, MLF_FIN_NONE)
+
+static const vh_mlf_pdistance_func pd_avx2[3][2] = {
+	{ pd_euclidean_dbl_avx2, pd_euclidean_flt_avx2 },
+	{ pd_manhattan_dbl_avx2, pd_manhattan_flt_avx2 },
+	{ pd_vectordot_dbl_avx2, pd_vectordot_flt_avx2 }
+};
+
+#endif
+
+/*
+ * vh_mlf_distance_packed
+ *
+ * Maps a TypeVarSlot distance function to its packed kernel for the widest
+ * instruction set available.
+ */
+vh_mlf_pdistance_func
+vh_mlf_distance_packed(vh_mlf_distance_func distance, bool f32)
+{
+	int32_t metric;
+
+	if (distance == vh_mlf_distance_euclidean)
+		metric = 0;
+	else if (distance == vh_mlf_distance_manhattan)
+		metric = 1;
+	else if (distance == vh_mlf_distance_vectordot)
+		metric = 2;
+	else
+		return 0;
+
+#if defined(VH_MLF_X86) && defined(__GNUC__)
+	if (__builtin_cpu_supports("avx2"))
+		return pd_avx2[metric][f32];
+#endif
+
+#if defined(VH_MLF_X86) && defined(__SSE2__)
+	return pd_sse2[metric][f32];
+#else
+	return pd_scalar[metric][f32];
+#endif
+}
@@ -10,6 +10,7 @@
 #include "io/analytics/ml/mlknn.h"
 #include "io/catalog/HeapField.h"
 #include "io/catalog/HeapTuple.h"
+#include "io/catalog/HeapTupleDef.h"
 #include "io/catalog/Type.h"
 #include "io/catalog/TypeVar.h"
 #include "io/catalog/TypeVarSlot.h"
@@ -31,6 +32,21 @@ struct mlKNNData
 	int32_t k;
 
 	ML_KNN_Mode mode;
+
+	/*
+	 * Packed training set, the matrix rows line up with the HeapTuplePtr
+	 * in |training_set|.  Rows are |stride| features wide, padded with zeros
+	 * to a multiple of the widest vector register.
+	 */
+	ML_KNN_Pack pack;
+	vh_mlf_pdistance_func pdistance;
+	HeapField *pack_hfs;
+	TypeVarOpExec *pack_ops;
+	void *matrix;
+	size_t width;
+	int32_t stride;
+	int32_t n_rows;
+	int32_t rows_cap;
 };
 
 struct mlKNNVoteData
@@ -45,11 +61,43 @@ struct mlKNNDistanceData
 	HeapTuplePtr htp;
 };
 
+struct mlKNNPackedData
+{
+	double distance;
+	int32_t row;
+};
+
+/*
+ * Packed rows are padded out to this many bytes, which covers an AVX register.
+ */
+#define KNN_PACK_ALIGN		32
+
+#define KNN_PACK_ROWS		1024
+
+static Type ml_knn_tys_dbl[] = { &vh_type_dbl, 0 };
+
 static int32_t ml_knn_train(void *ml, HeapTuplePtr, HeapTuple);
 
 static int32_t ml_knn_vote_compare(const void *lhs, const void *rhs);
 static int32_t ml_knn_class_compare(const void *lhs, const void *rhs);
 static int32_t ml_knn_distance_compare(const void *lhs, const void *rhs);
+static int32_t ml_knn_packed_compare(const void *lhs, const void *rhs);
+
+static void ml_knn_heap_up(void *heap, int32_t i, size_t sz,
+						   int32_t (*cmp)(const void*, const void*));
+static void ml_knn_heap_down(void *heap, int32_t n, size_t sz,
+							 int32_t (*cmp)(const void*, const void*));
+static void ml_knn_heap_swap(void *lhs, void *rhs, size_t sz);
+
+static int32_t ml_knn_vote(mlKNNData *knn, TypeVarSlot *target,
+						   HeapTuplePtr *neighbors, int32_t n_neighbors,
+						   struct mlKNNVoteData *votes);
+
+static bool ml_knn_pack_value(mlKNNData *knn, int32_t idx,
+							  Type *tys, void *data, bool null,
+							  void *out);
+static int32_t ml_knn_populate_packed(mlKNNData *knn, TypeVarSlot *target,
+									  TypeVarSlot **datas, int32_t n_datas);
 
 static int32_t ml_knn_populate_slot(void *pc, TypeVarSlot *target,
 									TypeVarSlot **datas, int32_t n_datas);
@@ -96,6 +144,7 @@ static int32_t
 ml_knn_finalize(void *ml)
 {
 	struct mlKNNData *knn = ml;
+	int32_t i;
 
 	if (knn->mlf_distance_cache)
 	{
@@ -107,9 +156,82 @@ ml_knn_finalize(void *ml)
 		vh_SListDestroy(knn->training_set);
 	}
 
+	if (knn->matrix)
+		vhfree(knn->matrix);
+
+	if (knn->pack_hfs)
+	{
+		for (i = 0; i < knn->mld.n_paths; i++)
+			if (knn->pack_ops[i])
+				vh_typevar_op_destroy(knn->pack_ops[i]);
+
+		vhfree(knn->pack_hfs);
+	}
+
 	return 0;
 }
 
+/*
+ * vh_ml_knn_pack
+ *
+ * Switches the training set to a packed feature matrix.  The HeapField and
+ * conversion operators for each path are resolved on the first tuple.
+ */
+bool
+vh_ml_knn_pack(void *ml, ML_KNN_Pack pack)
+{
+	mlKNNData *knn = ml;
+	vh_mlf_pdistance_func pdistance = 0;
+	int32_t per_reg;
+	size_t sz;
+
+	if (knn->training_set)
+	{
+		elog(WARNING,
+				emsg("vh_ml_knn_pack must be called before the KNN model is "
+					 "trained"));
+		return false;
+	}
+
+	if (pack != KNN_PackNone)
+	{
+		pdistance = vh_mlf_distance_packed(knn->distance, 
+										   pack == KNN_PackFloat32);
+
+		if (!pdistance)
+		{
+			elog(WARNING,
+					emsg("The KNN distance function does not have a packed "
+						 "equivalent, the training set will not be packed"));
+			return false;
+		}
+	}
+
+	if (knn->pack_hfs)
+	{
+		vhfree(knn->pack_hfs);
+		knn->pack_hfs = 0;
+		knn->pack_ops = 0;
+	}
+
+	knn->pack = pack;
+	knn->pdistance = pdistance;
+
+	if (!pdistance)
+		return true;
+
+	knn->width = pack == KNN_PackFloat32 ? sizeof(float) : sizeof(double);
+	per_reg = KNN_PACK_ALIGN / knn->width;
+	knn->stride = ((knn->mld.n_paths + per_reg - 1) / per_reg) * per_reg;
+
+	sz = (sizeof(HeapField) + sizeof(TypeVarOpExec)) * knn->mld.n_paths;
+	knn->pack_hfs = vhmalloc(sz);
+	knn->pack_ops = (TypeVarOpExec*)(knn->pack_hfs + knn->mld.n_paths);
+	memset(knn->pack_hfs, 0, sz);
+
+	return true;
+}
+
 
 /*
  * ============================================================================
@@ -120,6 +242,51 @@ static int32_t
 ml_knn_train(void *ml, HeapTuplePtr htp, HeapTuple ht)
 {
 	mlKNNData *knn = ml;
+	HeapField hf;
+	unsigned char *row;
+	int32_t i, sp_res;
+
+	if (knn->pdistance)
+	{
+		if (!ht)
+			ht = vh_htp_read(htp);
+
+		for (i = 0; i < knn->mld.n_paths; i++)
+		{
+			if (!knn->pack_hfs[i])
+			{
+				knn->pack_hfs[i] = vh_sp_search(knn->mld.paths[i], &sp_res,
+												1, VH_SP_CTX_HT, ht);
+
+				if (!knn->pack_hfs[i])
+					return -1;
+			}
+		}
+
+		if (knn->n_rows == knn->rows_cap)
+		{
+			knn->rows_cap = knn->rows_cap ? knn->rows_cap * 2 : KNN_PACK_ROWS;
+			knn->matrix = knn->matrix ?
+				vhrealloc(knn->matrix, knn->rows_cap * knn->stride * knn->width) :
+				vhmalloc(knn->rows_cap * knn->stride * knn->width);
+		}
+
+		row = (unsigned char*)knn->matrix + 
+			  (size_t)knn->n_rows * knn->stride * knn->width;
+		memset(row, 0, knn->stride * knn->width);
+
+		for (i = 0; i < knn->mld.n_paths; i++)
+		{
+			hf = knn->pack_hfs[i];
+
+			if (!ml_knn_pack_value(knn, i, vh_hf_type_stack(hf),
+								   vh_ht_field(ht, hf), vh_htf_isnull(ht, hf),
+								   row + (i * knn->width)))
+				return -1;
+		}
+
+		knn->n_rows++;
+	}
 
 	if (!knn->training_set)
 		vh_htp_SListCreate(knn->training_set);
@@ -139,23 +306,27 @@ ml_knn_train(void *ml, HeapTuplePtr htp, HeapTuple ht)
 /*
  * ml_knn_populate_slot
  *
- * Iterate the training set, calculating the distance between each and force the
- * distance into a BTree.  We should ideally only keep n neighbors in the tree.
+ * Iterate the training set, calculating the distance between each and keep the
+ * k closest in a bounded max heap.  The farthest neighbor sits at the root, so
+ * a new distance only has to beat the root to get in.
  */
 static int32_t
 ml_knn_populate_slot(void *pc, TypeVarSlot *target,
 					 TypeVarSlot **datas, int32_t n_datas)
 {
 	mlKNNData *knn = pc;
-	HeapTuplePtr *htp_head, htp;
-	struct mlKNNVoteData vote_probe = { }, *votes, *vote;
-	struct mlKNNDistanceData *distances;
+	HeapTuplePtr *htp_head, htp, *neighbors;
+	struct mlKNNVoteData *votes;
+	struct mlKNNDistanceData *distances, *scratch;
 	size_t working_set;
 	HeapTuple ht;
-	HeapField *hfs, hf_class = 0;
-	int32_t htp_sz, i, j, ret, n_class = 0, distance_count = 0, sp_res;
+	HeapField *hfs;
+	int32_t htp_sz, i, j, ret, distance_count = 0;
 	TypeVarSlot *slots;
 
+	if (knn->pdistance)
+		return ml_knn_populate_packed(knn, target, datas, n_datas);
+
 	/*
 	 * This is a hot path, so we want to minimize the number of malloc calls
 	 * we make.  We know exactly how much space we need so just do one
@@ -168,24 +339,30 @@ ml_knn_populate_slot(void *pc, TypeVarSlot *target,
  	 * 	2) HeapField* to suport knn->n_paths
 	 * 	3) struct mlKNNVoteData to support knn->k
 	 * 	4) struct mlKNNDistanceData to support knn->k + 1
+	 * 	5) HeapTuplePtr to support knn->k
+	 *
+	 * The extra distance slot is scratch space for the distance function.
 	 */
 	working_set = (sizeof(TypeVarSlot) * (knn->mld.n_paths)) +
 				  (sizeof(HeapField) * knn->mld.n_paths) +
 				  (sizeof(struct mlKNNVoteData) * knn->k) +
-				  (sizeof(struct mlKNNDistanceData) * (knn->k + 1));
+				  (sizeof(struct mlKNNDistanceData) * (knn->k + 1)) +
+				  (sizeof(HeapTuplePtr) * knn->k);
 
 	htp_sz = vh_SListIterator(knn->training_set, htp_head);
 	slots = vhmalloc(working_set);
 	hfs = (HeapField*)(slots + knn->mld.n_paths);
 	votes = (struct mlKNNVoteData*)(hfs + knn->mld.n_paths);
 	distances = (struct mlKNNDistanceData*)(votes + knn->k);
+	neighbors = (HeapTuplePtr*)(distances + knn->k + 1);
+	scratch = &distances[knn->k];
 
 	memset(slots, 0, working_set);
 
 	for (i = 0; i < htp_sz; i++)
 	{
 		htp = htp_head[i];
-		ht = vh_htp(htp);
+		ht = vh_htp_read(htp);
 
 		/*
 		 * Fill our TypeVarSlots from the training data before handing things
@@ -194,24 +371,8 @@ ml_knn_populate_slot(void *pc, TypeVarSlot *target,
 		for (j = 0; j < knn->mld.n_paths; j++)
 		{
 			if (!hfs[j])
-			{
 				hfs[j] = vh_sp_search(knn->mld.paths[j], &ret, 1, VH_SP_CTX_HT, ht);
 
-				if (j == 0)
-				{
-					/*
-					 * Store our distance result in the first type.  This could
-					 * be a little more advanced, but we'll make the assumption
-					 * (requirement?) that all distance calculations be performed
-					 * on the same type.
-					 */
-					//vh_tvs_init(distance_result);
-					//vh_tvs_store_var(distance_result,
-					//				 vh_typevar_make_tys(hfs[j]->types, hfs[j]->type_depth),
-					//				 VH_TVS_RA_DVAR);
-				}
-			}
-
 			vh_tvs_store_ht_hf(&slots[j], ht, hfs[j]);
 		}
 
@@ -220,7 +381,7 @@ ml_knn_populate_slot(void *pc, TypeVarSlot *target,
 		 * for us.
 		 */
 		ret = knn->distance(&knn->mlf_distance_cache,	/* Cache */
-							&distances[distance_count].distance,	/* TypeVarSlot: Result */
+							&scratch->distance,	/* TypeVarSlot: Result */
 							slots,				/* TypeVarSlot: Training */
 							datas,				/* TypeVarSlot: Instance */
 							n_datas);			/* Number of Slots */
@@ -230,56 +391,215 @@ ml_knn_populate_slot(void *pc, TypeVarSlot *target,
 			/*
 			 * Distance function threw an error up.
 			 */
+			continue;
 		}
 
-		distances[distance_count].htp = htp;
+		scratch->htp = htp;
 
+		/*
+		 * Swap the scratch entry into the heap, whatever falls out lands back
+		 * in the scratch slot and gets overwritten by the next distance.
+		 */
 		if (distance_count < knn->k)
 		{
-			/*
-			 * Since there are less than k distances in the array at the moment,
-			 * they're all eligible.  There's no sense in wasting resources doing
-			 * a qsort.  There's nothing to "fall off the edge" in the knn->k + 1
-			 * slot.
-			 *
-			 * Increment the distance_count and call it a day.
-			 */
+			ml_knn_heap_swap(&distances[distance_count], scratch,
+							 sizeof(struct mlKNNDistanceData));
+			ml_knn_heap_up(distances, distance_count,
+						   sizeof(struct mlKNNDistanceData),
+						   ml_knn_distance_compare);
 			distance_count++;
 		}
-		else if (distance_count == knn->k)
+		else if (ml_knn_distance_compare(scratch, &distances[0]) < 0)
 		{
-			/*
-			 * We need to sort the distance array.  Since we store knn->k +1 
-			 * distances in the array, by sorting we know we've always got the
-			 * closest neighbors.  It's far simplier than standing up another
-			 * data tree.  If k is small, it's a quick operation.
-			 */
-
-			qsort(distances, distance_count, sizeof(struct mlKNNDistanceData),
-				  ml_knn_distance_compare);
+			ml_knn_heap_swap(&distances[0], scratch,
+							 sizeof(struct mlKNNDistanceData));
+			ml_knn_heap_down(distances, distance_count,
+							 sizeof(struct mlKNNDistanceData),
+							 ml_knn_distance_compare);
 		}
 	}
 
+	qsort(distances, distance_count, sizeof(struct mlKNNDistanceData),
+		  ml_knn_distance_compare);
+
+	for (i = 0; i < distance_count; i++)
+		neighbors[i] = distances[i].htp;
+
+	ret = ml_knn_vote(knn, target, neighbors, distance_count, votes);
+
 	/*
-	 * Run thru our sorted distances to get the closest neighbors and do the
-	 * voting. 
+	 * Clean everything up.  We should probably call finalize on all our
+	 * TypeVarSlot sitting in this block of memory.
 	 */
-	i = 0;
-	while (i < knn->k && i < distance_count)
+
+	vhfree(slots);
+
+	return ret;
+}
+
+/*
+ * ml_knn_populate_packed
+ *
+ * Packs the instance the same way the training rows were packed and runs the
+ * packed distance kernel down the matrix.  Only the k nearest HeapTuplePtr
+ * are touched.
+ */
+static int32_t
+ml_knn_populate_packed(mlKNNData *knn, TypeVarSlot *target,
+					   TypeVarSlot **datas, int32_t n_datas)
+{
+	Type tys[VH_TAMS_MAX_DEPTH];
+	HeapTuplePtr *htp_head, *neighbors;
+	struct mlKNNPackedData *heap;
+	struct mlKNNVoteData *votes;
+	unsigned char *instance, *row;
+	size_t working_set, row_sz;
+	double distance;
+	int32_t i, ret, n_heap = 0;
+
+	if (n_datas > knn->mld.n_paths)
+		n_datas = knn->mld.n_paths;
+
+	/*
+	 * One allocation again:
+	 * 	1) Packed instance row
+	 * 	2) struct mlKNNPackedData to support knn->k
+	 * 	3) struct mlKNNVoteData to support knn->k
+	 * 	4) HeapTuplePtr to support knn->k
+	 */
+	row_sz = knn->stride * knn->width;
+	working_set = row_sz +
+				  (sizeof(struct mlKNNPackedData) * knn->k) +
+				  (sizeof(struct mlKNNVoteData) * knn->k) +
+				  (sizeof(HeapTuplePtr) * knn->k);
+
+	instance = vhmalloc(working_set);
+	heap = (struct mlKNNPackedData*)(instance + row_sz);
+	votes = (struct mlKNNVoteData*)(heap + knn->k);
+	neighbors = (HeapTuplePtr*)(votes + knn->k);
+
+	memset(instance, 0, working_set);
+
+	for (i = 0; i < n_datas; i++)
 	{
-		/*
-		 * Pull the classification and vote for it.  (We've got a gap
-		 * at the moment, where we should extract the classification
-		 * field from the HeapTuplePtr.
-		 */
+		vh_tvs_fill_tys(datas[i], tys);
+
+		if (!ml_knn_pack_value(knn, i, tys, 
+							   vh_tvs_value(datas[i]), vh_tvs_isnull(datas[i]),
+							   instance + (i * knn->width)))
+		{
+			vhfree(instance);
+			return -1;
+		}
+	}
+
+	for (i = 0, row = knn->matrix; i < knn->n_rows; i++, row += row_sz)
+	{
+		distance = knn->pdistance(row, instance, knn->stride);
+
+		if (n_heap < knn->k)
+		{
+			heap[n_heap].distance = distance;
+			heap[n_heap].row = i;
+			ml_knn_heap_up(heap, n_heap, sizeof(struct mlKNNPackedData),
+						   ml_knn_packed_compare);
+			n_heap++;
+		}
+		else if (distance < heap[0].distance)
+		{
+			heap[0].distance = distance;
+			heap[0].row = i;
+			ml_knn_heap_down(heap, n_heap, sizeof(struct mlKNNPackedData),
+							 ml_knn_packed_compare);
+		}
+	}
+
+	qsort(heap, n_heap, sizeof(struct mlKNNPackedData), ml_knn_packed_compare);
+
+	vh_SListIterator(knn->training_set, htp_head);
+
+	for (i = 0; i < n_heap; i++)
+		neighbors[i] = htp_head[heap[i].row];
+
+	ret = ml_knn_vote(knn, target, neighbors, n_heap, votes);
 
+	vhfree(instance);
+
+	return ret;
+}
+
+/*
+ * ml_knn_pack_value
+ *
+ * Converts a single feature to the packed representation.  Doubles and floats
+ * are read directly, everything else goes thru an assignment operator into a
+ * double that we keep around for the path.  Nulls are packed as zero.
+ */
+static bool
+ml_knn_pack_value(mlKNNData *knn, int32_t idx,
+				  Type *tys, void *data, bool null,
+				  void *out)
+{
+	double value = 0.0;
+
+	if (null)
+		value = 0.0;
+	else if (tys[0] == &vh_type_dbl && !tys[1])
+		value = *((double*)data);
+	else if (tys[0] == &vh_type_float && !tys[1])
+		value = *((float*)data);
+	else
+	{
+		if (!knn->pack_ops[idx])
+		{
+			knn->pack_ops[idx] = vh_typevar_op_init_tys("=", ml_knn_tys_dbl,
+														tys, 0);
+
+			if (!knn->pack_ops[idx])
+			{
+				elog(ERROR1,
+						emsg("KNN input path %d cannot be converted to a "
+							 "double for packing",
+							 idx));
+				return false;
+			}
+		}
+
+		vh_typevar_op_fp(knn->pack_ops[idx], &value, data);
+	}
+
+	if (knn->pack == KNN_PackFloat32)
+		*((float*)out) = (float)value;
+	else
+		*((double*)out) = value;
+
+	return true;
+}
+
+/*
+ * ml_knn_vote
+ *
+ * Pull the classification for each neighbor and vote for it.  The winning
+ * class is copied into @target.
+ */
+static int32_t
+ml_knn_vote(mlKNNData *knn, TypeVarSlot *target,
+			HeapTuplePtr *neighbors, int32_t n_neighbors,
+			struct mlKNNVoteData *votes)
+{
+	struct mlKNNVoteData vote_probe = { }, *vote;
+	HeapField hf_class = 0;
+	int32_t i, n_class = 0, sp_res;
+
+	for (i = 0; i < n_neighbors; i++)
+	{
 		if (hf_class == 0)
 		{
 			hf_class = vh_sp_search(knn->class, &sp_res, 
-									1, VH_SP_CTX_HTP, distances[i].htp);
+									1, VH_SP_CTX_HTP, neighbors[i]);
 		}
 
-		vh_tvs_store_htp_hf(&vote_probe.class, distances[i].htp, hf_class);
+		vh_tvs_store_htp_hf(&vote_probe.class, neighbors[i], hf_class);
 
 		vote = bsearch(&vote_probe, votes, n_class,
 					   sizeof(struct mlKNNVoteData),
@@ -298,11 +618,11 @@ ml_knn_populate_slot(void *pc, TypeVarSlot *target,
 			 * so our binary search stays in place.
 			 */
 			votes[n_class].votes = 1;
-			vh_tvs_store_htp_hf(&votes[n_class].class, distances[i].htp, hf_class);
+			vh_tvs_store_htp_hf(&votes[n_class].class, neighbors[i], hf_class);
 
 			n_class++;
 
-			if (i + 1 < knn->k)
+			if (i + 1 < n_neighbors)
 			{
 				/*
 				 * Don't sort it if we're at the last nearest neighbor,
@@ -312,10 +632,11 @@ ml_knn_populate_slot(void *pc, TypeVarSlot *target,
 					  ml_knn_class_compare);
 			}
 		}
-
-		i++;
 	}
 
+	if (!n_class)
+		return -1;
+
 	/*
 	 * Sort the votes and populate the @slot with the classification.
 	 */
@@ -324,14 +645,73 @@ ml_knn_populate_slot(void *pc, TypeVarSlot *target,
 	vote = &votes[n_class - 1];
 	vh_tvs_copy(target, &vote->class);
 
-	/*
-	 * Clean everything up.  We should probably call finalize on all our
-	 * TypeVarSlot sitting in this block of memory.
-	 */
+	return 0;
+}
 
-	vhfree(slots);
+/*
+ * ml_knn_heap_up
+ *
+ * Max heap sift up for the entry at @i.
+ */
+static void
+ml_knn_heap_up(void *heap, int32_t i, size_t sz,
+			   int32_t (*cmp)(const void*, const void*))
+{
+	unsigned char *h = heap;
+	int32_t parent;
 
-	return 0;
+	while (i > 0)
+	{
+		parent = (i - 1) / 2;
+
+		if (cmp(h + (parent * sz), h + (i * sz)) >= 0)
+			break;
+
+		ml_knn_heap_swap(h + (parent * sz), h + (i * sz), sz);
+		i = parent;
+	}
+}
+
+/*
+ * ml_knn_heap_down
+ *
+ * Max heap sift down from the root after it's been replaced.
+ */
+static void
+ml_knn_heap_down(void *heap, int32_t n, size_t sz,
+				 int32_t (*cmp)(const void*, const void*))
+{
+	unsigned char *h = heap;
+	int32_t i = 0, child;
+
+	while ((child = (i * 2) + 1) < n)
+	{
+		if (child + 1 < n && 
+			cmp(h + ((child + 1) * sz), h + (child * sz)) > 0)
+			child++;
+
+		if (cmp(h + (i * sz), h + (child * sz)) >= 0)
+			break;
+
+		ml_knn_heap_swap(h + (i * sz), h + (child * sz), sz);
+		i = child;
+	}
+}
+
+static void
+ml_knn_heap_swap(void *lhs, void *rhs, size_t sz)
+{
+	union
+	{
+		struct mlKNNDistanceData d;
+		struct mlKNNPackedData p;
+	} tmp;
+
+	assert(sz <= sizeof(tmp));
+
+	memcpy(&tmp, lhs, sz);
+	memcpy(lhs, rhs, sz);
+	memcpy(rhs, &tmp, sz);
 }
 
 /*
@@ -376,3 +756,16 @@ ml_knn_distance_compare(const void *lhs, const void *rhs)
 	return (vh_tvs_compare(&vlhs->distance, &vrhs->distance));
 }
 
+/*
+ * ml_knn_packed_compare
+ *
+ * Sorts the packed distances, from least to greatest.
+ */
+static int32_t
+ml_knn_packed_compare(const void *lhs, const void *rhs)
+{
+	const struct mlKNNPackedData *plhs = lhs, *prhs = rhs;
+
+	return (plhs->distance < prhs->distance ? -1 : 
+			plhs->distance > prhs->distance);
+}
@@ -93,7 +93,11 @@ vh_ml_naive_bayes_create(SearchPath *paths, int32_t n_paths,
 	nb->nl = 0;
 	nb->prob = prob;
 	nb->total_rows = 0;
-	nb->mctx = vh_MemoryPoolCreate(vh_mctx_current(), 1024, "Naive Bayes");
+	/*
+	 * Training is nothing but TypeVar accumulators being formed in the
+	 * summary nest, which is exactly what a slab is for.
+	 */
+	nb->mctx = vh_MemorySlabCreate(vh_mctx_current(), 0, "Naive Bayes");
 
 	return nb;
 }
@@ -213,7 +213,7 @@ vh_mln_input_htp(MLNormalize mln, HeapTuplePtr htp)
 	int32_t i, sp_ret, func_ret = 0, fail_count = 0;
 
 	vh_tvs_init(&slot);
-	ht = vh_htp(htp);
+	ht = vh_htp_read(htp);
 
 	for (i = 0; i < mln->n_cols; i++)
 	{
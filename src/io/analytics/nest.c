@@ -6,6 +6,7 @@
 
 
 #include <assert.h>
+#include <uv.h>
 
 #include "vh.h"
 #include "io/analytics/nestidx.h"
@@ -16,6 +17,45 @@
 #include "io/catalog/TypeVar.h"
 
 
+/*
+ * ============================================================================
+ * Parallel Helpers
+ * ============================================================================
+ */
+
+struct NestWorker
+{
+	uv_thread_t thread;
+	uv_sem_t *built;
+	uv_sem_t release;
+
+	CatalogContext shared;
+	Nest nest;
+	Nest partial;
+
+	HeapTuplePtr *htps;
+	HeapTuple *hts;
+	int32_t n_htps;
+
+	bool failed;
+};
+
+struct NestMergeCtx
+{
+	NestIdx idx;
+	NestIdx src;
+	NestIdxAccess nia;
+	TypeVarSlot **keys;
+	int32_t res;
+};
+
+static int32_t nest_input_ht(Nest nest, HeapTuple ht, HeapTuplePtr htp);
+static void nest_worker(void *arg);
+static Nest nest_partial_create(Nest nest);
+static int32_t nest_merge(Nest nest, Nest partial);
+static bool nest_merge_scan(NestIdxAccess nia, void *user);
+
+
 
 /*
  * ============================================================================
@@ -41,6 +81,14 @@ vh_nest_level_add(Nest nest, NestLevel nl)
 
 	if (nest->n_idxs)
 	{
+		/*
+		 * A level wanting ordered scans forces the shared index to a BTree,
+		 * which we can only do before the index has been built.
+		 */
+		ni = &nest->idxs[0];
+
+		if (nl->ordered && !ni->idx)
+			ni->method = VH_NESTIDX_METH_BTREE;
 	}
 	else
 	{
@@ -58,7 +106,7 @@ vh_nest_level_add(Nest nest, NestLevel nl)
 
 		nest->n_idxs = 1;
 
-		ni->method = VH_NESTIDX_METH_BTREE;
+		ni->method = nl->ordered ? VH_NESTIDX_METH_BTREE : VH_NESTIDX_METH_HASH;
 		ni->cols = vhmalloc(sizeof(GroupByCol*) * nl->groupby_n_cols);
 		ni->n_cols = nl->groupby_n_cols;
 		
@@ -107,6 +155,26 @@ vh_nest_level_add(Nest nest, NestLevel nl)
 
 int32_t
 vh_nest_input_htp(Nest nest, HeapTuplePtr htp)
+{
+	HeapTuple ht;
+
+	ht = vh_htp_read(htp);
+
+	if (!ht)
+		return -1;
+
+	return nest_input_ht(nest, ht, htp);
+}
+
+/*
+ * nest_input_ht
+ *
+ * Does the actual work for vh_nest_input_htp once the HeapTuple has been
+ * resolved.  Never touches the HeapBuffer, so the parallel workers can call
+ * it with HeapTuples the calling thread resolved for them.
+ */
+static int32_t
+nest_input_ht(Nest nest, HeapTuple ht, HeapTuplePtr htp)
 {
 	NestIdx ni;
 	NestIdxAccess nia;
@@ -115,11 +183,8 @@ vh_nest_input_htp(Nest nest, HeapTuplePtr htp)
 	GroupByCol gbc, *gbc_acols;
 	TypeVarSlot *slots, slot_temp, *slot_datas[1], **slot_akeys;
 	TableField tf;
-	HeapTuple ht;
 	int32_t i, j, k, sp_ret, pc_ret, acc_ret, nl_input_ret;
 
-	ht = vh_htp(htp);
-
 	for (i = 0; i < nest->n_idxs; i++)
 	{
 		ni = &nest->idxs[i];
@@ -253,7 +318,7 @@ vh_nest_input_htp(Nest nest, HeapTuplePtr htp)
 
 			if (nia->inserted)
 			{
-				vh_nestidxv_initialize(niv, 2000);
+				vh_nestidxv_initialize(niv, VH_NESTIDX_LEAF_SZ);
 			}
 
 			/*
@@ -269,14 +334,302 @@ vh_nest_input_htp(Nest nest, HeapTuplePtr htp)
 			}
 		}
 
-		vhfree(slots);
-
-		for (j = 0; j < nl->groupby_n_cols; j++)
+		for (j = 0; j < ni->n_cols; j++)
 		{
 			vh_tvs_reset(&slots[j]);
 		}
+
+		vhfree(slots);
+		vh_nestidx_access_destroy(ni, nia);
 	}
 
 	return 0;
 }
 
+/*
+ * vh_nest_input_htp_parallel
+ *
+ * We don't want the workers detaching before we've merged their partials, the
+ * partial indexes and ACM states live in the worker's top MemoryContext.  Each
+ * worker posts |built| when it's done with its partition and then waits on its
+ * own |release| semaphore.
+ */
+int32_t
+vh_nest_input_htp_parallel(Nest nest, HeapTuplePtr *htps, int32_t n_htps,
+						   int32_t n_workers)
+{
+	struct NestWorker *workers, *w;
+	HeapTuple *hts;
+	uv_sem_t built;
+	int32_t i, j, per_worker, res = 0;
+
+	if (n_workers > n_htps)
+		n_workers = n_htps;
+
+	if (n_workers <= 1)
+	{
+		for (i = 0; i < n_htps; i++)
+			vh_nest_input_htp(nest, htps[i]);
+
+		return 0;
+	}
+
+	if (uv_sem_init(&built, 0))
+	{
+		elog(ERROR1,
+				emsg("Unable to initialize the semaphore for a parallel nest."));
+		return -1;
+	}
+
+	/*
+	 * The HeapBuffer isn't thread safe, even a read relinks its LRU list.
+	 * Resolve every HeapTuple here so the workers never touch the buffer.
+	 */
+	hts = vhmalloc(sizeof(HeapTuple) * n_htps);
+
+	for (i = 0; i < n_htps; i++)
+		hts[i] = vh_htp_read(htps[i]);
+
+	workers = vhmalloc(sizeof(struct NestWorker) * n_workers);
+	memset(workers, 0, sizeof(struct NestWorker) * n_workers);
+	per_worker = (n_htps + n_workers - 1) / n_workers;
+
+	for (i = 0; i < n_workers; i++)
+	{
+		w = &workers[i];
+		w->built = &built;
+		w->shared = vh_ctx();
+		w->nest = nest;
+		w->htps = htps + (i * per_worker);
+		w->hts = hts + (i * per_worker);
+		w->n_htps = (i + 1) * per_worker > n_htps ? 
+						n_htps - (i * per_worker) : per_worker;
+
+		uv_sem_init(&w->release, 0);
+		
+		if (w->n_htps <= 0 ||
+			uv_thread_create(&w->thread, nest_worker, w))
+		{
+			w->failed = true;
+			uv_sem_post(&built);
+		}
+	}
+
+	for (i = 0; i < n_workers; i++)
+		uv_sem_wait(&built);
+
+	/*
+	 * Merge everything on the calling thread, the TypeVarAcm on |nest| do the
+	 * combining so none of the worker operator caches are touched.
+	 */
+	for (i = 0; i < n_workers; i++)
+	{
+		w = &workers[i];
+
+		if (!w->failed && w->partial)
+		{
+			if (nest_merge(nest, w->partial))
+				res = -1;
+		}
+	}
+
+	for (i = 0; i < n_workers; i++)
+	{
+		w = &workers[i];
+
+		if (w->thread)
+		{
+			uv_sem_post(&w->release);
+			uv_thread_join(&w->thread);
+		}
+
+		if (w->failed)
+		{
+			for (j = 0; j < w->n_htps; j++)
+			{
+				if (w->hts[j])
+					nest_input_ht(nest, w->hts[j], w->htps[j]);
+			}
+		}
+
+		uv_sem_destroy(&w->release);
+	}
+
+	uv_sem_destroy(&built);
+	vhfree(workers);
+	vhfree(hts);
+
+	return res;
+}
+
+
+
+/*
+ * ============================================================================
+ * Parallel Helpers
+ * ============================================================================
+ */
+
+static void
+nest_worker(void *arg)
+{
+	struct NestWorker *w = arg;
+	MemoryContext mctx_old;
+	int32_t i;
+
+	if (!vh_ctx_thread_attach(w->shared))
+	{
+		w->failed = true;
+		uv_sem_post(w->built);
+
+		return;
+	}
+
+	/*
+	 * The partial is mostly accumulator TypeVars, build it in a slab.  It's
+	 * a child of the thread's top context, so it goes away on detach.
+	 */
+	mctx_old = vh_mctx_switch(vh_MemorySlabCreate(vh_mctx_current(), 0,
+												  "Nest worker slab"));
+
+	w->partial = nest_partial_create(w->nest);
+
+	for (i = 0; i < w->n_htps; i++)
+	{
+		if (w->hts[i])
+			nest_input_ht(w->partial, w->hts[i], w->htps[i]);
+	}
+
+	vh_mctx_switch(mctx_old);
+
+	uv_sem_post(w->built);
+	uv_sem_wait(&w->release);
+
+	vh_ctx_thread_detach();
+}
+
+/*
+ * nest_partial_create
+ *
+ * Mirrors the indexes and NestLevels on |nest| with partial NestLevels and
+ * empty indexes.  The index columns are shared, they're read only once the
+ * NestLevels have been added.
+ */
+static Nest
+nest_partial_create(Nest nest)
+{
+	Nest partial;
+	NestIdx ni, src;
+	int32_t i, j, k;
+
+	partial = vh_nest_create();
+
+	if (nest->n_ls)
+	{
+		partial->ls = vhmalloc(sizeof(struct NestLevelData*) * nest->n_ls);
+		partial->n_ls = nest->n_ls;
+
+		for (i = 0; i < nest->n_ls; i++)
+		{
+			partial->ls[i] = vh_nl_partial_create(nest->ls[i]);
+			partial->ls[i]->nest = partial;
+		}
+	}
+
+	if (nest->n_idxs)
+	{
+		partial->idxs = vhmalloc(sizeof(struct NestIdxData) * nest->n_idxs);
+		partial->n_idxs = nest->n_idxs;
+
+		for (i = 0; i < nest->n_idxs; i++)
+		{
+			src = &nest->idxs[i];
+			ni = &partial->idxs[i];
+
+			memcpy(ni, src, sizeof(struct NestIdxData));
+			ni->idx = 0;
+			ni->in_use = false;
+			ni->ls = vhmalloc(sizeof(struct NestLevelData*) * src->n_ls);
+
+			for (j = 0; j < src->n_ls; j++)
+			{
+				for (k = 0; k < nest->n_ls; k++)
+				{
+					if (nest->ls[k] == src->ls[j])
+					{
+						ni->ls[j] = partial->ls[k];
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	return partial;
+}
+
+/*
+ * nest_merge
+ *
+ * Scans each of the partial's indexes and upserts the keys into ours, then
+ * has each NestLevel merge its aggregate states.
+ */
+static int32_t
+nest_merge(Nest nest, Nest partial)
+{
+	struct NestMergeCtx ctx = { };
+	int32_t i;
+
+	for (i = 0; i < nest->n_idxs; i++)
+	{
+		ctx.idx = &nest->idxs[i];
+		ctx.src = &partial->idxs[i];
+
+		if (!ctx.src->idx)
+			continue;
+
+		ctx.nia = vh_nestidx_access_create(ctx.idx);
+		ctx.keys = vhmalloc(sizeof(TypeVarSlot*) * ctx.idx->n_cols);
+
+		vh_nestidx_scan_all(ctx.src, nest_merge_scan, &ctx, true);
+
+		vh_nestidx_access_destroy(ctx.idx, ctx.nia);
+		vhfree(ctx.keys);
+	}
+
+	return ctx.res;
+}
+
+static bool
+nest_merge_scan(NestIdxAccess nia, void *user)
+{
+	struct NestMergeCtx *ctx = user;
+	NestIdx ni = ctx->idx;
+	NestIdxValue niv;
+	int32_t i;
+
+	for (i = 0; i < ni->n_cols; i++)
+		ctx->keys[i] = &nia->keys[i];
+
+	if (vh_nestidx_access(ni, ni->cols, ctx->keys, ni->n_cols,
+						  VH_NESTIDX_AM_FETCH | VH_NESTIDX_AM_INSERT,
+						  ctx->nia))
+	{
+		ctx->res = -1;
+		return true;
+	}
+
+	niv = ctx->nia->data;
+
+	if (ctx->nia->inserted)
+		vh_nestidxv_initialize(niv, VH_NESTIDX_LEAF_SZ);
+
+	for (i = 0; i < ni->n_ls; i++)
+	{
+		if (vh_nl_merge(ni->ls[i], niv, ctx->src->ls[i], nia->data))
+			ctx->res = -1;
+	}
+
+	return true;
+}
+
@@ -238,6 +238,9 @@ nestidx_get_funcs(NestIdx idx)
 	{
 		case VH_NESTIDX_METH_BTREE:
 			return &vh_nestidx_func_btree;
+
+		case VH_NESTIDX_METH_HASH:
+			return &vh_nestidx_func_hash;
 	}
 
 	return 0;
@@ -328,7 +331,7 @@ vh_nestidx_scan_all(NestIdx idx,
 {
 	IdxFuncs funcs;
 	NestIdxAccess nia;
-	bool run_more;
+	bool run_more = false;
 
 	if (!idx)
 	{
@@ -380,6 +383,30 @@ vh_nestidx_scan_all(NestIdx idx,
 	return 0;
 }
 
+/*
+ * vh_nestidx_sort
+ *
+ * Only unordered index types provide a sort function.
+ */
+int32_t
+vh_nestidx_sort(NestIdx idx)
+{
+	IdxFuncs funcs;
+
+	funcs = nestidx_get_funcs(idx);
+
+	if (!funcs)
+	{
+		elog(ERROR1,
+				emsg("Unable to resolve the function table to sort the index type %d.",
+					 idx->method));
+
+		return -1;
+	}
+
+	return funcs->sort ? funcs->sort(idx) : 0;
+}
+
 int32_t
 vh_nl_scan_all(NestLevel nl, vh_nestidx_scan_cb cb, void *user, bool fwd)
 {
@@ -0,0 +1,598 @@
+/*
+ * Copyright (c) 2011-2017, Kyle A. Gearhart
+ */
+
+
+
+#include <assert.h>
+
+#include "vh.h"
+#include "io/analytics/nestidx.h"
+#include "io/catalog/TypeVar.h"
+#include "io/catalog/types/String.h"
+#include "io/utils/htbl.h"
+
+
+/*
+ * ============================================================================
+ * NestIdx Hash Implementation
+ * ============================================================================
+ *
+ * Most group by levels never scan their index in order, so there's no reason
+ * to pay for a BTree search on every input row.  We hash the keys once per
+ * access and store the hash on the entry, so the HashTable never has to
+ * rehash a key when it grows and mismatched buckets are rejected on the hash
+ * alone.
+ *
+ * The HashTable only maps an entry pointer to its leaf.  We also keep the
+ * entries in an array in insertion order, which is what the scans walk.
+ * vh_nestidx_sort orders that array when a caller needs sorted output.
+ *
+ * Only single level fixed width types and String can be hashed.  When the
+ * first keys arrive with anything else, we switch the NestIdx over to a
+ * BTree.
+ */
+
+typedef struct NestIdxHashData *NestIdxHash;
+typedef struct NestIdxHashEntryData *NestIdxHashEntry;
+
+struct NestIdxHashEntryData
+{
+	int32_t hash;
+	NestIdxHash nih;
+	TypeVarSlot **probe;		/* Caller's keys, only set on lookups */
+	void *value;
+
+	TypeVarSlot keys[1];
+};
+
+struct NestIdxHashColData
+{
+	Type tys[VH_TAMS_MAX_DEPTH];
+	vh_tom_comp comp[VH_TAMS_MAX_DEPTH];
+	size_t width;
+	bool is_string;
+};
+
+struct NestIdxHashData
+{
+	HashTable htbl;
+	MemoryContext mctx;
+
+	NestIdxHashEntry *entries;
+	int32_t n_entries;
+	int32_t sz_entries;
+
+	size_t entry_sz;
+	bool sorted;
+
+	int32_t n_cols;
+	struct NestIdxHashColData cols[1];
+};
+
+struct NestIdxHashScanData
+{
+	int32_t pos;
+};
+
+#define nestidx_hash_entry_keys_sz(n_cols)											\
+	(offsetof(struct NestIdxHashEntryData, keys) + (sizeof(TypeVarSlot) * (n_cols)))
+
+#define nestidx_hash_entry_key(e, i)	((e)->probe ? (e)->probe[i] : &(e)->keys[i])
+
+static int32_t nestidx_hash_access(NestIdx idx, TypeVarSlot **keys, int32_t am,
+								   NestIdxAccess nia);
+static int32_t nestidx_hash_sort(NestIdx idx);
+
+static int32_t nestidx_hash_scan_begin(NestIdx idx, NestIdxAccess nia,
+									   int32_t n_skeys);
+static bool nestidx_hash_scan_first(NestIdx idx, NestIdxAccess nia,
+									NestScanKey *skeys, int32_t n_skeys,
+									bool forward);
+static bool nestidx_hash_scan_next(NestIdx idx, NestIdxAccess nia, bool forward);
+static void nestidx_hash_scan_end(NestIdx idx, NestIdxAccess nia);
+
+
+const struct NestIdxFuncTable vh_nestidx_func_hash = {
+	.access = nestidx_hash_access,
+	.sort = nestidx_hash_sort,
+
+	/* Scans */
+	.scan_begin = nestidx_hash_scan_begin,
+	.scan_first = nestidx_hash_scan_first,
+	.scan_next = nestidx_hash_scan_next,
+	.scan_end = nestidx_hash_scan_end
+};
+
+
+
+/*
+ * ============================================================================
+ * Hash Helper Functions
+ * ============================================================================
+ */
+
+static int32_t nestidx_hash_create(NestIdx idx, TypeVarSlot **keys);
+static NestIdxHashEntry nestidx_hash_entry_create(NestIdxHash nih,
+												  TypeVarSlot **keys,
+												  int32_t hash);
+static int32_t nestidx_hash_keys(NestIdxHash nih, TypeVarSlot **keys);
+static int32_t nestidx_hash_compare_keys(NestIdxHash nih,
+										 NestIdxHashEntry lhs,
+										 NestIdxHashEntry rhs);
+static void nestidx_hash_fill_nia(NestIdx idx, NestIdxAccess nia,
+								  NestIdxHashEntry entry);
+
+static int32_t nestidx_hash_htbl_hash(HashTable htbl, const void *key);
+static int32_t nestidx_hash_htbl_comp(HashTable htbl, const void *lhs,
+									  const void *rhs);
+
+
+/*
+ * nestidx_hash_access
+ *
+ * Same contract as the BTree access method: an UPSERT inserts the keys when
+ * they can't be found, otherwise a miss leaves the nia empty.
+ */
+static int32_t
+nestidx_hash_access(NestIdx idx, TypeVarSlot **keys, int32_t am,
+					NestIdxAccess nia)
+{
+	NestIdxHash nih;
+	struct NestIdxHashEntryData probe;
+	NestIdxHashEntry entry;
+	void **value;
+	int32_t res_create_idx, ret;
+	bool upsert;
+
+	nih = idx->idx;
+
+	if (!nih)
+	{
+		res_create_idx = nestidx_hash_create(idx, keys);
+
+		if (res_create_idx > 0)
+		{
+			/*
+			 * The key types can't be hashed, so we hand the index over to the
+			 * BTree implementation for good.
+			 */
+			idx->method = VH_NESTIDX_METH_BTREE;
+
+			return vh_nestidx_func_btree.access(idx, keys, am, nia);
+		}
+		else if (res_create_idx < 0)
+		{
+			return -2;
+		}
+
+		nih = idx->idx;
+	}
+
+	upsert = (am & VH_NESTIDX_AM_FETCH) && (am & VH_NESTIDX_AM_INSERT) ? true : false;
+
+	probe.hash = nestidx_hash_keys(nih, keys);
+	probe.nih = nih;
+	probe.probe = keys;
+	entry = &probe;
+
+	value = vh_htbl_get(nih->htbl, &entry);
+
+	if (value && *value)
+	{
+		nia->exists = true;
+		nia->inserted = false;
+		nia->data = *value;
+
+		return 0;
+	}
+
+	if (!upsert)
+	{
+		nia->exists = false;
+		nia->inserted = false;
+		nia->data = 0;
+
+		return 0;
+	}
+
+	entry = nestidx_hash_entry_create(nih, keys, probe.hash);
+
+	if (!entry)
+		return -10;
+
+	value = vh_htbl_put(nih->htbl, &entry, &ret);
+
+	if (ret < 0 || !value)
+		return -10;
+
+	*value = entry->value;
+
+	if (nih->n_entries == nih->sz_entries)
+	{
+		if (nih->entries)
+		{
+			nih->sz_entries *= 2;
+			nih->entries = vhrealloc(nih->entries,
+									 sizeof(NestIdxHashEntry) * nih->sz_entries);
+		}
+		else
+		{
+			nih->sz_entries = 64;
+			nih->entries = vhmalloc_ctx(nih->mctx,
+										sizeof(NestIdxHashEntry) * nih->sz_entries);
+		}
+	}
+
+	nih->entries[nih->n_entries++] = entry;
+	nih->sorted = false;
+
+	nia->exists = false;
+	nia->inserted = true;
+	nia->data = entry->value;
+
+	return 0;
+}
+
+/*
+ * nestidx_hash_create
+ *
+ * Returns 1 when the key types can't be hashed, so the caller can fall back
+ * to a BTree.
+ */
+static int32_t
+nestidx_hash_create(NestIdx idx, TypeVarSlot **keys)
+{
+	HashTableOpts hopts = { };
+	NestIdxHash nih;
+	struct NestIdxHashColData *col;
+	Type ty;
+	int32_t i;
+	int8_t ty_depth;
+
+	nih = vhmalloc(sizeof(struct NestIdxHashData) +
+				   (sizeof(struct NestIdxHashColData) * idx->n_cols));
+	memset(nih, 0, sizeof(struct NestIdxHashData) +
+				   (sizeof(struct NestIdxHashColData) * idx->n_cols));
+
+	nih->mctx = vh_mctx_current();
+	nih->n_cols = idx->n_cols;
+
+	for (i = 0; i < idx->n_cols; i++)
+	{
+		col = &nih->cols[i];
+		ty_depth = vh_tvs_fill_tys(keys[i], col->tys);
+
+		if (ty_depth <= 0)
+		{
+			vhfree(nih);
+
+			return -2;
+		}
+
+		ty = col->tys[0];
+
+		if (ty == &vh_type_String)
+		{
+			col->is_string = true;
+		}
+		else if (ty_depth > 1 ||
+				 ty->varlen ||
+				 ty->construct_forhtd ||
+				 !ty->size ||
+				 ty->size > sizeof(int64_t))
+		{
+			vhfree(nih);
+
+			return 1;
+		}
+		else
+		{
+			col->width = ty->size;
+		}
+
+		if (!vh_toms_fill_comp_funcs(col->tys, col->comp))
+		{
+			vhfree(nih);
+
+			return 1;
+		}
+	}
+
+	/*
+	 * The leaf lives right after the key slots, aligned so the NestIdxValue
+	 * lands on a pointer boundary.
+	 */
+	nih->entry_sz = nestidx_hash_entry_keys_sz(nih->n_cols);
+	nih->entry_sz = (nih->entry_sz + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1);
+
+	hopts.key_sz = sizeof(NestIdxHashEntry);
+	hopts.value_sz = sizeof(void*);
+	hopts.func_hash = nestidx_hash_htbl_hash;
+	hopts.func_compare = nestidx_hash_htbl_comp;
+	hopts.mctx = nih->mctx;
+	hopts.is_map = true;
+
+	nih->htbl = vh_htbl_create(&hopts, VH_HTBL_OPT_ALL);
+
+	if (!nih->htbl)
+	{
+		vhfree(nih);
+
+		return -3;
+	}
+
+	idx->idx = nih;
+
+	return 0;
+}
+
+/*
+ * nestidx_hash_entry_create
+ *
+ * Copies the keys into TypeVars owned by the entry, the caller's slots are
+ * likely pointing at a HeapTuple that won't be around for long.
+ */
+static NestIdxHashEntry
+nestidx_hash_entry_create(NestIdxHash nih, TypeVarSlot **keys, int32_t hash)
+{
+	MemoryContext mctx_old;
+	NestIdxHashEntry entry;
+	void *var;
+	int32_t i;
+
+	mctx_old = vh_mctx_switch(nih->mctx);
+	entry = vhmalloc(nih->entry_sz + VH_NESTIDX_LEAF_SZ);
+
+	entry->hash = hash;
+	entry->nih = nih;
+	entry->probe = 0;
+	entry->value = ((char*)entry) + nih->entry_sz;
+
+	for (i = 0; i < nih->n_cols; i++)
+	{
+		vh_tvs_init(&entry->keys[i]);
+
+		if (vh_tvs_isnull(keys[i]))
+		{
+			vh_tvs_store_null(&entry->keys[i]);
+			continue;
+		}
+
+		var = vh_typevar_make_tys(nih->cols[i].tys);
+		vh_typevar_op("=",
+					  VH_OP_MAKEFLAGS(VH_OP_DT_INVALID,
+									  VH_OP_DT_VAR,
+									  VH_OP_ID_INVALID,
+									  VH_OP_DT_TVS,
+									  VH_OP_ID_INVALID),
+					  var,
+					  keys[i]);
+		vh_tvs_store_var(&entry->keys[i], var, 0);
+	}
+
+	vh_mctx_switch(mctx_old);
+
+	return entry;
+}
+
+/*
+ * nestidx_hash_keys
+ *
+ * FNV-1a over the value of each key.  Nulls still advance the hash so that
+ * (NULL, 1) and (1, NULL) don't collide.
+ */
+static int32_t
+nestidx_hash_keys(NestIdxHash nih, TypeVarSlot **keys)
+{
+	struct NestIdxHashColData *col;
+	const unsigned char *data;
+	String str;
+	size_t len, j;
+	uint32_t h = 2166136261u;
+	int32_t i;
+
+	for (i = 0; i < nih->n_cols; i++)
+	{
+		col = &nih->cols[i];
+
+		if (vh_tvs_isnull(keys[i]))
+		{
+			h = (h ^ 0xffu) * 16777619u;
+			continue;
+		}
+
+		if (col->is_string)
+		{
+			str = vh_tvs_value(keys[i]);
+			data = (const unsigned char*)vh_str_buffer(str);
+			len = vh_strlen(str);
+		}
+		else
+		{
+			data = vh_tvs_value(keys[i]);
+			len = col->width;
+		}
+
+		for (j = 0; j < len; j++)
+			h = (h ^ data[j]) * 16777619u;
+	}
+
+	return (int32_t)h;
+}
+
+/*
+ * nestidx_hash_compare_keys
+ *
+ * Orders nulls first, like the BTree.
+ */
+static int32_t
+nestidx_hash_compare_keys(NestIdxHash nih,
+						  NestIdxHashEntry lhs, NestIdxHashEntry rhs)
+{
+	TypeVarSlot *lslot, *rslot;
+	int32_t i, comp;
+	bool lnull, rnull;
+
+	for (i = 0; i < nih->n_cols; i++)
+	{
+		lslot = nestidx_hash_entry_key(lhs, i);
+		rslot = nestidx_hash_entry_key(rhs, i);
+		lnull = vh_tvs_isnull(lslot);
+		rnull = vh_tvs_isnull(rslot);
+
+		if (lnull || rnull)
+			comp = lnull == rnull ? 0 : (lnull ? -1 : 1);
+		else
+			comp = vh_tom_firea_comp(nih->cols[i].tys, nih->cols[i].comp,
+									 vh_tvs_value(lslot),
+									 vh_tvs_value(rslot));
+
+		if (comp)
+			return comp;
+	}
+
+	return 0;
+}
+
+static int32_t
+nestidx_hash_htbl_hash(HashTable htbl, const void *key)
+{
+	const NestIdxHashEntry *entry = key;
+
+	return (*entry)->hash;
+}
+
+static int32_t
+nestidx_hash_htbl_comp(HashTable htbl, const void *lhs, const void *rhs)
+{
+	const NestIdxHashEntry *lentry = lhs, *rentry = rhs;
+
+	if ((*lentry)->hash != (*rentry)->hash)
+		return 0;
+
+	return nestidx_hash_compare_keys((*lentry)->nih, *lentry, *rentry) == 0;
+}
+
+/*
+ * nestidx_hash_sort
+ *
+ * Bottom up merge sort on the entry array, this is stable and only runs when
+ * an output routine asks for sorted results.
+ */
+static int32_t
+nestidx_hash_sort(NestIdx idx)
+{
+	NestIdxHash nih = idx->idx;
+	NestIdxHashEntry *src, *dst, *swap;
+	int32_t width, i, left, mid, right, l, r, k;
+
+	if (!nih || nih->sorted || nih->n_entries < 2)
+		return 0;
+
+	src = nih->entries;
+	dst = vhmalloc(sizeof(NestIdxHashEntry) * nih->n_entries);
+
+	for (width = 1; width < nih->n_entries; width *= 2)
+	{
+		for (i = 0; i < nih->n_entries; i += 2 * width)
+		{
+			left = i;
+			mid = i + width < nih->n_entries ? i + width : nih->n_entries;
+			right = i + (2 * width) < nih->n_entries ? i + (2 * width) : nih->n_entries;
+
+			for (l = left, r = mid, k = left; k < right; k++)
+			{
+				if (l < mid &&
+					(r >= right || nestidx_hash_compare_keys(nih, src[l], src[r]) <= 0))
+					dst[k] = src[l++];
+				else
+					dst[k] = src[r++];
+			}
+		}
+
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if (src != nih->entries)
+		memcpy(nih->entries, src, sizeof(NestIdxHashEntry) * nih->n_entries);
+
+	vhfree(src == nih->entries ? dst : src);
+	nih->sorted = true;
+
+	return 0;
+}
+
+static void
+nestidx_hash_fill_nia(NestIdx idx, NestIdxAccess nia, NestIdxHashEntry entry)
+{
+	int32_t i;
+
+	nia->data = entry->value;
+
+	for (i = 0; i < idx->n_cols; i++)
+	{
+		vh_tvs_copy(&nia->keys[i], &entry->keys[i]);
+	}
+}
+
+static int32_t
+nestidx_hash_scan_begin(NestIdx idx, NestIdxAccess nia,
+						int32_t n_skeys)
+{
+	struct NestIdxHashScanData *scan;
+
+	scan = vhmalloc(sizeof(struct NestIdxHashScanData));
+	scan->pos = -1;
+	nia->opaque = scan;
+
+	return 0;
+}
+
+static bool
+nestidx_hash_scan_first(NestIdx idx, NestIdxAccess nia,
+						NestScanKey *skeys, int32_t n_skeys,
+						bool forward)
+{
+	NestIdxHash nih = idx->idx;
+	struct NestIdxHashScanData *scan = nia->opaque;
+
+	if (!nih || !nih->n_entries || n_skeys)
+		return false;
+
+	scan->pos = forward ? 0 : nih->n_entries - 1;
+	nestidx_hash_fill_nia(idx, nia, nih->entries[scan->pos]);
+
+	return true;
+}
+
+static bool
+nestidx_hash_scan_next(NestIdx idx, NestIdxAccess nia, bool forward)
+{
+	NestIdxHash nih = idx->idx;
+	struct NestIdxHashScanData *scan = nia->opaque;
+
+	if (!nih || scan->pos < 0)
+		return false;
+
+	scan->pos += forward ? 1 : -1;
+
+	if (scan->pos < 0 || scan->pos >= nih->n_entries)
+		return false;
+
+	nestidx_hash_fill_nia(idx, nia, nih->entries[scan->pos]);
+
+	return true;
+}
+
+static void
+nestidx_hash_scan_end(NestIdx idx, NestIdxAccess nia)
+{
+	if (nia->opaque)
+		vhfree(nia->opaque);
+
+	nia->opaque = 0;
+}
+
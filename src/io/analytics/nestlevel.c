@@ -77,6 +77,8 @@ static NestAggCol nl_agg_create(NestLevel nl, const char *name,
  */
 
 static int32_t nl_initialize_cols(NestLevel nl, NestIdxValue niv, HeapTuple ht);
+static int32_t nl_initialize_leaf(NestLevel nl, NestIdxValue niv);
+static void nl_create_acm(NestAggCol col, Type *tys);
 static int32_t nl_initialize_agg_cols(NestLevel nl, NestIdxValue niv);
 static int32_t nl_initialize_trend_cols(NestLevel nl, NestIdxValue niv);
 
@@ -104,6 +106,12 @@ vh_nl_create(void)
 	return nl;
 }
 
+void
+vh_nl_ordered(NestLevel nl, bool ordered)
+{
+	nl->ordered = ordered;
+}
+
 
 /*
  * vh_nl_gropuby_create
@@ -324,6 +332,7 @@ nl_agg_create(NestLevel nl, const char *name,
 	ac->sp_field = sp;
 	ac->pc = pc;
 	ac->acm_create = acm;
+	ac->acm = 0;
 	ac->idx = nl->agg_n_cols;
 	ac->acms_sz = 0;
 
@@ -482,9 +491,8 @@ nl_initialize_cols(NestLevel nl, NestIdxValue niv, HeapTuple ht)
 {
 	NestAggCol col;
 	HeapField hf;
-	size_t space;
 	int32_t sp_res;
-	int8_t i, items;
+	int8_t i;
 	
 	if (!nl->acm_created)
 	{
@@ -500,16 +508,29 @@ nl_initialize_cols(NestLevel nl, NestIdxValue niv, HeapTuple ht)
 							  VH_SP_CTX_NESTLEVEL, nl);
 
 			if (hf)
-			{
-				col->tys_depth = vh_type_stack_copy(col->tys, hf->types);
-				col->acm = col->acm_create(hf->types);
-				col->acms_sz = vh_acms_size(col->acm);
-			}
+				nl_create_acm(col, hf->types);
 		}
 
 		nl->acm_created = true;
 	}
 
+	return nl_initialize_leaf(nl, niv);
+}
+
+static void
+nl_create_acm(NestAggCol col, Type *tys)
+{
+	col->tys_depth = vh_type_stack_copy(col->tys, tys);
+	col->acm = col->acm_create(tys);
+	col->acms_sz = vh_acms_size(col->acm);
+}
+
+static int32_t
+nl_initialize_leaf(NestLevel nl, NestIdxValue niv)
+{
+	size_t space;
+	int8_t items;
+
 	/*
 	 * Check to make sure we've got enough space on this thing.
 	 */
@@ -565,3 +586,104 @@ nl_initialize_trend_cols(NestLevel nl, NestIdxValue niv)
 	return 0;
 }
 
+
+/*
+ * ============================================================================
+ * Partial NestLevels
+ * ============================================================================
+ */
+
+/*
+ * vh_nl_partial_create
+ *
+ * Copies the NestLevel definition into the current MemoryContext.  The Group By
+ * columns are shared with |nl|, the aggregate columns are copied without their
+ * ACM.
+ */
+NestLevel
+vh_nl_partial_create(NestLevel nl)
+{
+	NestLevel partial;
+	NestAggCol col;
+	int32_t i;
+
+	partial = vh_nl_create();
+	memcpy(partial, nl, sizeof(struct NestLevelData));
+
+	partial->nest = 0;
+	partial->acm_created = false;
+
+	if (nl->agg_n_cols)
+	{
+		partial->agg_cols = vhmalloc(sizeof(struct NestAggColData) * 
+									 nl->agg_n_cols);
+		memcpy(partial->agg_cols, nl->agg_cols, 
+			   sizeof(struct NestAggColData) * nl->agg_n_cols);
+
+		for (i = 0; i < nl->agg_n_cols; i++)
+		{
+			col = &partial->agg_cols[i];
+			col->acm = 0;
+			col->acms_sz = 0;
+		}
+	}
+
+	return partial;
+}
+
+/*
+ * vh_nl_merge
+ *
+ * Merges the aggregate states of a partial NestLevel leaf into ours.  The
+ * partial ACMs tell us which Type stack to create our ACMs with when nothing
+ * has been input into |nl| yet.
+ */
+int32_t
+vh_nl_merge(NestLevel nl, NestIdxValue niv,
+			NestLevel src_nl, NestIdxValue src_niv)
+{
+	void *target, *source;
+	int32_t i, res = 0;
+
+	if (!src_nl->acm_created || 
+		!vh_nestidxv_value(src_niv, src_nl->idx, 0))
+		return 0;
+
+	if (!nl->acm_created)
+	{
+		for (i = 0; i < nl->agg_n_cols; i++)
+		{
+			if (src_nl->agg_cols[i].acm)
+				nl_create_acm(&nl->agg_cols[i], src_nl->agg_cols[i].tys);
+		}
+
+		nl->acm_created = true;
+	}
+
+	if (!vh_nestidxv_value(niv, nl->idx, 0))
+	{
+		if (nl_initialize_leaf(nl, niv))
+			return -1;
+	}
+
+	for (i = 0; i < nl->agg_n_cols; i++)
+	{
+		target = vh_nestidxv_value(niv, nl->idx, i);
+		source = vh_nestidxv_value(src_niv, src_nl->idx, i);
+
+		if (!target || !source)
+			continue;
+
+		if (vh_acms_merge(nl->agg_cols[i].acm, target, source))
+		{
+			elog(WARNING,
+					emsg("Unable to merge the partial state for aggregate "
+						 "column %s on NestLevel [%p].",
+						 nl->agg_cols[i].name,
+						 nl));
+			res = -1;
+		}
+	}
+
+	return res;
+}
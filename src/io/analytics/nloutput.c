@@ -51,6 +51,9 @@ vh_nlo_json(NestLevel nl, int32_t flags)
 
 	idx = &nl->nest->idxs[nl->idx];
 
+	if (flags & VH_NLO_FLAG_SORT)
+		vh_nestidx_sort(idx);
+
 	nlo_ctx.root = vh_json_make_array();
 	nlo_ctx.root_method = NLO_ROOT_METHOD_ARRAY;
 	nlo_ctx.output_keys = true;
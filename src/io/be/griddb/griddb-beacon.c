@@ -130,7 +130,7 @@ grdb_beac_htp_shard(void *beac, HeapTuplePtr htp, bool assign)
 	TableDef td;
 	int32_t partition_id, ret;
 
-	ht = vh_htp(htp);
+	ht = vh_htp_read(htp);
 
 	if (ht)
 	{
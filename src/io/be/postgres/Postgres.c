@@ -5,6 +5,8 @@
 
 
 #include <assert.h>
+#include <errno.h>
+#include <poll.h>
 
 #include "vh.h"
 #include "io/be/postgres/Impl.h"
@@ -20,8 +22,11 @@
 #include "io/nodes/NodeField.h"
 #include "io/nodes/NodeFrom.h"
 #include "io/nodes/NodeQueryInsert.h"
+#include "io/nodes/NodeQueryUpdate.h"
+#include "io/plan/pcache.h"
 #include "io/plan/pstmt.h"
 #include "io/plan/pstmt_funcs.h"
+#include "io/utils/kset.h"
 #include "io/utils/SList.h"
 #include "io/utils/stopwatch.h"
 
@@ -45,7 +50,17 @@ static bool pgres_xact_rollback(BackEndConnection);
 static bool pgres_xact_tpc_commit(BackEndConnection);
 static bool pgres_xact_tpc_rollback(BackEndConnection);
 
+static bool pgres_savepoint(BackEndConnection, String sp);
+static bool pgres_xact_rollbackto(BackEndConnection, String sp);
+
+static bool pgres_pipeline_begin(BackEndConnection);
+static bool pgres_pipeline_end(BackEndConnection, uint64_t *failed_tag);
+static void pgres_pipeline_reset(PostgresConnection pconn);
+static bool pgres_pipeline_sync(PostgresConnection pconn);
+
 static void pgres_exec(BackEndExecPlan beep);
+static int pgres_exec_send(BackEndExecPlan beep);
+static int32_t pgres_exec_poll(BackEndExecPlan beep);
 
 static String pgres_command(Node node, int32_t param_offset,
 							TypeVarSlot **param_values, int32_t *param_count);
@@ -74,6 +89,7 @@ static struct BinaryAMOptionData InboundBinaryOptions = {
 
 static void pgres_cmd_param_ph(String cmd, NodeSqlCmdContext ctx, TypeVarSlot *tvs);
 static bool pgres_cmd_to_sql_query(String cmd, void *node, NodeSqlCmdContext ctx);
+static void pgres_cmd_upd_cast(String cmd, NodeSqlCmdContext ctx, TableField tf);
 
 static const NodeSqlCmdFuncTable pgres_nsql_cmd_ft[] = {
 	{ Query, pgres_cmd_to_sql_query },
@@ -91,15 +107,22 @@ struct PgresExecPortalData
 	BackEndExecPlan beep;
 
 	PGconn *pgconn;
+	String command_copy;		/* COPY wrapped around the command */
 
 	HeapTuplePtr *rs_transfer, *rs_htp;
 	HeapTuple *rs_comp;
+	HeapBufferBatch rs_batch;
 
 	QrpTableProjection qrp_table;
 	QrpFieldProjection qrp_field;
 	QrpBackEndProjection qrp_be;
 	vh_be_htc htc;
 	int32_t qrp_ntables;
+	int32_t ncols;
+	int64_t be_wait_count;
+
+	bool htc_first;
+	bool latebind;
 };
 
 
@@ -108,7 +131,14 @@ typedef struct PgresExecPortalData *PgresExecPortal;
 static void pgres_ep_open(PgresExecPortal pep, BackEndExecPlan beep);
 static void pgres_ep_close(PgresExecPortal pep);
 static void pgres_ep_htc(PgresExecPortal pep);
-static void pgres_ep_sendcmd(PgresExecPortal pep, bool bulk);
+static void pgres_ep_htc_begin(PgresExecPortal pep);
+static void pgres_ep_htc_batch(PgresExecPortal pep);
+static void pgres_ep_htc_row(PgresExecPortal pep, PGresult *pgres);
+static void pgres_ep_htc_end(PgresExecPortal pep);
+static bool pgres_ep_sendcmd(PgresExecPortal pep, bool bulk);
+static bool pgres_ep_pipeline(PgresExecPortal pep, PostgresConnection pconn);
+static bool pgres_ep_prepare(PgresExecPortal pep, const char *name,
+							 int p_count, Oid *p_oids);
 static void pgres_ep_checkerror(PgresExecPortal pep, PGresult *pgres,
 								bool in_copy);
 
@@ -140,9 +170,43 @@ struct PgresCopyInTupleHeader
 	int16_t ncols;
 };
 
+/*
+ * COPY IN is double buffered: we encode the next chunk in our buffer while
+ * the previous one drains from libpq's output buffer.  The connection is
+ * switched to non-blocking mode for the duration of the COPY so
+ * PQputCopyData and PQflush never stall the encoder; we only wait on the
+ * socket when the next chunk is ready before the previous one has gone out.
+ */
+#define PGRES_COPYIN_CHUNK_SZ		(256 * 1024)
+#define PGRES_COPYIN_PUMP_ROWS		64
+
+struct PgresCopyInWriterData
+{
+	PGconn *conn;
+	bool pending;				/* Previous chunk still in libpq's buffer */
+	bool failed;
+	int64_t chunks;
+	int64_t stalls;				/* Times we waited on the socket */
+};
+
+typedef struct PgresCopyInWriterData *PgresCopyInWriter;
+
 const char pgres_copyin_signature [] = { "PGCOPY\n\377\r\n\0" };
 static void pgres_ep_copytuples(TableDef td, SList htps, PGconn *conn);
-static void pgres_ep_sendbuffer(PGconn *conn, void *buffer, size_t size);
+static void pgres_ep_copyin_rows(PgresCopyInWriter w, TableDefVer tdv,
+								 TamUnion **tam_funcs, SList htps,
+								 unsigned char *buffer, size_t buffersz);
+static void pgres_ep_sendbuffer(PgresCopyInWriter w, void *buffer, size_t size);
+static void pgres_ep_copyin_pump(PgresCopyInWriter w);
+static bool pgres_ep_copyin_drain(PgresCopyInWriter w);
+static bool pgres_ep_copyin_wait(PgresCopyInWriter w);
+
+/*
+ * Bulk Fetch Definitions
+ */
+static void pgres_ep_copyout(PgresExecPortal pep);
+static bool pgres_ep_copyout_rows(PgresExecPortal pep, const char *buffer,
+								  int32_t len, bool *header);
 
 
 /*
@@ -163,13 +227,19 @@ static struct BackEndData vh_be_pgres =
 		.disconnect = pgres_nconn_disconnect,
 		.ping = pgres_nconn_ping,
 
+		.savepoint = pgres_savepoint,
 		.xactbegin = pgres_xact_begin,
 		.xactcommit = pgres_xact_commit,
 		.xactrollback = pgres_xact_rollback,
+		.xactrollbackto = pgres_xact_rollbackto,
 		.tpccommit = pgres_xact_tpc_commit,
 		.tpcrollback = pgres_xact_tpc_rollback,
 
 		.exec = pgres_exec,
+		.exec_send = pgres_exec_send,
+		.exec_poll = pgres_exec_poll,
+		.pipeline_begin = pgres_pipeline_begin,
+		.pipeline_end = pgres_pipeline_end,
 		.command = pgres_command,
 		.param = pgres_parameter
 	},
@@ -201,25 +271,30 @@ static struct BackEndData vh_be_pgres =
 	vh_be_type_setnative(be, tynm, &tys[0]);									\
 }
 
+/*
+ * Sorted by Oid for pgres_oid_map_find.  The |name| of the first entry for a
+ * Type is the one used to cast parameters to it.
+ */
 struct PgresOidType
 {
 	Oid oid;
 	Type tys[VH_TAMS_MAX_DEPTH];
+	const char *name;
 };
 
 static const struct PgresOidType pgres_oid_map[] = {
-	{ 16, { &vh_type_bool, 0 } },
-	{ 20, { &vh_type_int64, 0 } },
-	{ 21, { &vh_type_int16, 0 } },
-	{ 23, { &vh_type_int32, 0 } },
-	{ 25, { &vh_type_String, 0 } },
-	{ 26, { &vh_type_int32, 0 } },
-	{ 700, { &vh_type_float, 0 } },
-	{ 701, { &vh_type_dbl, 0 } },
-	{ 1042, { &vh_type_String, 0 } },
-	{ 1082, { &vh_type_Date, 0 } },
-	{ 1114, { &vh_type_DateTime, 0 } },
-	{ 1700, { &vh_type_numeric, 0 } }
+	{ 16, { &vh_type_bool, 0 }, "boolean" },
+	{ 20, { &vh_type_int64, 0 }, "bigint" },
+	{ 21, { &vh_type_int16, 0 }, "smallint" },
+	{ 23, { &vh_type_int32, 0 }, "integer" },
+	{ 25, { &vh_type_String, 0 }, "text" },
+	{ 26, { &vh_type_int32, 0 }, "oid" },
+	{ 700, { &vh_type_float, 0 }, "real" },
+	{ 701, { &vh_type_dbl, 0 }, "double precision" },
+	{ 1042, { &vh_type_String, 0 }, "character" },
+	{ 1082, { &vh_type_Date, 0 }, "date" },
+	{ 1114, { &vh_type_DateTime, 0 }, "timestamp" },
+	{ 1700, { &vh_type_numeric, 0 }, "numeric" }
 };
 
 static Type* pgres_oid_map_find(Oid oid);
@@ -285,6 +360,15 @@ pgres_nconn_alloc(void)
 	pconn->pgres = 0;
 	pconn->connStatus = CONNECTION_BAD;
 	pconn->xactStatus = PQTRANS_IDLE;
+	pconn->prepared = vh_htbl_create(&((struct HashTableOpts) {
+										.key_sz = sizeof(uint32_t),
+										.value_sz = 0,
+										.func_hash = vh_htbl_hash_int32,
+										.func_compare = vh_htbl_comp_int32,
+										.mctx = vh_mctx_from_pointer(pconn),
+										.is_map = false }),
+									 VH_HTBL_OPT_ALL);
+	pgres_pipeline_reset(pconn);
 	
 	return (BackEndConnection)pconn;
 }
@@ -312,6 +396,7 @@ pgres_nconn_connect(BackEndConnection nconn, BackEndCredentialVal *bec,
 
 	pconn->pgconn = PQconnectdb(vh_str_buffer(connstr));
 	pconn->connStatus = PQstatus(pconn->pgconn);
+	vh_htbl_clear(pconn->prepared);
 
 	if (pconn->connStatus == CONNECTION_OK)
 		connected = true;
@@ -339,6 +424,11 @@ pgres_nconn_connect(BackEndConnection nconn, BackEndCredentialVal *bec,
 static void
 pgres_nconn_free(BackEndConnection nconn)
 {
+	PostgresConnection pconn = (PostgresConnection)nconn;
+
+	if (pconn->prepared)
+		vh_kset_destroy(pconn->prepared);
+
 	vhfree(nconn);
 }
 
@@ -352,6 +442,8 @@ pgres_nconn_reset(BackEndConnection nconn)
 	PQfinish(pconn->pgconn);
 	pconn->connStatus = CONNECTION_BAD;
 	pconn->xactStatus = PQTRANS_IDLE;
+	vh_htbl_clear(pconn->prepared);
+	pgres_pipeline_reset(pconn);
 
 	return true;
 }
@@ -362,6 +454,8 @@ pgres_nconn_disconnect(BackEndConnection nconn)
 	PostgresConnection pgres = (PostgresConnection) nconn;
 
 	PQfinish(pgres->pgconn);
+	vh_htbl_clear(pgres->prepared);
+	pgres_pipeline_reset(pgres);
 	
 	return true;
 }
@@ -369,7 +463,22 @@ pgres_nconn_disconnect(BackEndConnection nconn)
 static bool 
 pgres_nconn_ping(BackEndConnection nconn)
 {
-	return false;
+	PostgresConnection pconn = (PostgresConnection)nconn;
+	PGresult *res;
+	bool alive;
+
+	if (!pconn->pgconn || PQstatus(pconn->pgconn) != CONNECTION_OK)
+		return false;
+
+	/*
+	 * An empty query is the cheapest round trip the server will answer, it
+	 * catches sockets the server or a firewall dropped while we sat idle.
+	 */
+	res = PQexec(pconn->pgconn, "");
+	alive = PQresultStatus(res) == PGRES_EMPTY_QUERY;
+	PQclear(res);
+
+	return alive;
 }
 
 
@@ -380,6 +489,8 @@ pgres_xact_begin(BackEndConnection nconn)
 	PGresult *res;
 
 	pconn = (PostgresConnection)nconn;
+	pgres_pipeline_sync(pconn);
+
 	res = PQexec(pconn->pgconn, "BEGIN;");
 	PQclear(res);
 
@@ -393,6 +504,8 @@ pgres_xact_commit(BackEndConnection nconn)
 	PGresult *res;
 
 	pconn = (PostgresConnection)nconn;
+	pgres_pipeline_sync(pconn);
+
 	res = PQexec(pconn->pgconn, "COMMIT;");
 	PQclear(res);
 
@@ -406,12 +519,210 @@ pgres_xact_rollback(BackEndConnection nconn)
 	PGresult *res;
 
 	pconn = (PostgresConnection)nconn;
+	pgres_pipeline_sync(pconn);
+
 	res = PQexec(pconn->pgconn, "ROLLBACK;");
 	PQclear(res);
 
 	return true;
 }
 
+/*
+ * pgres_savepoint
+ *
+ * While the connection is pipelining the SAVEPOINT goes out with the
+ * statements around it, under the same tag as the statement that follows.
+ */
+static bool
+pgres_savepoint(BackEndConnection nconn, String sp)
+{
+	PostgresConnection pconn = (PostgresConnection)nconn;
+	PGresult *res;
+	String cmd;
+	bool success;
+
+	cmd = vh_str.Convert("SAVEPOINT ");
+	vh_str.AppendStr(cmd, sp);
+
+	if (pconn->pipeline &&
+		(PQpipelineStatus(pconn->pgconn) != PQ_PIPELINE_OFF ||
+		 PQenterPipelineMode(pconn->pgconn)))
+	{
+		success = PQsendQueryParams(pconn->pgconn, vh_str_buffer(cmd),
+									0, 0, 0, 0, 0, 0);
+
+		if (success)
+			pconn->pipeline_tags[pconn->pipeline_pending++] = 
+				nconn->pipeline_tag;
+
+		if (pconn->pipeline_pending == PGRES_PIPELINE_MAX)
+			pgres_pipeline_sync(pconn);
+	}
+	else
+	{
+		pgres_pipeline_sync(pconn);
+
+		res = PQexec(pconn->pgconn, vh_str_buffer(cmd));
+		success = PQresultStatus(res) == PGRES_COMMAND_OK;
+		PQclear(res);
+	}
+
+	vh_str.Destroy(cmd);
+
+	return success;
+}
+
+static bool
+pgres_xact_rollbackto(BackEndConnection nconn, String sp)
+{
+	PostgresConnection pconn = (PostgresConnection)nconn;
+	PGresult *res;
+	String cmd;
+	bool success;
+
+	pgres_pipeline_sync(pconn);
+
+	cmd = vh_str.Convert("ROLLBACK TO SAVEPOINT ");
+	vh_str.AppendStr(cmd, sp);
+
+	res = PQexec(pconn->pgconn, vh_str_buffer(cmd));
+	success = PQresultStatus(res) == PGRES_COMMAND_OK;
+	PQclear(res);
+
+	vh_str.Destroy(cmd);
+
+	return success;
+}
+
+/*
+ * Pipelining
+ *
+ * While an XAct flushes its SavePoints, statements whose results are
+ * discarded are sent back to back in libpq pipeline mode.  Anything else,
+ * a result set, a COPY or a transaction command, first syncs the pipeline:
+ * the results queued so far are collected and libpq leaves pipeline mode.
+ *
+ * The server aborts every statement after the first failure up to the next
+ * sync, so only the first failed tag is kept.  It stays put across syncs
+ * until pipeline_end reports it.
+ */
+static bool
+pgres_pipeline_begin(BackEndConnection nconn)
+{
+	PostgresConnection pconn = (PostgresConnection)nconn;
+
+	if (!pconn->pipeline)
+	{
+		pconn->pipeline = true;
+		pconn->pipeline_failed = false;
+		pconn->pipeline_failed_tag = 0;
+	}
+
+	return true;
+}
+
+static bool
+pgres_pipeline_end(BackEndConnection nconn, uint64_t *failed_tag)
+{
+	PostgresConnection pconn = (PostgresConnection)nconn;
+	bool success;
+
+	success = pgres_pipeline_sync(pconn);
+
+	if (!success)
+		*failed_tag = pconn->pipeline_failed_tag;
+
+	pconn->pipeline = false;
+	pconn->pipeline_failed = false;
+	pconn->pipeline_failed_tag = 0;
+
+	return success;
+}
+
+static void
+pgres_pipeline_reset(PostgresConnection pconn)
+{
+	pconn->pipeline = false;
+	pconn->pipeline_failed = false;
+	pconn->pipeline_failed_tag = 0;
+	pconn->pipeline_pending = 0;
+}
+
+/*
+ * pgres_pipeline_sync
+ *
+ * Collects the result of every statement in the pipeline and takes libpq out
+ * of pipeline mode.  Returns false when a statement failed since the
+ * pipeline began.
+ */
+static bool
+pgres_pipeline_sync(PostgresConnection pconn)
+{
+	PGconn *conn = pconn->pgconn;
+	PGresult *res;
+	ExecStatusType est;
+	int32_t i;
+
+	if (!conn || PQpipelineStatus(conn) == PQ_PIPELINE_OFF)
+		return !pconn->pipeline_failed;
+
+	if (!PQpipelineSync(conn))
+	{
+		if (!pconn->pipeline_failed && pconn->pipeline_pending)
+		{
+			pconn->pipeline_failed = true;
+			pconn->pipeline_failed_tag = pconn->pipeline_tags[0];
+		}
+
+		pconn->pipeline_pending = 0;
+
+		return false;
+	}
+
+	for (i = 0; i < pconn->pipeline_pending; i++)
+	{
+		while ((res = PQgetResult(conn)))
+		{
+			est = PQresultStatus(res);
+
+			if (est == PGRES_FATAL_ERROR && !pconn->pipeline_failed)
+			{
+				pconn->pipeline_failed = true;
+				pconn->pipeline_failed_tag = pconn->pipeline_tags[i];
+
+				elog(WARNING,
+					 emsg("Postgres: pipelined statement %d of %d failed\n%s",
+						  i + 1, pconn->pipeline_pending,
+						  PQresultErrorMessage(res)));
+			}
+
+			PQclear(res);
+		}
+	}
+
+	/*
+	 * Last comes the PGRES_PIPELINE_SYNC result, anything else means the
+	 * connection went away underneath us.
+	 */
+	res = PQgetResult(conn);
+
+	if (!res || PQresultStatus(res) != PGRES_PIPELINE_SYNC)
+	{
+		if (!pconn->pipeline_failed && pconn->pipeline_pending)
+		{
+			pconn->pipeline_failed = true;
+			pconn->pipeline_failed_tag = pconn->pipeline_tags[0];
+		}
+	}
+
+	PQclear(res);
+	PQexitPipelineMode(conn);
+
+	pconn->pipeline_pending = 0;
+
+	return !pconn->pipeline_failed;
+}
+
 static bool
 pgres_xact_tpc_commit(BackEndConnection nconn)
 {
@@ -513,6 +824,16 @@ static bool pgres_cmd_to_sql_query(String cmd, void *node,
 		 */
 		vh_strappd(cmd, "FROM STDIN WITH (FORMAT BINARY, OIDS false);");
 	}
+	else if (nq->action == Update && ((NodeQueryUpdate)nq)->htps)
+	{
+		/*
+		 * Parameters are sent untyped, which Postgres resolves to text in a
+		 * VALUES list.  Cast the first row so the columns take on the type
+		 * of the binary values we're sending.
+		 */
+		vh_sqlq_upd_values_cmd(cmd, (NodeQueryUpdate)nq, ctx, 
+							   pgres_cmd_upd_cast);
+	}
 	else
 	{
 		vh_nsql_cmd_impl_def(&nq->node, cmd, ctx, false);
@@ -536,6 +857,30 @@ static bool pgres_cmd_to_sql_query(String cmd, void *node,
 	return true;
 }
 
+static void
+pgres_cmd_upd_cast(String cmd, NodeSqlCmdContext ctx, TableField tf)
+{
+	const struct PgresOidType *map;
+	int32_t i, map_sz;
+
+	if (tf->heap.type_depth != 1)
+		return;
+
+	map_sz = sizeof(pgres_oid_map) / sizeof(struct PgresOidType);
+
+	for (i = 0; i < map_sz; i++)
+	{
+		map = &pgres_oid_map[i];
+
+		if (map->tys[0] == tf->heap.types[0])
+		{
+			vh_strappd(cmd, "::");
+			vh_strappd(cmd, map->name);
+			return;
+		}
+	}
+}
+
 static String
 pgres_command(Node node, int32_t param_offset,
 			  TypeVarSlot **param_values, int32_t *param_count)
@@ -637,16 +982,24 @@ static void
 pgres_exec(BackEndExecPlan beep)
 {
 	struct PgresExecPortalData pep;
+	PostgresConnection pconn;
 	PGresult *pgres_bi;
 	NodeQueryInsert nqins;
 
 	assert(beep);
 
 	pgres_ep_open(&pep, beep);
+	pconn = (PostgresConnection)beep->pstmtshd->nconn;
 
 	VH_TRY();
 	{
-		if (beep->pstmt->nquery &&
+		if (pgres_ep_pipeline(&pep, pconn))
+		{
+			/*
+			 * The result is collected when the pipeline syncs.
+			 */
+		}
+		else if (beep->pstmt->nquery &&
 			beep->pstmt->nquery->action == BulkInsert)
 		{
 			/*
@@ -673,6 +1026,10 @@ pgres_exec(BackEndExecPlan beep)
 				PQclear(pgres_bi);
 			}
 		}
+		else if (beep->pstmt->bulk && !beep->discard)
+		{
+			pgres_ep_copyout(&pep);
+		}
 		else
 		{
 			pgres_ep_sendcmd(&pep, false);
@@ -706,6 +1063,145 @@ pgres_exec(BackEndExecPlan beep)
 	pgres_ep_close(&pep);
 }
 
+/*
+ * pgres_exec_send
+ *
+ * Asynchronous half of pgres_exec for result sets.  The command goes out on
+ * the wire and we return the connection's socket without waiting on the
+ * result.  The portal lives on |beep| until pgres_exec_poll sees the last
+ * PGresult.  Bulk inserts, bulk fetches and discards aren't worth splitting
+ * up, they run to completion here and report the socket as -2 so the caller
+ * knows not to poll.
+ */
+static int
+pgres_exec_send(BackEndExecPlan beep)
+{
+	PgresExecPortal pep;
+	int sock = -1;
+
+	assert(beep);
+
+	if (beep->discard || beep->pstmt->bulk ||
+		(beep->pstmt->nquery &&
+		 beep->pstmt->nquery->action == BulkInsert))
+	{
+		pgres_exec(beep);
+
+		return -2;
+	}
+
+	pep = vhmalloc_ctx(beep->mctx_work, sizeof(struct PgresExecPortalData));
+	memset(pep, 0, sizeof(struct PgresExecPortalData));
+
+	pgres_ep_open(pep, beep);
+	beep->be_state = pep;
+
+	VH_TRY();
+	{
+		pgres_pipeline_sync((PostgresConnection)beep->pstmtshd->nconn);
+		pgres_ep_sendcmd(pep, false);
+
+		/*
+		 * The connection stays in blocking mode, so PQflush only returns
+		 * once the whole command has been handed to the kernel.
+		 */
+		if (PQflush(pep->pgconn))
+			elog(ERROR2,
+				 emsg("Postgres: unable to flush the command to the server: %s",
+					  PQerrorMessage(pep->pgconn)));
+
+		pgres_ep_htc_begin(pep);
+		sock = PQsocket(pep->pgconn);
+	}
+	VH_CATCH();
+	{
+		sock = -1;
+	}
+	VH_ENDTRY();
+
+	vh_mctx_switch(pep->mctx_old);
+
+	if (sock < 0)
+	{
+		pgres_ep_close(pep);
+		beep->be_state = 0;
+	}
+
+	return sock;
+}
+
+/*
+ * pgres_exec_poll
+ *
+ * Called once the socket is readable.  Forms HeapTuple from every PGresult
+ * that has fully arrived and returns without blocking when libpq would have
+ * to wait on the server again.
+ */
+static int32_t
+pgres_exec_poll(BackEndExecPlan beep)
+{
+	PgresExecPortal pep = beep->be_state;
+	PGresult *pgres;
+	struct vh_stopwatch sw;
+	int32_t ret = 0;
+
+	if (!pep)
+		return -1;
+
+	vh_stopwatch_start(&sw);
+	pep->mctx_old = vh_mctx_switch(pep->mctx_work);
+
+	VH_TRY();
+	{
+		if (!PQconsumeInput(pep->pgconn))
+			elog(ERROR2,
+				 emsg("Postgres: lost the connection while reading results "
+					  "for the query (%s): %s",
+					  vh_str_buffer(beep->pstmtshd->command),
+					  PQerrorMessage(pep->pgconn)));
+
+		while (!PQisBusy(pep->pgconn))
+		{
+			if (!(pgres = PQgetResult(pep->pgconn)))
+			{
+				ret = 1;
+				break;
+			}
+
+			pgres_ep_htc_row(pep, pgres);
+		}
+	}
+	VH_CATCH();
+	{
+		ret = -1;
+	}
+	VH_ENDTRY();
+	
+	if (ret)
+	{
+		/*
+		 * On an error we still have to drain the connection so it can be
+		 * returned to the ConnectionCatalog in a usable state.
+		 */
+		if (ret < 0)
+			while ((pgres = PQgetResult(pep->pgconn)))
+				PQclear(pgres);
+
+		pgres_ep_htc_end(pep);
+		pgres_ep_close(pep);
+		beep->be_state = 0;
+	}
+	else
+	{
+		vh_mctx_switch(pep->mctx_old);
+	}
+
+	vh_stopwatch_end(&sw);
+	beep->stat_htform += vh_stopwatch_ms(&sw);
+
+	return ret;
+}
+
 static void
 pgres_ep_open(PgresExecPortal pep, BackEndExecPlan beep)
 {
@@ -739,6 +1235,8 @@ pgres_ep_open(PgresExecPortal pep, BackEndExecPlan beep)
 	   									 "Postgres working");
 	pep->mctx_old = vh_mctx_switch(pep->mctx_work);
 	pep->beep = beep;
+	pep->rs_batch = 0;
+	pep->command_copy = 0;
 }
 
 static void
@@ -767,6 +1265,7 @@ pgres_ep_checkerror(PgresExecPortal pep, PGresult *pgres, bool in_copy)
 			break;
 
 		case PGRES_COPY_IN:
+		case PGRES_COPY_OUT:
 			
 			if (!in_copy)
 			{
@@ -796,237 +1295,710 @@ pgres_ep_checkerror(PgresExecPortal pep, PGresult *pgres, bool in_copy)
 	}
 }
 
-static void
+static bool
 pgres_ep_sendcmd(PgresExecPortal pep, bool bulk)
 {
+	PlannedStmtShard pstmtshd = pep->beep->pstmtshd;
 	String command;
-	char **p_values;
+	char **p_values, prepname[VH_PCACHE_PREPNAME_SZ];
 	int *p_lengths, *p_formats, p_count, res;
 	Oid *p_oids;
+	bool prepared = false;
 	struct vh_stopwatch sw;
 
-	p_count = pgres_ep_transferparameters(pep->beep->pstmtshd->parameters,
+	p_count = pgres_ep_transferparameters(pstmtshd->parameters,
 				  						  &p_values, &p_lengths,
 				  						  &p_formats, &p_oids);
 
-	command = pep->beep->pstmtshd->command;
+	command = pep->command_copy ? pep->command_copy : pstmtshd->command;
 
 	vh_stopwatch_start(&sw);
 
-	res = PQsendQueryParams(pep->pgconn,						/* Connection */
-		  					vh_str_buffer(command),			/* Command */
-		  					p_count, 					/* Parameter count */
-		  					p_oids, 					/* Parameter OID */
-			  				(const char* const*)p_values,	/* Parameter values */
-		  					p_lengths, 				/* Parameter lengths */
-		  					p_formats, 				/* Parameter formats */
-		  					1);						/* 1: Binary, 0: Text */
-
-	if (res)
+	if (!bulk && pstmtshd->prepare_id)
 	{
+		vh_pcache_prepname(pstmtshd->prepare_id, &prepname[0], sizeof(prepname));
+		prepared = pgres_ep_prepare(pep, &prepname[0], p_count, p_oids);
 	}
 
-	if (!pep->beep->discard)
+	if (prepared)
+		res = PQsendQueryPrepared(pep->pgconn,					/* Connection */
+								  &prepname[0],					/* Statement */
+								  p_count,						/* Parameter count */
+								  (const char* const*)p_values,	/* Parameter values */
+								  p_lengths,					/* Parameter lengths */
+								  p_formats,					/* Parameter formats */
+								  1);							/* 1: Binary, 0: Text */
+	else
+		res = PQsendQueryParams(pep->pgconn,						/* Connection */
+			  					vh_str_buffer(command),			/* Command */
+			  					p_count, 					/* Parameter count */
+			  					p_oids, 					/* Parameter OID */
+				  				(const char* const*)p_values,	/* Parameter values */
+			  					p_lengths, 				/* Parameter lengths */
+			  					p_formats, 				/* Parameter formats */
+			  					1);						/* 1: Binary, 0: Text */
+
+	if (!pep->beep->discard && !bulk)
 	{
 		PQsetSingleRowMode(pep->pgconn);
 	}
 	
 	vh_stopwatch_end(&sw);
 	pep->beep->stat_qexec += vh_stopwatch_ms(&sw);
-}
 
+	return res;
+}
 
-static void 
-pgres_ep_htc(PgresExecPortal pep)
+/*
+ * pgres_ep_pipeline
+ *
+ * Sends a discarded statement into the connection's pipeline without
+ * waiting on the result, pgres_pipeline_sync collects it later.  Returns
+ * false when the statement has to run the usual way, after syncing whatever
+ * is already in the pipeline.  A failure found by that sync belongs to the
+ * statement that caused it and is reported by pipeline_end.
+ */
+static bool
+pgres_ep_pipeline(PgresExecPortal pep, PostgresConnection pconn)
 {
-	HeapTuplePtr *rs_transfer, *rs_htp, htp;
-	HeapTuple ht, *rs_comp;
-	int32_t i, j, ncols = 0, ntables;
-	int8_t td_i;
-	TableDefVer tdv;
-	TableField tf;
-	vh_be_htc htc;
-	PGresult *pgres;
-	struct vh_stopwatch sw;
-	QrpTableProjection qrpt;
-	QrpFieldProjection qrpf;
-	QrpBackEndProjection qrpb;
-	int64_t be_wait_count = 0;
-	bool latebind, first = true;
-
-	vh_stopwatch_start(&sw);
-	htc = pep->beep->htc_info->htc_cb;
+	BackEndExecPlan beep = pep->beep;
 
-	if (!htc)
+	if (!pconn->pipeline || !beep->discard || beep->pstmt->bulk ||
+		beep->pstmtshd->prepare_id ||
+		(beep->pstmt->nquery && beep->pstmt->nquery->action == BulkInsert) ||
+		(PQpipelineStatus(pep->pgconn) == PQ_PIPELINE_OFF &&
+		 !PQenterPipelineMode(pep->pgconn)))
 	{
-		elog(ERROR2,
-			 emsg("Critical error, a HeapTupleCollector was not passed "
-				  "to the back end executor.  Review planer implementation."));
-		return;
+		pgres_pipeline_sync(pconn);
+
+		return false;
 	}
 
-	latebind = vh_pstmt_is_lb(pep->beep->pstmt);
-	
-	while ((pgres = PQgetResult(pep->pgconn)))
+	if (pgres_ep_sendcmd(pep, false))
 	{
-		pgres_ep_checkerror(pep, pgres, false);
-
-		if (!PQntuples(pgres))
+		pconn->pipeline_tags[pconn->pipeline_pending++] = 
+			pconn->bec.pipeline_tag;
+	}
+	else if (!pconn->pipeline_failed)
+	{
+		pconn->pipeline_failed = true;
+		pconn->pipeline_failed_tag = pconn->bec.pipeline_tag;
+	}
+
+	if (pconn->pipeline_pending == PGRES_PIPELINE_MAX)
+		pgres_pipeline_sync(pconn);
+
+	return true;
+}
+
+/*
+ * pgres_ep_prepare
+ *
+ * Makes sure the PlanCache statement |name| exists on the connection, parsing
+ * it on the server the first time the connection sees it.  The parameter
+ * types are taken from the first execution, the PlanCache only shares an
+ * entry between queries whose parameters have the same Type.  Returns false
+ * when the statement couldn't be prepared so the caller sends the command as
+ * a one off.
+ */
+static bool
+pgres_ep_prepare(PgresExecPortal pep, const char *name,
+				 int p_count, Oid *p_oids)
+{
+	PlannedStmtShard pstmtshd = pep->beep->pstmtshd;
+	PostgresConnection pconn = (PostgresConnection)pstmtshd->nconn;
+	PGresult *res;
+	bool prepared;
+
+	if (!pconn || !pconn->prepared)
+		return false;
+
+	if (vh_kset_exists(pconn->prepared, &pstmtshd->prepare_id))
+		return true;
+
+	res = PQprepare(pep->pgconn,
+					name,
+					vh_str_buffer(pstmtshd->command),
+					p_count,
+					p_oids);
+	prepared = (PQresultStatus(res) == PGRES_COMMAND_OK);
+
+	if (prepared)
+		vh_kset_key(pconn->prepared, &pstmtshd->prepare_id);
+	else
+		elog(WARNING,
+			 emsg("Postgres: unable to prepare statement %s, sending the "
+				  "command without preparing it: %s",
+				  name,
+				  PQresultErrorMessage(res)));
+
+	PQclear(res);
+
+	return prepared;
+}
+
+/*
+ * pgres_ep_htc
+ *
+ * Drains every PGresult from the connection, forming HeapTuple as we go.
+ * The work is split into begin, row and end so the asynchronous path can
+ * hand us results one at a time as they arrive on the socket.
+ */
+static void 
+pgres_ep_htc(PgresExecPortal pep)
+{
+	PGresult *pgres;
+	struct vh_stopwatch sw;
+
+	vh_stopwatch_start(&sw);
+
+	pgres_ep_htc_begin(pep);
+
+	while ((pgres = PQgetResult(pep->pgconn)))
+		pgres_ep_htc_row(pep, pgres);
+
+	pgres_ep_htc_end(pep);
+	
+	vh_stopwatch_end(&sw);
+	pep->beep->stat_htform += vh_stopwatch_ms(&sw);
+}
+
+static void
+pgres_ep_htc_begin(PgresExecPortal pep)
+{
+	pep->htc = pep->beep->htc_info->htc_cb;
+
+	if (!pep->htc)
+	{
+		elog(ERROR2,
+			 emsg("Critical error, a HeapTupleCollector was not passed "
+				  "to the back end executor.  Review planer implementation."));
+		return;
+	}
+
+	pep->latebind = vh_pstmt_is_lb(pep->beep->pstmt);
+	pep->htc_first = true;
+	pep->ncols = 0;
+	pep->be_wait_count = 0;
+}
+
+/*
+ * pgres_ep_htc_batch
+ *
+ * Sets up the projections and the HeapBufferBatch for each result table once
+ * the first row has arrived.
+ */
+static void
+pgres_ep_htc_batch(PgresExecPortal pep)
+{
+	int32_t i, ntables;
+
+	pep->qrp_table = pep->beep->pstmt->qrp_table;
+	pep->qrp_field = pep->beep->pstmt->qrp_field;
+	pep->qrp_be = pep->beep->pstmt->qrp_backend;
+
+	ntables = pep->qrp_ntables = pep->beep->pstmt->qrp_ntables;
+
+	pep->rs_transfer = vhmalloc_ctx(pep->mctx_work, sizeof(HeapTuple) * ntables * 3);
+	pep->rs_comp = (HeapTuple*)pep->rs_transfer + ntables;
+	pep->rs_htp = (HeapTuplePtr*)pep->rs_comp + ntables;
+
+	memset(pep->rs_transfer, 0, sizeof(HeapTuple) * ntables * 3);
+
+	/*
+	 * Form the HeapTuple for each table in batches rather than one
+	 * row at a time, see vh_hb_allocht_n.
+	 */
+	pep->rs_batch = vhmalloc_ctx(pep->mctx_work, 
+								 sizeof(HeapBufferBatchData) * ntables);
+
+	for (i = 0; i < ntables; i++)
+		vh_hb_batch_init(&pep->rs_batch[i],
+						 vh_hb(pep->beep->htc_info->hbno),
+						 (HeapTupleDef)pep->qrp_table[i].rtdv,
+						 0,
+						 pep->mctx_work);
+
+	pep->htc_first = false;
+}
+
+static void
+pgres_ep_htc_row(PgresExecPortal pep, PGresult *pgres)
+{
+	HeapTuplePtr *rs_transfer, *rs_htp, htp;
+	HeapTuple ht, *rs_comp;
+	int32_t j, ncols, ntables;
+	int8_t td_i;
+	TableField tf;
+	QrpFieldProjection qrpf;
+	QrpBackEndProjection qrpb;
+
+	pgres_ep_checkerror(pep, pgres, false);
+
+	if (!PQntuples(pgres))
+	{
+		PQclear(pgres);
+		pep->be_wait_count++;
+		return;
+	}
+
+	if (pep->latebind)
+	{
+		pgres_latebind(pep, pgres);
+		pep->latebind = false;
+	}
+
+	if (pep->htc_first)
+		pgres_ep_htc_batch(pep);
+
+	qrpf = pep->qrp_field;
+	qrpb = pep->qrp_be;
+	ntables = pep->qrp_ntables;
+
+	rs_transfer = pep->rs_transfer;
+	rs_comp = pep->rs_comp;
+	rs_htp = pep->rs_htp;
+
+	pep->beep->htc_info->nrows++;
+
+	if (!pep->ncols)
+	{
+		pep->ncols = PQnfields(pgres);
+		assert(pep->ncols == pep->beep->pstmt->qrp_nfields);
+	}
+
+	ncols = pep->ncols;
+
+	/*
+	 * Loop thru all of the query columns, grabbing their values from
+	 * the database results.
+	 */
+	for (j = 0; j < ncols; j++)
+	{
+		/* 
+		 * Derived from the Query Result Projection using the
+		 * current column:
+		 * td - TableDef
+		 * tf - TableField
+		 * ty - Type
+		 */
+		td_i = qrpf[j].td_idx;
+		tf = (TableField)qrpf[j].hf;
+
+		ht = rs_comp[td_i];
+
+		if (!ht)
 		{
-			PQclear(pgres);
-			be_wait_count++;
-			continue;
-		}
+			htp = vh_hb_batch_next(&pep->rs_batch[td_i], &ht);
+			assert(ht->htd == (HeapTupleDef)pep->qrp_table[td_i].rtdv);
 
-		if (latebind)
+			rs_comp[td_i] = ht;
+			rs_htp[td_i] = htp;
+		}
+		
+		if (PQgetisnull(pgres, 0, j))
+			vh_htf_setnull(ht, tf);
+		else
 		{
-			pgres_latebind(pep, pgres);
-			latebind = false;
+			vh_htf_clearnull(ht, tf);
+
+			/*
+			 * Do what we came here to do, fill a HeapTuple with data from
+			 * the back end.  We call vh_tam_fireu_bin_set which takes the
+			 * Type stack for the given field and the TamSetUnion.  We
+			 * assume tam_types and tam_funcs were built by QRP which
+			 * pretty much guarantees our result set column order will 
+			 * match the type order and indexing.
+			 */
+			vh_tam_fireu_bin_set(qrpf[j].tys, qrpb[j].tam_func,
+								 &InboundBinaryOptions,
+								 PQgetvalue(pgres, 0, j),
+								 vh_ht_field(ht, tf),
+								 PQgetlength(pgres, 0, j),
+								 0);
 		}
+	}
 
-		if (first)
-		{	
-			qrpt = pep->beep->pstmt->qrp_table;
-			qrpf = pep->beep->pstmt->qrp_field;
-			qrpb = pep->beep->pstmt->qrp_backend;
 
-			ntables = pep->beep->pstmt->qrp_ntables;
+	/*
+	 * Call the HTC, checking to see if we need to re-point the local
+	 * copy of pointer to the HTC.  The HTC makes no guarantees the function
+	 * pointer will remain the same when cycling (i.e. it may detect memory
+	 * pressure and flush the results to disk).
+	 */
+
+	pep->htc(pep->beep->htc_info, rs_comp, rs_htp);
+	
+	for (j = 0; j < ntables; j++)
+	{
+		rs_transfer[j] = rs_htp[j];
+		rs_comp[j] = 0;
+	}
+
+	PQclear(pgres);
+}
+
+static void
+pgres_ep_htc_end(PgresExecPortal pep)
+{
+	int32_t i;
+
+	if (pep->rs_batch)
+	{
+		for (i = 0; i < pep->qrp_ntables; i++)
+			vh_hb_batch_release(&pep->rs_batch[i]);
+
+		pep->rs_batch = 0;
+	}
+	
+	pep->beep->stat_wait_count += pep->be_wait_count;
+}
+
+/*
+ * pgres_ep_copyout
+ *
+ * Streams a large result set with COPY (SELECT ...) TO STDOUT in the binary
+ * format instead of one single row PGresult per tuple.  Each field in the
+ * stream is laid out just like a binary result column, so the values go
+ * straight thru the TAM binary setters as they do in pgres_ep_htc_row.
+ *
+ * https://www.postgresql.org/docs/9.6/static/sql-copy.html
+ */
+static void
+pgres_ep_copyout(PgresExecPortal pep)
+{
+	PGresult *pgres;
+	struct vh_stopwatch sw;
+	char *buffer = 0;
+	int32_t len = 0;
+	bool header = true, more = true;
 
-			rs_transfer = vhmalloc_ctx(pep->mctx_work, sizeof(HeapTuple) * ntables * 3);
-			rs_comp = (HeapTuple*)rs_transfer + ntables;
-			rs_htp = (HeapTuplePtr*)rs_comp + ntables;
+	pep->command_copy = vh_str.Convert("COPY (");
+	vh_str.AppendStr(pep->command_copy, pep->beep->pstmtshd->command);
+	vh_str.Append(pep->command_copy, "\n) TO STDOUT WITH (FORMAT BINARY)");
 
+	pgres_ep_sendcmd(pep, true);
 
-			memset(rs_transfer, 0, sizeof(HeapTuple) * ntables);
+	pgres = PQgetResult(pep->pgconn);
+	pgres_ep_checkerror(pep, pgres, true);
 
-			for (i = 0; i < ntables; i++)
-				rs_htp[i] = vh_hb_allocht(vh_hb(pep->beep->htc_info->hbno),
-										  (HeapTupleDef)qrpt[i].rtdv,
-										  &rs_comp[i]);
+	if (!pgres || PQresultStatus(pgres) != PGRES_COPY_OUT)
+	{
+		PQclear(pgres);
+
+		while ((pgres = PQgetResult(pep->pgconn)))
+			PQclear(pgres);
+
+		elog(ERROR2,
+			 emsg("Postgres did not start a COPY OUT for the bulk fetch of "
+				  "the query [%s]",
+				  vh_str_buffer(pep->beep->pstmtshd->command)));
+	}
+
+	PQclear(pgres);
+
+	vh_stopwatch_start(&sw);
 
-			first = false;
+	pgres_ep_htc_begin(pep);
+	pgres_ep_htc_batch(pep);
+	pep->ncols = pep->beep->pstmt->qrp_nfields;
 
+	VH_TRY();
+	{
+		/*
+		 * libpq hands back one row per PQgetCopyData call, the file header
+		 * arrives with the first one.
+		 */
+		while ((len = PQgetCopyData(pep->pgconn, &buffer, 0)) > 0)
+		{
+			if (more)
+				more = pgres_ep_copyout_rows(pep, buffer, len, &header);
+
+			PQfreemem(buffer);
+			buffer = 0;
 		}
 
-		pep->beep->htc_info->nrows++;
+		if (len == -2)
+			elog(ERROR2,
+				 emsg("Postgres COPY OUT failed for the query [%s]: %s",
+					  vh_str_buffer(pep->beep->pstmtshd->command),
+					  PQerrorMessage(pep->pgconn)));
 
-		if (!ncols)
+		while ((pgres = PQgetResult(pep->pgconn)))
 		{
-			ncols = PQnfields(pgres);
-			assert(ncols == pep->beep->pstmt->qrp_nfields);
+			pgres_ep_checkerror(pep, pgres, false);
+			PQclear(pgres);
 		}
+	}
+	VH_CATCH();
+	{
+		/*
+		 * Drain what's left of the stream so the connection can go back to
+		 * the ConnectionCatalog.
+		 */
+		if (buffer)
+			PQfreemem(buffer);
+
+		while (PQgetCopyData(pep->pgconn, &buffer, 0) > 0)
+			PQfreemem(buffer);
+
+		while ((pgres = PQgetResult(pep->pgconn)))
+			PQclear(pgres);
 
 		/*
-		 * Loop thru all of the query columns, grabbing their values from
-		 * the database results.
+		 * Don't let pgres_ep_htc_end hand a partial result set back as if
+		 * it were complete.
 		 */
+		vh_rethrow();
+	}
+	VH_ENDTRY();
+
+	pgres_ep_htc_end(pep);
+
+	vh_stopwatch_end(&sw);
+	pep->beep->stat_htform += vh_stopwatch_ms(&sw);
+}
+
+/*
+ * pgres_ep_copyout_rows
+ *
+ * Forms a HeapTuple from every row in |buffer|.  Returns false once the
+ * trailer has been seen.
+ */
+static bool
+pgres_ep_copyout_rows(PgresExecPortal pep, const char *buffer, int32_t len,
+					  bool *header)
+{
+	const char *cursor = buffer, *end = buffer + len;
+	HeapTuplePtr *rs_transfer, *rs_comp_htp, htp;
+	HeapTuple ht, *rs_comp;
+	QrpFieldProjection qrpf;
+	QrpBackEndProjection qrpb;
+	TableField tf;
+	int32_t j, ntables, ncols, flen, ext;
+	int16_t tcols;
+	int8_t td_i;
+
+	if (*header)
+	{
+		if (len < 19 || memcmp(cursor, &pgres_copyin_signature[0], 11))
+			elog(ERROR2,
+				 emsg("Postgres sent an invalid binary COPY header"));
+
+		memcpy(&ext, cursor + 15, sizeof(int32_t));
+		cursor += 19 + __bswap_32(ext);
+		*header = false;
+	}
+
+	qrpf = pep->qrp_field;
+	qrpb = pep->qrp_be;
+	ntables = pep->qrp_ntables;
+	ncols = pep->ncols;
+
+	rs_transfer = pep->rs_transfer;
+	rs_comp = pep->rs_comp;
+	rs_comp_htp = pep->rs_htp;
+
+	while (end - cursor >= (int32_t)sizeof(int16_t))
+	{
+		memcpy(&tcols, cursor, sizeof(int16_t));
+		tcols = __bswap_16(tcols);
+		cursor += sizeof(int16_t);
+
+		if (tcols == -1)
+			return false;
+
+		if (tcols != ncols)
+			elog(ERROR2,
+				 emsg("Postgres COPY OUT sent a row with %d columns, %d "
+					  "columns were expected",
+					  tcols,
+					  ncols));
+
 		for (j = 0; j < ncols; j++)
 		{
-			/* 
-			 * Derived from the Query Result Projection using the
-			 * current column:
-			 * td - TableDef
-			 * tf - TableField
-			 * ty - Type
-			 */
+			if (end - cursor < (int32_t)sizeof(int32_t))
+				elog(ERROR2,
+					 emsg("Postgres COPY OUT row was truncated"));
+
+			memcpy(&flen, cursor, sizeof(int32_t));
+			flen = __bswap_32(flen);
+			cursor += sizeof(int32_t);
+
 			td_i = qrpf[j].td_idx;
-			tdv = qrpt[td_i].rtdv;
 			tf = (TableField)qrpf[j].hf;
 
 			ht = rs_comp[td_i];
 
 			if (!ht)
 			{
-				htp = vh_hb_allocht(vh_hb(pep->beep->htc_info->hbno),
-									(HeapTupleDef)tdv,
-									&ht);
+				htp = vh_hb_batch_next(&pep->rs_batch[td_i], &ht);
+				assert(ht->htd == (HeapTupleDef)pep->qrp_table[td_i].rtdv);
+
 				rs_comp[td_i] = ht;
-				rs_htp[td_i] = htp;
+				rs_comp_htp[td_i] = htp;
 			}
-			
-			if (PQgetisnull(pgres, 0, j))
-				vh_htf_setnull(ht, tf);
-			else
-			{
-				vh_htf_clearnull(ht, tf);
 
-				/*
-				 * Do what we came here to do, fill a HeapTuple with data from
-				 * the back end.  We call vh_tam_fireu_bin_set which takes the
-				 * Type stack for the given field and the TamSetUnion.  We
-				 * assume tam_types and tam_funcs were built by QRP which
-				 * pretty much guarantees our result set column order will 
-				 * match the type order and indexing.
-				 */
-				vh_tam_fireu_bin_set(qrpf[j].tys, qrpb[j].tam_func,
-									 &InboundBinaryOptions,
-									 PQgetvalue(pgres, 0, j),
-									 vh_ht_field(ht, tf),
-									 PQgetlength(pgres, 0, j),
-									 0);
+			if (flen < 0)
+			{
+				vh_htf_setnull(ht, tf);
+				continue;
 			}
-		}
 
+			if (end - cursor < flen)
+				elog(ERROR2,
+					 emsg("Postgres COPY OUT row was truncated"));
 
-		/*
-		 * Call the HTC, checking to see if we need to re-point the local
-		 * copy of pointer to the HTC.  The HTC makes no guarantees the function
-		 * pointer will remain the same when cycling (i.e. it may detect memory
-		 * pressure and flush the results to disk).
-		 */
+			vh_htf_clearnull(ht, tf);
+			vh_tam_fireu_bin_set(qrpf[j].tys, qrpb[j].tam_func,
+								 &InboundBinaryOptions,
+								 cursor,
+								 vh_ht_field(ht, tf),
+								 flen,
+								 0);
+
+			cursor += flen;
+		}
+
+		pep->beep->htc_info->nrows++;
+		pep->htc(pep->beep->htc_info, rs_comp, rs_comp_htp);
 
-		htc(pep->beep->htc_info, rs_comp, rs_htp);
-		
 		for (j = 0; j < ntables; j++)
 		{
-			rs_transfer[j] = rs_htp[j];
+			rs_transfer[j] = rs_comp_htp[j];
 			rs_comp[j] = 0;
 		}
-
-		PQclear(pgres);
 	}
-	
-	vh_stopwatch_end(&sw);
-	pep->beep->stat_htform += vh_stopwatch_ms(&sw);
-	pep->beep->stat_wait_count += be_wait_count;
+
+	return true;
 }
 
 /*
  * Postgres Bulk Copy interface
  *
  * http://www.postgresql.org/docs/9.6/static/sql-copy.html
+ *
+ * The COPY has already been started by the caller.  We always finish it
+ * here: PQputCopyEnd on success, or with an error message when the wire
+ * failed or the tuples couldn't be encoded, so the server aborts the COPY.
+ * Either way the caller picks up the outcome from PQgetResult.
  */
 static void 
 pgres_ep_copytuples(TableDef td, SList htps, PGconn *conn)
 {
-	const size_t buffersz = 1024 * 1000;
+	struct PgresCopyInWriterData w = { };
+	unsigned char *buffer;
+	TableDefVer tdv;
+	TamUnion **tam_funcs;
+	int32_t pqend_err;
+
+	w.conn = conn;
+	buffer = vhmalloc(PGRES_COPYIN_CHUNK_SZ);
+
+	/*
+	 * Let's get the Type Access Method arrays setup for the given HeapTupleDef.
+	 */
+	tdv = vh_td_tdv_lead(td);
+	tam_funcs = vh_tam_htd_create(0, TAM_Binary, &tdv->heap, &vh_be_pgres, 0, true);
+	assert(tam_funcs);
+
+	if (PQsetnonblocking(conn, 1))
+		w.failed = true;
+
+	VH_TRY();
+	{
+		if (!w.failed)
+			pgres_ep_copyin_rows(&w, tdv, tam_funcs, htps,
+								 buffer, PGRES_COPYIN_CHUNK_SZ);
+	}
+	VH_CATCH();
+	{
+		w.failed = true;
+	}
+	VH_ENDTRY();
+
+	vhfree(tam_funcs);
+
+	if (!w.failed && !pgres_ep_copyin_drain(&w))
+		w.failed = true;
+
+	/*
+	 * Go back to blocking mode before ending the COPY, PQputCopyEnd will
+	 * then flush the CopyDone message for us and the rest of the executor
+	 * expects a blocking connection.  libpq refuses the switch while output
+	 * is still queued, which can happen when we bailed out mid chunk, so
+	 * keep flushing until it takes.  A failed wait means the socket is
+	 * gone; the connection can't be handed back as if it were usable.
+	 */
+	while (PQsetnonblocking(conn, 0))
+	{
+		if (!pgres_ep_copyin_wait(&w))
+		{
+			vhfree(buffer);
+
+			elog(ERROR2,
+				 emsg("Bulk Insert could not return the connection to "
+					  "blocking mode, the connection is unusable\n%s",
+					  PQerrorMessage(conn)));
+
+			return;
+		}
+
+		PQflush(conn);
+	}
+
+	if (w.failed)
+	{
+		elog(WARNING,
+			 emsg("Bulk Insert aborted after %ld chunks\n%s",
+				  w.chunks, PQerrorMessage(conn)));
+
+		PQputCopyEnd(conn, "vh bulk insert aborted");
+	}
+	else
+	{
+		pqend_err = PQputCopyEnd(conn, 0);
+
+		if (pqend_err == -1)
+			elog(ERROR2,
+				 emsg("Bulk Insert wire transmission error\n%s",
+					  PQerrorMessage(conn)));
+
+		elog(DEBUG2,
+			 emsg("Bulk Insert sent %ld chunks, waited on the socket %ld times",
+				  w.chunks, w.stalls));
+	}
+
+	vhfree(buffer);
+}
+
+/*
+ * pgres_ep_copyin_rows
+ *
+ * Encodes |htps| in the binary COPY format, shipping |buffer| each time it
+ * fills.  Stops early once the writer has failed.
+ */
+static void
+pgres_ep_copyin_rows(PgresCopyInWriter w, TableDefVer tdv,
+					 TamUnion **tam_funcs, SList htps,
+					 unsigned char *buffer, size_t buffersz)
+{
 	size_t hf_len, hf_cursor;
-	unsigned char *buffer, *cursor, *bufferend;
+	unsigned char *cursor, *bufferend;
 	TableField *tf_head, tf;
-	TableDefVer tdv;
 	HeapTuplePtr *htp_head;
 	HeapTuple ht;
 	uint32_t tf_sz, htp_sz, i, j;
-	int32_t *n_32, pqend_err;
+	int32_t *n_32;
 	struct PgresCopyInTupleHeader *cpi_tup;
 	struct PgresCopyInField *cpi_field;
 	Type **tam_types;
-	TamUnion **tam_funcs;
 
-	buffer = vhmalloc(buffersz);
 	bufferend = buffer + buffersz;
 	cursor = buffer;
 
-	/*
-	 * Let's get the Type Access Method arrays setup for the given HeapTupleDef.
-	 */
-
-	tdv = vh_td_tdv_lead(td);
 	tam_types = vh_htd_type_stack(&tdv->heap);
-	tam_funcs = vh_tam_htd_create(0, TAM_Binary, &tdv->heap, &vh_be_pgres, 0, true);
-
 	assert(tam_types);
-	assert(tam_funcs);
 
 
 	/*
@@ -1051,9 +2023,12 @@ pgres_ep_copytuples(TableDef td, SList htps, PGconn *conn)
 	htp_sz = vh_SListIterator(htps, htp_head);
 	tf_sz = vh_SListIterator(tdv->heap.fields, tf_head);
 
-	for (i = 0; i < htp_sz; i++)
+	for (i = 0; i < htp_sz && !w->failed; i++)
 	{
-		ht = vh_htp(htp_head[i]);
+		if (i % PGRES_COPYIN_PUMP_ROWS == 0)
+			pgres_ep_copyin_pump(w);
+
+		ht = vh_htp_read(htp_head[i]);
 
 		if (ht)
 		{
@@ -1065,7 +2040,7 @@ pgres_ep_copytuples(TableDef td, SList htps, PGconn *conn)
 			if (bufferend - cursor <
 				sizeof(struct PgresCopyInTupleHeader))
 			{
-				pgres_ep_sendbuffer(conn, buffer, cursor - buffer);
+				pgres_ep_sendbuffer(w, buffer, cursor - buffer);
 				cursor = buffer;
 			}
 
@@ -1087,7 +2062,7 @@ pgres_ep_copytuples(TableDef td, SList htps, PGconn *conn)
 				{
 					if (bufferend - cursor < sizeof(struct PgresCopyInField))
 					{
-						pgres_ep_sendbuffer(conn, buffer, cursor - buffer);
+						pgres_ep_sendbuffer(w, buffer, cursor - buffer);
 						cursor = buffer;
 					}
 
@@ -1109,7 +2084,7 @@ pgres_ep_copytuples(TableDef td, SList htps, PGconn *conn)
 
 				if ((bufferend - cursor) < sizeof(struct PgresCopyInField) + 32)
 				{
-					pgres_ep_sendbuffer(conn, buffer, cursor - buffer);
+					pgres_ep_sendbuffer(w, buffer, cursor - buffer);
 					cursor = buffer;
 				}
 
@@ -1175,7 +2150,7 @@ pgres_ep_copytuples(TableDef td, SList htps, PGconn *conn)
 
 					while (hf_len > hf_cursor)
 					{
-						pgres_ep_sendbuffer(conn, buffer, cursor - buffer); 
+						pgres_ep_sendbuffer(w, buffer, cursor - buffer); 
 						cursor = buffer;
 
 						hf_len = bufferend - cursor;
@@ -1199,7 +2174,7 @@ pgres_ep_copytuples(TableDef td, SList htps, PGconn *conn)
 
 	if (bufferend - cursor < sizeof(struct PgresCopyInTupleHeader))
 	{
-		pgres_ep_sendbuffer(conn, buffer, cursor - buffer);
+		pgres_ep_sendbuffer(w, buffer, cursor - buffer);
 		cursor = buffer;
 	}
 
@@ -1207,35 +2182,133 @@ pgres_ep_copytuples(TableDef td, SList htps, PGconn *conn)
 	cpi_tup->ncols = __bswap_16(-1);
 	cursor = (unsigned char*)(cpi_tup + 1);
 
-	pgres_ep_sendbuffer(conn, buffer, cursor - buffer);
+	pgres_ep_sendbuffer(w, buffer, cursor - buffer);
+}
 
-	pqend_err = PQputCopyEnd(conn, 0);
+/*
+ * pgres_ep_sendbuffer
+ *
+ * Hands a full chunk to libpq.  The previous chunk has to be out of libpq's
+ * output buffer first, that's our backpressure: we never queue more than one
+ * chunk ahead of the socket.  PQputCopyData copies the chunk, so the caller
+ * may start encoding the next one into the same buffer as soon as we return.
+ *
+ * http://www.postgresql.org/docs/9.6/static/libpq-copy.html
+ */
+static void
+pgres_ep_sendbuffer(PgresCopyInWriter w, void *buffer, size_t bytes)
+{
+	int32_t result;
 
-	if (pqend_err == -1)
-		elog(ERROR2,
-			 emsg("Bulk Insert wire transmission error\n%s",
-				  PQerrorMessage(conn)));
+	if (w->failed || !bytes)
+		return;
 
-	vhfree(buffer);
-	vhfree(tam_funcs);
+	if (!pgres_ep_copyin_drain(w))
+		return;
+
+	/*
+	 * In non-blocking mode PQputCopyData returns zero when libpq couldn't
+	 * make room for the data; wait for the socket and try again.
+	 */
+	while (!(result = PQputCopyData(w->conn, buffer, bytes)))
+	{
+		if (!pgres_ep_copyin_wait(w))
+			return;
+	}
+
+	if (result < 0)
+	{
+		w->failed = true;
+		return;
+	}
+
+	w->chunks++;
+	w->pending = true;
+
+	pgres_ep_copyin_pump(w);
 }
 
 /*
- * Performs PQputCopyData and handles an errors that may be returned.  libpq
- * introduces a wait semantic for PQputCopyData and we'll also handle this.
+ * pgres_ep_copyin_pump
  *
- * http://www.postgresql.org/docs/9.6/static/libpq-copy.html
+ * Pushes whatever the socket will take from libpq's output buffer without
+ * waiting.  Called between rows while the next chunk is being encoded.
  */
 static void
-pgres_ep_sendbuffer(PGconn *conn, void *buffer, size_t bytes)
+pgres_ep_copyin_pump(PgresCopyInWriter w)
 {
 	int32_t result;
 
-	result = PQputCopyData(conn, buffer, bytes);
+	if (!w->pending || w->failed)
+		return;
+
+	result = PQflush(w->conn);
+
+	if (result < 0)
+		w->failed = true;
+	else
+		w->pending = result;
+}
+
+/*
+ * pgres_ep_copyin_drain
+ *
+ * Waits for libpq's output buffer to empty.
+ */
+static bool
+pgres_ep_copyin_drain(PgresCopyInWriter w)
+{
+	pgres_ep_copyin_pump(w);
+
+	while (w->pending && !w->failed)
+	{
+		if (!pgres_ep_copyin_wait(w))
+			break;
 
-	if (result)
+		pgres_ep_copyin_pump(w);
+	}
+
+	return !w->failed;
+}
+
+/*
+ * pgres_ep_copyin_wait
+ *
+ * Blocks until the socket is writable.  libpq asks that we also consume any
+ * input while we wait, the server may send a NOTICE or an error mid COPY and
+ * stop reading until we do.  An error ends the COPY IN state on the
+ * connection, so the next PQputCopyData or PQflush reports it.
+ */
+static bool
+pgres_ep_copyin_wait(PgresCopyInWriter w)
+{
+	struct pollfd pfd = { };
+	int32_t ret;
+
+	pfd.fd = PQsocket(w->conn);
+	pfd.events = POLLOUT | POLLIN;
+
+	if (pfd.fd < 0)
+	{
+		w->failed = true;
+		return false;
+	}
+
+	w->stalls++;
+
+	do
 	{
+		ret = poll(&pfd, 1, -1);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0 ||
+		((pfd.revents & POLLIN) && !PQconsumeInput(w->conn)))
+	{
+		w->failed = true;
+		return false;
 	}
+
+	return true;
 }
 
 static int pgres_ep_htc_rp_cb(PGresult *res, const PGdataValue *cols,
@@ -1246,10 +2319,8 @@ static int pgres_ep_htc_rp_cb(PGresult *res, const PGdataValue *cols,
 	HeapTuple ht, *rs_comp;
 	int32_t j, ntables;
 	int8_t td_i;
-	TableDefVer tdv;
 	TableField tf;
 	vh_be_htc htc;
-	QrpTableProjection qrpt;
 	QrpFieldProjection qrpf;
 	QrpBackEndProjection qrpb;
 
@@ -1260,7 +2331,6 @@ static int pgres_ep_htc_rp_cb(PGresult *res, const PGdataValue *cols,
 	}
 
 	htc = pep->htc;
-	qrpt = pep->qrp_table;;
 	qrpf = pep->qrp_field;
 	qrpb = pep->qrp_be;
 	ntables = pep->qrp_ntables;
@@ -1283,16 +2353,15 @@ static int pgres_ep_htc_rp_cb(PGresult *res, const PGdataValue *cols,
 		 * ty - Type
 		 */
 		td_i = qrpf[j].td_idx;
-		tdv = qrpt[td_i].rtdv;
 		tf = (TableField)qrpf[j].hf;
 
 		ht = rs_comp[td_i];
 
 		if (!ht)
 		{
-			htp = vh_hb_allocht(vh_hb(pep->beep->htc_info->hbno),
-								(HeapTupleDef)tdv,
-								&ht);
+			htp = vh_hb_batch_next(&pep->rs_batch[td_i], &ht);
+			assert(ht->htd == (HeapTupleDef)pep->qrp_table[td_i].rtdv);
+
 			rs_comp[td_i] = ht;
 			rs_htp[td_i] = htp;
 		}
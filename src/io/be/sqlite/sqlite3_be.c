@@ -24,8 +24,10 @@
 #include "io/nodes/NodeField.h"
 #include "io/nodes/NodeFrom.h"
 #include "io/nodes/NodeQueryInsert.h"
+#include "io/nodes/NodeQueryUpdate.h"
 #include "io/plan/pstmt_funcs.h"
 #include "io/sql/InfoScheme.h"
+#include "io/utils/kvmap.h"
 #include "io/utils/SList.h"
 #include "io/utils/stopwatch.h"
 
@@ -50,6 +52,7 @@ typedef struct SqliteExecPortal
 	BackEndExecPlan beep;
 	sqlite3_stmt *stmt;
 	MemoryContext mctx_work;
+	bool stmt_cached;
 } SqliteExecPortal;
 
 static void vh_sqlite_exec_portal_open(SqliteExecPortal*, BackEndExecPlan);
@@ -59,6 +62,8 @@ static void vh_sqlite_exec(BackEndExecPlan);
 static void vh_sqlite_htc(SqliteExecPortal*);
 
 static void vh_sqlite_latebind(SqliteExecPortal*);
+static void sqlite_exec_bind(SqliteExecPortal*, int32_t nparams);
+static void sqlite_exec_rows(SqliteExecPortal*, int32_t nbind);
 
 static SqlInfoSchemePackage vh_sqlite_schema_get(BackEndConnection bec,
 												 SqlInfoSchemeContext sisc);
@@ -85,6 +90,8 @@ struct QinsAddParamData
 static void qins_cmd_add_param(Node n, void *);
 static bool vh_sqlite_cmd_query(String cmd, void *node,
 								NodeSqlCmdContext ctx);
+static bool sqlite_cmd_upd_rows(String cmd, NodeQueryUpdate nq,
+								NodeSqlCmdContext ctx);
 
 static const NodeSqlCmdFuncTable sqlite_cmd_ft[] = {
 	{ Query, vh_sqlite_cmd_query },
@@ -103,17 +110,78 @@ typedef struct SqliteConnectionData
 	sqlite3 *db;
 	bool db_open;
 	bool db_inxact;
+
+	/*
+	 * Compiled statements we keep for the life of the connection: the
+	 * PlanCache statements keyed by their prepare_id and the transaction
+	 * control statements.  They're reset after each use and finalized
+	 * before the database is closed.
+	 */
+	KeyValueMap stmts;
+	sqlite3_stmt *stmt_begin;
+	sqlite3_stmt *stmt_commit;
+	sqlite3_stmt *stmt_rollback;
 } SqliteConnectionData, *SqliteConnection;
 
+/*
+ * Typed binds and column fetch
+ *
+ * SQLite keeps integers and reals in their native form, so there's no reason
+ * to format them as text for a bind or parse the text back when a row is
+ * read.  We classify the Type stack of each parameter and result column: the
+ * integer and floating point Types are bound with sqlite3_bind_int64/double
+ * and fetched with sqlite3_column_int64/double, String columns are copied
+ * straight from sqlite3_column_text/blob.  The value moves in and out of the
+ * Type with its binary TAM in host byte order.
+ *
+ * Everything else, including nested Types and a column whose storage class
+ * doesn't match the declared Type (SQLite is dynamically typed), goes through
+ * the CStr TAM like before.
+ */
+typedef enum SqliteTyClass
+{
+	VH_SQLITE_TYC_TEXT,			/* CStr TAM */
+	VH_SQLITE_TYC_INT,
+	VH_SQLITE_TYC_FLOAT,
+	VH_SQLITE_TYC_STRING
+} SqliteTyClass;
+
+typedef union SqliteTyValue
+{
+	int8_t i8;
+	int16_t i16;
+	int32_t i32;
+	int64_t i64;
+	float flt;
+	double dbl;
+} SqliteTyValue;
+
+static SqliteTyClass sqlite_ty_class(Type *tys);
+static bool sqlite_ty_get(Type ty, SqliteTyClass tyc, 
+						  const void *source, SqliteTyValue *value);
+static bool sqlite_column_typed(sqlite3_stmt *stmt, int32_t col, 
+								int32_t col_type, SqliteTyClass tyc,
+								Type ty, void *target);
+
+static bool sqlite_typed_io = true;
+
 typedef struct SqliteParameterData
 {
 	struct ParameterData p;
+	SqliteTyClass tyc;
+	SqliteTyValue val;
 } SqliteParameterData, *SqliteParameter;
 
 static struct CStrAMOptionsData sqlite3_cstr_be_opts = {
 	.malloc = false
 };
 
+static struct BinaryAMOptionData sqlite3_bin_opts = {
+	.sourceBigEndian = false,
+	.targetBigEndian = false,
+	.malloc = false
+};
+
 /*
  * We've got a few convenience functions here, mostly to call the interface
  * and do the error handling.  We want to be very verbose with errors: if the 
@@ -134,6 +202,9 @@ static sqlite3_stmt *sqlite_stmt_prepare(SqliteConnection, const char *sql_cmd,
 										 sqlite3_stmt* (*callback)(SqliteConnection, int32_t));
 static bool sqlite_step_no_rows(SqliteConnection, sqlite3_stmt*,
 								bool (*callback)(SqliteConnection, int32_t));
+static sqlite3_stmt *sqlite_stmt_keep(SqliteConnection, sqlite3_stmt **stmt,
+									  const char *sql_cmd);
+static void sqlite_stmt_cache_clear(SqliteConnection);
 
 
 
@@ -211,6 +282,12 @@ vh_be_sqlite3_register(CatalogContext ctx)
 	NATIVE_TYPE("integer", int32);
 	NATIVE_TYPE("int", int32);
 	NATIVE_TYPE("bigint", int64);
+	NATIVE_TYPE("smallint", int16);
+	NATIVE_TYPE("boolean", bool);
+	NATIVE_TYPE("real", dbl);
+	NATIVE_TYPE("double", dbl);
+	NATIVE_TYPE("float", dbl);
+	NATIVE_TYPE("blob", String);
 	NATIVE_TYPE("text", String);
 	NATIVE_TYPE("varchar", String);
 	NATIVE_TYPE("nvarchar", String);
@@ -233,6 +310,14 @@ vh_sqlite_nconn_alloc(void)
 	sconn->db = 0;
 	sconn->db_open = false;
 	sconn->db_inxact = false;
+	sconn->stmt_begin = 0;
+	sconn->stmt_commit = 0;
+	sconn->stmt_rollback = 0;
+	sconn->stmts = vh_kvmap_create_impl(sizeof(uint32_t),
+										sizeof(sqlite3_stmt*),
+										vh_htbl_hash_int32,
+										vh_htbl_comp_int32,
+										vh_mctx_from_pointer(sconn));
 
 	return &sconn->node;
 }
@@ -261,6 +346,9 @@ vh_sqlite_nconn_free(BackEndConnection nconn)
 {
 	SqliteConnection sconn = (SqliteConnection)nconn;
 
+	if (sconn->stmts)
+		vh_kvmap_destroy(sconn->stmts);
+
 	vhfree(sconn);
 }
 
@@ -293,6 +381,7 @@ vh_sqlite_nconn_disconnect(BackEndConnection nconn)
 		return false;
 	}
 
+	sqlite_stmt_cache_clear(sconn);
 	rc = sqlite3_close(sconn->db);
 
 	if (rc == SQLITE_OK)
@@ -333,7 +422,7 @@ vh_sqlite_xact_begin(BackEndConnection nconn)
 		return false;
 	}
 
-	stmt = sqlite_stmt_prepare(sconn, begin_xact, 0);
+	stmt = sqlite_stmt_keep(sconn, &sconn->stmt_begin, begin_xact);
 
 	if (!stmt)
 		return false;
@@ -341,7 +430,7 @@ vh_sqlite_xact_begin(BackEndConnection nconn)
 	xact_started = sqlite_step_no_rows(sconn, stmt, 0);
 	sconn->db_inxact = xact_started;
 
-	sqlite_stmt_finalize(sconn, stmt, 0);
+	sqlite3_reset(stmt);
 
 	return xact_started;
 }
@@ -366,7 +455,7 @@ vh_sqlite_xact_commit(BackEndConnection nconn)
 		return false;
 	}
 
-	stmt = sqlite_stmt_prepare(sconn, commit_xact, 0);
+	stmt = sqlite_stmt_keep(sconn, &sconn->stmt_commit, commit_xact);
 
 	if (!stmt)
 		return false;
@@ -374,7 +463,7 @@ vh_sqlite_xact_commit(BackEndConnection nconn)
 	xact_committed = sqlite_step_no_rows(sconn, stmt, 0);
 	sconn->db_inxact = !xact_committed;
 
-	sqlite_stmt_finalize(sconn, stmt, 0);
+	sqlite3_reset(stmt);
 
 	return xact_committed;
 }
@@ -398,7 +487,7 @@ vh_sqlite_xact_rollback(BackEndConnection nconn)
 		return false;
 	}
 
-	stmt = sqlite_stmt_prepare(sconn, rollback_xact, 0);
+	stmt = sqlite_stmt_keep(sconn, &sconn->stmt_rollback, rollback_xact);
 
 	if (!stmt)
 		return false;
@@ -406,7 +495,7 @@ vh_sqlite_xact_rollback(BackEndConnection nconn)
 	xact_rolled = sqlite_step_no_rows(sconn, stmt, 0);
 	sconn->db_inxact = !xact_rolled;
 
-	sqlite_stmt_finalize(sconn, stmt, 0);
+	sqlite3_reset(stmt);
 
 	return xact_rolled;
 }
@@ -503,6 +592,7 @@ vh_sqlite_parameter(ParameterList pl,
 	mctx_old = vh_param_switchmctx(pl);
 
 	p = vh_param_create(pl, sizeof(struct SqliteParameterData));
+	p->tyc = VH_SQLITE_TYC_TEXT;
 
 	if (fnull)
 	{
@@ -511,15 +601,34 @@ vh_sqlite_parameter(ParameterList pl,
 	else
 	{
 		p->p.null = false;
-		p->p.value = vh_tam_fireu_cstr_get(tys, 				/* Type stack */
-	  									   tam, 				/* Functions */
-	  									   &cstr_opts,		 	/* Options */
-		  								   data, 				/* Source field */
-	  									   0, 					/* Target */
-	  									   &tam_param_size,		/* Size pointer */
-	  									   0,					/* Cursor pointer */
-	  									   tam_formatters); 	/* Formatters */
-		p->p.size = (int32_t)tam_param_size;
+
+		if (sqlite_typed_io)
+			p->tyc = sqlite_ty_class(tys);
+
+		/*
+		 * Strings are bound as text either way, there's nothing to gain by
+		 * skipping the CStr TAM for them.
+		 */
+		if ((p->tyc == VH_SQLITE_TYC_INT || p->tyc == VH_SQLITE_TYC_FLOAT) &&
+			sqlite_ty_get(tys[0], p->tyc, data, &p->val))
+		{
+			p->p.value = &p->val;
+			p->p.size = p->tyc == VH_SQLITE_TYC_INT ? sizeof(int64_t) : 
+													  sizeof(double);
+		}
+		else
+		{
+			p->tyc = VH_SQLITE_TYC_TEXT;
+			p->p.value = vh_tam_fireu_cstr_get(tys, 				/* Type stack */
+		  									   tam, 				/* Functions */
+		  									   &cstr_opts,		 	/* Options */
+			  								   data, 				/* Source field */
+		  									   0, 					/* Target */
+		  									   &tam_param_size,		/* Size pointer */
+		  									   0,					/* Cursor pointer */
+		  									   tam_formatters); 	/* Formatters */
+			p->p.size = (int32_t)tam_param_size;
+		}
 	}
 
 	vh_mctx_switch(mctx_old);
@@ -531,60 +640,171 @@ static void vh_sqlite_exec(BackEndExecPlan beep)
 {
 	SqliteExecPortal sep = { };
 	SqliteConnection sc = (SqliteConnection)beep->pstmtshd->nconn;
-	SqliteParameter sp;
-	int i, bind_error;
+	sqlite3_stmt **stmt_cached;
+	uint32_t prepare_id = beep->pstmtshd->prepare_id;
+	int32_t nbind;
 
 	vh_sqlite_exec_portal_open(&sep, beep);
 
 	VH_TRY();
 	{
-		sep.stmt = vh_sqlite_stmt_prepare(sc, vh_str_buffer(beep->pstmtshd->command), 0);
+		/*
+		 * PlanCache statements are compiled once per connection and reset
+		 * after every run.
+		 */
+		if (prepare_id && sc->stmts)
+		{
+			if (!vh_kvmap_value(sc->stmts, &prepare_id, stmt_cached))
+			{
+				*stmt_cached = 0;
+				*stmt_cached = vh_sqlite_stmt_prepare(sc,
+													  vh_str_buffer(beep->pstmtshd->command),
+													  0);
+			}
 
-		if (beep->pstmtshd->paramcount)
+			sep.stmt = *stmt_cached;
+			sep.stmt_cached = true;
+		}
+		else
 		{
-			i = 0;
+			sep.stmt = vh_sqlite_stmt_prepare(sc, vh_str_buffer(beep->pstmtshd->command), 0);
+		}
+
+		nbind = sqlite3_bind_parameter_count(sep.stmt);
+
+		if (beep->pstmtshd->paramcount)
 			vh_param_it_init(beep->pstmtshd->parameters);
 
-			while ((sp = vh_param_it_next(beep->pstmtshd->parameters)))
+		if (nbind && beep->pstmtshd->paramcount > nbind)
+		{
+			/*
+			 * The command holds a single row and the parameters for every
+			 * row were pushed (see sqlite_cmd_upd_rows).
+			 */
+			sqlite_exec_rows(&sep, nbind);
+		}
+		else
+		{
+			sqlite_exec_bind(&sep, beep->pstmtshd->paramcount);
+
+			if (vh_pstmt_is_lb(beep->pstmt))
 			{
-				if (sp->p.null)
-					bind_error = sqlite3_bind_null(sep.stmt, ++i);
-				else
-					bind_error = sqlite3_bind_text(sep.stmt, 
-												   ++i, 
-												   sp->p.value, 
-												   sp->p.size, 
-												   0);
-
-				if (bind_error != SQLITE_OK)
-					elog(WARNING,
-						 emsg("Error binding parameter %d, Sqlite return %d",
-							  i,
-							  bind_error));
+				vh_sqlite_latebind(&sep);
 			}
 
-			assert(i == beep->pstmtshd->paramcount);
+			vh_sqlite_htc(&sep);
 		}
 
-		if (vh_pstmt_is_lb(beep->pstmt))
+		if (sep.stmt_cached)
 		{
-			vh_sqlite_latebind(&sep);
+			sqlite3_reset(sep.stmt);
+			sqlite3_clear_bindings(sep.stmt);
+		}
+		else
+		{
+			sqlite3_finalize(sep.stmt);
 		}
-
-		vh_sqlite_htc(&sep);
-
-		sqlite3_finalize(sep.stmt);
 	}
 	VH_CATCH();
 	{
-		if (sep.stmt)
+		if (sep.stmt && sep.stmt_cached)
+		{
+			sqlite3_reset(sep.stmt);
+			sqlite3_clear_bindings(sep.stmt);
+		}
+		else if (sep.stmt)
+		{
 			sqlite3_finalize(sep.stmt);
+		}
+		else if (prepare_id && sc->stmts)
+		{
+			/*
+			 * The statement didn't compile, don't leave an empty slot
+			 * behind for the next run to trip over.
+			 */
+			vh_kvmap_remove(sc->stmts, &prepare_id);
+		}
 	}
 	VH_ENDTRY();
 
 	vh_sqlite_exec_portal_close(&sep);
 }
 
+/*
+ * sqlite_exec_bind
+ *
+ * Binds the next |nparams| from the ParameterList iterator to the statement.
+ */
+static void
+sqlite_exec_bind(SqliteExecPortal *sep, int32_t nparams)
+{
+	SqliteParameter sp;
+	int32_t i = 0, bind_error;
+
+	while (i < nparams &&
+		   (sp = vh_param_it_next(sep->beep->pstmtshd->parameters)))
+	{
+		if (sp->p.null)
+			bind_error = sqlite3_bind_null(sep->stmt, ++i);
+		else if (sp->tyc == VH_SQLITE_TYC_INT)
+			bind_error = sqlite3_bind_int64(sep->stmt, ++i, sp->val.i64);
+		else if (sp->tyc == VH_SQLITE_TYC_FLOAT)
+			bind_error = sqlite3_bind_double(sep->stmt, ++i, sp->val.dbl);
+		else
+			bind_error = sqlite3_bind_text(sep->stmt, 
+										   ++i, 
+										   sp->p.value, 
+										   sp->p.size, 
+										   0);
+
+		if (bind_error != SQLITE_OK)
+			elog(WARNING,
+				 emsg("Error binding parameter %d, Sqlite return %d",
+					  i,
+					  bind_error));
+	}
+
+	assert(i == nparams);
+}
+
+/*
+ * sqlite_exec_rows
+ *
+ * Runs the statement once for every |nbind| parameters in the list.  The
+ * statement must not return rows.
+ */
+static void
+sqlite_exec_rows(SqliteExecPortal *sep, int32_t nbind)
+{
+	SqliteConnection sc = (SqliteConnection)sep->beep->pstmtshd->nconn;
+	int32_t nruns, i, rc;
+
+	if (sep->beep->pstmtshd->paramcount % nbind)
+		elog(ERROR2,
+			 emsg("Sqlite3 statement [%s] takes %d parameters, unable to run "
+				  "it for %d parameters",
+				  vh_str_buffer(sep->beep->pstmtshd->command),
+				  nbind,
+				  sep->beep->pstmtshd->paramcount));
+
+	nruns = sep->beep->pstmtshd->paramcount / nbind;
+
+	for (i = 0; i < nruns; i++)
+	{
+		sqlite_exec_bind(sep, nbind);
+		rc = sqlite3_step(sep->stmt);
+
+		if (rc != SQLITE_DONE)
+			elog(ERROR2,
+				 emsg("Sqlite3 statement [%s] failed on row set %d: %s",
+					  vh_str_buffer(sep->beep->pstmtshd->command),
+					  i,
+					  sqlite3_errmsg(sc->db)));
+
+		sqlite3_reset(sep->stmt);
+	}
+}
+
 static void 
 vh_sqlite_exec_portal_open(SqliteExecPortal *sep, BackEndExecPlan beep)
 {
@@ -604,6 +824,7 @@ static void vh_sqlite_htc(SqliteExecPortal* sep)
 {
 	HeapTuplePtr *rs_transfer, *rs_htp, htp;
 	HeapTuple ht, *rs_comp;
+	HeapBufferBatch rs_batch;
 	int32_t i, ncols = 0, rtups = 0, step_res, col_type, col_len;
 	vh_be_htc htc;
 	struct vh_stopwatch sw;
@@ -611,12 +832,12 @@ static void vh_sqlite_htc(SqliteExecPortal* sep)
 	QrpTableProjection qrpt;
 	QrpFieldProjection qrpf;
 	QrpBackEndProjection qrpb;
-	TableDefVer tdv;
 	TableField tf;
 	int8_t td_idx;
 	void **tam_formatters;
 	union TamSetUnion *tam_func;
 	Type *tam_type;
+	SqliteTyClass *col_tyc;
 
 	vh_stopwatch_start(&sw);
 	htc = sep->beep->htc_info->htc_cb;
@@ -640,12 +861,26 @@ static void vh_sqlite_htc(SqliteExecPortal* sep)
 	rs_comp = (HeapTuple*)rs_transfer + rtups;
 	rs_htp = (HeapTuplePtr*)rs_comp + rtups;
 
-	memset(rs_transfer, 0, sizeof(HeapTuple) * rtups);
+	memset(rs_transfer, 0, sizeof(HeapTuple) * rtups * 3);
+
+	/*
+	 * Form the HeapTuple for each table in batches rather than one row at a
+	 * time, see vh_hb_allocht_n.
+	 */
+	rs_batch = vhmalloc_ctx(sep->mctx_work, sizeof(HeapBufferBatchData) * rtups);
 
 	for (i = 0; i < rtups; i++)
-		rs_htp[i] = vh_hb_allocht(vh_hb(sep->beep->htc_info->hbno),
-								  (HeapTupleDef)qrpt[i].rtdv,
-								  &rs_comp[i]);
+		vh_hb_batch_init(&rs_batch[i],
+						 vh_hb(sep->beep->htc_info->hbno),
+						 (HeapTupleDef)qrpt[i].rtdv,
+						 0,
+						 sep->mctx_work);
+
+	col_tyc = vhmalloc_ctx(sep->mctx_work, sizeof(SqliteTyClass) * (ncols + 1));
+
+	for (i = 0; i < ncols; i++)
+		col_tyc[i] = sqlite_typed_io ? sqlite_ty_class(qrpf[i].tys) : 
+									   VH_SQLITE_TYC_TEXT;
 
 	do
 	{
@@ -666,7 +901,6 @@ static void vh_sqlite_htc(SqliteExecPortal* sep)
 		{
 			td_idx = qrpf[i].td_idx;
 			tf = (TableField)qrpf[i].hf;
-			tdv = qrpt[td_idx].rtdv;
 
 			tam_type = qrpf[i].tys;
 			tam_formatters = qrpb[i].tam_formatters;
@@ -676,9 +910,9 @@ static void vh_sqlite_htc(SqliteExecPortal* sep)
 
 			if (!ht)
 			{
-				htp = vh_hb_allocht(vh_hb(sep->beep->htc_info->hbno),
-									(HeapTupleDef)tdv,
-									&ht);
+				htp = vh_hb_batch_next(&rs_batch[td_idx], &ht);
+				assert(ht->htd == (HeapTupleDef)qrpt[td_idx].rtdv);
+
 				rs_comp[td_idx] = ht;
 				rs_htp[td_idx] = htp;
 			}
@@ -693,6 +927,12 @@ static void vh_sqlite_htc(SqliteExecPortal* sep)
 			{
 				vh_htf_setnull(ht, tf);
 			}
+			else if (col_tyc[i] != VH_SQLITE_TYC_TEXT &&
+					 sqlite_column_typed(sep->stmt, i, col_type, col_tyc[i],
+										 tam_type[0], vh_ht_field(ht, tf)))
+			{
+				vh_htf_clearnull(ht, tf);
+			}
 			else
 			{	
 				col_len = sqlite3_column_bytes(sep->stmt, i);
@@ -723,10 +963,221 @@ static void vh_sqlite_htc(SqliteExecPortal* sep)
 
 	} while (1);
 
+	for (i = 0; i < rtups; i++)
+		vh_hb_batch_release(&rs_batch[i]);
+
 	vh_stopwatch_end(&sw);
 	sep->beep->stat_htform += vh_stopwatch_ms(&sw);
 }
 
+/*
+ * sqlite_ty_class
+ *
+ * Picks the typed path for a Type stack.  Only flat stacks qualify, an Array
+ * or Range always goes thru the CStr TAM.
+ */
+static SqliteTyClass
+sqlite_ty_class(Type *tys)
+{
+	Type ty = tys[0];
+
+	if (!ty || tys[1] || !ty->tam.bin_get || !ty->tam.bin_set)
+		return VH_SQLITE_TYC_TEXT;
+
+	if (ty == &vh_type_int8 || ty == &vh_type_int16 ||
+		ty == &vh_type_int32 || ty == &vh_type_int64 ||
+		ty == &vh_type_bool)
+		return VH_SQLITE_TYC_INT;
+
+	if (ty == &vh_type_dbl || ty == &vh_type_float)
+		return VH_SQLITE_TYC_FLOAT;
+
+	if (ty == &vh_type_String)
+		return VH_SQLITE_TYC_STRING;
+
+	return VH_SQLITE_TYC_TEXT;
+}
+
+/*
+ * sqlite_ty_get
+ *
+ * Pulls a bindable value out of |source| with the Type's binary TAM, widening
+ * integers to int64_t and floats to double.
+ */
+static bool
+sqlite_ty_get(Type ty, SqliteTyClass tyc, 
+			  const void *source, SqliteTyValue *value)
+{
+	SqliteTyValue v = { };
+	size_t len = ty->size, cursor = 0;
+
+	vh_tam_firee_bin_get(ty->tam.bin_get, &sqlite3_bin_opts, 
+						 source, &v, &len, &cursor);
+
+	switch (tyc)
+	{
+	case VH_SQLITE_TYC_INT:
+		switch (ty->size)
+		{
+		case sizeof(int8_t):
+			value->i64 = v.i8;
+			return true;
+
+		case sizeof(int16_t):
+			value->i64 = v.i16;
+			return true;
+
+		case sizeof(int32_t):
+			value->i64 = v.i32;
+			return true;
+
+		case sizeof(int64_t):
+			value->i64 = v.i64;
+			return true;
+		}
+
+		break;
+
+	case VH_SQLITE_TYC_FLOAT:
+		switch (ty->size)
+		{
+		case sizeof(float):
+			value->dbl = v.flt;
+			return true;
+
+		case sizeof(double):
+			value->dbl = v.dbl;
+			return true;
+		}
+
+		break;
+
+	default:
+		break;
+	}
+
+	return false;
+}
+
+/*
+ * sqlite_column_typed
+ *
+ * Sets |target| from column |col| of the current row without going thru
+ * text.  Returns false when the column's storage class doesn't line up with
+ * the Type or the integer doesn't fit, the caller should fall back to the
+ * CStr TAM so the behavior matches the text path.
+ */
+static bool
+sqlite_column_typed(sqlite3_stmt *stmt, int32_t col, int32_t col_type,
+					SqliteTyClass tyc, Type ty, void *target)
+{
+	SqliteTyValue v;
+	const void *buffer;
+	int64_t i64;
+	double dbl;
+	int32_t len;
+
+	switch (tyc)
+	{
+	case VH_SQLITE_TYC_INT:
+
+		if (col_type != SQLITE_INTEGER)
+			return false;
+
+		i64 = sqlite3_column_int64(stmt, col);
+
+		if (ty == &vh_type_bool)
+		{
+			v.i8 = i64 != 0;
+		}
+		else
+		{
+			switch (ty->size)
+			{
+			case sizeof(int8_t):
+				if (i64 < INT8_MIN || i64 > INT8_MAX)
+					return false;
+				v.i8 = (int8_t)i64;
+				break;
+
+			case sizeof(int16_t):
+				if (i64 < INT16_MIN || i64 > INT16_MAX)
+					return false;
+				v.i16 = (int16_t)i64;
+				break;
+
+			case sizeof(int32_t):
+				if (i64 < INT32_MIN || i64 > INT32_MAX)
+					return false;
+				v.i32 = (int32_t)i64;
+				break;
+
+			case sizeof(int64_t):
+				v.i64 = i64;
+				break;
+
+			default:
+				return false;
+			}
+		}
+
+		vh_tam_firee_bin_set(ty->tam.bin_set, &sqlite3_bin_opts,
+							 &v, target, ty->size, 0);
+
+		return true;
+
+	case VH_SQLITE_TYC_FLOAT:
+
+		if (col_type != SQLITE_FLOAT && col_type != SQLITE_INTEGER)
+			return false;
+
+		dbl = sqlite3_column_double(stmt, col);
+
+		if (ty->size == sizeof(float))
+			v.flt = (float)dbl;
+		else if (ty->size == sizeof(double))
+			v.dbl = dbl;
+		else
+			return false;
+
+		vh_tam_firee_bin_set(ty->tam.bin_set, &sqlite3_bin_opts,
+							 &v, target, ty->size, 0);
+
+		return true;
+
+	case VH_SQLITE_TYC_STRING:
+
+		/*
+		 * Per the SQLite docs, fetch the pointer first and then the size so
+		 * the size reflects any conversion the pointer call did.
+		 */
+		if (col_type == SQLITE_BLOB)
+			buffer = sqlite3_column_blob(stmt, col);
+		else if (col_type == SQLITE_TEXT)
+			buffer = sqlite3_column_text(stmt, col);
+		else
+			return false;
+
+		len = sqlite3_column_bytes(stmt, col);
+
+		vh_tam_firee_bin_set(ty->tam.bin_set, &sqlite3_bin_opts,
+							 buffer ? buffer : "", target, (size_t)len, 0);
+
+		return true;
+
+	default:
+		break;
+	}
+
+	return false;
+}
+
+void
+vh_be_sqlite3_typed_io(bool enabled)
+{
+	sqlite_typed_io = enabled;
+}
+
 /*
  * vh_sqlite_latebind
  *
@@ -997,6 +1448,53 @@ sqlite_stmt_prepare(SqliteConnection sc, const char *sql_cmd,
 	return 0;	
 }
 
+/*
+ * sqlite_stmt_keep
+ *
+ * Returns the statement held in |stmt|, compiling |sql_cmd| into it the first
+ * time around.  The caller resets the statement when it's done with it.
+ */
+static sqlite3_stmt*
+sqlite_stmt_keep(SqliteConnection sc, sqlite3_stmt **stmt, const char *sql_cmd)
+{
+	if (!*stmt)
+		*stmt = sqlite_stmt_prepare(sc, sql_cmd, 0);
+
+	return *stmt;
+}
+
+static void
+sqlite_stmt_cache_clear(SqliteConnection sc)
+{
+	KeyValueMapIterator it;
+	sqlite3_stmt **stmt;
+	uint32_t *prepare_id;
+
+	if (sc->stmts)
+	{
+		vh_kvmap_it_init(&it, sc->stmts);
+
+		while (vh_kvmap_it_next(&it, &prepare_id, &stmt))
+			if (*stmt)
+				sqlite3_finalize(*stmt);
+
+		vh_htbl_clear(sc->stmts);
+	}
+
+	if (sc->stmt_begin)
+		sqlite3_finalize(sc->stmt_begin);
+
+	if (sc->stmt_commit)
+		sqlite3_finalize(sc->stmt_commit);
+
+	if (sc->stmt_rollback)
+		sqlite3_finalize(sc->stmt_rollback);
+
+	sc->stmt_begin = 0;
+	sc->stmt_commit = 0;
+	sc->stmt_rollback = 0;
+}
+
 static bool 
 sqlite_step_no_rows(SqliteConnection sc, sqlite3_stmt* stmt,
 					bool (*callback)(SqliteConnection, int32_t))
@@ -1062,6 +1560,9 @@ vh_sqlite_cmd_query(String cmd, void *node,	NodeSqlCmdContext ctx)
 	TypeVarSlot tvs;
 	bool first_col = true, first_rec = true;
 
+	if (q->action == Update && ((NodeQueryUpdate)q)->htps)
+		return sqlite_cmd_upd_rows(cmd, node, ctx);
+
 	/*
 	 * If we are a not a BulkInsert or an Insert, just call the default
 	 * command.
@@ -1177,6 +1678,87 @@ vh_sqlite_cmd_query(String cmd, void *node,	NodeSqlCmdContext ctx)
 	return true;
 }
 
+/*
+ * sqlite_cmd_upd_rows
+ *
+ * Older versions of Sqlite don't have UPDATE ... FROM, so a batched UPDATE
+ * is formed as a single row statement keyed on the primary key.  The
+ * parameters for every HeapTuplePtr are pushed in the same order and
+ * vh_sqlite_exec re-runs the compiled statement once per row.
+ */
+static bool
+sqlite_cmd_upd_rows(String cmd, NodeQueryUpdate nq, NodeSqlCmdContext ctx)
+{
+	TableDefVer tdv;
+	TableField *tfs;
+	HeapTuplePtr *htp_head;
+	TypeVarSlot tvs;
+	String cmd_row;
+	int32_t tfs_sz, nkeys, htp_sz, i, j;
+
+	if (!nq->nfrom)
+		elog(ERROR2,
+			 emsg("Missing FROM table during NodeQueryUpdate to_sql_cmd!"));
+
+	tdv = nq->nfrom->tdv;
+	nkeys = tdv->key_primary.nfields;
+	htp_sz = vh_SListIterator(nq->htps, htp_head);
+	tfs_sz = vh_sqlq_upd_fields(nq, 0, 0);
+
+	if (!nkeys || !htp_sz || !tfs_sz)
+		elog(ERROR2,
+			 emsg("A batched NodeQueryUpdate requires a primary key, at least "
+				  "one field and at least one HeapTuplePtr!"));
+
+	tfs = vhmalloc(sizeof(TableField) * (tfs_sz + nkeys));
+	vh_sqlq_upd_fields(nq, tfs, tfs_sz);
+
+	for (i = 0; i < nkeys; i++)
+		tfs[tfs_sz + i] = tdv->key_primary.fields[i];
+
+	vh_str.Append(cmd, "UPDATE ");
+	vh_nsql_cmd_impl(&nq->nfrom->node, cmd, ctx, false);
+	vh_str.Append(cmd, " SET ");
+
+	for (j = 0; j < tfs_sz + nkeys; j++)
+	{
+		if (j == tfs_sz)
+			vh_str.Append(cmd, " WHERE ");
+		else if (j > tfs_sz)
+			vh_str.Append(cmd, " AND ");
+		else if (j)
+			vh_str.Append(cmd, ", ");
+
+		vh_str.AppendStr(cmd, tfs[j]->fname);
+		vh_str.Append(cmd, " = ");
+
+		vh_tvs_init(&tvs);
+		vh_tvs_store_htp_hf(&tvs, htp_head[0], &tfs[j]->heap);
+		vh_nsql_cmd_param_placeholder(cmd, ctx, &tvs);
+	}
+
+	/*
+	 * The remaining rows only push their parameters, the placeholder text
+	 * is thrown away.
+	 */
+	cmd_row = vh_str.Convert("");
+
+	for (i = 1; i < htp_sz; i++)
+	{
+		for (j = 0; j < tfs_sz + nkeys; j++)
+		{
+			vh_tvs_init(&tvs);
+			vh_tvs_store_htp_hf(&tvs, htp_head[i], &tfs[j]->heap);
+			vh_nsql_cmd_param_placeholder(cmd_row, ctx, &tvs);
+		}
+	}
+
+	vh_str.Destroy(cmd_row);
+	vhfree(tfs);
+
+	return true;
+}
+
 /*
  * qins_cmd_add_param
  *
@@ -6,38 +6,100 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <uv.h>
 
 #include "vh.h"
 #include "io/executor/xact.h"
 #include "io/buffer/HeapBuffer.h"
 #include "io/buffer/HeapPage.h"
 #include "io/buffer/BuffMgr.h"
-#include "io/utils/kvmap.h"
 #include "io/utils/SList.h"
+#include "io/utils/mmgr/sharedctx.h"
 
-#define VH_HB_MAXBUFFERS 		10
-
+/*
+ * |vh_buffers| is shared by every thread in the process.  Slots are claimed
+ * from |hbmgr_free| while holding |hbmgr_lock| and the HeapBuffer is then
+ * published into |vh_buffers| with release semantics.  Readers (i.e. vh_hb
+ * and vh_htp) perform a single acquire load on the slot and never take the
+ * lock.
+ *
+ * |vh_buffers| is always VH_HB_MAXBUFFERS long, regardless of how many
+ * buffers the registry was sized for.  The HeapBufferNo packed into a
+ * HeapTuplePtr can address any of them, so the read path never needs a
+ * bounds check.
+ *
+ * |hbmgr_free| is a stack of the slots not currently handed out.  Closing a
+ * buffer pushes its slot back on the stack, so opens and closes are constant
+ * time no matter how large the registry is.
+ *
+ * |hbmgr_gen| is bumped every time a slot is handed out and becomes the xid
+ * of the new HeapBuffer.  A HeapTuplePtr formed against a closed buffer will
+ * then fail the xid check in vh_htp_flags rather than silently resolving into
+ * a different thread's HeapBuffer that happens to occupy the same slot.
+ */
 HeapBuffer* vh_buffers = 0;
 
+static uv_mutex_t hbmgr_lock;
+static HeapBufferNo *hbmgr_free = 0;
+static uint32_t hbmgr_nfree = 0;
+static uint32_t hbmgr_nbuffers = 0;
+static uint16_t hbmgr_gen[VH_HB_MAXBUFFERS];
+
+static void hbmgr_publish(HeapBufferNo buffno, HeapBuffer hb);
+static HeapBufferNo hbmgr_claim_lowest(void);
+static bool hbmgr_claim(HeapBufferNo buffno);
+
 /*
  * vh_hbmgr_startup
  *
- * The HeapBuffer array local to a process.
+ * The HeapBuffer array local to a process.  Must be called once from the
+ * main thread, prior to any worker threads opening a HeapBuffer.
+ *
+ * |nbuffers| sizes the registry, slots below VH_HB_FIRSTBUFFER are reserved
+ * and never handed out.  Passing zero takes VH_HB_DEFAULT_BUFFERS.
  */
 
 bool
-vh_hbmgr_startup(MemoryContext mctx)
+vh_hbmgr_startup(MemoryContext mctx, uint32_t nbuffers)
 {
 	MemoryContext mctx_old;
+	uint32_t i;
 
 	if (vh_buffers)
 		elog(FATAL,
 			 emsg("Buffer manager has already been started!"));
 
+	if (!nbuffers)
+		nbuffers = VH_HB_DEFAULT_BUFFERS;
+
+	if (nbuffers <= VH_HB_FIRSTBUFFER || nbuffers > VH_HB_MAXBUFFERS)
+		elog(FATAL,
+			 emsg("The buffer manager must be sized between %d and %d "
+				  "HeapBuffers, %d were requested!",
+				  VH_HB_FIRSTBUFFER + 1,
+				  VH_HB_MAXBUFFERS,
+				  nbuffers));
+
+	if (uv_mutex_init(&hbmgr_lock))
+		elog(FATAL,
+			 emsg("Unable to initialize the buffer manager lock!"));
+
 	mctx_old = vh_mctx_switch(mctx);
 
 	vh_buffers = vhmalloc(sizeof(HeapBuffer) * VH_HB_MAXBUFFERS);
 	memset(vh_buffers, 0, sizeof(HeapBuffer) * VH_HB_MAXBUFFERS);
+	memset(hbmgr_gen, 0, sizeof(hbmgr_gen));
+
+	/*
+	 * Push the slots in reverse so the lowest slot gets handed out first,
+	 * the general HeapBuffer always lands in VH_HB_FIRSTBUFFER.
+	 */
+	hbmgr_nbuffers = nbuffers;
+	hbmgr_nfree = 0;
+	hbmgr_free = vhmalloc(sizeof(HeapBufferNo) * nbuffers);
+
+	for (i = nbuffers - 1; i >= VH_HB_FIRSTBUFFER; i--)
+		hbmgr_free[hbmgr_nfree++] = (HeapBufferNo)i;
 
 	vh_mctx_switch(mctx_old);
 
@@ -52,50 +114,65 @@ vh_hb_open(MemoryContext mctx)
 	HeapBuffer hb = 0;
 	char name_buffer[50];
 
-	for (buffno = 5; buffno < VH_HB_MAXBUFFERS - 1; buffno++)
+	uv_mutex_lock(&hbmgr_lock);
+
+	if (!hbmgr_nfree)
 	{
-		if (!vh_hb(buffno))
-		{
-			snprintf(&name_buffer[0], 50, "HeapBuffer %d context", buffno);
-			mctx_hb = vh_MemoryPoolCreate(mctx,
-   										  VH_HEAPPAGE_SIZE * 5,
-   										  &name_buffer[0]);
-			mctx_old = vh_mctx_switch(mctx_hb);
-
-			hb = vhmalloc(sizeof(struct HeapBufferData));
-			memset(hb, 0, sizeof(struct HeapBufferData));
-
-			hb->mctx = mctx_hb;
-			hb->idx = buffno;		
-			hb->xid = 0;	
-			hb->free_list = 0;
-			hb->allocfactor = 10;
-			
-			/*
-			 * Create the block table here
-			 */
-			hb->blocks = vh_kvmap_create_impl(sizeof(BufferBlockNo),
-											  sizeof(void*),
-											  vh_htbl_hash_int32,
-											  vh_htbl_comp_int32,
-											  mctx_hb);
-
-			mctx_hb = vh_mctx_switch(mctx_old);
-			
-			vh_hb(buffno) = hb;
-
-			return buffno;
-		}
+		uv_mutex_unlock(&hbmgr_lock);
+
+		elog(ERROR2,
+			 emsg("Unable to find a free HeapBuffer!  All %d HeapBuffers are "
+				  "open.  Check transaction depth and number of current "
+				  "transactions running in the cluster",
+				  hbmgr_nbuffers - VH_HB_FIRSTBUFFER));
+
+		return 0;
 	}
 
-	elog(ERROR2,
-		 emsg("Unable to find a free HeapBuffer!  "
-			  "Check transaction depth and number of current "
-			  "transactions running in the cluster"));
+	/*
+	 * Claim the slot so no other thread can take it while we build the
+	 * HeapBuffer.  Readers continue to see an empty slot until we publish.
+	 */
+	buffno = hbmgr_free[--hbmgr_nfree];
+	hbmgr_gen[buffno]++;
+
+	uv_mutex_unlock(&hbmgr_lock);
+
+	snprintf(&name_buffer[0], 50, "HeapBuffer %d context", buffno);
+	mctx_hb = vh_MemoryPoolCreate(mctx,
+								  VH_HEAPPAGE_SIZE * 5,
+								  &name_buffer[0]);
+	mctx_old = vh_mctx_switch(mctx_hb);
+
+	hb = vhmalloc(sizeof(struct HeapBufferData));
+	memset(hb, 0, sizeof(struct HeapBufferData));
+
+	hb->mctx = mctx_hb;
+	hb->idx = buffno;		
+	hb->xid = hbmgr_gen[buffno];	
+	hb->free_list = 0;
+	hb->allocfactor = 10;
+
+	/*
+	 * The block directory is grown by hb_insert as blocks get used.
+	 */
+	hb->blocks = 0;
+	hb->nleaves = 0;
+
+	mctx_hb = vh_mctx_switch(mctx_old);
 
-	return 0;
+	hbmgr_publish(buffno, hb);
+
+	return buffno;
 }
 
+/*
+ * vh_hb_close
+ *
+ * Releases the HeapBuffer and returns its slot to the free stack.  The slot
+ * may be reopened immediately by any thread, the generation bump in
+ * vh_hb_open keeps old HeapTuplePtr from resolving into the new buffer.
+ */
 bool
 vh_hb_close(HeapBufferNo buffno)
 {
@@ -103,19 +180,202 @@ vh_hb_close(HeapBufferNo buffno)
 
 	assert(hb);
 
+#ifdef VH_MMGR_DEBUG
 	vh_mctx_print_stats(vh_ctx()->memoryTop, true);
+#endif
 
-	vh_kvmap_destroy(hb->blocks);
-	vh_mctx_destroy(hb->mctx);
+	/*
+	 * Unpublish the slot before we tear down the HeapBuffer, so a late reader
+	 * sees an empty slot instead of freed memory.
+	 *
+	 * A shared HeapBuffer may still be read by other processes, its memory
+	 * goes away with the shared MemoryContext.
+	 */
+	hbmgr_publish(buffno, 0);
+
+	if (!hb->shared)
+	{
+		vh_hb_destroyblktbl(hb);
+		vh_mctx_destroy(hb->mctx);
+	}
 
-	vh_hb(buffno) = 0;
+	uv_mutex_lock(&hbmgr_lock);
+	assert(hbmgr_nfree < hbmgr_nbuffers);
+	hbmgr_free[hbmgr_nfree++] = buffno;
+	uv_mutex_unlock(&hbmgr_lock);
 
 	return true;
 }
 
+/*
+ * vh_hb_open_shared
+ *
+ * Opens a HeapBuffer that lives entirely in the shared MemoryContext
+ * |shared| and sets it as the context's root, so other processes can map it
+ * with vh_hb_attach_shared.
+ *
+ * A HeapTuplePtr carries the HeapBufferNo, so every process must find the
+ * buffer in the same slot.  Worker contexts pop their buffers off the top of
+ * the free stack, we take the lowest free slot to stay out of their way.
+ *
+ * Only the opening process may form tuples in the buffer and it should be
+ * done filling it before any other process attaches.  HeapTuple reference
+ * their HeapTupleDef by pointer, so attaching processes must be forked from
+ * a process that had already created the TableDefs.
+ */
+HeapBufferNo
+vh_hb_open_shared(MemoryContext shared)
+{
+	HeapBufferNo buffno;
+	HeapBuffer hb;
+
+	if (!(buffno = hbmgr_claim_lowest()))
+		return 0;
+
+	hb = vhmalloc_ctx(shared, sizeof(struct HeapBufferData));
+
+	if (!hb)
+	{
+		uv_mutex_lock(&hbmgr_lock);
+		hbmgr_free[hbmgr_nfree++] = buffno;
+		uv_mutex_unlock(&hbmgr_lock);
+
+		return 0;
+	}
+
+	memset(hb, 0, sizeof(struct HeapBufferData));
+
+	hb->mctx = shared;
+	hb->idx = buffno;
+	hb->xid = hbmgr_gen[buffno];
+	hb->allocfactor = 10;
+	hb->shared = true;
+
+	vh_mctx_shared_set_root(shared, hb);
+	hbmgr_publish(buffno, hb);
+
+	return buffno;
+}
+
+/*
+ * vh_hb_attach_shared
+ *
+ * Publishes the HeapBuffer another process opened with vh_hb_open_shared
+ * in our registry, under the same slot and xid, so HeapTuplePtr formed by
+ * the other process resolve here.  The buffer is read only, use
+ * vh_htp_immutable to read its tuples.
+ */
+HeapBufferNo
+vh_hb_attach_shared(MemoryContext shared)
+{
+	HeapBuffer hb = vh_mctx_shared_root(shared);
+
+	if (!hb || !hb->shared)
+	{
+		elog(ERROR2,
+			 emsg("Shared MemoryContext %s does not hold a HeapBuffer we can "
+				  "use, it is either empty or mapped at a different address "
+				  "than the process that created it",
+				  shared->name));
+
+		return 0;
+	}
+
+	if (!hbmgr_claim(hb->idx))
+	{
+		elog(ERROR2,
+			 emsg("Unable to attach shared HeapBuffer %d, the slot is already "
+				  "open in this process",
+				  hb->idx));
+
+		return 0;
+	}
+
+	/*
+	 * Take the xid over from the other process, so the next local open of
+	 * this slot still bumps past it.
+	 */
+	hbmgr_gen[hb->idx] = hb->xid;
+	hbmgr_publish(hb->idx, hb);
+
+	return hb->idx;
+}
+
 bool
 vh_hb_isopen(HeapBufferNo buffno)
 {
 	return vh_hb(buffno) != 0;
 }
 
+/*
+ * vh_hbmgr_nbuffers
+ *
+ * Number of HeapBuffers that may be open at once.
+ */
+uint32_t
+vh_hbmgr_nbuffers(void)
+{
+	return hbmgr_nbuffers - VH_HB_FIRSTBUFFER;
+}
+
+static void
+hbmgr_publish(HeapBufferNo buffno, HeapBuffer hb)
+{
+	__atomic_store_n(&vh_buffers[buffno], hb, __ATOMIC_RELEASE);
+}
+
+static HeapBufferNo
+hbmgr_claim_lowest(void)
+{
+	HeapBufferNo buffno;
+	uint32_t i, lowest;
+
+	uv_mutex_lock(&hbmgr_lock);
+
+	if (!hbmgr_nfree)
+	{
+		uv_mutex_unlock(&hbmgr_lock);
+
+		elog(ERROR2,
+			 emsg("Unable to find a free HeapBuffer!  All %d HeapBuffers are "
+				  "open.",
+				  hbmgr_nbuffers - VH_HB_FIRSTBUFFER));
+
+		return 0;
+	}
+
+	for (i = 1, lowest = 0; i < hbmgr_nfree; i++)
+		if (hbmgr_free[i] < hbmgr_free[lowest])
+			lowest = i;
+
+	buffno = hbmgr_free[lowest];
+	hbmgr_free[lowest] = hbmgr_free[--hbmgr_nfree];
+	hbmgr_gen[buffno]++;
+
+	uv_mutex_unlock(&hbmgr_lock);
+
+	return buffno;
+}
+
+static bool
+hbmgr_claim(HeapBufferNo buffno)
+{
+	uint32_t i;
+
+	uv_mutex_lock(&hbmgr_lock);
+
+	for (i = 0; i < hbmgr_nfree; i++)
+	{
+		if (hbmgr_free[i] == buffno)
+		{
+			hbmgr_free[i] = hbmgr_free[--hbmgr_nfree];
+			uv_mutex_unlock(&hbmgr_lock);
+
+			return true;
+		}
+	}
+
+	uv_mutex_unlock(&hbmgr_lock);
+
+	return false;
+}
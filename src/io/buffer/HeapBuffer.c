@@ -12,7 +12,6 @@
 #include "io/buffer/HeapPage.h"
 #include "io/catalog/HeapTuple.h"
 #include "io/catalog/HeapTupleDef.h"
-#include "io/utils/kvmap.h"
 #include "io/utils/SList.h"
 
 #define HB_BLOCK_PAGE(blk) 	((HeapPage)(((char*)blk) + offsetof(struct BlockData, page)))
@@ -29,7 +28,13 @@ typedef struct BlockData
 static inline HeapTuplePtr hb_allocht(HeapBuffer hb, HeapTupleDef htd, 
 		   							  HeapTuple *ht, BufferBlockNo *hint);
 
+static uint32_t hb_allocht_n(HeapBuffer hb, HeapTupleDef htd, uint32_t n,
+							 HeapTuplePtr *out, HeapTuple *hts,
+							 HeapPage *pages);
+
 static void hb_extend(HeapBuffer hb, uint32_t blocks);
+static Block hb_newblock(HeapBuffer hb);
+static Block hb_paxblock(HeapBuffer hb, HeapTupleDef htd);
 static Block hb_fetch(HeapBuffer hb, BufferBlockNo blockno);
 static void hb_insert(HeapBuffer, Block blk);
 static void hb_markblock_hot(HeapBuffer hb, Block blk);
@@ -42,6 +47,9 @@ static void hb_markblock_hot(HeapBuffer hb, Block blk);
  * 	moment.  If a users requests the MUTABLE copy, we go all lengths to
  * 	attempt to grab it.
  *
+ * 	VH_HB_HT_FLAG_FORREAD takes precedence over VH_HT_FLAG_MUTABLE and
+ * 	returns the mutable copy only when it already exists.
+ *
  * |compare|
  * 	Calls vh_ht_compare when the mutable HeapTuple is requested and tells
  * 	it to set the change flags.  This way we don't have to depend on users
@@ -85,7 +93,37 @@ vh_hb_heaptuple(HeapBuffer hb, HeapTuplePtr htp, uint16_t flags)
 		if (!ht)
 			return 0;
 
-		if (flags & VH_HT_FLAG_MUTABLE)
+		if (flags & VH_HB_HT_FLAG_FORREAD)
+		{
+			/*
+			 * Readers want the latest version of the tuple, but they don't
+			 * get to create a mutable copy.  If the mutable copy already
+			 * exists, sync its null and change flags against the immutable
+			 * copy the same way vh_htp does and hand it back, otherwise the
+			 * immutable copy is current.
+			 */
+			if ((vh_ht_flags(ht) & VH_HT_FLAG_MUTABLE) || !ht->tupcpy)
+				return ht;
+
+			mutable_blk = hb_fetch(hb, vh_HTP_BLOCKNO(ht->tupcpy));
+
+			if (mutable_blk)
+			{
+				mutable_hp = HB_BLOCK_PAGE(mutable_blk);
+				mutable_ht = (HeapTuple)VH_HP_TUPLE(mutable_hp,
+													vh_HTP_ITEMNO(ht->tupcpy));
+
+				assert(mutable_blk->blockno == vh_HTP_BLOCKNO(ht->tupcpy));
+				assert(vh_ht_flags(mutable_ht) & VH_HT_FLAG_MUTABLE);
+
+				vh_ht_compare(ht, mutable_ht, true);
+
+				return mutable_ht;
+			}
+
+			return ht;
+		}
+		else if (flags & VH_HT_FLAG_MUTABLE)
 		{
 			if (vh_ht_flags(ht) & VH_HT_FLAG_MUTABLE)
 			{
@@ -247,7 +285,29 @@ hb_allocht(HeapBuffer hb,
 	Block blk;
 	HeapItemSlot slot;
 	HeapTuplePtr htp;
-	uint32_t self_calls = 0;
+
+	if (vh_htd_ispax(htd))
+	{
+		/*
+		 * PAX pages are dedicated to a single HeapTupleDef, so the hint
+		 * and the LRU head are no use to us.
+		 */
+		blk = hb_paxblock(hb, htd);
+
+		if (!blk)
+			return 0;
+
+		slot = vh_hp_construct_tup(hb, HB_BLOCK_PAGE(blk), htd);
+		htp = vh_HTP_FORM(blk->blockno,
+						  hb->xid,
+						  hb->idx,
+						  slot);
+
+		if (ht)
+			*ht = (HeapTuple)VH_HP_TUPLE(HB_BLOCK_PAGE(blk), slot);
+
+		return htp;
+	}
 
 	if (hint)
 	{
@@ -258,7 +318,8 @@ hb_allocht(HeapBuffer hb,
 
 		if (blk)
 		{
-			if (vh_hp_freespaceitm(HB_BLOCK_PAGE(blk)) >= htd->heapasize)
+			if (vh_hp_freespaceitm(HB_BLOCK_PAGE(blk)) >= htd->heapasize &&
+				HB_BLOCK_PAGE(blk)->n_items < VH_HP_MAXITEMS)
 			{
 				slot = vh_hp_construct_tup(hb, HB_BLOCK_PAGE(blk), htd);
 				htp = vh_HTP_FORM(blk->blockno,
@@ -285,7 +346,8 @@ hb_allocht(HeapBuffer hb,
 	if (hb->lru_first)
 	{
 		if (vh_hp_freespaceitm(HB_BLOCK_PAGE(hb->lru_first)) >=
-							   htd->heapasize)
+							   htd->heapasize &&
+			HB_BLOCK_PAGE(hb->lru_first)->n_items < VH_HP_MAXITEMS)
 		{
 			slot = vh_hp_construct_tup(hb,
 	 								   HB_BLOCK_PAGE(hb->lru_first),
@@ -318,20 +380,10 @@ hb_allocht(HeapBuffer hb,
 		}
 	}
 
-use_freelist:
-	blk = hb->free_list;
+	blk = hb_newblock(hb);
 
 	if (blk)
 	{
-		hb->free_list = blk->next;
-
-		blk->next = 0;
-		blk->prev = 0;
-
-		blk->pins = 0;
-		blk->blockno = ++hb->nblocks;
-		
-		vh_hp_init(HB_BLOCK_PAGE(blk));
 		slot = vh_hp_construct_tup(hb,
 		 						  HB_BLOCK_PAGE(blk),
 		 						  htd);
@@ -343,9 +395,6 @@ use_freelist:
 		assert(vh_HTP_XID(htp) == hb->xid);
 		assert(vh_HTP_BLOCKNO(htp) == blk->blockno);
 
-		hb_insert(hb, blk);
-		hb_markblock_hot(hb, blk);
-		
 		if (ht)
 		{
 			*ht = (HeapTuple)VH_HP_TUPLE(HB_BLOCK_PAGE(blk),
@@ -356,19 +405,207 @@ use_freelist:
 		return htp;
 	}
 
-	/*
-	 * If we get to here, we need to extend the relation by one and
-	 * then go back to the use_freelist section.
-	 */
+	return 0;
+}
 
-	if (++self_calls > 5)
-		return 0;
-	else
-		hb_extend(hb, hb->allocfactor);
+/*
+ * vh_hb_allocht_n
+ *
+ * Allocates |n| HeapTuple of |htd| in as few passes as possible.  Rather than
+ * going thru the LRU check and constructing one tuple at a time, we fill the
+ * hottest block with as many tuples as it can hold and then move on to fresh
+ * blocks off the free list.  Each page is carved up and constructed in one
+ * call to vh_hp_construct_tup_n.
+ *
+ * |out| must have room for |n| HeapTuplePtr.  |hts| is optional, when
+ * provided it receives the address of each HeapTuple.  Returns the number of
+ * tuples allocated, which will only be less than |n| if the buffer could not
+ * be extended.
+ */
+uint32_t
+vh_hb_allocht_n(HeapBuffer hb, HeapTupleDef htd, uint32_t n,
+				HeapTuplePtr *out, HeapTuple *hts)
+{
+	return hb_allocht_n(hb, htd, n, out, hts, 0);
+}
 
-	goto use_freelist;
+static uint32_t
+hb_allocht_n(HeapBuffer hb, HeapTupleDef htd, uint32_t n,
+			 HeapTuplePtr *out, HeapTuple *hts, HeapPage *pages)
+{
+	HeapItemSlot slots[VH_HP_MAXITEMS];
+	HeapTuple page_hts[VH_HP_MAXITEMS];
+	Block blk;
+	HeapPage hp;
+	uint32_t done = 0, fit, i;
+	bool fresh;
 
-	return 0;
+	while (done < n)
+	{
+		if (vh_htd_ispax(htd))
+		{
+			/*
+			 * hb_paxblock always hands back a page with room on it.
+			 */
+			blk = hb_paxblock(hb, htd);
+			fresh = true;
+		}
+		else
+		{
+			blk = hb->lru_first;
+			fresh = false;
+
+			if (!blk || 
+				vh_hp_freespaceitm(HB_BLOCK_PAGE(blk)) < htd->heapasize ||
+				HB_BLOCK_PAGE(blk)->n_items >= VH_HP_MAXITEMS)
+			{
+				blk = hb_newblock(hb);
+				fresh = true;
+			}
+		}
+
+		if (!blk)
+			break;
+
+		hp = HB_BLOCK_PAGE(blk);
+		fit = vh_hp_construct_tup_n(hb, hp, htd, n - done, slots,
+									hts ? hts + done : page_hts);
+
+		if (!fit)
+		{
+			/*
+			 * A fresh page that can't hold a single tuple means the tuple
+			 * will never fit, don't keep extending the buffer.
+			 */
+			if (fresh)
+				break;
+
+			blk = hb_newblock(hb);
+
+			if (!blk)
+				break;
+
+			hp = HB_BLOCK_PAGE(blk);
+			fit = vh_hp_construct_tup_n(hb, hp, htd, n - done, slots,
+										hts ? hts + done : page_hts);
+
+			if (!fit)
+				break;
+		}
+
+		for (i = 0; i < fit; i++)
+		{
+			out[done + i] = vh_HTP_FORM(blk->blockno,
+										hb->xid,
+										hb->idx,
+										slots[i]);
+
+			if (pages)
+				pages[done + i] = hp;
+		}
+
+		hb_markblock_hot(hb, blk);
+
+		done += fit;
+	}
+
+	return done;
+}
+
+/*
+ * vh_hb_batch_init
+ *
+ * A HeapBufferBatch hands out HeapTuple one at a time to loops that don't
+ * know how many rows they'll be forming (i.e. back end result sets), while
+ * allocating them from the HeapBuffer |size| at a time with vh_hb_allocht_n.
+ *
+ * We keep the HeapPage for each tuple rather than the HeapTuple address.
+ * The page may be collapsed by someone else freeing and allocating on it
+ * while the batch is outstanding, which moves tuples around on the page but
+ * never moves the page itself.
+ */
+void
+vh_hb_batch_init(HeapBufferBatch batch, HeapBuffer hb, HeapTupleDef htd,
+				 uint32_t size, MemoryContext mctx)
+{
+	if (!size)
+		size = VH_HB_BATCH_DEFAULT;
+
+	batch->hb = hb;
+	batch->htd = htd;
+	batch->size = size;
+	batch->next = 0;
+	batch->navail = 0;
+
+	batch->htps = vhmalloc_ctx(mctx, (sizeof(HeapTuplePtr) + sizeof(HeapPage)) * size);
+	batch->pages = (HeapPage*)(batch->htps + size);
+}
+
+/*
+ * vh_hb_batch_next
+ *
+ * Returns the next HeapTuplePtr in the batch, refilling the batch from the
+ * HeapBuffer when it's been exhausted.  If |ht| is provided, it's set to the
+ * address of the HeapTuple.
+ */
+HeapTuplePtr
+vh_hb_batch_next(HeapBufferBatch batch, HeapTuple *ht)
+{
+	HeapTuplePtr htp;
+
+	if (batch->next == batch->navail)
+	{
+		batch->next = 0;
+		batch->navail = hb_allocht_n(batch->hb, batch->htd, batch->size,
+									 batch->htps, 0, batch->pages);
+
+		if (!batch->navail)
+		{
+			elog(ERROR1,
+				 emsg("Unable to allocate a batch of %d HeapTuple in buffer %d",
+					  batch->size,
+					  batch->hb->idx));
+
+			return 0;
+		}
+	}
+
+	htp = batch->htps[batch->next];
+
+	if (ht)
+		*ht = (HeapTuple)VH_HP_TUPLE(batch->pages[batch->next], 
+									 vh_HTP_ITEMNO(htp));
+
+	batch->next++;
+
+	return htp;
+}
+
+/*
+ * vh_hb_batch_release
+ *
+ * Frees the HeapTuple that were allocated but never handed out and releases
+ * the batch's arrays.
+ */
+void
+vh_hb_batch_release(HeapBufferBatch batch)
+{
+	HeapTuplePtr htp;
+	uint32_t i;
+
+	for (i = batch->next; i < batch->navail; i++)
+	{
+		htp = batch->htps[i];
+		vh_hb_free(batch->hb, vh_HTP_BLOCKNO(htp), vh_HTP_ITEMNO(htp));
+	}
+
+	if (batch->htps)
+		vhfree(batch->htps);
+
+	batch->htps = 0;
+	batch->pages = 0;
+	batch->next = 0;
+	batch->navail = 0;
 }
 
 HeapTuplePtr
@@ -408,7 +645,7 @@ vh_hb_copyht(HeapTuplePtr source, HeapTuple source_hint,
 	if (source_hint)
 		ht = source_hint;
 	else
-		ht = vh_htp(source);
+		ht = vh_htp_read(source);
 
 	if (ht && source)
 	{
@@ -538,8 +775,19 @@ vh_hb_prealloc(HeapBuffer hb,
 void
 vh_hb_destroyblktbl(HeapBuffer hb)
 {
+	uint32_t i;
+
 	if (hb && hb->blocks)
-		vh_kvmap_destroy(hb->blocks);
+	{
+		for (i = 0; i < hb->nleaves; i++)
+			if (hb->blocks[i])
+				vhfree(hb->blocks[i]);
+
+		vhfree(hb->blocks);
+
+		hb->blocks = 0;
+		hb->nleaves = 0;
+	}
 }
 
 /*
@@ -633,12 +881,86 @@ hb_extend(HeapBuffer hb, uint32_t blocks)
 	}
 }
 
+/*
+ * Pulls the next Block off the free list, extending the buffer if the list
+ * is empty.  The Block is numbered, initialized, placed in the directory and
+ * marked hot before it's returned.
+ */
+static Block
+hb_newblock(HeapBuffer hb)
+{
+	Block blk;
+	uint32_t extends = 0;
+
+	while (!hb->free_list)
+	{
+		if (++extends > 5)
+			return 0;
+
+		hb_extend(hb, hb->allocfactor);
+	}
+
+	blk = hb->free_list;
+	hb->free_list = blk->next;
+
+	blk->next = 0;
+	blk->prev = 0;
+
+	blk->pins = 0;
+	blk->blockno = ++hb->nblocks;
+
+	vh_hp_init(HB_BLOCK_PAGE(blk));
+
+	hb_insert(hb, blk);
+	hb_markblock_hot(hb, blk);
+
+	return blk;
+}
+
+/*
+ * Returns the PAX block being filled for |htd|, starting a new one when
+ * there isn't one yet or the current one is full.
+ */
+static Block
+hb_paxblock(HeapBuffer hb, HeapTupleDef htd)
+{
+	Block blk;
+	uint32_t i;
+
+	for (i = 0; i < VH_HB_PAX_PAGES; i++)
+	{
+		if (hb->pax[i].htd == htd)
+		{
+			blk = hb->pax[i].blk;
+
+			if (!vh_hp_pax_full(HB_BLOCK_PAGE(blk), htd))
+				return blk;
+
+			break;
+		}
+	}
+
+	if (i == VH_HB_PAX_PAGES)
+		i = hb->pax_next++ % VH_HB_PAX_PAGES;
+
+	blk = hb_newblock(hb);
+
+	if (!blk)
+		return 0;
+
+	vh_hp_pax_init(HB_BLOCK_PAGE(blk), htd);
+
+	hb->pax[i].htd = htd;
+	hb->pax[i].blk = blk;
+
+	return blk;
+}
+
 /*
  * The goal is to get the page containing the desired HeapTuple
- * into the buffer.  First we check the lookup table to see if
+ * into the buffer.  First we check the block directory to see if
  * the block number is already available on the heap.  If it hasn't
- * been evicted, the pavl_table will return a Block pointer.  The page
- * can be accessed 
+ * been evicted, the directory slot holds the Block pointer.
 
  * In the event the block cannot be found on the heap, we should first
  * determine if additional blocks can be added to the buffer.  If so,
@@ -646,13 +968,14 @@ hb_extend(HeapBuffer hb, uint32_t blocks)
  * more blocks can be added, we must first gracefully evict an existing
  * block and refill it from the desired block on the disk.
  *
- * The |lkp| table on the HeapBuffer tracks all blocks that are available
- * on the Heap and the corresponding slot in the |pages| array.
+ * The |blocks| directory on the HeapBuffer tracks all blocks that are
+ * available on the Heap.
  */
 static Block
 hb_fetch(HeapBuffer hb, BufferBlockNo blockno)
 {
-	Block *blk;
+	Block blk;
+	uint32_t leaf;
 
 	if (blockno > hb->nblocks)
 	{
@@ -665,14 +988,20 @@ hb_fetch(HeapBuffer hb, BufferBlockNo blockno)
 		return 0;
 	}
 
-
-	blk = vh_kvmap_find(hb->blocks, &blockno);
+	leaf = blockno >> VH_HB_BLKDIR_LEAFSHIFT;
+	blk = leaf < hb->nleaves && hb->blocks[leaf] ?
+		hb->blocks[leaf][blockno & VH_HB_BLKDIR_LEAFMASK] : 0;
 
 	if (blk)
 	{
-		hb_markblock_hot(hb, *blk);
+		/*
+		 * Other processes read a shared buffer concurrently, the LRU list
+		 * belongs to the process filling it.
+		 */
+		if (!hb->shared)
+			hb_markblock_hot(hb, blk);
 
-		return *blk;
+		return blk;
 	}
 	else
 	{
@@ -685,14 +1014,49 @@ hb_fetch(HeapBuffer hb, BufferBlockNo blockno)
 	return 0;
 }
 
+/*
+ * Places |blk| in the block directory, growing the top level and allocating
+ * the leaf as necessary.  The top level doubles so repeated extensions stay
+ * amortized constant.
+ */
 static void
 hb_insert(HeapBuffer hb, Block blk)
 {
-	Block *ptr;
+	Block **blocks;
+	uint32_t leaf, nleaves;
+
+	leaf = blk->blockno >> VH_HB_BLKDIR_LEAFSHIFT;
+
+	if (leaf >= hb->nleaves)
+	{
+		nleaves = hb->nleaves ? hb->nleaves : 4;
+
+		while (nleaves <= leaf)
+			nleaves <<= 1;
+
+		blocks = vhmalloc_ctx(hb->mctx, sizeof(Block*) * nleaves);
+		memset(blocks, 0, sizeof(Block*) * nleaves);
+
+		if (hb->blocks)
+		{
+			memcpy(blocks, hb->blocks, sizeof(Block*) * hb->nleaves);
+			vhfree(hb->blocks);
+		}
 
-	if (!vh_kvmap_value(hb->blocks, &blk->blockno, ptr))
+		hb->blocks = blocks;
+		hb->nleaves = nleaves;
+	}
+
+	if (!hb->blocks[leaf])
+	{
+		hb->blocks[leaf] = vhmalloc_ctx(hb->mctx,
+										sizeof(Block) * VH_HB_BLKDIR_LEAFSZ);
+		memset(hb->blocks[leaf], 0, sizeof(Block) * VH_HB_BLKDIR_LEAFSZ);
+	}
+
+	if (!hb->blocks[leaf][blk->blockno & VH_HB_BLKDIR_LEAFMASK])
 	{
-		*ptr = blk;
+		hb->blocks[leaf][blk->blockno & VH_HB_BLKDIR_LEAFMASK] = blk;
 	}
 	else
 	{
@@ -703,4 +1067,3 @@ hb_insert(HeapBuffer hb, Block blk)
 					 hb->idx));
 	}
 }
-
@@ -10,8 +10,13 @@
 #include "io/buffer/HeapBuffer.h"
 #include "io/buffer/HeapPage.h"
 #include "io/buffer/ItemPtr.h"
+#include "io/catalog/HeapField.h"
 #include "io/catalog/HeapTupleDef.h"
 #include "io/catalog/HeapTuple.h"
+#include "io/utils/SList.h"
+
+static uint32_t hp_pax_carve(HeapPage hp, HeapTupleDef htd, uint32_t n,
+							 HeapItemSlot *slots, HeapTuple *hts);
 
 
 void
@@ -33,6 +38,21 @@ vh_hp_construct_tup(HeapBuffer hb,
 	HeapTuple htat;
 	char *ptr;
 
+	if (vh_hp_ispax(hp))
+	{
+		if (hp_pax_carve(hp, htd, 1, &slot, &htat))
+		{
+			vh_ht_construct(htd, htat, hb->idx);
+
+			return slot;
+		}
+
+		elog(ERROR1,
+			 emsg("PAX page is full, no more HeapTuple may be placed on it!"));
+
+		return 0;
+	}
+
 	if (vh_hp_freespaceitm(hp) >= htd->heapasize)
 	{
 		/*
@@ -57,6 +77,7 @@ vh_hp_construct_tup(HeapBuffer hb,
 		hp->items[slot].empty = 0;
 		
 		htat = (HeapTuple)(ptr + hp->d_fupper);
+		htat->flags[0] = 0;
 		
 		//memset(htat, 0, htd->heapasize);
 		vh_ht_construct(htd, htat, hb->idx);
@@ -75,6 +96,91 @@ vh_hp_construct_tup(HeapBuffer hb,
 }
 
 
+/*
+ * vh_hp_construct_tup_n
+ *
+ * Carves as many of |n| HeapTuple out of the page as will fit in one pass.
+ * The item pointers are laid down first and then the fields for all of the
+ * tuples are constructed together by vh_ht_construct_n.  Returns the number
+ * of tuples constructed, their slots and addresses are written to |slots|
+ * and |hts|.
+ */
+uint32_t
+vh_hp_construct_tup_n(HeapBuffer hb,
+					  HeapPage hp,
+					  HeapTupleDef htd,
+					  uint32_t n,
+					  HeapItemSlot *slots,
+					  HeapTuple *hts)
+{
+	const uint32_t itmsz = htd->heapasize + sizeof(HeapItemPtrData);
+	uint32_t i, fit;
+	HeapItemSlot slot;
+	char *ptr;
+
+	if (vh_hp_ispax(hp))
+	{
+		fit = hp_pax_carve(hp, htd, n, slots, hts);
+
+		if (fit)
+			vh_ht_construct_n(htd, hts, fit, hb->idx);
+
+		return fit;
+	}
+
+	fit = hp->d_freespace / itmsz;
+
+	if (fit > VH_HP_MAXITEMS - hp->n_items)
+		fit = VH_HP_MAXITEMS - hp->n_items;
+
+	if (fit > n)
+		fit = n;
+
+	if (!fit)
+		return 0;
+
+	/*
+	 * Check to see if we need to reclaim freespace on the page.  Collapsing
+	 * only reclaims the space of freed tuples, so make sure we still have
+	 * room for all of them in the middle of the page.
+	 */
+	if (hp->d_fupper - hp->d_flower < fit * itmsz)
+	{
+		vh_hp_collapse_empty(hp);
+
+		if (hp->d_fupper - hp->d_flower < fit * itmsz)
+			fit = (hp->d_fupper - hp->d_flower) / itmsz;
+
+		if (!fit)
+			return 0;
+	}
+
+	ptr = (char*) hp;
+
+	for (i = 0; i < fit; i++)
+	{
+		hp->d_flower += sizeof(HeapItemPtrData);
+		hp->d_fupper -= htd->heapasize;
+
+		assert(hp->d_flower <= hp->d_fupper);
+
+		slot = hp->n_items++;
+
+		hp->items[slot].length = htd->heapasize;
+		hp->items[slot].offset = hp->d_fupper;
+		hp->items[slot].empty = 0;
+
+		slots[i] = slot;
+		hts[i] = (HeapTuple)(ptr + hp->d_fupper);
+		hts[i]->flags[0] = 0;
+	}
+
+	hp->d_freespace -= fit * itmsz;
+
+	vh_ht_construct_n(htd, hts, fit, hb->idx);
+
+	return fit;
+}
 
 /*
  * Desconstructs a HeapTuple at a given item number on a page.  If
@@ -90,6 +196,8 @@ vh_hp_freetup(HeapPage hp,
 	HeapTuple ht;
 	HeapTupleDef htd;
 	HeapItemPtr hip;
+	HeapField *hf_head;
+	uint32_t i, hf_sz;
 
 	if (hidx <= hp->n_items)
 	{
@@ -97,7 +205,24 @@ vh_hp_freetup(HeapPage hp,
 		hip = &hp->items[hidx];
 		htd = ht->htd;
 
-		if (!hip->empty)
+		if (!hip->empty && vh_hp_ispax(hp))
+		{
+			/*
+			 * Flag the slot null in every minipage so column scans skip it,
+			 * the slot itself is never handed out again.
+			 */
+			vh_ht_destruct(ht);
+
+			hf_sz = vh_SListIterator(htd->fields, hf_head);
+
+			for (i = 0; i < hf_sz; i++)
+				vh_ht_nbm_setnull(((unsigned char*)hp) + hf_head[i]->paxnbm,
+								  hidx);
+
+			memset(ht, 0, htd->paxhdrsz);
+			hip->empty = 1;
+		}
+		else if (!hip->empty)
 		{
 			vh_ht_destruct(ht);
 			memset(ht, 0, htd->heapsize);
@@ -167,6 +292,13 @@ vh_hp_collapse_empty(HeapPage hp)
 				((char*)hp) + upper,
 				offset - upper);
 
+		/*
+		 * The bottom |length| bytes still hold a stale copy of whatever we
+		 * just moved.  vh_ht_construct doesn't clear the fields, so a String
+		 * formed there would pick up another tuple's out of line buffer.
+		 */
+		memset(((char*)hp) + upper, 0, length);
+
 		hip->empty = 1;
 		hip->length = 0;
 
@@ -184,3 +316,70 @@ vh_hp_collapse_empty(HeapPage hp)
 	vh_hp_cleardirty(hp);
 }
 
+/*
+ * vh_hp_pax_init
+ *
+ * Dedicates a freshly initialized page to |htd| using the PAX layout.  The
+ * page reports no freespace so the row allocation paths will pass it by.
+ */
+void
+vh_hp_pax_init(HeapPage hp, HeapTupleDef htd)
+{
+	assert(vh_htd_ispax(htd));
+
+	hp->flags |= VH_HP_FLAGPAX;
+	hp->d_freespace = 0;
+	hp->d_flower = htd->paxhdrbase;
+	hp->d_fupper = htd->paxhdrbase;
+}
+
+void*
+vh_hp_pax_column(HeapPage hp, HeapField hf, unsigned char **nbm)
+{
+	assert(vh_hp_ispax(hp));
+
+	if (nbm)
+		*nbm = ((unsigned char*)hp) + hf->paxnbm;
+
+	return ((char*)hp) + hf->paxoffset;
+}
+
+/*
+ * hp_pax_carve
+ *
+ * Hands out up to |n| header slots on a PAX page.  The headers are stamped
+ * with the PAX flag and their slot number so vh_ht_field can find the
+ * minipages before the constructor runs.
+ */
+static uint32_t
+hp_pax_carve(HeapPage hp, HeapTupleDef htd, uint32_t n,
+			 HeapItemSlot *slots, HeapTuple *hts)
+{
+	uint32_t i, fit;
+	HeapItemSlot slot;
+	HeapTuple ht;
+
+	fit = htd->paxcap - hp->n_items;
+
+	if (fit > n)
+		fit = n;
+
+	for (i = 0; i < fit; i++)
+	{
+		slot = hp->n_items++;
+
+		hp->items[slot].offset = htd->paxhdrbase + slot * htd->paxhdrsz;
+		hp->items[slot].length = htd->paxhdrsz;
+		hp->items[slot].empty = 0;
+
+		ht = (HeapTuple)(((char*)hp) + hp->items[slot].offset);
+		ht->htd = htd;
+		ht->flags[0] = VH_HT_FLAG_PAX;
+		vh_ht_pax_slot(ht) = slot;
+
+		slots[i] = slot;
+		hts[i] = ht;
+	}
+
+	return fit;
+}
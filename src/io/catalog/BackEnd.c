@@ -68,6 +68,7 @@ vh_be_conn_init(BackEndConnection bec)
 	bec->currentdb = 0;
 	bec->intx = false;
 	bec->in2pc = false;
+	bec->pipeline_tag = 0;
 }
 
 
@@ -423,6 +424,117 @@ vh_be_exec(BackEndConnection bec, BackEndExecPlan beep)
 	return error;
 }
 
+/*
+ * vh_be_exec_send
+ *
+ * Dispatches |beep| without waiting on the result, see vh_beat_exec_send.
+ * Back ends without the asynchronous actions run the statement to completion
+ * with vh_be_exec and report -2, so callers can treat every back end the
+ * same way.
+ */
+int
+vh_be_exec_send(BackEndConnection bec, BackEndExecPlan beep)
+{
+	BackEnd be;
+	int sock = -1;
+
+	assert(bec);
+	assert(beep);
+
+	be = bec->be;
+
+	if (!vh_be_has_exec_async(be))
+		return vh_be_exec(bec, beep) ? -1 : -2;
+
+	VH_TRY();
+	{
+		sock = be->at.exec_send(beep);
+	}
+	VH_CATCH();
+	{
+		sock = -1;
+	}
+	VH_ENDTRY();
+
+	return sock;
+}
+
+int32_t
+vh_be_exec_poll(BackEndConnection bec, BackEndExecPlan beep)
+{
+	BackEnd be;
+	int32_t ret = -1;
+
+	assert(bec);
+	assert(beep);
+
+	be = bec->be;
+
+	if (!vh_be_has_exec_async(be))
+		return -1;
+
+	VH_TRY();
+	{
+		ret = be->at.exec_poll(beep);
+	}
+	VH_CATCH();
+	{
+		ret = -1;
+	}
+	VH_ENDTRY();
+
+	return ret;
+}
+
+bool
+vh_be_pipeline_begin(BackEndConnection bec)
+{
+	BackEnd be;
+
+	assert(bec);
+
+	be = bec->be;
+
+	if (!vh_be_has_pipeline(be))
+		return false;
+
+	return be->at.pipeline_begin(bec);
+}
+
+/*
+ * vh_be_pipeline_end
+ *
+ * Returns true when every pipelined statement succeeded, including when the
+ * back end doesn't pipeline at all.
+ */
+bool
+vh_be_pipeline_end(BackEndConnection bec, uint64_t *failed_tag)
+{
+	BackEnd be;
+	bool success = true;
+
+	assert(bec);
+	assert(failed_tag);
+
+	be = bec->be;
+
+	if (!vh_be_has_pipeline(be))
+		return true;
+
+	VH_TRY();
+	{
+		success = be->at.pipeline_end(bec, failed_tag);
+	}
+	VH_CATCH();
+	{
+		*failed_tag = bec->pipeline_tag;
+		success = false;
+	}
+	VH_ENDTRY();
+
+	return success;
+}
+
 bool
 vh_be_xact_begin(BackEndConnection bec)
 {
@@ -14,6 +14,7 @@
 #include "io/catalog/Type.h"
 #include "io/catalog/TypeCatalog.h"
 #include "io/executor/xact.h"
+#include "io/plan/pcache.h"
 #include "io/shard/BeaconCatalog.h"
 #include "io/shard/ConnectionCatalog.h"
 
@@ -26,6 +27,18 @@ static void register_standard_types(void);
 
 CatalogContext 
 vh_start(void)
+{
+	return vh_start_nbuffers(0);
+}
+
+/*
+ * vh_start_nbuffers
+ *
+ * Same as vh_start but sizes the HeapBuffer registry to |nbuffers|.  Zero
+ * takes the buffer manager's default.
+ */
+CatalogContext
+vh_start_nbuffers(uint32_t nbuffers)
 {
 	MemoryContext top;
 	CatalogContext context;
@@ -60,7 +73,7 @@ vh_start(void)
 	 * Start the HeapBuffer Manager up.
 	 */
 
-	vh_hbmgr_startup(top);
+	vh_hbmgr_startup(top, nbuffers);
 	context->hbno_general = vh_hb_open(top);
 
 	/*
@@ -89,6 +102,88 @@ vh_shutdown(void)
 	}
 }
 
+/*
+ * vh_ctx_thread_attach
+ *
+ * Stands up a CatalogContext for the calling worker thread.  The catalogs are
+ * borrowed from |shared| and must not be modified while workers are attached.
+ * Everything that gets mutated on a per call basis (i.e. the MemoryContext
+ * stack, the error queue, transactions and the general HeapBuffer) is private
+ * to the thread.
+ */
+CatalogContext
+vh_ctx_thread_attach(CatalogContext shared)
+{
+	MemoryContext top;
+	CatalogContext context;
+
+	/*
+	 * We can't elog here, the calling thread doesn't have an error queue
+	 * until it's attached.
+	 */
+	if (!AttachedInstance || !shared)
+		return 0;
+
+	top = vh_MemoryPoolCreate(0, 1024, "Thread top level memory context");
+	context = (CatalogContext)vh_mctx_alloc(top, sizeof(CatalogContextData));
+
+	vh_ctx_init(context);
+
+	context->memoryCurrent = top;
+	context->memoryTop = top;
+
+	context->catalogBackEnd = shared->catalogBackEnd;
+	context->catalogBeacon = shared->catalogBeacon;
+	context->catalogConnection = shared->catalogConnection;
+	context->catalogTable = shared->catalogTable;
+	context->catalogType = shared->catalogType;
+	context->shard_general = shared->shard_general;
+
+	uv_key_set(&UvInstance, context);
+
+	context->errorQueue = vh_err_queue_alloc(top, 1);
+	vh_err_queue_console(context->errorQueue, 0);
+
+	context->hbno_general = vh_hb_open(top);
+
+	return context;
+}
+
+/*
+ * vh_ctx_thread_detach
+ *
+ * Releases everything vh_ctx_thread_attach created for the calling thread.
+ * The shared catalogs are left alone, they belong to the main thread.
+ */
+void
+vh_ctx_thread_detach(void)
+{
+	CatalogContext cc = vh_ctx();
+	MemoryContext top;
+
+	if (!cc)
+		return;
+
+	top = cc->memoryTop;
+
+	if (cc->xactCurrent)
+		vh_xact_destroy(cc->xactCurrent);
+
+	if (cc->planCache)
+		vh_pcache_destroy(cc->planCache);
+
+	if (cc->hbno_general)
+		vh_hb_close(cc->hbno_general);
+
+	/*
+	 * The CatalogContext lives in |top|, but the destroy routine still needs
+	 * vh_ctx() to check the current MemoryContext.  Detach after the context
+	 * has been torn down.
+	 */
+	vh_mctx_destroy(top);
+	uv_key_set(&UvInstance, 0);
+}
+
 static void
 register_standard_types(void)
 {
@@ -144,6 +239,7 @@ vh_ctx_init(CatalogContext context)
 		context->catalogTable = 0;
 		context->xactCurrent = 0;
 		context->xactTop = 0;
+		context->planCache = 0;
 	}
 }
 
@@ -156,6 +252,12 @@ vh_ctx_destroy(CatalogContext cc)
 	if (cc->catalogConnection)
 		vh_ConnectionCatalogShutDown(cc->catalogConnection);
 
+	if (cc->planCache)
+	{
+		vh_pcache_destroy(cc->planCache);
+		cc->planCache = 0;
+	}
+
 	if (cc->hbno_general)
 		vh_hb_close(cc->hbno_general);
 }
@@ -129,6 +129,7 @@ vh_ht_create(HeapTupleDef htd)
 	ht = vhmalloc(htd->heapsize);
 	ht->htd = htd;
 	ht->tupcpy = 0;
+	ht->flags[0] = 0;
 
 	vh_ht_construct(htd, ht, 0);
 
@@ -140,6 +141,9 @@ vh_ht_create(HeapTupleDef htd)
  * if the Type indicates to do so.  We make assumptions the HeapTuple passed 
  * in was already zero-ed out by the caller at some point.  We do make some 
  * attempt to set a few of the flags properly.
+ *
+ * The caller is responsible for the header flags being either zero or just
+ * VH_HT_FLAG_PAX, which is the only one we keep.
  */
 HeapTuple
 vh_ht_construct(HeapTupleDef htd, HeapTuple ht, HeapBufferNo hbno)
@@ -151,7 +155,7 @@ vh_ht_construct(HeapTupleDef htd, HeapTuple ht, HeapBufferNo hbno)
 	ht->htd = htd;
 	ht->shard = 0;
 	ht->tupcpy = 0;
-	ht->flags[0] = 0;
+	ht->flags[0] &= VH_HT_FLAG_PAX;
 
 	sz = vh_SListIterator(htd->fields, hf_head);
 
@@ -160,9 +164,8 @@ vh_ht_construct(HeapTupleDef htd, HeapTuple ht, HeapBufferNo hbno)
 		hf = hf_head[i];
 		field = vh_ht_field(ht, hf);
 
-		VH_HT_FieldFlagsSet(ht, hf, 
-							VH_HTF_FLAG_NULL |
-							VH_HTF_FLAG_CONSTRUCTED);
+		VH_HT_FieldFlagsSet(ht, hf, VH_HTF_FLAG_CONSTRUCTED);
+		vh_htf_setnull(ht, hf);
 
 		if (hf->hasvarlen)
 		{
@@ -185,6 +188,73 @@ vh_ht_construct(HeapTupleDef htd, HeapTuple ht, HeapBufferNo hbno)
 	return ht;
 }
 
+/*
+ * vh_ht_construct_n
+ *
+ * Same as vh_ht_construct, but for |n| HeapTuple of the same HeapTupleDef.
+ * We walk the fields in the outer loop so the decision on how to construct
+ * a field is only made once for the whole batch.
+ */
+void
+vh_ht_construct_n(HeapTupleDef htd, HeapTuple *hts, uint32_t n,
+				  HeapBufferNo hbno)
+{
+	HeapField *hf_head, hf;
+	HeapTuple ht;
+	void *field;
+	uint32_t i, j, sz;
+
+	for (j = 0; j < n; j++)
+	{
+		ht = hts[j];
+		ht->htd = htd;
+		ht->shard = 0;
+		ht->tupcpy = 0;
+		ht->flags[0] &= VH_HT_FLAG_PAX;
+	}
+
+	sz = vh_SListIterator(htd->fields, hf_head);
+
+	for (i = 0; i < sz; i++)
+	{
+		hf = hf_head[i];
+
+		for (j = 0; j < n; j++)
+		{
+			VH_HT_FieldFlagsSet(hts[j], hf, VH_HTF_FLAG_CONSTRUCTED);
+			vh_htf_setnull(hts[j], hf);
+		}
+
+		if (hf->hasvarlen)
+		{
+			if (hf->type_depth == 1)
+			{
+				for (j = 0; j < n; j++)
+				{
+					field = vh_ht_field(hts[j], hf);
+					((struct vhvarlenmpad*)field)->hbno = hbno;
+				}
+			}
+			else
+			{
+				for (j = 0; j < n; j++)
+				{
+					field = vh_ht_field(hts[j], hf);
+					vh_hf_tom_construct(hf, field, hbno);
+				}
+			}
+		}
+		else if (hf->hasconstructor)
+		{
+			for (j = 0; j < n; j++)
+			{
+				field = vh_ht_field(hts[j], hf);
+				vh_hf_tom_construct(hf, field, hbno);
+			}
+		}
+	}
+}
+
 /*
  * Calls the destructor if it's present for each field on the HeapTuple.  After
  * the destructor has been called for each HeapTuple instance, it can be free-d 
@@ -220,7 +290,14 @@ vh_ht_destruct(HeapTuple ht)
 			vh_hf_tom_destruct(hf, field);
 	}
 
-	memset(ht, 0xf, htd->heapasize);
+	/*
+	 * A PAX HeapTuple only owns its header slot, the rest of the page
+	 * belongs to its neighbors.
+	 */
+	if (vh_ht_flags(ht) & VH_HT_FLAG_PAX)
+		memset(ht, 0xf, htd->paxhdrsz);
+	else
+		memset(ht, 0xf, htd->heapasize);
 }
 
 
@@ -274,9 +351,7 @@ vh_ht_commit(HeapTuple ht_m, HeapTuple ht_im)
 
 			if (vh_hf_tom_comp(hf, lfield, rfield))
 			{
-				VH_HT_FieldFlagsClear(ht_im,
-									  hf,
-									  VH_HTF_FLAG_NULL);
+				vh_htf_clearnull(ht_im, hf);
 
 				vh_tam_fireh_memset_set(hf, lfield, rfield, true);
 			}
@@ -302,7 +377,7 @@ vh_ht_commit(HeapTuple ht_m, HeapTuple ht_im)
 					}
 				}
 
-				VH_HT_FieldFlagsSet(ht_im, hf, VH_HTF_FLAG_NULL);
+				vh_htf_setnull(ht_im, hf);
 			}
 			else
 			{
@@ -330,7 +405,12 @@ vh_ht_copy(HeapTuple source, HeapTuple target, HeapBufferNo hbno)
 	void *sfield, *tfield;
 
 	htd = source->htd;
-	vh_ht_flags(target) = vh_ht_flags(source);
+
+	/*
+	 * The layout belongs to where the target was formed, not the source.
+	 */
+	vh_ht_flags(target) = (vh_ht_flags(source) & ~VH_HT_FLAG_PAX) |
+						  (vh_ht_flags(target) & VH_HT_FLAG_PAX);
 
 	sz = vh_SListIterator(htd->fields, hf_head);
 
@@ -349,6 +429,11 @@ vh_ht_copy(HeapTuple source, HeapTuple target, HeapBufferNo hbno)
 
 		vh_htf_flags(target, hf) = sflags;
 
+		if (sflags & VH_HTF_FLAG_NULL)
+			vh_htf_setnull(target, hf);
+		else
+			vh_htf_clearnull(target, hf);
+
 		if (sflags & VH_HTF_FLAG_NULL &&
 			vh_htf_flags(target, hf) & ~VH_HTF_FLAG_CONSTRUCTED)
 		{
@@ -7,6 +7,7 @@
 #include <assert.h>
 
 #include "vh.h"
+#include "io/buffer/HeapPage.h"
 #include "io/catalog/HeapField.h"
 #include "io/catalog/HeapTuple.h"
 #include "io/catalog/HeapTupleDef.h"
@@ -18,6 +19,10 @@
 
 static void HTD_AddPK(HeapTupleDef htd,
 					  HeapField hf);
+static uint32_t htd_pax_place(HeapTupleDef htd, uint32_t cap, bool assign);
+static bool htd_pax_layout(HeapTupleDef htd);
+
+#define htd_align(x, a)		((x) % (a) ? (x) + ((a) - ((x) % (a))) : (x))
 
 size_t 
 vh_htd_tam_calcsize(HeapTupleDef htd)
@@ -147,6 +152,13 @@ vh_htd_add_field(HeapTupleDef htd, HeapField hf)
 		vh_SListPush(htd->fields, hf);
 		vh_SListPush(htd->type_stack, &hf->types[0]);
 
+		/*
+		 * Adding a field changes the width of every minipage, so the PAX
+		 * layout has to be recalculated.
+		 */
+		if (vh_htd_ispax(htd))
+			return htd_pax_layout(htd);
+
 		return true;
 	}
 
@@ -250,3 +262,125 @@ vh_htd_field_by_idx(HeapTupleDef htd, uint16_t field_idx)
 	return 0;
 }
 
+/*
+ * vh_htd_set_pax
+ *
+ * Switches the HeapTupleDef between the row and PAX page layouts.  This
+ * should be done before the HeapBuffer has allocated any HeapTuple for the
+ * HeapTupleDef, existing HeapTuple stay in the layout they were formed with.
+ *
+ * Returns false if a PAX page could not hold a single HeapTuple, in which
+ * case the HeapTupleDef stays with the row layout.
+ */
+bool
+vh_htd_set_pax(HeapTupleDef htd, bool pax)
+{
+	if (!pax)
+	{
+		htd->paxcap = 0;
+		htd->paxhdrsz = 0;
+		htd->paxhdrbase = 0;
+
+		return true;
+	}
+
+	return htd_pax_layout(htd);
+}
+
+/*
+ * htd_pax_layout
+ *
+ * A PAX page is laid out as:
+ *
+ * 	1)	HeapPageData header and |paxcap| item pointers
+ * 	2)	|paxcap| header slots, each holding the HeapTupleData header, the
+ * 		field flags and the tuple's slot number on the page
+ * 	3)	for each field, a null bitmap of |paxcap| bits followed by the
+ * 		minipage of |paxcap| values
+ *
+ * We guess the capacity from the per tuple cost and then back off until the
+ * alignment padding fits on the page too.
+ */
+static bool
+htd_pax_layout(HeapTupleDef htd)
+{
+	HeapField *hf_head, hf;
+	uint32_t hf_sz, i, per, cap;
+
+	htd->paxhdrsz = htd_align(htd->tupoffset + sizeof(uint16_t), 8);
+	per = sizeof(HeapItemPtrData) + htd->paxhdrsz;
+
+	hf_sz = vh_SListIterator(htd->fields, hf_head);
+
+	for (i = 0; i < hf_sz; i++)
+	{
+		hf = hf_head[i];
+		hf->paxwidth = htd_align(vh_type_stack_data_width(&hf->types[0]),
+								 hf->maxalign ? hf->maxalign : 1);
+		per += hf->paxwidth;
+	}
+
+	cap = (VH_HEAPPAGE_SIZE - offsetof(HeapPageData, items)) * 8 / 
+		  (per * 8 + hf_sz);
+
+	if (cap > VH_HP_MAXITEMS)
+		cap = VH_HP_MAXITEMS;
+
+	while (cap && htd_pax_place(htd, cap, false) > VH_HEAPPAGE_SIZE)
+		cap--;
+
+	if (!cap)
+	{
+		htd->paxcap = 0;
+		htd->paxhdrsz = 0;
+
+		return false;
+	}
+
+	htd_pax_place(htd, cap, true);
+	htd->paxcap = cap;
+
+	return true;
+}
+
+/*
+ * htd_pax_place
+ *
+ * Walks the PAX page layout for |cap| tuples and returns the number of bytes
+ * it occupies.  When |assign| is set the offsets are stored on the
+ * HeapTupleDef and its HeapField.
+ */
+static uint32_t
+htd_pax_place(HeapTupleDef htd, uint32_t cap, bool assign)
+{
+	HeapField *hf_head, hf;
+	uint32_t hf_sz, i, off;
+
+	off = offsetof(HeapPageData, items) + cap * sizeof(HeapItemPtrData);
+	off = htd_align(off, 8);
+
+	if (assign)
+		htd->paxhdrbase = off;
+
+	off += cap * htd->paxhdrsz;
+
+	hf_sz = vh_SListIterator(htd->fields, hf_head);
+
+	for (i = 0; i < hf_sz; i++)
+	{
+		hf = hf_head[i];
+
+		if (assign)
+			hf->paxnbm = off;
+
+		off += (cap + 7) / 8;
+		off = htd_align(off, hf->maxalign ? hf->maxalign : 1);
+
+		if (assign)
+			hf->paxoffset = off;
+
+		off += cap * hf->paxwidth;
+	}
+
+	return off;
+}
@@ -149,7 +149,7 @@ vh_ptup_field(PrintTupCtx ptup,
 	HeapTuple ht;
 
 	ptf = &ptup->fields[hf->heapord];
-	ht = vh_htp(htp);
+	ht = vh_htp_read(htp);
 
 	assert(ptf->hf == hf);
 	assert(ht);
@@ -191,7 +191,7 @@ vh_ptup_field_buffer(PrintTupCtx ptup,
 	HeapTuple ht;
 
 	ptf = &ptup->fields[hf->heapord];
-	ht = vh_htp(htp);
+	ht = vh_htp_read(htp);
 
 	assert(ptf->hf == hf);
 	assert(ht);
@@ -1210,7 +1210,7 @@ TD_CompareLK(HeapTuplePtr htpl,
 			 HeapTuplePtr htpr)
 {
 	TableDefVer tdv;
-	HeapTuple l = vh_htp(htpl), r = vh_htp(htpr);
+	HeapTuple l = vh_htp_read(htpl), r = vh_htp_read(htpr);
 
 	if (l->htd == r->htd)
 	{
@@ -1231,7 +1231,7 @@ TD_ComparePK(HeapTuplePtr htpl,
 			 HeapTuplePtr htpr)
 {
 	TableDefVer tdv;
-	HeapTuple l = vh_htp(htpl), r = vh_htp(htpr);
+	HeapTuple l = vh_htp_read(htpl), r = vh_htp_read(htpr);
 
 	if (l->htd == r->htd)
 	{
@@ -1254,7 +1254,7 @@ TD_CompareFields(HeapTuplePtr a,
 	 			 TableField* tfs, 
 	 			 uint16_t tfsz)
 {
-	HeapTuple hta = vh_htp(a), htb = vh_htp(b);
+	HeapTuple hta = vh_htp_read(a), htb = vh_htp_read(b);
 
 	return TD_CompareFields_HT(hta, htb, tfs, tfsz);
 }
@@ -1420,7 +1420,7 @@ QSortComp_Fields(HeapTuplePtr l,
 				 const struct QSC_Fields * const params)
 {
 	int32_t comp, i = 0;
-	HeapTuple htl = vh_htp(l), htr = vh_htp(r);
+	HeapTuple htl = vh_htp_read(l), htr = vh_htp_read(r);
 
 	do
 	{
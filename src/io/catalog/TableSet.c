@@ -419,12 +419,12 @@ vh_tsri_ht(TableSetRel tsr, vh_tsri_ht_cb cb, void *cb_data)
 
 		while (vh_kvlist_it_next(&it, &htp_parent, &htps)) 
 		{
-			ht_outter = vh_htp(htp_parent);
+			ht_outter = vh_htp_read(htp_parent);
 			htp_sz = vh_SListIterator(htps, htp_head);
 
 			for (i = 0; i < htp_sz; i++)
 			{
-				ht_inner = vh_htp(htp_head[i]);
+				ht_inner = vh_htp_read(htp_head[i]);
 
 				if (!cb(ht_inner, htp_head[i],
 						ht_outter, htp_parent,
@@ -445,7 +445,7 @@ vh_tsri_ht(TableSetRel tsr, vh_tsri_ht_cb cb, void *cb_data)
 
 		for (i = 0; i < htp_sz; i++)
 		{
-			ht_inner = vh_htp(htp_head[i]);
+			ht_inner = vh_htp_read(htp_head[i]);
 
 			if (!cb(ht_inner, htp_head[i], 0, 0, cb_data))
 				return i;
@@ -546,7 +546,7 @@ tsr_buildidx_parent_cb(HeapTuplePtr htp_inner,
 					   HeapTuplePtr htp_outter,  void *cb_data)
 {
 	BuildIdx bidx = cb_data;
-	HeapTuple ht = vh_htp(htp_inner);
+	HeapTuple ht = vh_htp_read(htp_inner);
 	size_t key_sz = 0;
 	void* idx_val;
 	SList htps;
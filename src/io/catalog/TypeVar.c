@@ -154,6 +154,8 @@ struct OpExecSideData
 	int32_t dt_flags;
 	
 	uint16_t ty_depth;
+	HeapField ht_hf;		/* Field for PAX HeapTuple, see opes_ht_data */
+
 	uint16_t ht_null;		/* Store the Null Flag Index */
 	uint16_t ht_offset;		/* Store the HeapTuple offset for a field */
 	
@@ -162,6 +164,16 @@ struct OpExecSideData
 	bool has_formatters;
 };
 
+/*
+ * Row HeapTuple can be addressed with the precomputed |ht_offset|, PAX
+ * HeapTuple keep their values out in the page's minipages so we have to
+ * go thru vh_ht_field.
+ */
+#define opes_ht_data(side, ht)	((vh_ht_flags(ht) & VH_HT_FLAG_PAX) && 		\
+								 (side)->ht_hf ? 								\
+								 (unsigned char*)vh_ht_field(ht, (side)->ht_hf) :	\
+								 ((unsigned char*)(ht)) + (side)->ht_offset)
+
 /*
  * Begin/End Functions for:
  * 	HeapTuplePtr
@@ -303,7 +315,7 @@ static void cleanup_formatter(TypeVarOpExec exec, OpExecSide fmts);
 #define VH_COMP_LTEQ		0x3c3du
 #define VH_COMP_GTEQ		0x3e3du
 #define VH_COMP_EQ			0x3d3du
-#define VH_COMP_NEQ			0x21edu
+#define VH_COMP_NEQ			0x213du
 
 #define VH_OP_PL			0x2b00u
 #define VH_OP_PLEQ			0x2b3du
@@ -3254,13 +3266,13 @@ process_dt_flag_fp(TypeVarOpExec exec,
 
 			if (ht)
 			{
-				entry->data = ((unsigned char*)ht) + side->ht_offset;
+				entry->data = opes_ht_data(side, ht);
 				entry->null = (ht->flags[side->ht_null + 1]) & VH_HTF_FLAG_NULL;
 				entry->htp = htp;	
 
 				if (side2 && entry2)
 				{
-					entry2->data = ((unsigned char*)ht) + side->ht_offset;
+					entry2->data = opes_ht_data(side, ht);
 					entry2->null = (ht->flags[side2->ht_null + 1]) & VH_HTF_FLAG_NULL;
 				}
 			}
@@ -3279,7 +3291,7 @@ process_dt_flag_fp(TypeVarOpExec exec,
 
 		if (ht)
 		{
-			entry->data = ((unsigned char*)ht) + side->ht_offset;
+			entry->data = opes_ht_data(side, ht);
 			entry->null = (ht->flags[side->ht_null + 1]) & VH_HTF_FLAG_NULL;
 			entry->ht = ht;
 
@@ -3518,12 +3530,14 @@ process_id_flag(TypeVarOpExec exec,
 			{
 				side->ht_offset += tf->heap.offset;
 				side->ht_null = tf->heap.dord;
+				side->ht_hf = &tf->heap;
 				side->ty_depth = vh_type_stack_copy(&side->tys[0], &tf->heap.types[0]);
 
 				if (side2)
 				{
 					side2->ht_offset = side->ht_offset;
 					side2->ht_null = side->ht_null;
+					side2->ht_hf = side->ht_hf;
 					side2->ty_depth = side->ty_depth;
 				
 					side->ty_depth = vh_type_stack_copy(&side2->tys[0], &tf->heap.types[0]);
@@ -3543,12 +3557,14 @@ process_id_flag(TypeVarOpExec exec,
 		{
 			side->ht_offset += hf->offset;
 			side->ht_null = hf->dord;
+			side->ht_hf = hf;
 			side->ty_depth = vh_type_stack_copy(&side->tys[0], &hf->types[0]);
 
 			if (side2)
 			{
 				side2->ht_offset = side->ht_offset;
 				side2->ht_null = side->ht_null;
+				side2->ht_hf = side->ht_hf;
 				side2->ty_depth = vh_type_stack_copy(&side->tys[0], &hf->types[0]);
 			}
 
@@ -3566,12 +3582,14 @@ process_id_flag(TypeVarOpExec exec,
 		{
 			side->ht_offset += hf->offset;
 			side->ht_null = hf->dord;
+			side->ht_hf = hf;
 			side->ty_depth = vh_type_stack_copy(&side->tys[0], &hf->types[0]);
 
 			if (side2)
 			{
 				side2->ht_offset = side->ht_offset;
 				side2->ht_null = side->ht_null;
+				side2->ht_hf = side->ht_hf;
 				side2->ty_depth = vh_type_stack_copy(&side->tys[0], &hf->types[0]);
 			}
 
@@ -3794,8 +3812,8 @@ opes_ht_begin(TypeVarOpExec exec, TypeVarOpEntry data, uint8_t sides)
 
 	for (i = 0; i < count; i++)
 	{
-		cursor = (char*)combiner[i].data->ht;
-		combiner[i].data->data = cursor + combiner[i].exec->ht_offset;
+		cursor = (char*)opes_ht_data(combiner[i].exec, combiner[i].data->ht);
+		combiner[i].data->data = cursor;
 	}
 }
 
@@ -3812,8 +3830,7 @@ opes_htp_begin(TypeVarOpExec exec, TypeVarOpEntry data, uint8_t sides)
 	for (i = 0; i < count; i++)
 	{
 		ht = vh_htp(combiner[i].data->htp);
-		cursor = (unsigned char*)ht;
-		cursor += combiner[i].exec->ht_offset;
+		cursor = opes_ht_data(combiner[i].exec, ht);
 
 		combiner[i].data->data = cursor;	
 	}
@@ -4619,3 +4636,319 @@ op_exec(TypeVarOpExec ed, bool fp)
 	return 0;
 }
 
+
+
+/*
+ * ===========================================================================
+ * Specialized Operators
+ * ===========================================================================
+ */
+
+/*
+ * Kernels for primitive numeric types where both sides are the same type.
+ * These are simple enough loops for the compiler to vectorize.
+ */
+#define TVSPEC_ARITH_KERNEL(name, ctype, oper)								\
+	static void name(const void *lhs, const void *rhs, void *ret, 			\
+					 uint32_t n)											\
+	{																		\
+		const ctype *l = lhs, *r = rhs;										\
+		ctype *o = ret;														\
+		uint32_t i;															\
+																			\
+		for (i = 0; i < n; i++)												\
+			o[i] = l[i] oper r[i];											\
+	}
+
+#define TVSPEC_COMP_KERNEL(name, ctype, oper)								\
+	static void name(const void *lhs, const void *rhs, void *ret,			\
+					 uint32_t n)											\
+	{																		\
+		const ctype *l = lhs, *r = rhs;										\
+		bool *o = ret;														\
+		uint32_t i;															\
+																			\
+		for (i = 0; i < n; i++)												\
+			o[i] = l[i] oper r[i];											\
+	}
+
+#define TVSPEC_KERNELS(tn, ctype)											\
+	TVSPEC_ARITH_KERNEL(tvspec_##tn##_pl, ctype, +)							\
+	TVSPEC_ARITH_KERNEL(tvspec_##tn##_su, ctype, -)							\
+	TVSPEC_ARITH_KERNEL(tvspec_##tn##_mult, ctype, *)						\
+	TVSPEC_COMP_KERNEL(tvspec_##tn##_lt, ctype, <)							\
+	TVSPEC_COMP_KERNEL(tvspec_##tn##_lteq, ctype, <=)						\
+	TVSPEC_COMP_KERNEL(tvspec_##tn##_eq, ctype, ==)							\
+	TVSPEC_COMP_KERNEL(tvspec_##tn##_neq, ctype, !=)						\
+	TVSPEC_COMP_KERNEL(tvspec_##tn##_gt, ctype, >)							\
+	TVSPEC_COMP_KERNEL(tvspec_##tn##_gteq, ctype, >=)
+
+TVSPEC_KERNELS(i16, int16_t)
+TVSPEC_KERNELS(i32, int32_t)
+TVSPEC_KERNELS(i64, int64_t)
+TVSPEC_KERNELS(flt, float)
+TVSPEC_KERNELS(dbl, double)
+
+TVSPEC_ARITH_KERNEL(tvspec_flt_div, float, /)
+TVSPEC_ARITH_KERNEL(tvspec_dbl_div, double, /)
+
+#define TVSPEC_PL		0
+#define TVSPEC_SU		1
+#define TVSPEC_MULT		2
+#define TVSPEC_DIV		3
+#define TVSPEC_LT		4
+#define TVSPEC_LTEQ		5
+#define TVSPEC_EQ		6
+#define TVSPEC_NEQ		7
+#define TVSPEC_GT		8
+#define TVSPEC_GTEQ		9
+#define TVSPEC_NOPS		10
+
+#define TVSPEC_ROW(tn, div) { tvspec_##tn##_pl, tvspec_##tn##_su, 			\
+							  tvspec_##tn##_mult, div,						\
+							  tvspec_##tn##_lt, tvspec_##tn##_lteq,			\
+							  tvspec_##tn##_eq, tvspec_##tn##_neq,			\
+							  tvspec_##tn##_gt, tvspec_##tn##_gteq }
+
+static const struct
+{
+	Type ty;
+	vh_typevar_op_kernel kernels[TVSPEC_NOPS];
+} tvspec_kernels[] = {
+	{ &vh_type_int16, TVSPEC_ROW(i16, 0) },
+	{ &vh_type_int32, TVSPEC_ROW(i32, 0) },
+	{ &vh_type_int64, TVSPEC_ROW(i64, 0) },
+	{ &vh_type_float, TVSPEC_ROW(flt, tvspec_flt_div) },
+	{ &vh_type_dbl, TVSPEC_ROW(dbl, tvspec_dbl_div) }
+};
+
+/*
+ * Masks for vh_typevar_spec_comp, bit 0 is set when the operator is true for
+ * a less than result, bit 1 for equal and bit 2 for greater than.
+ */
+#define TVSPEC_CM_LT	0x01u
+#define TVSPEC_CM_EQ	0x02u
+#define TVSPEC_CM_GT	0x04u
+
+/*
+ * vh_typevar_op_spec
+ *
+ * Fills |spec| with the functions for |op| against the type stacks.  Returns
+ * false if the operator isn't supported for the types.
+ */
+bool
+vh_typevar_op_spec(TypeVarOpSpec spec, const char *op,
+				   Type *tys_lhs, Type *tys_rhs)
+{
+	const char *base_op = op;
+	uint16_t opi = (uint16_t)((op[0] << 8) | op[1]);
+	int32_t kidx = -1, i, ldepth, rdepth = 0;
+
+	memset(spec, 0, sizeof(TypeVarOpSpecData));
+
+	spec->opi = opi;
+
+	switch (opi)
+	{
+		case VH_COMP_LT:
+			spec->comp_mask = TVSPEC_CM_LT;
+			kidx = TVSPEC_LT;
+			break;
+
+		case VH_COMP_LTEQ:
+			spec->comp_mask = TVSPEC_CM_LT | TVSPEC_CM_EQ;
+			kidx = TVSPEC_LTEQ;
+			break;
+
+		case VH_COMP_EQ:
+			spec->comp_mask = TVSPEC_CM_EQ;
+			kidx = TVSPEC_EQ;
+			break;
+
+		case VH_COMP_NEQ:
+			spec->comp_mask = TVSPEC_CM_LT | TVSPEC_CM_GT;
+			kidx = TVSPEC_NEQ;
+			break;
+
+		case VH_COMP_GT:
+			spec->comp_mask = TVSPEC_CM_GT;
+			kidx = TVSPEC_GT;
+			break;
+
+		case VH_COMP_GTEQ:
+			spec->comp_mask = TVSPEC_CM_GT | TVSPEC_CM_EQ;
+			kidx = TVSPEC_GTEQ;
+			break;
+
+		case VH_OP_PLEQ:
+			spec->self = true;
+		case VH_OP_PL:
+			base_op = "+";
+			kidx = TVSPEC_PL;
+			break;
+
+		case VH_OP_SUEQ:
+			spec->self = true;
+		case VH_OP_SU:
+			base_op = "-";
+			kidx = TVSPEC_SU;
+			break;
+
+		case VH_OP_MULTEQ:
+			spec->self = true;
+		case VH_OP_MULT:
+			base_op = "*";
+			kidx = TVSPEC_MULT;
+			break;
+
+		case VH_OP_DIVEQ:
+			spec->self = true;
+		case VH_OP_DIV:
+			base_op = "/";
+			kidx = TVSPEC_DIV;
+			break;
+	}
+
+	spec->comp = spec->comp_mask != 0;
+
+	if (!tys_lhs || !tys_lhs[0])
+		return false;
+
+	ldepth = vh_type_stack_copy(&spec->tys_lhs[0], tys_lhs);
+
+	if (tys_rhs && tys_rhs[0])
+		rdepth = vh_type_stack_copy(&spec->tys_rhs[0], tys_rhs);
+
+	spec->lhs_width = vh_type_stack_data_width(&spec->tys_lhs[0]);
+	spec->rhs_width = rdepth ? vh_type_stack_data_width(&spec->tys_rhs[0]) : 0;
+
+	if (spec->comp)
+	{
+		if (!rdepth || 
+			!vh_type_stack_match(&spec->tys_lhs[0], &spec->tys_rhs[0]) ||
+			!vh_toms_fill_comp_funcs(&spec->tys_lhs[0], &spec->funcs.comp[0]))
+			return false;
+
+		spec->func.comp = spec->funcs.comp[0];
+		spec->comp_stack.types = &spec->tys_lhs[1];
+		spec->comp_stack.funcs = &spec->funcs.comp[1];
+	}
+	else
+	{
+		if (rdepth && rdepth != ldepth)
+			return false;
+
+		for (i = 0; i < ldepth; i++)
+		{
+			spec->funcs.oper[i] = vh_type_oper(spec->tys_lhs[i], base_op,
+											   rdepth ? spec->tys_rhs[i] : 0, 0);
+
+			if (!spec->funcs.oper[i])
+				return false;
+		}
+
+		spec->func.oper = spec->funcs.oper[0];
+		spec->oper_stack.tys_lhs = &spec->tys_lhs[1];
+		spec->oper_stack.tys_rhs = &spec->tys_rhs[1];
+		spec->oper_stack.funcs = &spec->funcs.oper[1];
+	}
+
+	if (kidx >= 0 && ldepth == 1 && rdepth == 1 &&
+		spec->tys_lhs[0] == spec->tys_rhs[0])
+	{
+		for (i = 0; i < sizeof(tvspec_kernels) / sizeof(tvspec_kernels[0]); i++)
+		{
+			if (tvspec_kernels[i].ty == spec->tys_lhs[0])
+			{
+				spec->kernel = tvspec_kernels[i].kernels[kidx];
+				break;
+			}
+		}
+	}
+
+	return true;
+}
+
+void
+vh_typevar_op_batch(TypeVarOpSpec spec, TypeVarSlot *lhs,
+					TypeVarSlot *rhs, TypeVarSlot *ret, 
+					bool *res, uint32_t n)
+{
+	TypeVarSlot *target;
+	uint32_t i;
+	bool null;
+
+	for (i = 0; i < n; i++)
+	{
+		null = vh_tvs_isnull(&lhs[i]) || (rhs && vh_tvs_isnull(&rhs[i]));
+
+		if (spec->comp)
+		{
+			res[i] = null ? false :
+				vh_typevar_spec_comp(spec, vh_tvs_value(&lhs[i]),
+									 vh_tvs_value(&rhs[i]));
+
+			continue;
+		}
+
+		target = (spec->self || !ret) ? &lhs[i] : &ret[i];
+
+		if (null)
+		{
+			vh_tvs_setnull(target);
+			continue;
+		}
+
+		spec->func.oper(&spec->oper_stack, 
+						vh_tvs_value(&lhs[i]),
+						rhs ? vh_tvs_value(&rhs[i]) : 0,
+						vh_tvs_value(target));
+		vh_tvs_clearnull(target);
+	}
+}
+
+void
+vh_typevar_op_array(TypeVarOpSpec spec, const void *lhs,
+					const void *rhs, void *ret, uint32_t n)
+{
+	const unsigned char *l = lhs, *r = rhs;
+	unsigned char *o;
+	bool *res;
+	uint32_t i;
+
+	if (spec->self)
+		ret = (void*)lhs;
+
+	if (spec->kernel)
+	{
+		spec->kernel(lhs, rhs, ret, n);
+		return;
+	}
+
+	if (spec->comp)
+	{
+		res = ret;
+
+		for (i = 0; i < n; i++)
+		{
+			res[i] = vh_typevar_spec_comp(spec, l, r);
+			l += spec->lhs_width;
+			r += spec->rhs_width;
+		}
+
+		return;
+	}
+
+	o = ret;
+
+	for (i = 0; i < n; i++)
+	{
+		spec->func.oper(&spec->oper_stack, (void*)l, r ? (void*)r : 0, o);
+
+		l += spec->lhs_width;
+		o += spec->lhs_width;
+
+		if (r)
+			r += spec->rhs_width;
+	}
+}
@@ -98,6 +98,17 @@ vh_acms_result(TypeVarAcm acm, TypeVarAcmState acms, TypeVarSlot *slot)
 	return -1;
 }
 
+int32_t
+vh_acms_merge(TypeVarAcm acm, TypeVarAcmState target, TypeVarAcmState source)
+{
+	if (acm && target && source && acm->funcs->merge)
+	{
+		return acm->funcs->merge(acm, target, source);
+	}
+
+	return -1;
+}
+
 /*
  * ============================================================================
  * acm/acm_impl.h
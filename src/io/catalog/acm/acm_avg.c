@@ -19,6 +19,7 @@ struct acm_avg
 
 	TypeVarOpExec op;
 	TypeVarOpExec calcop;
+	TypeVarOpExec mergeop;
 
 	size_t typevar_sz;
 
@@ -53,6 +54,7 @@ static void acms_avg_finalize(TypeVarAcm, TypeVarAcmState);
 
 static int32_t acms_avg_input(TypeVarAcm, TypeVarAcmState, va_list args);
 static int32_t acms_avg_result(TypeVarAcm, TypeVarAcmState, TypeVarSlot*);
+static int32_t acms_avg_merge(TypeVarAcm, TypeVarAcmState, TypeVarAcmState);
 
 static void acm_avg_finalize(TypeVarAcm);
 
@@ -62,6 +64,7 @@ static const struct TypeVarAcmFuncs acm_avg_funcs = {
 
 	.input = acms_avg_input,
 	.result = acms_avg_result,
+	.merge = acms_avg_merge,
 
 	.finalize = acm_avg_finalize
 };
@@ -88,6 +91,7 @@ static void acms_count_finalize(TypeVarAcm, TypeVarAcmState);
 
 static int32_t acms_count_input(TypeVarAcm, TypeVarAcmState, va_list args);
 static int32_t acms_count_result(TypeVarAcm, TypeVarAcmState, TypeVarSlot*);
+static int32_t acms_count_merge(TypeVarAcm, TypeVarAcmState, TypeVarAcmState);
 
 static void acm_count_finalize(TypeVarAcm);
 
@@ -97,6 +101,7 @@ static const struct TypeVarAcmFuncs acm_count_funcs = {
 
 	.input = acms_count_input,
 	.result = acms_count_result,
+	.merge = acms_count_merge,
 
 	.finalize = acm_count_finalize
 };
@@ -142,10 +147,12 @@ vh_acm_avg_tys(Type *tys)
 								 tys_accum, tys_accum, tys);
 
 	acm->calcop = vh_typevar_op_init_tys("/", tys_accum, ty_int64, tys_accum);
+	acm->mergeop = vh_typevar_op_init_tys("+=", tys_accum, tys_accum, 0);
 	acm->ty_depth = vh_type_stack_copy(acm->tys, tys_accum);
 	acm->typevar_sz = typevar_sz;
 
 	assert(acm->calcop);
+	assert(acm->mergeop);
 	assert(acm->ty_depth);
 
 	if (acm->op)
@@ -234,6 +241,29 @@ acms_avg_result(TypeVarAcm tvacm, TypeVarAcmState tvacms,
 	return 0;
 }
 
+/*
+ * acms_avg_merge
+ *
+ * We carry the running sum and count rather than the average itself, so the
+ * merge is exact: add the sums and add the counts.
+ */
+static int32_t
+acms_avg_merge(TypeVarAcm tvacm, TypeVarAcmState target, 
+			   TypeVarAcmState source)
+{
+	struct acm_avg *acm = (struct acm_avg*)tvacm;
+	struct acm_avg_state *tgt = (struct acm_avg_state*)target;
+	struct acm_avg_state *src = (struct acm_avg_state*)source;
+
+	if (!src->count)
+		return 0;
+
+	vh_typevar_op_fp(acm->mergeop, acms_avg(tgt), acms_avg(src));
+	tgt->count += src->count;
+
+	return 0;
+}
+
 static void
 acm_avg_finalize(TypeVarAcm a)
 {
@@ -244,6 +274,12 @@ acm_avg_finalize(TypeVarAcm a)
 		vh_typevar_op_destroy(acm->op);
 		acm->op = 0;
 	}
+
+	if (acm->mergeop)
+	{
+		vh_typevar_op_destroy(acm->mergeop);
+		acm->mergeop = 0;
+	}
 }
 
 /*
@@ -289,6 +325,18 @@ acms_count_result(TypeVarAcm tvacm, TypeVarAcmState tvacms,
 	return 0;
 }
 
+static int32_t
+acms_count_merge(TypeVarAcm tvacm, TypeVarAcmState target,
+				 TypeVarAcmState source)
+{
+	struct acm_count_state *tgt = (struct acm_count_state*)target;
+	struct acm_count_state *src = (struct acm_count_state*)source;
+
+	tgt->count += src->count;
+
+	return 0;
+}
+
 static void
 acm_count_finalize(TypeVarAcm a)
 {
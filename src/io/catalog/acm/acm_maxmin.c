@@ -57,6 +57,7 @@ static void acms_maxmin_finalize(TypeVarAcm, TypeVarAcmState);
 
 static int32_t acms_maxmin_input(TypeVarAcm, TypeVarAcmState, va_list args);
 static int32_t acms_maxmin_result(TypeVarAcm, TypeVarAcmState, TypeVarSlot*);
+static int32_t acms_maxmin_merge(TypeVarAcm, TypeVarAcmState, TypeVarAcmState);
 
 static void acm_maxmin_finalize(TypeVarAcm);
 
@@ -67,6 +68,7 @@ static const struct TypeVarAcmFuncs acm_maxmin_funcs = {
 
 	.input = acms_maxmin_input,
 	.result = acms_maxmin_result,
+	.merge = acms_maxmin_merge,
 
 	.finalize = acm_maxmin_finalize
 };
@@ -262,6 +264,38 @@ acms_maxmin_result(TypeVarAcm tvacm, TypeVarAcmState tvacms, TypeVarSlot *slot)
 	return 0;
 }
 
+/*
+ * acms_maxmin_merge
+ *
+ * Treat the source's value as one more input, if the source has seen any.
+ */
+static int32_t
+acms_maxmin_merge(TypeVarAcm tvacm, TypeVarAcmState target,
+				  TypeVarAcmState source)
+{
+	struct acm_maxmin *acm = (struct acm_maxmin*)tvacm;
+	struct acm_maxmin_state *tgt = (struct acm_maxmin_state*)target;
+	struct acm_maxmin_state *src = (struct acm_maxmin_state*)source;
+
+	if (!src->set)
+		return 0;
+
+	if (!tgt->set)
+	{
+		vh_typevar_op_fp(acm->setter, acms_maxmin(tgt), acms_maxmin(src));
+		tgt->set = true;
+
+		return 0;
+	}
+
+	if (vh_typevar_comp_fp(acm->comp, acms_maxmin(src), acms_maxmin(tgt)))
+	{
+		vh_typevar_op_fp(acm->setter, acms_maxmin(tgt), acms_maxmin(src));
+	}
+
+	return 0;
+}
+
 static void
 acm_maxmin_finalize(TypeVarAcm tvacm)
 {
@@ -86,6 +86,8 @@ static int32_t acms_stat_input(TypeVarAcm tvacm, TypeVarAcmState tvacms,
 							   va_list args);
 static int32_t acms_stat_result(TypeVarAcm tvacm, TypeVarAcmState tvacms,
  								TypeVarSlot *slot);
+static int32_t acms_stat_merge(TypeVarAcm tvacm, TypeVarAcmState target,
+							   TypeVarAcmState source);
 
 static void acm_finalize(TypeVarAcm tvacm);
 
@@ -95,6 +97,7 @@ static const struct TypeVarAcmFuncs acm_stat_func = {
 
 	.input = acms_stat_input,
 	.result = acms_stat_result,
+	.merge = acms_stat_merge,
 
 	.finalize = acm_finalize
 };
@@ -302,6 +305,31 @@ acms_stat_result(TypeVarAcm tvacm, TypeVarAcmState tvacms, TypeVarSlot *slot)
 	return 0;
 }
 
+/*
+ * acms_stat_merge
+ *
+ * The state is just the count, the sum of x and the sum of x squared.  All
+ * three are additive, so partial states combine exactly.
+ */
+static int32_t
+acms_stat_merge(TypeVarAcm tvacm, TypeVarAcmState target, 
+				TypeVarAcmState source)
+{
+	acms_decl(tgt, target);
+	acms_decl(src, source);
+	acm_decl(acm, tvacm);
+
+	if (!src->count)
+		return 0;
+
+	tgt->count += src->count;
+
+	vh_typevar_op_fp(acm->accum, acms_sum_x(tgt), acms_sum_x(src));
+	vh_typevar_op_fp(acm->accum, acms_sum_x2(tgt), acms_sum_x2(src));
+
+	return 0;
+}
+
 static void
 acm_finalize(TypeVarAcm tvacm)
 {
@@ -44,6 +44,7 @@ static void acms_sum_finalize(TypeVarAcm, TypeVarAcmState);
 
 static int32_t acms_sum_input(TypeVarAcm, TypeVarAcmState, va_list args);
 static int32_t acms_sum_result(TypeVarAcm, TypeVarAcmState, TypeVarSlot*);
+static int32_t acms_sum_merge(TypeVarAcm, TypeVarAcmState, TypeVarAcmState);
 
 static void acm_sum_finalize(TypeVarAcm);
 
@@ -54,6 +55,7 @@ static const struct TypeVarAcmFuncs acm_sum_funcs = {
 
 	.input = acms_sum_input,
 	.result = acms_sum_result,
+	.merge = acms_sum_merge,
 
 	.finalize = acm_sum_finalize
 };
@@ -143,6 +145,18 @@ acms_sum_result(TypeVarAcm tvacm, TypeVarAcmState tvacms, TypeVarSlot *slot)
 	return 0;
 }
 
+static int32_t
+acms_sum_merge(TypeVarAcm tvacm, TypeVarAcmState target, TypeVarAcmState source)
+{
+	struct acm_sum *acm = (struct acm_sum*)tvacm;
+	struct acm_sum_state *tgt = (struct acm_sum_state*)target;
+	struct acm_sum_state *src = (struct acm_sum_state*)source;
+
+	vh_typevar_op_fp(acm->op, acms_sum(tgt), acms_sum(src));
+
+	return 0;
+}
+
 static void
 acm_sum_finalize(TypeVarAcm tvacm)
 {
@@ -317,7 +317,6 @@ static struct JsonStringifyFormats stringify_fmts[] = {
 	{ 0, 0 }
 };
 
-static const char* json_stringify_get_fmt(Type ty);
 
 
 
@@ -2033,7 +2032,7 @@ json_htp_resolve_field_name(HeapTuplePtr htp, const char *field_name)
 	HeapTuple ht;
 	HeapField hf;
 
-	ht = vh_htp(htp);
+	ht = vh_htp_read(htp);
 
 	if (ht)
 	{
@@ -2340,7 +2339,7 @@ json_stringify(HashTable htbl, Json jval, String str)
 
 			if (jpr->htp)
 			{
-				ht = vh_htp(jpr->htp);
+				ht = vh_htp_read(jpr->htp);
 				hf = vh_htd_field_by_idx(ht->htd, jpr->field_idx);
 
 				vh_str.Append(str, "\"");
@@ -2456,7 +2455,7 @@ json_stringify(HashTable htbl, Json jval, String str)
 
 			if (jpvr->htp)
 			{
-				ht = vh_htp(jpvr->htp);
+				ht = vh_htp_read(jpvr->htp);
 				hf = vh_htd_field_by_idx(ht->htd, jpvr->field_idx);
 				/*
 				 * Need to grab the field index from the HeapTuple.
@@ -2543,7 +2542,7 @@ json_stringify(HashTable htbl, Json jval, String str)
 
 			jvr = jval;
 
-			ht = vh_htp(jvr->htp);
+			ht = vh_htp_read(jvr->htp);
 			hf = vh_htd_field_by_idx(ht->htd, jvr->field_idx);
 			fval = vh_ht_field(ht, hf);
 
@@ -2638,7 +2637,7 @@ json_stringify_data(HashTable htbl, Type *tys, int32_t ty_depth,
 			 * vh_tam_cstr_format which will build us a formatter we can then
 			 * push back into the hash table.
 			 */
-			pattern = json_stringify_get_fmt(ty);
+			pattern = vh_json_stringify_fmt(ty);
 			formatter = vh_tam_cstr_format(ty, 					/* Type */
 										   pattern,				/* Pattern */
 										   0,					/* Patterns */
@@ -2760,8 +2759,14 @@ json_stringify_extend_str_buff(void *buffer_head,
 	return buf;
 }
 
-static const char*
-json_stringify_get_fmt(Type ty)
+/*
+ * vh_json_stringify_fmt
+ *
+ * Returns the cstr format pattern JSON output uses for a Type, or null when
+ * the Type's default output is already a JSON literal.
+ */
+const char*
+vh_json_stringify_fmt(Type ty)
 {
 	const char *fmt = 0;
 	int32_t i;
@@ -2856,7 +2861,7 @@ vh_htp_json(HeapTuplePtr htp,
 	HeapTupleDef htd;
 	int32_t ret;
 
-	ht = vh_htp(htp);
+	ht = vh_htp_read(htp);
 
 	if (ht)
 	{
@@ -2889,7 +2894,7 @@ vh_htp_json_nm_inc(HeapTuplePtr htp,
 	HeapTupleDef htd;
 	int32_t ret;
 
-	ht = vh_htp(htp);
+	ht = vh_htp_read(htp);
 
 	if (ht)
 	{
@@ -4,13 +4,113 @@
 
 
 
+#include <assert.h>
+
 #include "vh.h"
+#include "io/catalog/HeapTuple.h"
+#include "io/catalog/TableDef.h"
+#include "io/catalog/TableField.h"
+#include "io/catalog/Type.h"
+#include "io/catalog/tam.h"
 #include "io/catalog/types/njson.h"
 #include "io/catalog/types/njson_parse.h"
+#include "io/utils/SList.h"
+
+static Type tys_bool[] = { &vh_type_bool, 0 };
+static Type tys_dbl[] = { &vh_type_dbl, 0 };
+static Type tys_int64[] = { &vh_type_int64, 0 };
+static Type tys_string[] = { &vh_type_String, 0 };
+
+
+/*
+ * Json tree builder
+ *
+ * Every container that's still open sits on |stack|.  A value inside an
+ * object becomes a JsonPair named by the last key we saw, a value inside an
+ * array is pushed as is.  Containers are linked into their parent as soon as
+ * they're opened so nothing has to be remembered when they close.
+ */
+typedef struct JsonTreeBuilderData
+{
+	Json root;
+	Json stack[VH_JSON_SAX_MAXDEPTH];
+	int32_t depth;
 
-#include "njson_gram.h"
+	char *key;
+	size_t key_sz;
+} JsonTreeBuilderData, *JsonTreeBuilder;
 
-vh_json_strp_scan_t vh_json_strp_scanner_init(const char*, size_t, struct JsonScanExtraData*);
+static bool jtb_object_start(void *user);
+static bool jtb_array_start(void *user);
+static bool jtb_end(void *user);
+static bool jtb_key(void *user, const char *key, size_t len);
+static bool jtb_string(void *user, const char *str, size_t len);
+static bool jtb_number_i(void *user, int64_t value, const char *text, size_t len);
+static bool jtb_number_f(void *user, double value, const char *text, size_t len);
+static bool jtb_boolean(void *user, bool value);
+static bool jtb_null(void *user);
+
+static void* jtb_scalar(JsonTreeBuilder jtb, Type *tys);
+static void jtb_container(JsonTreeBuilder jtb, Json jcont);
+
+static const JsonSaxCallbacks jtb_callbacks = {
+	.object_start = jtb_object_start,
+	.object_end = jtb_end,
+	.array_start = jtb_array_start,
+	.array_end = jtb_end,
+	.key = jtb_key,
+	.string = jtb_string,
+	.number_i = jtb_number_i,
+	.number_f = jtb_number_f,
+	.boolean = jtb_boolean,
+	.null = jtb_null
+};
+
+
+/*
+ * Json to HeapTuple
+ *
+ * Only the keys of the top level object are matched against the TableDefVer's
+ * fields by name.  Nested objects and arrays are validated and skipped.
+ *
+ * Fields with a single native numeric, bool or String type are written
+ * directly from the parsed value.  Any other Type gets the token text
+ * through its cstr_set TAM.
+ */
+typedef struct JsonHtpFillData
+{
+	TableField *tf_head;
+	int32_t tf_sz;
+
+	HeapTuple ht;
+	TableField tf;
+	int32_t depth;
+} JsonHtpFillData, *JsonHtpFill;
+
+static bool jhf_object_start(void *user);
+static bool jhf_array_start(void *user);
+static bool jhf_end(void *user);
+static bool jhf_key(void *user, const char *key, size_t len);
+static bool jhf_string(void *user, const char *str, size_t len);
+static bool jhf_number_i(void *user, int64_t value, const char *text, size_t len);
+static bool jhf_number_f(void *user, double value, const char *text, size_t len);
+static bool jhf_boolean(void *user, bool value);
+static bool jhf_null(void *user);
+
+static void jhf_cstr(JsonHtpFill jhf, const char *text, size_t len);
+
+static const JsonSaxCallbacks jhf_callbacks = {
+	.object_start = jhf_object_start,
+	.object_end = jhf_end,
+	.array_start = jhf_array_start,
+	.array_end = jhf_end,
+	.key = jhf_key,
+	.string = jhf_string,
+	.number_i = jhf_number_i,
+	.number_f = jhf_number_f,
+	.boolean = jhf_boolean,
+	.null = jhf_null
+};
 
 
 Json
@@ -22,17 +122,491 @@ vh_json_strp_parser(const char *str)
 Json
 vh_json_strp_parsern(const char *str, size_t len)
 {
-	vh_json_strp_scan_t yyscanner;
-	JsonParserExtraData yyextra;
-	int yyresult;
+	JsonTreeBuilderData jtb = { };
+	int32_t ret;
+
+	ret = vh_json_sax_parse(str, len, &jtb_callbacks, &jtb);
 
-	yyscanner = vh_json_strp_scanner_init(str, len, &yyextra.scanner_yy_extra);
-	yyresult = json_parse_yyparse(yyscanner);
+	if (jtb.key)
+		vhfree(jtb.key);
 
-	if (yyresult)
+	if (ret)
 	{
+		if (jtb.root)
+			vh_json_destroy(jtb.root);
+
 		return 0;
 	}
 
-	return yyextra.root;
+	return jtb.root;
+}
+
+/*
+ * vh_json_strp_htp_tdv
+ *
+ * Parses a JSON object straight into a new HeapTuple for |tdv|, without
+ * building a Json tree first.  Returns zero on success and a negative value
+ * when the document isn't valid JSON or isn't an object, in which case
+ * |htp| is set to zero.
+ */
+int32_t
+vh_json_strp_htp_tdv(TableDefVer tdv,
+					 const char *str, size_t len,
+					 HeapTuplePtr *htp)
+{
+	JsonHtpFillData jhf = { };
+	SList fields;
+	HeapTuplePtr htpl;
+	int32_t ret;
+
+	fields = vh_tdv_tf_filter(tdv, 0, 0, false);
+	assert(fields);
+
+	jhf.tf_sz = vh_SListIterator(fields, jhf.tf_head);
+
+	htpl = vh_allochtp_td(tdv->td);
+	jhf.ht = vh_htp(htpl);
+
+	ret = vh_json_sax_parse(str, len, &jhf_callbacks, &jhf);
+
+	vh_SListDestroy(fields);
+
+	if (ret)
+	{
+		vh_htp_free(htpl);
+		*htp = 0;
+
+		return ret;
+	}
+
+	*htp = htpl;
+
+	return 0;
+}
+
+
+/*
+ * ============================================================================
+ * Json Tree Builder Callbacks
+ * ============================================================================
+ */
+
+static bool
+jtb_object_start(void *user)
+{
+	jtb_container(user, vh_json_make_object());
+
+	return true;
+}
+
+static bool
+jtb_array_start(void *user)
+{
+	jtb_container(user, vh_json_make_array());
+
+	return true;
+}
+
+static bool
+jtb_end(void *user)
+{
+	JsonTreeBuilder jtb = user;
+
+	assert(jtb->depth > 0);
+	jtb->depth--;
+
+	return true;
+}
+
+static bool
+jtb_key(void *user, const char *key, size_t len)
+{
+	JsonTreeBuilder jtb = user;
+
+	if (len + 1 > jtb->key_sz)
+	{
+		if (jtb->key)
+			vhfree(jtb->key);
+
+		jtb->key_sz = len + 1 < 64 ? 64 : len + 1;
+		jtb->key = vhmalloc(jtb->key_sz);
+	}
+
+	memcpy(jtb->key, key, len);
+	jtb->key[len] = '\0';
+
+	return true;
+}
+
+static bool
+jtb_string(void *user, const char *str, size_t len)
+{
+	String val = jtb_scalar(user, tys_string);
+
+	vh_str.AssignN(val, str, len);
+
+	return true;
+}
+
+static bool
+jtb_number_i(void *user, int64_t value, const char *text, size_t len)
+{
+	int64_t *val = jtb_scalar(user, tys_int64);
+
+	*val = value;
+
+	return true;
+}
+
+static bool
+jtb_number_f(void *user, double value, const char *text, size_t len)
+{
+	double *val = jtb_scalar(user, tys_dbl);
+
+	*val = value;
+
+	return true;
+}
+
+static bool
+jtb_boolean(void *user, bool value)
+{
+	bool *val = jtb_scalar(user, tys_bool);
+
+	*val = value;
+
+	return true;
+}
+
+static bool
+jtb_null(void *user)
+{
+	JsonTreeBuilder jtb = user;
+	Json jval, parent = jtb->depth ? jtb->stack[jtb->depth - 1] : 0;
+
+	if (parent && vh_json_isa_obj(parent))
+	{
+		jval = vh_json_make_pair_null(jtb->key);
+		vh_json_obj_add_pair(parent, jval);
+	}
+	else
+	{
+		jval = vh_json_make_value_null();
+
+		if (parent)
+			vh_json_arr_push(parent, jval);
+		else
+			jtb->root = jval;
+	}
+
+	return true;
+}
+
+/*
+ * Makes a pair or value for a scalar of type |tys|, links it into the tree
+ * and returns the storage for the scalar.
+ */
+static void*
+jtb_scalar(JsonTreeBuilder jtb, Type *tys)
+{
+	Json jval, parent = jtb->depth ? jtb->stack[jtb->depth - 1] : 0;
+	bool is_typevar;
+
+	if (parent && vh_json_isa_obj(parent))
+	{
+		jval = vh_json_make_pair(tys, 1, jtb->key);
+		vh_json_obj_add_pair(parent, jval);
+	}
+	else
+	{
+		jval = vh_json_make_value(tys, 1);
+
+		if (parent)
+			vh_json_arr_push(parent, jval);
+		else
+			jtb->root = jval;
+	}
+
+	return vh_json_typevar(jval, &is_typevar);
+}
+
+static void
+jtb_container(JsonTreeBuilder jtb, Json jcont)
+{
+	Json parent = jtb->depth ? jtb->stack[jtb->depth - 1] : 0;
+
+	if (!parent)
+		jtb->root = jcont;
+	else if (vh_json_isa_obj(parent))
+		vh_json_obj_add_pair(parent, vh_json_make_pair_objarr(jtb->key, jcont));
+	else
+		vh_json_arr_push(parent, jcont);
+
+	assert(jtb->depth < VH_JSON_SAX_MAXDEPTH);
+	jtb->stack[jtb->depth++] = jcont;
+}
+
+
+/*
+ * ============================================================================
+ * Json to HeapTuple Callbacks
+ * ============================================================================
+ */
+
+static bool
+jhf_object_start(void *user)
+{
+	JsonHtpFill jhf = user;
+
+	jhf->depth++;
+
+	return true;
+}
+
+static bool
+jhf_array_start(void *user)
+{
+	JsonHtpFill jhf = user;
+
+	if (!jhf->depth)
+	{
+		elog(WARNING,
+			 emsg("A JSON array cannot be parsed into a HeapTuple, a JSON "
+				  "object was expected."));
+
+		return false;
+	}
+
+	jhf->depth++;
+
+	return true;
+}
+
+static bool
+jhf_end(void *user)
+{
+	JsonHtpFill jhf = user;
+
+	jhf->depth--;
+	jhf->tf = 0;
+
+	return true;
+}
+
+static bool
+jhf_key(void *user, const char *key, size_t len)
+{
+	JsonHtpFill jhf = user;
+	TableField tf;
+	int32_t i;
+
+	jhf->tf = 0;
+
+	if (jhf->depth != 1)
+		return true;
+
+	for (i = 0; i < jhf->tf_sz; i++)
+	{
+		tf = jhf->tf_head[i];
+
+		if (vh_strlen(tf->fname) == len &&
+			memcmp(vh_str_buffer(tf->fname), key, len) == 0)
+		{
+			jhf->tf = tf;
+			break;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * The scalar callbacks only act on a value directly under a matched key.
+ * A scalar at the top level isn't an object, so we stop the parse.
+ */
+#define jhf_target(jhf)																\
+	( (jhf)->depth == 1 ? (jhf)->tf : 0 )
+
+#define jhf_toplevel(jhf)															\
+	do {																			\
+		if (!(jhf)->depth)															\
+		{																			\
+			elog(WARNING,															\
+				 emsg("A JSON scalar cannot be parsed into a HeapTuple, a JSON "	\
+					  "object was expected."));										\
+			return false;															\
+		}																			\
+	} while (0)
+
+static bool
+jhf_string(void *user, const char *str, size_t len)
+{
+	JsonHtpFill jhf = user;
+	TableField tf;
+
+	jhf_toplevel(jhf);
+
+	if (!(tf = jhf_target(jhf)))
+		return true;
+
+	vh_htf_clearnull(jhf->ht, &tf->heap);
+
+	if (tf->heap.type_depth == 1 && tf->heap.types[0] == &vh_type_String)
+		vh_str.AssignN((String)vh_ht_field(jhf->ht, &tf->heap), str, len);
+	else
+		jhf_cstr(jhf, str, len);
+
+	return true;
+}
+
+static bool
+jhf_number_i(void *user, int64_t value, const char *text, size_t len)
+{
+	JsonHtpFill jhf = user;
+	TableField tf;
+	void *field;
+	Type ty;
+
+	jhf_toplevel(jhf);
+
+	if (!(tf = jhf_target(jhf)))
+		return true;
+
+	vh_htf_clearnull(jhf->ht, &tf->heap);
+
+	field = vh_ht_field(jhf->ht, &tf->heap);
+	ty = tf->heap.type_depth == 1 ? tf->heap.types[0] : 0;
+
+	if (ty == &vh_type_int64)
+		*((int64_t*)field) = value;
+	else if (ty == &vh_type_int32)
+		*((int32_t*)field) = (int32_t)value;
+	else if (ty == &vh_type_int16)
+		*((int16_t*)field) = (int16_t)value;
+	else if (ty == &vh_type_dbl)
+		*((double*)field) = (double)value;
+	else if (ty == &vh_type_float)
+		*((float*)field) = (float)value;
+	else if (ty == &vh_type_bool)
+		*((bool*)field) = value != 0;
+	else
+		jhf_cstr(jhf, text, len);
+
+	return true;
+}
+
+static bool
+jhf_number_f(void *user, double value, const char *text, size_t len)
+{
+	JsonHtpFill jhf = user;
+	TableField tf;
+	void *field;
+	Type ty;
+
+	jhf_toplevel(jhf);
+
+	if (!(tf = jhf_target(jhf)))
+		return true;
+
+	vh_htf_clearnull(jhf->ht, &tf->heap);
+
+	field = vh_ht_field(jhf->ht, &tf->heap);
+	ty = tf->heap.type_depth == 1 ? tf->heap.types[0] : 0;
+
+	if (ty == &vh_type_dbl)
+		*((double*)field) = value;
+	else if (ty == &vh_type_float)
+		*((float*)field) = (float)value;
+	else if (ty == &vh_type_int64)
+		*((int64_t*)field) = (int64_t)value;
+	else if (ty == &vh_type_int32)
+		*((int32_t*)field) = (int32_t)value;
+	else if (ty == &vh_type_int16)
+		*((int16_t*)field) = (int16_t)value;
+	else
+		jhf_cstr(jhf, text, len);
+
+	return true;
+}
+
+static bool
+jhf_boolean(void *user, bool value)
+{
+	JsonHtpFill jhf = user;
+	TableField tf;
+
+	jhf_toplevel(jhf);
+
+	if (!(tf = jhf_target(jhf)))
+		return true;
+
+	vh_htf_clearnull(jhf->ht, &tf->heap);
+
+	if (tf->heap.type_depth == 1 && tf->heap.types[0] == &vh_type_bool)
+		*((bool*)vh_ht_field(jhf->ht, &tf->heap)) = value;
+	else if (value)
+		jhf_cstr(jhf, "true", 4);
+	else
+		jhf_cstr(jhf, "false", 5);
+
+	return true;
 }
+
+static bool
+jhf_null(void *user)
+{
+	JsonHtpFill jhf = user;
+	TableField tf;
+
+	jhf_toplevel(jhf);
+
+	if ((tf = jhf_target(jhf)))
+		vh_htf_setnull(jhf->ht, &tf->heap);
+
+	return true;
+}
+
+/*
+ * jhf_cstr
+ *
+ * Hands the token text to the field's cstr_set TAM.  Not every Type honors
+ * the length, so the text gets null terminated first.
+ */
+static void
+jhf_cstr(JsonHtpFill jhf, const char *text, size_t len)
+{
+	static const struct CStrAMOptionsData cstr_opts = { .malloc = false };
+	TableField tf = jhf->tf;
+	TamSetUnion funcs[VH_TAMS_MAX_DEPTH];
+	void *fmts[VH_TAMS_MAX_DEPTH] = { };
+	vh_tam_cstr_fmt_destroy fmt_destroy;
+	char buf[64], *tmp;
+	int32_t i;
+
+	vh_tam_tf_fill_set(TAM_CStr, tf, funcs, fmts);
+
+	tmp = len < sizeof(buf) ? buf : vhmalloc(len + 1);
+	memcpy(tmp, text, len);
+	tmp[len] = '\0';
+
+	vh_tam_fireu_cstr_set(&tf->heap.types[0],					/* Type stack */
+						  funcs,								/* Functions */
+						  &cstr_opts,							/* CStrAMOptions */
+						  tmp,									/* Source */
+						  vh_ht_field(jhf->ht, &tf->heap),		/* Target */
+						  len,									/* Length */
+						  0,									/* Cursor */
+						  fmts);								/* Format */
+
+	if (tmp != buf)
+		vhfree(tmp);
+
+	for (i = 0; i < tf->heap.type_depth; i++)
+	{
+		fmt_destroy = tf->heap.types[i]->tam.cstr_fmt_destroy;
+
+		if (fmt_destroy && fmts[i])
+			fmt_destroy(tf->heap.types[i], fmts[i]);
+	}
+}
+
@@ -0,0 +1,828 @@
+/*
+ * Copyright (c) 2011-2017, Kyle A. Gearhart
+ */
+
+
+
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vh.h"
+#include "io/buffer/HeapBuffer.h"
+#include "io/catalog/HeapField.h"
+#include "io/catalog/HeapTuple.h"
+#include "io/catalog/TableDef.h"
+#include "io/catalog/TableField.h"
+#include "io/catalog/Type.h"
+#include "io/catalog/types/njson.h"
+#include "io/catalog/types/njson_plan.h"
+#include "io/utils/SList.h"
+
+#define JSON_PLAN_FD_BUFFER				(64 * 1024)
+#define JSON_PLAN_TAM_WIDTH				(32)
+#define JSON_PLAN_STR_WIDTH				(32)
+
+/*
+ * JsonPlanSink
+ *
+ * Both outputs share one writer.  For a String we write straight into the
+ * String's buffer and set its length once we're done.  For a file descriptor
+ * we fill a fixed size buffer and flush it with write(2) whenever the next
+ * value won't fit.
+ *
+ * One byte past |cap| is always available so the String can be null
+ * terminated.
+ */
+typedef struct JsonPlanSinkData
+{
+	char *buffer;
+	size_t len;
+	size_t cap;
+	String str;
+	int fd;
+	int32_t err;
+} JsonPlanSinkData, *JsonPlanSink;
+
+typedef struct JsonPlanFieldData *JsonPlanField;
+typedef void (*JsonPlanPut)(JsonPlanSink sink, JsonPlanField jpf,
+							const void *data);
+
+struct JsonPlanFieldData
+{
+	HeapField hf;
+	JsonPlanPut put;
+	const char *key;		/* {"name": for the first field, ,"name": after */
+	size_t key_len;
+	size_t width;			/* Estimated width of the value */
+	TamGetUnion getters[VH_TAMS_MAX_DEPTH];
+	void *fmts[VH_TAMS_MAX_DEPTH];
+};
+
+struct JsonHtpPlanData
+{
+	TableDefVer tdv;
+	struct JsonPlanFieldData *fields;
+	int32_t nfields;
+	size_t row_sz;
+	char *keys;
+};
+
+static bool jps_flush(JsonPlanSink sink);
+static bool jps_grow(JsonPlanSink sink, size_t space);
+static void jps_str_finish(JsonPlanSink sink);
+
+#define jps_reserve(sink, space)	(((sink)->cap - (sink)->len >= (space) || 	\
+									  jps_grow((sink), (space))) ?				\
+									 (sink)->buffer + (sink)->len : 0)
+
+static void jps_put(JsonPlanSink sink, const char *src, size_t len);
+
+static int32_t jp_write(JsonHtpPlan plan, HeapTuplePtr *htps, int32_t nhtps,
+						bool array, JsonPlanSink sink);
+static void jp_write_ht(JsonHtpPlan plan, HeapTuple ht, JsonPlanSink sink);
+static int32_t jp_write_str(JsonHtpPlan plan, HeapTuplePtr *htps,
+							int32_t nhtps, bool array, String str);
+
+static size_t jp_escape(char *dst, const char *src, size_t len);
+static size_t jp_uint64(char *dst, uint64_t value);
+
+static void jpf_put_int16(JsonPlanSink sink, JsonPlanField jpf, const void *data);
+static void jpf_put_int32(JsonPlanSink sink, JsonPlanField jpf, const void *data);
+static void jpf_put_int64(JsonPlanSink sink, JsonPlanField jpf, const void *data);
+static void jpf_put_dbl(JsonPlanSink sink, JsonPlanField jpf, const void *data);
+static void jpf_put_float(JsonPlanSink sink, JsonPlanField jpf, const void *data);
+static void jpf_put_bool(JsonPlanSink sink, JsonPlanField jpf, const void *data);
+static void jpf_put_string(JsonPlanSink sink, JsonPlanField jpf, const void *data);
+static void jpf_put_tam(JsonPlanSink sink, JsonPlanField jpf, const void *data);
+
+static void jpf_resolve(JsonPlanField jpf);
+
+
+/*
+ * ============================================================================
+ * Plan Construction
+ * ============================================================================
+ */
+
+JsonHtpPlan
+vh_json_htp_plan_create(TableDefVer tdv,
+						TableField *field_list, int32_t nfields,
+						bool mode_exclude)
+{
+	JsonHtpPlan plan;
+	JsonPlanField jpf;
+	SList fields;
+	TableField *tf_head, tf;
+	size_t keys_sz = 0, key_len;
+	int32_t i, tf_sz;
+	char *keys;
+
+	fields = vh_tdv_tf_filter(tdv, field_list, nfields, mode_exclude);
+	assert(fields);
+
+	tf_sz = vh_SListIterator(fields, tf_head);
+
+	/*
+	 * Escaping can grow a name by six times, plus two quotes, the colon and
+	 * the leading brace or comma.
+	 */
+	for (i = 0; i < tf_sz; i++)
+		keys_sz += vh_strlen(tf_head[i]->fname) * 6 + 4;
+
+	plan = vhmalloc(sizeof(struct JsonHtpPlanData));
+	plan->tdv = tdv;
+	plan->nfields = tf_sz;
+	plan->fields = tf_sz ? vhmalloc(sizeof(struct JsonPlanFieldData) * tf_sz) : 0;
+	plan->keys = keys = tf_sz ? vhmalloc(keys_sz) : 0;
+	plan->row_sz = 2;
+
+	for (i = 0; i < tf_sz; i++)
+	{
+		tf = tf_head[i];
+		jpf = &plan->fields[i];
+
+		keys[0] = i ? ',' : '{';
+		keys[1] = '"';
+		key_len = jp_escape(keys + 2, vh_str_buffer(tf->fname),
+							vh_strlen(tf->fname));
+		keys[key_len + 2] = '"';
+		keys[key_len + 3] = ':';
+
+		jpf->hf = &tf->heap;
+		jpf->key = keys;
+		jpf->key_len = key_len + 4;
+		keys += jpf->key_len;
+
+		jpf_resolve(jpf);
+
+		plan->row_sz += jpf->key_len + jpf->width;
+	}
+
+	vh_SListDestroy(fields);
+
+	return plan;
+}
+
+void
+vh_json_htp_plan_destroy(JsonHtpPlan plan)
+{
+	JsonPlanField jpf;
+	int32_t i;
+
+	for (i = 0; i < plan->nfields; i++)
+	{
+		jpf = &plan->fields[i];
+
+		if (jpf->put == jpf_put_tam)
+			vh_tam_cstr_formats_destroy(jpf->hf->types, jpf->fmts);
+	}
+
+	if (plan->fields)
+		vhfree(plan->fields);
+
+	if (plan->keys)
+		vhfree(plan->keys);
+
+	vhfree(plan);
+}
+
+/*
+ * jpf_resolve
+ *
+ * Picks the put function for a field.  Single level types we know how to
+ * write natively skip the TAM entirely; everything else gets its getters and
+ * formatters resolved here, once for the life of the plan.
+ */
+static void
+jpf_resolve(JsonPlanField jpf)
+{
+	HeapField hf = jpf->hf;
+	Type ty = hf->types[0];
+	int32_t i;
+
+	if (hf->type_depth == 1)
+	{
+		if (ty == &vh_type_int16)
+		{
+			jpf->put = jpf_put_int16;
+			jpf->width = 6;
+			return;
+		}
+		else if (ty == &vh_type_int32)
+		{
+			jpf->put = jpf_put_int32;
+			jpf->width = 11;
+			return;
+		}
+		else if (ty == &vh_type_int64)
+		{
+			jpf->put = jpf_put_int64;
+			jpf->width = 20;
+			return;
+		}
+		else if (ty == &vh_type_dbl)
+		{
+			jpf->put = jpf_put_dbl;
+			jpf->width = 24;
+			return;
+		}
+		else if (ty == &vh_type_float)
+		{
+			jpf->put = jpf_put_float;
+			jpf->width = 16;
+			return;
+		}
+		else if (ty == &vh_type_bool)
+		{
+			jpf->put = jpf_put_bool;
+			jpf->width = 5;
+			return;
+		}
+		else if (ty == &vh_type_String)
+		{
+			jpf->put = jpf_put_string;
+			jpf->width = JSON_PLAN_STR_WIDTH;
+			return;
+		}
+	}
+
+	jpf->put = jpf_put_tam;
+	jpf->width = JSON_PLAN_TAM_WIDTH;
+
+	memset(jpf->fmts, 0, sizeof(jpf->fmts));
+
+	for (i = 0; i < hf->type_depth; i++)
+		jpf->fmts[i] = vh_tam_cstr_format(hf->types[i],
+										  vh_json_stringify_fmt(hf->types[i]),
+										  0, 0);
+
+	if (!vh_tams_fill_get_funcs(hf->types, jpf->getters, TAM_CStr))
+		jpf->getters[0].cstr = 0;
+}
+
+
+/*
+ * ============================================================================
+ * Output
+ * ============================================================================
+ */
+
+int32_t
+vh_json_htp_plan_str(JsonHtpPlan plan,
+					 HeapTuplePtr *htps, int32_t nhtps,
+					 String str)
+{
+	return jp_write_str(plan, htps, nhtps, true, str);
+}
+
+int32_t
+vh_json_htp_plan_obj_str(JsonHtpPlan plan,
+						 HeapTuplePtr htp,
+						 String str)
+{
+	return jp_write_str(plan, &htp, 1, false, str);
+}
+
+int32_t
+vh_json_htp_plan_fd(JsonHtpPlan plan,
+					HeapTuplePtr *htps, int32_t nhtps,
+					int fd)
+{
+	JsonPlanSinkData sink = { };
+	int32_t ret;
+
+	sink.buffer = vhmalloc(JSON_PLAN_FD_BUFFER + 1);
+	sink.cap = JSON_PLAN_FD_BUFFER;
+	sink.fd = fd;
+
+	ret = jp_write(plan, htps, nhtps, true, &sink);
+
+	if (!ret)
+		jps_flush(&sink);
+
+	vhfree(sink.buffer);
+
+	return ret ? ret : sink.err;
+}
+
+/*
+ * jp_write_str
+ *
+ * Reserves enough of the String for the whole batch based on the plan's row
+ * estimate, so a typical batch never resizes.  The estimate is raised to what
+ * we actually wrote, so the next batch through the plan reserves enough.
+ */
+static int32_t
+jp_write_str(JsonHtpPlan plan, HeapTuplePtr *htps, int32_t nhtps,
+			 bool array, String str)
+{
+	JsonPlanSinkData sink = { };
+	size_t start, row_sz;
+	int32_t ret;
+
+	start = vh_strlen(str);
+
+	sink.str = str;
+	sink.fd = -1;
+	sink.buffer = vh_str_buffer(str);
+	sink.len = start;
+	sink.cap = vh_str_capacity(str) - 1;
+
+	jps_reserve(&sink, plan->row_sz * nhtps + 2);
+
+	ret = jp_write(plan, htps, nhtps, array, &sink);
+
+	if (nhtps)
+	{
+		row_sz = (sink.len - start) / nhtps;
+
+		if (row_sz > plan->row_sz)
+			plan->row_sz = row_sz;
+	}
+
+	jps_str_finish(&sink);
+
+	return ret;
+}
+
+static int32_t
+jp_write(JsonHtpPlan plan, HeapTuplePtr *htps, int32_t nhtps,
+		 bool array, JsonPlanSink sink)
+{
+	HeapTuple ht;
+	int32_t i;
+
+	if (array)
+		jps_put(sink, "[", 1);
+
+	for (i = 0; i < nhtps; i++)
+	{
+		if (i)
+			jps_put(sink, ",", 1);
+
+		ht = htps[i] ? vh_htp(htps[i]) : 0;
+
+		if (!ht)
+		{
+			jps_put(sink, "null", 4);
+			continue;
+		}
+
+		if (ht->htd != vh_tdv_htd(plan->tdv))
+		{
+			elog(WARNING,
+					emsg("HeapTuplePtr [%llu] at index %d does not belong to "
+						 "the TableDefVer [%p] the JSON plan was compiled for.",
+						 (unsigned long long)htps[i],
+						 i,
+						 plan->tdv));
+
+			return -1;
+		}
+
+		jp_write_ht(plan, ht, sink);
+	}
+
+	if (array)
+		jps_put(sink, "]", 1);
+
+	return sink->err;
+}
+
+static void
+jp_write_ht(JsonHtpPlan plan, HeapTuple ht, JsonPlanSink sink)
+{
+	JsonPlanField jpf;
+	int32_t i;
+
+	if (!plan->nfields)
+	{
+		jps_put(sink, "{}", 2);
+		return;
+	}
+
+	for (i = 0; i < plan->nfields; i++)
+	{
+		jpf = &plan->fields[i];
+
+		jps_put(sink, jpf->key, jpf->key_len);
+
+		if (vh_htf_isnull(ht, jpf->hf))
+			jps_put(sink, "null", 4);
+		else
+			jpf->put(sink, jpf, vh_ht_field(ht, jpf->hf));
+	}
+
+	jps_put(sink, "}", 1);
+}
+
+
+/*
+ * ============================================================================
+ * Field Writers
+ * ============================================================================
+ */
+
+static void
+jpf_put_int16(JsonPlanSink sink, JsonPlanField jpf, const void *data)
+{
+	int16_t value = *(const int16_t*)data;
+	char *p;
+
+	if ((p = jps_reserve(sink, 6)))
+	{
+		if (value < 0)
+		{
+			*p = '-';
+			sink->len += jp_uint64(p + 1, -(int64_t)value) + 1;
+		}
+		else
+		{
+			sink->len += jp_uint64(p, value);
+		}
+	}
+}
+
+static void
+jpf_put_int32(JsonPlanSink sink, JsonPlanField jpf, const void *data)
+{
+	int32_t value = *(const int32_t*)data;
+	char *p;
+
+	if ((p = jps_reserve(sink, 11)))
+	{
+		if (value < 0)
+		{
+			*p = '-';
+			sink->len += jp_uint64(p + 1, -(int64_t)value) + 1;
+		}
+		else
+		{
+			sink->len += jp_uint64(p, value);
+		}
+	}
+}
+
+static void
+jpf_put_int64(JsonPlanSink sink, JsonPlanField jpf, const void *data)
+{
+	int64_t value = *(const int64_t*)data;
+	char *p;
+
+	if ((p = jps_reserve(sink, 20)))
+	{
+		if (value < 0)
+		{
+			*p = '-';
+			sink->len += jp_uint64(p + 1, -(uint64_t)value) + 1;
+		}
+		else
+		{
+			sink->len += jp_uint64(p, value);
+		}
+	}
+}
+
+/*
+ * jpf_put_dbl
+ *
+ * JSON has no representation for NaN or infinity, so those are written as
+ * null.  We try the shorter precision first and only fall back to the full
+ * 17 digits when it doesn't round trip.
+ */
+static void
+jpf_put_dbl(JsonPlanSink sink, JsonPlanField jpf, const void *data)
+{
+	double value = *(const double*)data;
+	char *p;
+	int len;
+
+	if (!isfinite(value))
+	{
+		jps_put(sink, "null", 4);
+		return;
+	}
+
+	if ((p = jps_reserve(sink, 32)))
+	{
+		len = snprintf(p, 32, "%.15g", value);
+
+		if (strtod(p, 0) != value)
+			len = snprintf(p, 32, "%.17g", value);
+
+		sink->len += len;
+	}
+}
+
+static void
+jpf_put_float(JsonPlanSink sink, JsonPlanField jpf, const void *data)
+{
+	float value = *(const float*)data;
+	char *p;
+	int len;
+
+	if (!isfinite(value))
+	{
+		jps_put(sink, "null", 4);
+		return;
+	}
+
+	if ((p = jps_reserve(sink, 32)))
+	{
+		len = snprintf(p, 32, "%.6g", value);
+
+		if (strtof(p, 0) != value)
+			len = snprintf(p, 32, "%.9g", value);
+
+		sink->len += len;
+	}
+}
+
+static void
+jpf_put_bool(JsonPlanSink sink, JsonPlanField jpf, const void *data)
+{
+	if (*(const bool*)data)
+		jps_put(sink, "true", 4);
+	else
+		jps_put(sink, "false", 5);
+}
+
+static void
+jpf_put_string(JsonPlanSink sink, JsonPlanField jpf, const void *data)
+{
+	String value = (String)data;
+	size_t len = vh_strlen(value);
+	char *p;
+
+	if ((p = jps_reserve(sink, len * 6 + 2)))
+	{
+		p[0] = '"';
+		len = jp_escape(p + 1, vh_str_buffer(value), len);
+		p[len + 1] = '"';
+
+		sink->len += len + 2;
+	}
+}
+
+/*
+ * jpf_put_tam
+ *
+ * Hands the value to the Type's cstr_get TAM with the formatters we resolved
+ * when the plan was compiled.  When the TAM tells us the value didn't fit,
+ * we grow the sink and ask again.
+ */
+static void
+jpf_put_tam(JsonPlanSink sink, JsonPlanField jpf, const void *data)
+{
+	static const struct CStrAMOptionsData cstropts = { .malloc = false };
+	size_t space = jpf->width, tam_len, tam_cursor;
+	int8_t try_count;
+	char *p;
+
+	if (jpf->getters[0].cstr)
+	{
+		for (try_count = 0; try_count < 3; try_count++)
+		{
+			if (!(p = jps_reserve(sink, space)))
+				return;
+
+			tam_len = space;
+			tam_cursor = 0;
+
+			vh_tam_fireu_cstr_get(jpf->hf->types,
+								  jpf->getters,
+								  &cstropts,
+								  data,
+								  p,
+								  &tam_len,
+								  &tam_cursor,
+								  jpf->fmts);
+
+			if (tam_cursor == tam_len && tam_len <= space)
+			{
+				sink->len += tam_len;
+
+				if (tam_len > jpf->width)
+					jpf->width = tam_len;
+
+				return;
+			}
+
+			space = (tam_len > space ? tam_len : space * 2) + 1;
+		}
+	}
+
+	jps_put(sink, "null", 4);
+}
+
+
+/*
+ * ============================================================================
+ * Encoding Helpers
+ * ============================================================================
+ */
+
+/*
+ * jp_escape
+ *
+ * Writes |src| to |dst| with JSON string escapes applied and returns the
+ * number of bytes written.  |dst| must have room for six times |len|.
+ */
+static size_t
+jp_escape(char *dst, const char *src, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	char *d = dst;
+	unsigned char c;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+	{
+		c = (unsigned char)src[i];
+
+		if (c >= 0x20 && c != '"' && c != '\\')
+		{
+			*d++ = c;
+			continue;
+		}
+
+		*d++ = '\\';
+
+		switch (c)
+		{
+			case '"':
+			case '\\':
+				*d++ = c;
+				break;
+
+			case '\b':
+				*d++ = 'b';
+				break;
+
+			case '\f':
+				*d++ = 'f';
+				break;
+
+			case '\n':
+				*d++ = 'n';
+				break;
+
+			case '\r':
+				*d++ = 'r';
+				break;
+
+			case '\t':
+				*d++ = 't';
+				break;
+
+			default:
+				*d++ = 'u';
+				*d++ = '0';
+				*d++ = '0';
+				*d++ = hex[c >> 4];
+				*d++ = hex[c & 0x0f];
+				break;
+		}
+	}
+
+	return d - dst;
+}
+
+static size_t
+jp_uint64(char *dst, uint64_t value)
+{
+	char tmp[20];
+	size_t len = 0, i;
+
+	do
+	{
+		tmp[len++] = '0' + (value % 10);
+		value /= 10;
+	} while (value);
+
+	for (i = 0; i < len; i++)
+		dst[i] = tmp[len - i - 1];
+
+	return len;
+}
+
+
+/*
+ * ============================================================================
+ * Sink
+ * ============================================================================
+ */
+
+static void
+jps_put(JsonPlanSink sink, const char *src, size_t len)
+{
+	char *p;
+
+	if ((p = jps_reserve(sink, len)))
+	{
+		memcpy(p, src, len);
+		sink->len += len;
+	}
+}
+
+/*
+ * jps_grow
+ *
+ * Makes room for at least |space| more bytes.  A String is resized at least
+ * geometrically so a run of small values doesn't resize every time.  A file
+ * descriptor sink flushes first and only grows its buffer for a single value
+ * larger than the buffer itself.
+ */
+static bool
+jps_grow(JsonPlanSink sink, size_t space)
+{
+	size_t need = sink->len + space;
+
+	if (sink->str)
+	{
+		if (need < sink->cap * 2)
+			need = sink->cap * 2;
+
+		jps_str_finish(sink);
+		vh_str.Resize(sink->str, need + 1);
+
+		sink->buffer = vh_str_buffer(sink->str);
+		sink->cap = vh_str_capacity(sink->str) - 1;
+
+		return true;
+	}
+
+	if (!jps_flush(sink))
+		return false;
+
+	if (space > sink->cap)
+	{
+		sink->buffer = vhrealloc(sink->buffer, space + 1);
+		sink->cap = space;
+	}
+
+	return true;
+}
+
+/*
+ * jps_flush
+ *
+ * Writes the buffer to the file descriptor, retrying partial writes and
+ * interrupted calls.  Once a write fails the sink discards everything else
+ * it's handed.
+ */
+static bool
+jps_flush(JsonPlanSink sink)
+{
+	size_t off = 0;
+	ssize_t ret;
+
+	if (sink->err)
+		return false;
+
+	while (off < sink->len)
+	{
+		ret = write(sink->fd, sink->buffer + off, sink->len - off);
+
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			elog(WARNING,
+					emsg("Unable to write JSON to file descriptor %d: %s",
+						 sink->fd,
+						 strerror(errno)));
+
+			sink->err = -1;
+			sink->len = 0;
+
+			return false;
+		}
+
+		off += ret;
+	}
+
+	sink->len = 0;
+
+	return true;
+}
+
+static void
+jps_str_finish(JsonPlanSink sink)
+{
+	String str = sink->str;
+
+	sink->buffer[sink->len] = '\0';
+
+	if (VH_STR_IS_OOL(str))
+		str->varlen.size = sink->len | VH_STR_FLAG_OOL;
+	else
+		str->varlen.size = sink->len;
+}
+
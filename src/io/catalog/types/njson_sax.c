@@ -0,0 +1,815 @@
+/*
+ * Copyright (c) 2011-2017, Kyle A. Gearhart
+ */
+
+
+
+#include <assert.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "vh.h"
+#include "io/catalog/types/njson_sax.h"
+
+/*
+ * The parser is a small state machine driven by an explicit stack of open
+ * containers, so deeply nested documents can't blow the C stack.  Each
+ * label in vh_json_sax_parse is a state:
+ *
+ * 	value	expecting any JSON value
+ * 	next	a value just finished; expecting a separator or a closing bracket
+ * 	key		expecting an object key followed by a colon
+ *
+ * Plain runs inside strings are located 16 bytes at a time with SSE2, or
+ * 8 bytes at a time in a register without it.  Only strings containing
+ * escape sequences are copied.
+ */
+
+#define SAX_OBJECT			1
+#define SAX_ARRAY			2
+
+#define SAX_OK				0
+#define SAX_SYNTAX			-1
+#define SAX_ABORT			-2
+
+#define SAX_SCRATCH_MIN		256
+
+typedef struct JsonSaxStateData
+{
+	const char *start;
+	const char *cursor;
+	const char *end;
+
+	const JsonSaxCallbacks *callbacks;
+	void *user;
+
+	char *scratch;
+	size_t scratch_sz;
+	size_t scratch_len;
+} JsonSaxStateData, *JsonSaxState;
+
+#define sax_fire(st, cb, ...)															\
+	( (st)->callbacks->cb ? (st)->callbacks->cb((st)->user, ##__VA_ARGS__) : true )
+
+#define sax_skip_ws(st)																	\
+	while ((st)->cursor < (st)->end &&													\
+		   (*(st)->cursor == ' ' || *(st)->cursor == '\n' ||								\
+			*(st)->cursor == '\r' || *(st)->cursor == '\t'))								\
+		(st)->cursor++
+
+#define sax_isdigit(c)		((unsigned char)((c) - '0') < 10)
+
+static const double sax_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int32_t sax_error(JsonSaxState st, const char *at, const char *msg);
+static void sax_scratch_append(JsonSaxState st, const char *src, size_t len);
+static int32_t sax_string(JsonSaxState st, const char **str, size_t *len);
+static int32_t sax_string_escaped(JsonSaxState st, const char *p, char quote,
+								  const char **str, size_t *len);
+static int32_t sax_unicode(JsonSaxState st, const char **p);
+static int32_t sax_number(JsonSaxState st);
+static int32_t sax_literal(JsonSaxState st);
+
+
+int32_t
+vh_json_sax_parse(const char *str, size_t len,
+				  const JsonSaxCallbacks *callbacks,
+				  void *user)
+{
+	JsonSaxStateData st = { };
+	uint8_t stack[VH_JSON_SAX_MAXDEPTH];
+	const char *s;
+	size_t slen;
+	int32_t depth = 0, ret;
+
+	st.start = st.cursor = str;
+	st.end = str + len;
+	st.callbacks = callbacks;
+	st.user = user;
+
+value:
+
+	sax_skip_ws(&st);
+
+	if (st.cursor >= st.end)
+	{
+		ret = sax_error(&st, st.cursor, "unexpected end of input");
+		goto done;
+	}
+
+	switch (*st.cursor)
+	{
+		case '{':
+
+			st.cursor++;
+
+			if (!sax_fire(&st, object_start))
+			{
+				ret = SAX_ABORT;
+				goto done;
+			}
+
+			sax_skip_ws(&st);
+
+			if (st.cursor < st.end && *st.cursor == '}')
+			{
+				st.cursor++;
+
+				if (!sax_fire(&st, object_end))
+				{
+					ret = SAX_ABORT;
+					goto done;
+				}
+
+				goto next;
+			}
+
+			if (depth == VH_JSON_SAX_MAXDEPTH)
+			{
+				ret = sax_error(&st, st.cursor, "nesting too deep");
+				goto done;
+			}
+
+			stack[depth++] = SAX_OBJECT;
+
+			goto key;
+
+		case '[':
+
+			st.cursor++;
+
+			if (!sax_fire(&st, array_start))
+			{
+				ret = SAX_ABORT;
+				goto done;
+			}
+
+			sax_skip_ws(&st);
+
+			if (st.cursor < st.end && *st.cursor == ']')
+			{
+				st.cursor++;
+
+				if (!sax_fire(&st, array_end))
+				{
+					ret = SAX_ABORT;
+					goto done;
+				}
+
+				goto next;
+			}
+
+			if (depth == VH_JSON_SAX_MAXDEPTH)
+			{
+				ret = sax_error(&st, st.cursor, "nesting too deep");
+				goto done;
+			}
+
+			stack[depth++] = SAX_ARRAY;
+
+			goto value;
+
+		case '"':
+		case '\'':
+
+			if ((ret = sax_string(&st, &s, &slen)))
+				goto done;
+
+			if (!sax_fire(&st, string, s, slen))
+			{
+				ret = SAX_ABORT;
+				goto done;
+			}
+
+			break;
+
+		case 't':
+		case 'f':
+		case 'n':
+
+			if ((ret = sax_literal(&st)))
+				goto done;
+
+			break;
+
+		case '-':
+		case '0': case '1': case '2': case '3': case '4':
+		case '5': case '6': case '7': case '8': case '9':
+
+			if ((ret = sax_number(&st)))
+				goto done;
+
+			break;
+
+		default:
+
+			ret = sax_error(&st, st.cursor, "unexpected character");
+			goto done;
+	}
+
+next:
+
+	sax_skip_ws(&st);
+
+	if (!depth)
+	{
+		if (st.cursor != st.end)
+			ret = sax_error(&st, st.cursor, "unexpected characters after the document");
+		else
+			ret = SAX_OK;
+
+		goto done;
+	}
+
+	if (st.cursor >= st.end)
+	{
+		ret = sax_error(&st, st.cursor, "unexpected end of input");
+		goto done;
+	}
+
+	if (stack[depth - 1] == SAX_OBJECT)
+	{
+		if (*st.cursor == ',')
+		{
+			st.cursor++;
+
+			sax_skip_ws(&st);
+
+			goto key;
+		}
+
+		if (*st.cursor == '}')
+		{
+			st.cursor++;
+			depth--;
+
+			if (!sax_fire(&st, object_end))
+			{
+				ret = SAX_ABORT;
+				goto done;
+			}
+
+			goto next;
+		}
+
+		ret = sax_error(&st, st.cursor, "expected ',' or '}'");
+		goto done;
+	}
+
+	if (*st.cursor == ',')
+	{
+		st.cursor++;
+		goto value;
+	}
+
+	if (*st.cursor == ']')
+	{
+		st.cursor++;
+		depth--;
+
+		if (!sax_fire(&st, array_end))
+		{
+			ret = SAX_ABORT;
+			goto done;
+		}
+
+		goto next;
+	}
+
+	ret = sax_error(&st, st.cursor, "expected ',' or ']'");
+	goto done;
+
+key:
+
+	if (st.cursor >= st.end ||
+		(*st.cursor != '"' && *st.cursor != '\''))
+	{
+		ret = sax_error(&st, st.cursor, "expected an object key");
+		goto done;
+	}
+
+	if ((ret = sax_string(&st, &s, &slen)))
+		goto done;
+
+	if (!sax_fire(&st, key, s, slen))
+	{
+		ret = SAX_ABORT;
+		goto done;
+	}
+
+	sax_skip_ws(&st);
+
+	if (st.cursor >= st.end || *st.cursor != ':')
+	{
+		ret = sax_error(&st, st.cursor, "expected ':'");
+		goto done;
+	}
+
+	st.cursor++;
+
+	goto value;
+
+done:
+
+	if (st.scratch)
+		vhfree(st.scratch);
+
+	return ret;
+}
+
+static int32_t
+sax_error(JsonSaxState st, const char *at, const char *msg)
+{
+	elog(WARNING,
+		 emsg("JSON parse error at offset %lu: %s",
+			  (unsigned long)(at - st->start),
+			  msg));
+
+	return SAX_SYNTAX;
+}
+
+static void
+sax_scratch_append(JsonSaxState st, const char *src, size_t len)
+{
+	size_t sz;
+
+	if (st->scratch_len + len > st->scratch_sz)
+	{
+		sz = st->scratch_sz ? st->scratch_sz : SAX_SCRATCH_MIN;
+
+		while (sz < st->scratch_len + len)
+			sz <<= 1;
+
+		if (st->scratch)
+			st->scratch = vhrealloc(st->scratch, sz);
+		else
+			st->scratch = vhmalloc(sz);
+
+		st->scratch_sz = sz;
+	}
+
+	memcpy(st->scratch + st->scratch_len, src, len);
+	st->scratch_len += len;
+}
+
+/*
+ * sax_scan_string
+ *
+ * Returns the first byte at or after |p| that isn't a plain string
+ * character: the closing |quote|, a backslash or a control character.
+ */
+static inline const char*
+sax_scan_string(const char *p, const char *end, char quote)
+{
+#if defined(__SSE2__)
+	__m128i vq = _mm_set1_epi8(quote);
+	__m128i vb = _mm_set1_epi8('\\');
+	__m128i vc = _mm_set1_epi8(0x1f);
+	__m128i x, m;
+	int32_t mask;
+
+	while (end - p >= 16)
+	{
+		x = _mm_loadu_si128((const __m128i*)p);
+		m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, vq),
+									  _mm_cmpeq_epi8(x, vb)),
+						 _mm_cmpeq_epi8(_mm_max_epu8(x, vc), vc));
+		mask = _mm_movemask_epi8(m);
+
+		if (mask)
+			return p + __builtin_ctz(mask);
+
+		p += 16;
+	}
+#else
+	static const uint64_t lsb = 0x0101010101010101ull;
+	static const uint64_t msb = 0x8080808080808080ull;
+	uint64_t x, q, b;
+
+	/*
+	 * Skip whole words that can't contain a stop byte and let the byte loop
+	 * below find the exact position in the word that does.
+	 */
+	while (end - p >= 8)
+	{
+		memcpy(&x, p, sizeof(x));
+		q = x ^ (lsb * (unsigned char)quote);
+		b = x ^ (lsb * '\\');
+
+		if ((((q - lsb) & ~q) | ((b - lsb) & ~b) | ((x - lsb * 0x20) & ~x)) & msb)
+			break;
+
+		p += 8;
+	}
+#endif
+
+	while (p < end && *p != quote && *p != '\\' && (unsigned char)*p >= 0x20)
+		p++;
+
+	return p;
+}
+
+/*
+ * sax_string
+ *
+ * The cursor sits on the opening quote.  When the string has no escape
+ * sequences we return a pointer into the source.
+ */
+static int32_t
+sax_string(JsonSaxState st, const char **str, size_t *len)
+{
+	char quote = *st->cursor++;
+	const char *p;
+
+	p = sax_scan_string(st->cursor, st->end, quote);
+
+	if (p < st->end && *p == quote)
+	{
+		*str = st->cursor;
+		*len = p - st->cursor;
+		st->cursor = p + 1;
+
+		return SAX_OK;
+	}
+
+	return sax_string_escaped(st, p, quote, str, len);
+}
+
+static int32_t
+sax_string_escaped(JsonSaxState st, const char *p, char quote,
+				   const char **str, size_t *len)
+{
+	const char *run = st->cursor;
+	char c;
+	int32_t ret;
+
+	st->scratch_len = 0;
+
+	while (1)
+	{
+		if (p >= st->end)
+			return sax_error(st, p, "unterminated string");
+
+		if (*p == quote)
+			break;
+
+		if ((unsigned char)*p < 0x20)
+			return sax_error(st, p, "control character in string");
+
+		sax_scratch_append(st, run, p - run);
+
+		if (++p >= st->end)
+			return sax_error(st, p, "unterminated string");
+
+		switch (*p)
+		{
+			case '"':
+			case '\'':
+			case '\\':
+			case '/':
+				c = *p;
+				break;
+
+			case 'b':
+				c = '\b';
+				break;
+
+			case 'f':
+				c = '\f';
+				break;
+
+			case 'n':
+				c = '\n';
+				break;
+
+			case 'r':
+				c = '\r';
+				break;
+
+			case 't':
+				c = '\t';
+				break;
+
+			case 'u':
+
+				if ((ret = sax_unicode(st, &p)))
+					return ret;
+
+				run = p;
+				p = sax_scan_string(p, st->end, quote);
+
+				continue;
+
+			default:
+				return sax_error(st, p, "invalid escape sequence");
+		}
+
+		sax_scratch_append(st, &c, 1);
+
+		run = ++p;
+		p = sax_scan_string(p, st->end, quote);
+	}
+
+	sax_scratch_append(st, run, p - run);
+
+	*str = st->scratch;
+	*len = st->scratch_len;
+	st->cursor = p + 1;
+
+	return SAX_OK;
+}
+
+static inline int32_t
+sax_hex4(const char *p, const char *end)
+{
+	int32_t i, v = 0;
+	char c;
+
+	if (end - p < 4)
+		return -1;
+
+	for (i = 0; i < 4; i++)
+	{
+		c = p[i];
+		v <<= 4;
+
+		if (c >= '0' && c <= '9')
+			v |= c - '0';
+		else if (c >= 'a' && c <= 'f')
+			v |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			v |= c - 'A' + 10;
+		else
+			return -1;
+	}
+
+	return v;
+}
+
+/*
+ * sax_unicode
+ *
+ * Decodes a \u escape, and the low half of a surrogate pair when there is
+ * one, into UTF-8.  |p| points at the 'u' on the way in and just past the
+ * escape on the way out.
+ */
+static int32_t
+sax_unicode(JsonSaxState st, const char **p)
+{
+	const char *at = *p + 1;
+	char utf8[4];
+	int32_t cp, lo, n;
+
+	if ((cp = sax_hex4(at, st->end)) < 0)
+		return sax_error(st, at, "invalid unicode escape");
+
+	at += 4;
+
+	if (cp >= 0xd800 && cp <= 0xdbff)
+	{
+		if (st->end - at < 6 || at[0] != '\\' || at[1] != 'u' ||
+			(lo = sax_hex4(at + 2, st->end)) < 0xdc00 || lo > 0xdfff)
+			return sax_error(st, at, "unpaired unicode surrogate");
+
+		cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+		at += 6;
+	}
+	else if (cp >= 0xdc00 && cp <= 0xdfff)
+	{
+		return sax_error(st, at, "unpaired unicode surrogate");
+	}
+
+	if (cp < 0x80)
+	{
+		utf8[0] = cp;
+		n = 1;
+	}
+	else if (cp < 0x800)
+	{
+		utf8[0] = 0xc0 | (cp >> 6);
+		utf8[1] = 0x80 | (cp & 0x3f);
+		n = 2;
+	}
+	else if (cp < 0x10000)
+	{
+		utf8[0] = 0xe0 | (cp >> 12);
+		utf8[1] = 0x80 | ((cp >> 6) & 0x3f);
+		utf8[2] = 0x80 | (cp & 0x3f);
+		n = 3;
+	}
+	else
+	{
+		utf8[0] = 0xf0 | (cp >> 18);
+		utf8[1] = 0x80 | ((cp >> 12) & 0x3f);
+		utf8[2] = 0x80 | ((cp >> 6) & 0x3f);
+		utf8[3] = 0x80 | (cp & 0x3f);
+		n = 4;
+	}
+
+	sax_scratch_append(st, utf8, n);
+	*p = at;
+
+	return SAX_OK;
+}
+
+/*
+ * sax_number
+ *
+ * Accumulates up to 19 significant digits into an unsigned 64-bit mantissa
+ * while validating the JSON number grammar.  Integers that fit go straight
+ * out as an int64.  Doubles with an exact mantissa and a power of ten no
+ * larger than 1e22 are computed directly, which is exact because both
+ * operands are exactly representable.  Anything else goes to strtod.
+ */
+static int32_t
+sax_number(JsonSaxState st)
+{
+	const char *p = st->cursor, *end = st->end, *start = p;
+	char buf[64], *tmp;
+	uint64_t mant = 0;
+	int32_t sig = 0, exp10 = 0, exp_val = 0, d;
+	bool neg = false, is_int = true, truncated = false, exp_neg = false;
+	double dbl;
+	int64_t i64;
+	size_t len;
+
+	if (*p == '-')
+	{
+		neg = true;
+		p++;
+	}
+
+	if (p >= end || !sax_isdigit(*p))
+		return sax_error(st, p, "invalid number");
+
+	if (*p == '0')
+	{
+		p++;
+
+		if (p < end && sax_isdigit(*p))
+			return sax_error(st, p, "leading zero in number");
+	}
+	else
+	{
+		while (p < end && sax_isdigit(*p))
+		{
+			if (sig < 19)
+			{
+				mant = mant * 10 + (*p - '0');
+				sig++;
+			}
+			else
+			{
+				exp10++;
+				truncated = true;
+			}
+
+			p++;
+		}
+	}
+
+	if (p < end && *p == '.')
+	{
+		is_int = false;
+		p++;
+
+		if (p >= end || !sax_isdigit(*p))
+			return sax_error(st, p, "invalid number");
+
+		while (p < end && sax_isdigit(*p))
+		{
+			d = *p - '0';
+
+			if (sig < 19)
+			{
+				if (mant || d)
+				{
+					mant = mant * 10 + d;
+					sig++;
+				}
+
+				exp10--;
+			}
+			else if (d)
+			{
+				truncated = true;
+			}
+
+			p++;
+		}
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		is_int = false;
+		p++;
+
+		if (p < end && (*p == '+' || *p == '-'))
+			exp_neg = (*p++ == '-');
+
+		if (p >= end || !sax_isdigit(*p))
+			return sax_error(st, p, "invalid number exponent");
+
+		while (p < end && sax_isdigit(*p))
+		{
+			if (exp_val < 100000)
+				exp_val = exp_val * 10 + (*p - '0');
+
+			p++;
+		}
+
+		exp10 += exp_neg ? -exp_val : exp_val;
+	}
+
+	len = p - start;
+	st->cursor = p;
+
+	if (is_int && !truncated)
+	{
+		if (neg && mant <= (uint64_t)INT64_MAX + 1)
+		{
+			i64 = (int64_t)(0 - mant);
+
+			if (!sax_fire(st, number_i, i64, start, len))
+				return SAX_ABORT;
+
+			return SAX_OK;
+		}
+		else if (!neg && mant <= INT64_MAX)
+		{
+			if (!sax_fire(st, number_i, (int64_t)mant, start, len))
+				return SAX_ABORT;
+
+			return SAX_OK;
+		}
+	}
+
+	if (!truncated && mant <= (1ull << 53) && exp10 >= -22 && exp10 <= 22)
+	{
+		dbl = (double)mant;
+
+		if (exp10 < 0)
+			dbl /= sax_pow10[-exp10];
+		else
+			dbl *= sax_pow10[exp10];
+
+		if (neg)
+			dbl = -dbl;
+	}
+	else
+	{
+		/*
+		 * The source isn't null terminated, so strtod gets a copy.
+		 */
+		tmp = len < sizeof(buf) ? buf : vhmalloc(len + 1);
+		memcpy(tmp, start, len);
+		tmp[len] = '\0';
+
+		dbl = strtod(tmp, 0);
+
+		if (tmp != buf)
+			vhfree(tmp);
+	}
+
+	if (!sax_fire(st, number_f, dbl, start, len))
+		return SAX_ABORT;
+
+	return SAX_OK;
+}
+
+static int32_t
+sax_literal(JsonSaxState st)
+{
+	const char *p = st->cursor;
+	size_t left = st->end - p;
+
+	if (left >= 4 && memcmp(p, "true", 4) == 0)
+	{
+		st->cursor += 4;
+
+		return sax_fire(st, boolean, true) ? SAX_OK : SAX_ABORT;
+	}
+
+	if (left >= 5 && memcmp(p, "false", 5) == 0)
+	{
+		st->cursor += 5;
+
+		return sax_fire(st, boolean, false) ? SAX_OK : SAX_ABORT;
+	}
+
+	if (left >= 4 && memcmp(p, "null", 4) == 0)
+	{
+		st->cursor += 4;
+
+		return sax_fire(st, null) ? SAX_OK : SAX_ABORT;
+	}
+
+	return sax_error(st, p, "invalid literal");
+}
+
@@ -27,8 +27,8 @@ vh_exec_eplan_create(void)
 	ExecPlan ep;
 
 	mctx_old = vh_mctx_current();
-	mctx_ep = vh_MemoryPoolCreate(mctx_old, 8192,
-								  "Execution Plan context");
+	mctx_ep = vh_MemoryArenaCreate(mctx_old, 8192,
+								   "Execution Plan context");
 
 	vh_mctx_switch(mctx_ep);
 
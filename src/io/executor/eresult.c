@@ -25,6 +25,8 @@ vh_exec_result_create(int32_t rtds)
 	er->tups = vh_SListCreate();
 	er->hbno = 0;
 	er->rtds = rtds;
+	er->shard_stats = 0;
+	er->nshard_stats = 0;
 
 	for (i = 0; i < rtds; i++)
 		vh_slot_td_init(&er->slots[i]);
@@ -52,6 +52,7 @@ vh_es_create(enum ExecStepTag tag, ExecStep parent)
 
 	case EST_Fetch:
 		es = vhmalloc(sizeof(struct ExecStepFetchData));
+		((ExecStepFetch)es)->dispatched = false;
 		break;
 
 	case EST_Funnel:	
@@ -5,6 +5,8 @@
 
 
 #include <assert.h>
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 
 #include "vh.h"
@@ -23,6 +25,29 @@
 #include "io/nodes/NodeQueryInsert.h"
 #include "io/nodes/NodeFrom.h"
 #include "io/utils/SList.h"
+#include "io/utils/stopwatch.h"
+
+/*
+ * EsFetchRun
+ *
+ * Everything a fetch needs while its statement is outstanding.  The serial
+ * path keeps one on the stack, a Funnel allocates one per child so they can
+ * all be in flight at once.
+ */
+struct EsFetchRun
+{
+	ExecStepFetch esfetch;
+	struct HTC_SListCtx htc_slist;
+	struct HTCIndexData htc_idx;
+	struct BackEndExecPlanData beep;
+	MemoryContext mctx_execnode;
+	struct vh_stopwatch watch;
+	int sock;
+
+	bool started;
+	bool inflight;
+	bool error;
+};
 
 static void es_runstep(ExecStep es, void* esd);
 static void es_finishstep(ExecStep es, void* esd);
@@ -36,6 +61,16 @@ static void es_fetch_run_slist(ExecStepFetch, ExecState);
 static void es_fetch_run_returning(ExecStepFetch, ExecState);
 static void es_fetch_finish(ExecStepFetch, ExecState);
 
+static void es_fetch_begin(struct EsFetchRun *run, ExecStepFetch, ExecState);
+static void es_fetch_end(struct EsFetchRun *run, ExecState);
+static bool es_fetch_async(ExecStep es);
+
+static void es_funnel_dispatch(ExecStepFunnel, ExecState);
+static void es_funnel_send(struct EsFetchRun *runs, int32_t nruns,
+						   ExecState estate);
+
+static ExecResultShardStat* es_stat_push(ExecState estate);
+
 static void es_transfer_tups(ExecState estate, SList tups);
 
 int32_t
@@ -62,16 +97,19 @@ vh_es_open(void)
 
 	cc = vh_ctx();
 
-	estate = vhmalloc(sizeof(struct ExecStepData));
+	estate = vhmalloc(sizeof(struct ExecStateData));
 
 	if (cc)
 		estate->cc = cc->catalogConnection;
 
-	estate->mctx_work = vh_MemoryPoolCreate(vh_mctx_current(),
-											8192,
-											"Executor Working context");
+	estate->mctx_work = vh_MemoryArenaCreate(vh_mctx_current(),
+											 8192,
+											 "Executor Working context");
 	estate->mctx_result = 0;
 	estate->er = 0;
+	estate->shard_stats = 0;
+	estate->nshard_stats = 0;
+	estate->shard_stats_sz = 0;
 
 	return estate;
 }
@@ -80,11 +118,14 @@ vh_es_open(void)
 void 
 vh_es_reset(ExecState es)
 {
-	vh_mctx_destroy(es->mctx_work);
-	
-	es->mctx_work = vh_MemoryPoolCreate(es->mctx_result,
-										8192,
-										"Executor working context after reset");
+	vh_mctx_reset(es->mctx_work);
+
+	/*
+	 * Any stats collected belong to the ExecResult from the prior run.
+	 */
+	es->shard_stats = 0;
+	es->nshard_stats = 0;
+	es->shard_stats_sz = 0;
 }
 
 void
@@ -130,6 +171,10 @@ es_finishstep(ExecStep es, void* esd)
 			es_fetch_finish((ExecStepFetch)es, esd);
 			break;
 
+		case EST_Funnel:
+			es_funnel_finish((ExecStepFunnel)es, esd);
+			break;
+
 	default:
 		break;
 	}
@@ -158,17 +203,23 @@ es_funnel_run(ExecStepFunnel esf, ExecState estate)
 {
 	if (!esf->tups)
 		esf->tups = vh_SListCreate_ctx(estate->mctx_result);	
+
+	es_funnel_dispatch(esf, estate);
 }
 
 static void 
 es_funnel_finish(ExecStepFunnel esf, ExecState estate)
 {
-	es_transfer_tups(estate, esf->tups);
+	if (estate->er)
+		es_transfer_tups(estate, esf->tups);
 }
 
 static void
 es_fetch_run(ExecStepFetch esf, ExecState estate)
 {
+	if (esf->dispatched)
+		return;
+
 	if (esf->returning)
 		es_fetch_run_returning(esf, estate);
 	else
@@ -196,9 +247,9 @@ es_fetch_run_returning(ExecStepFetch esfetch, ExecState estate)
 	pstmtshd = esfetch->pstmtshd;
 	nqins = (NodeQueryInsert)pstmt->nquery;
 	
-	mctx_execnode = vh_MemoryPoolCreate(estate->mctx_work,
-										1024,
-										"Executor Collect Node Working Context");
+	mctx_execnode = vh_MemoryArenaCreate(estate->mctx_work,
+										 1024,
+										 "Executor Collect Node Working Context");
 
 	/*
 	 * Make sure our HTC Returning allocates into the executor working context
@@ -266,14 +317,27 @@ es_fetch_run_returning(ExecStepFetch esfetch, ExecState estate)
 static void 
 es_fetch_run_slist(ExecStepFetch esfetch, ExecState estate)
 {
-	struct HTC_SListCtx htc_slist = { };
-	struct HTCIndexData htc_idx = { };
-	struct BackEndExecPlanData beep = { };
+	struct EsFetchRun run = { };
+
+	es_fetch_begin(&run, esfetch, estate);
+	run.error = vh_be_exec(esfetch->pstmtshd->nconn, &run.beep);
+	es_fetch_end(&run, estate);
+}
+
+/*
+ * es_fetch_begin
+ *
+ * Sets up the HTC and BackEndExecPlan for a fetch.  Nothing is sent to the
+ * back end, the caller decides whether to run the statement to completion
+ * or dispatch it asynchronously.
+ */
+static void
+es_fetch_begin(struct EsFetchRun *run, ExecStepFetch esfetch,
+			   ExecState estate)
+{
 	HeapTupleCollectorInfo htc_info;
 	ExecStep esparent;
 	PlannedStmt pstmt;
-	PlannedStmtShard pstmtshd;
-	MemoryContext mctx_execnode;
 	int32_t i;
 	
 	assert(esfetch->pstmt);
@@ -281,9 +345,10 @@ es_fetch_run_slist(ExecStepFetch esfetch, ExecState estate)
 	assert(esfetch->pstmtshd);
 
 	pstmt = esfetch->pstmt;
-	pstmtshd = esfetch->pstmtshd;
+	run->esfetch = esfetch;
+	run->started = true;
 	
-	htc_slist.esz = pstmt->qrp_ntables;
+	run->htc_slist.esz = pstmt->qrp_ntables;
 
 	if ((esparent = esfetch->es.parent))
 	{
@@ -297,66 +362,279 @@ es_fetch_run_slist(ExecStepFetch esfetch, ExecState estate)
 		vh_htp_SListCreate_ctx(esfetch->tups, estate->mctx_result);
 	}
 
-	htc_slist.tups = esfetch->tups;
-	htc_slist.htci.htc_cb = vh_htc_slist;
-	htc_slist.htci.hbno = esfetch->hbno;
-	htc_slist.htci.result_ctx = estate->mctx_result;
+	run->htc_slist.tups = esfetch->tups;
+	run->htc_slist.htci.htc_cb = vh_htc_slist;
+	run->htc_slist.htci.hbno = esfetch->hbno;
+	run->htc_slist.htci.result_ctx = estate->mctx_result;
 
 
-	mctx_execnode = vh_MemoryPoolCreate(estate->mctx_work,
-										1024,
-										"Executor Collect Node Working Context");
+	run->mctx_execnode = vh_MemoryArenaCreate(estate->mctx_work,
+											  1024,
+											  "Executor Collect Node Working Context");
 	if (esfetch->indexed)
 	{
-		vh_htc_idx_init(&htc_idx, pstmt->qrp_ntables, vh_htc_slist, &htc_slist);
+		vh_htc_idx_init(&run->htc_idx, pstmt->qrp_ntables,
+						vh_htc_slist, &run->htc_slist);
 
 		for (i = 0; i < pstmt->qrp_ntables; i++)
-			vh_htc_idx_add(&htc_idx, i, esfetch->hfs[i], esfetch->nhfs[i]);
+			vh_htc_idx_add(&run->htc_idx, i, esfetch->hfs[i], esfetch->nhfs[i]);
 
-		htc_info = &htc_idx.htci;
+		htc_info = &run->htc_idx.htci;
 	}
 	else
 	{
-		htc_info = &htc_slist.htci;
+		htc_info = &run->htc_slist.htci;
 	}
 
-	beep.pstmt = esfetch->pstmt;
-	beep.pstmtshd = esfetch->pstmtshd;
-	beep.mctx_work = mctx_execnode;
-	beep.mctx_result = estate->mctx_result;
-	beep.htc_info = htc_info;
-	beep.stat_wait_count = 0;
-	beep.discard = false;
+	run->beep.pstmt = esfetch->pstmt;
+	run->beep.pstmtshd = esfetch->pstmtshd;
+	run->beep.mctx_work = run->mctx_execnode;
+	run->beep.mctx_result = estate->mctx_result;
+	run->beep.htc_info = htc_info;
+	run->beep.stat_wait_count = 0;
+	run->beep.discard = false;
 
-	if (vh_be_exec(pstmtshd->nconn, &beep))
+	vh_stopwatch_start(&run->watch);
+}
+
+/*
+ * es_fetch_end
+ *
+ * Releases the HTC and working context for a fetch and records its timing
+ * on the ExecState.
+ */
+static void
+es_fetch_end(struct EsFetchRun *run, ExecState estate)
+{
+	ExecStepFetch esfetch = run->esfetch;
+	ExecResultShardStat *stat;
+
+	vh_stopwatch_end(&run->watch);
+
+	if (run->error)
 	{
-		/*
-		 * We had an error
-		 */
+		elog(WARNING,
+				emsg("Back end query execution failed against the query (%s)",
+					 vh_str_buffer(esfetch->pstmtshd->command)));
 	}
 
-/*
-	printf("\n=================================================\n"
-		   "EXECUTOR QUERY STATISTICS FOR:\n%s\n\n"
-		   " query execution:\t%'d ms\n"
-		   " heaptuple:\t\t%'d ms\n"
-		   " total:\t\t\t%'d ms\n"
-		   " records processed:\t%'d\n"
-		   " wait count:\t\t%ld\n"
-		   "=================================================\n\n",
-		   vh_str_buffer(esfetch->pstmtshd->command),
-		   beep.stat_qexec,
-		   beep.stat_htform,
-		   beep.stat_qexec + beep.stat_htform,
-		   beep.htc_info->nrows,
-		   beep.stat_wait_count);
-*/
+	stat = es_stat_push(estate);
+	stat->shard = esfetch->pstmtshd->shard;
+	stat->stat_qexec = vh_stopwatch_ms(&run->watch);
+	stat->stat_htform = run->beep.stat_htform;
+	stat->nrows = run->beep.htc_info->nrows;
+	stat->error = run->error;
+
 	if (esfetch->indexed)
 	{
-		vh_htc_idx_destroy(&htc_idx, true);
+		vh_htc_idx_destroy(&run->htc_idx, true);
 	}
 
-	vh_mctx_destroy(mctx_execnode);
+	vh_mctx_destroy(run->mctx_execnode);
+	run->mctx_execnode = 0;
+}
+
+/*
+ * es_fetch_async
+ *
+ * A fetch may be dispatched concurrently by its Funnel when it already has a
+ * connection and the connection's back end can execute asynchronously.
+ * Returning fetches are left to run serially.
+ */
+static bool
+es_fetch_async(ExecStep es)
+{
+	ExecStepFetch esfetch;
+	BackEndConnection nconn;
+
+	if (es->tag != EST_Fetch)
+		return false;
+
+	esfetch = (ExecStepFetch)es;
+
+	if (esfetch->returning || !esfetch->pstmtshd)
+		return false;
+
+	nconn = esfetch->pstmtshd->nconn;
+
+	return nconn && vh_be_has_exec_async(nconn->be);
+}
+
+/*
+ * es_funnel_dispatch
+ *
+ * Sends every eligible Fetch child's statement before waiting on any of
+ * them, then forms HeapTuple from whichever connection has results ready.
+ * A connection can only have one statement outstanding, so children sharing
+ * a connection are sent one after the other as the prior one completes.
+ *
+ * The children are marked dispatched so the tree walk doesn't run them a
+ * second time.
+ */
+static void
+es_funnel_dispatch(ExecStepFunnel esf, ExecState estate)
+{
+	struct EsFetchRun *runs, *run;
+	struct pollfd *pfds;
+	ExecStep child;
+	BackEndConnection nconn;
+	int32_t *pfd_runs, i, nruns = 0, npfds, ret;
+
+	for (child = esf->es.child; child; child = child->sibling)
+		if (es_fetch_async(child))
+			nruns++;
+
+	if (nruns < 2)
+		return;
+
+	runs = vhmalloc_ctx(estate->mctx_work, sizeof(struct EsFetchRun) * nruns);
+	pfds = vhmalloc_ctx(estate->mctx_work, sizeof(struct pollfd) * nruns);
+	pfd_runs = vhmalloc_ctx(estate->mctx_work, sizeof(int32_t) * nruns);
+	memset(runs, 0, sizeof(struct EsFetchRun) * nruns);
+
+	for (i = 0, child = esf->es.child; child; child = child->sibling)
+	{
+		if (es_fetch_async(child))
+		{
+			runs[i].esfetch = (ExecStepFetch)child;
+			runs[i].esfetch->dispatched = true;
+			i++;
+		}
+	}
+
+	for (;;)
+	{
+		es_funnel_send(runs, nruns, estate);
+
+		for (i = 0, npfds = 0; i < nruns; i++)
+		{
+			if (runs[i].inflight)
+			{
+				pfds[npfds].fd = runs[i].sock;
+				pfds[npfds].events = POLLIN;
+				pfds[npfds].revents = 0;
+				pfd_runs[npfds] = i;
+				npfds++;
+			}
+		}
+
+		if (!npfds)
+			break;
+
+		ret = poll(pfds, npfds, -1);
+
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			/*
+			 * Let the back ends sort it out, they'll consume what they can
+			 * without blocking.
+			 */
+			for (i = 0; i < npfds; i++)
+				pfds[i].revents = POLLIN;
+		}
+
+		for (i = 0; i < npfds; i++)
+		{
+			if (!pfds[i].revents)
+				continue;
+
+			run = &runs[pfd_runs[i]];
+			nconn = run->esfetch->pstmtshd->nconn;
+
+			ret = vh_be_exec_poll(nconn, &run->beep);
+
+			if (ret)
+			{
+				run->inflight = false;
+				run->error = ret < 0;
+				es_fetch_end(run, estate);
+			}
+		}
+	}
+}
+
+/*
+ * es_funnel_send
+ *
+ * Dispatches every run that hasn't been started yet, as long as no other
+ * run is outstanding on the same connection.
+ */
+static void
+es_funnel_send(struct EsFetchRun *runs, int32_t nruns, ExecState estate)
+{
+	struct EsFetchRun *run;
+	BackEndConnection nconn;
+	int32_t i, j;
+	bool busy;
+
+	for (i = 0; i < nruns; i++)
+	{
+		run = &runs[i];
+
+		if (run->started)
+			continue;
+
+		nconn = run->esfetch->pstmtshd->nconn;
+
+		for (j = 0, busy = false; j < nruns && !busy; j++)
+			busy = runs[j].inflight &&
+				   runs[j].esfetch->pstmtshd->nconn == nconn;
+
+		if (busy)
+			continue;
+
+		es_fetch_begin(run, run->esfetch, estate);
+		run->sock = vh_be_exec_send(nconn, &run->beep);
+
+		if (run->sock >= 0)
+		{
+			run->inflight = true;
+		}
+		else
+		{
+			/*
+			 * Either the send failed or the back end ran the statement to
+			 * completion on its own.
+			 */
+			run->error = run->sock == -1;
+			es_fetch_end(run, estate);
+		}
+	}
+}
+
+/*
+ * es_stat_push
+ *
+ * Returns the next ExecResultShardStat on the ExecState.  The array lives in
+ * the result context so it can be handed straight to the ExecResult.
+ */
+static ExecResultShardStat*
+es_stat_push(ExecState estate)
+{
+	ExecResultShardStat *stat;
+	int32_t sz;
+
+	if (estate->nshard_stats == estate->shard_stats_sz)
+	{
+		sz = estate->shard_stats_sz ? estate->shard_stats_sz * 2 : 8;
+
+		if (estate->shard_stats)
+			estate->shard_stats = vhrealloc(estate->shard_stats,
+											sizeof(ExecResultShardStat) * sz);
+		else
+			estate->shard_stats = vhmalloc_ctx(estate->mctx_result,
+											   sizeof(ExecResultShardStat) * sz);
+
+		estate->shard_stats_sz = sz;
+	}
+
+	stat = &estate->shard_stats[estate->nshard_stats++];
+	memset(stat, 0, sizeof(ExecResultShardStat));
+
+	return stat;
 }
 
 static void
@@ -369,6 +647,8 @@ es_fetch_finish(ExecStepFetch esfetch, ExecState estate)
 	QrpTableProjection qrp_table = esfetch->pstmt->qrp_table;
 	MemoryContext mctx_old;
 
+	esfetch->dispatched = false;
+
 	mctx_old = vh_mctx_switch(estate->mctx_result);
 
 	er = estate->er = vh_exec_result_create(esfetch->pstmt->qrp_ntables);
@@ -391,6 +671,8 @@ static void
 es_transfer_tups(ExecState estate, SList tups)
 {
 	estate->er->tups = tups;
+	estate->er->shard_stats = estate->shard_stats;
+	estate->er->nshard_stats = estate->nshard_stats;
 }
 
 /*
@@ -416,9 +698,9 @@ es_discard_run(ExecStepDiscard esdiscard, ExecState estate)
 	
 	if (be_exec)
 	{
-		mctx_execnode = vh_MemoryPoolCreate(estate->mctx_work,
-											1024,
-											"Executor Collect Node Working Context");
+		mctx_execnode = vh_MemoryArenaCreate(estate->mctx_work,
+											 1024,
+											 "Executor Collect Node Working Context");
 		beep.pstmt = esdiscard->pstmt;
 		beep.pstmtshd = esdiscard->pstmtshd;
 		beep.mctx_work = mctx_execnode;
@@ -31,6 +31,8 @@ struct PutConnsContext
 	XAct xact;
 	KeyValueMap nconn_read;			/* key: ShardAccess, value: BackEndConnection */
 	bool begin_tx;
+	bool pipeline;
+	uint64_t pipeline_tag;
 
 	uint32_t sp_conn_attached;
 	uint32_t sp_conn_attach_fail;
@@ -52,7 +54,9 @@ struct SavePointData
 	SList plans;
 	KeySet shards;					/* key: ShardAccess */
 	uint32_t sp_flushedthru_idx;
+	uint32_t sp_failed_idx;			/* ExecPlan that failed in a pipeline */
 	bool sp_flushed;
+	bool sp_failed;
 	bool sp_committed;
 	bool sp_rolled_back;
 };
@@ -102,11 +106,25 @@ static void xact_plan_popts_init(XAct sxact, PlannerOpts *popts);
  * ExecPlan Execution Functions
  */
 
-static bool xact_es_runtree_plan(SavePoint sp_target, ExecState es);
+static bool xact_es_runtree_plan(SavePoint sp_target, ExecState es,
+								 uint32_t ep_idx);
 static ExecResult xact_es_runtree_read(XAct sxact, ExecState es);
 static bool xact_sp_rollbackto(SavePoint sp, bool xact_local);
 static bool xact_sp_flushthru(SavePoint sp);
 
+/*
+ * Pipelining
+ *
+ * A Serialized XAct flushes its queued writes with the back end's pipeline
+ * when it has one.  Each statement is tagged with the SavePoint and ExecPlan
+ * it came from so a failure can be traced back once the results arrive.
+ */
+#define XActPipelineTag(sp_idx, ep_idx)	(((uint64_t)(sp_idx) << 32) | (ep_idx))
+#define XActPipelineTagSp(tag)			((uint32_t)((tag) >> 32))
+#define XActPipelineTagEp(tag)			((uint32_t)(tag))
+
+static bool xact_pipeline_end(XAct txact, SavePoint sp_target);
+
 /*
  * Control functions
  */
@@ -608,6 +626,8 @@ xact_sp_create(XAct sxact)
 	sp->sp_rolled_back = false;
 	sp->sp_flushed = false;
 	sp->sp_flushedthru_idx = 0;
+	sp->sp_failed = false;
+	sp->sp_failed_idx = 0;
 	sp->sp_committed = false;
 	sp->shards = vh_kset_create();
 	sp->plans = vh_SListCreate();
@@ -704,7 +724,7 @@ xact_plan_popts_init(XAct sxact, PlannerOpts *popts)
  * caller.
  */
 static bool 
-xact_es_runtree_plan(SavePoint sp_target, ExecState es)
+xact_es_runtree_plan(SavePoint sp_target, ExecState es, uint32_t ep_idx)
 {
 	struct PutConnsContext pcc = { };
 	XAct sxact = sp_target->owner, txact = TopXAct(sxact);
@@ -720,6 +740,8 @@ xact_es_runtree_plan(SavePoint sp_target, ExecState es)
 	pcc.xact = sxact;
 	pcc.sp = sp_target;
 	pcc.begin_tx = true;
+	pcc.pipeline = txact->mode == Serialized;
+	pcc.pipeline_tag = XActPipelineTag(sp_target->idx, ep_idx);
 
 	VH_TRY();
 	{
@@ -869,7 +891,7 @@ xact_sp_flushthru(SavePoint sp_target)
 	
 			VH_TRY();
 			{		
-				xact_es_runtree_plan(sp, es);
+				xact_es_runtree_plan(sp, es, j);
 			}
 			VH_CATCH();
 			{
@@ -900,9 +922,71 @@ xact_sp_flushthru(SavePoint sp_target)
 	if (es)
 		vh_es_close(es);
 
+	if (txact->mode == Serialized && !xact_pipeline_end(txact, sp_target))
+		flushed = false;
+
 	return flushed;
 }
 
+/*
+ * xact_pipeline_end
+ *
+ * Collects the results of every statement pipelined during the flush.  When
+ * one failed, the SavePoint it ran under is marked as failed at that ExecPlan:
+ * its SAVEPOINT made it to the server, so xact_sp_rollbackto can still roll
+ * back to it.  Everything queued after the failure was aborted by the server,
+ * those SavePoints go back to never having been flushed, so the next flush
+ * starts over at the failed statement.
+ */
+static bool
+xact_pipeline_end(XAct txact, SavePoint sp_target)
+{
+	BackEndConnection *nconn;
+	ShardAccess sa;
+	KeyValueMapIterator it;
+	SavePoint *sp_head, sp;
+	uint64_t tag, tag_failed = UINT64_MAX;
+	uint32_t sp_failed_idx, i;
+
+	vh_kvmap_it_init(&it, txact->nconns);
+	while (vh_kvmap_it_next(&it, &sa, &nconn))
+	{
+		if (!vh_be_pipeline_end(*nconn, &tag) && tag < tag_failed)
+			tag_failed = tag;
+	}
+
+	if (tag_failed == UINT64_MAX)
+		return true;
+
+	vh_SListIterator(txact->sps, sp_head);
+	sp_failed_idx = XActPipelineTagSp(tag_failed);
+
+	sp = sp_head[sp_failed_idx];
+	sp->sp_failed = true;
+	sp->sp_failed_idx = XActPipelineTagEp(tag_failed);
+	sp->sp_flushed = sp->sp_failed_idx > 0;
+	sp->sp_flushedthru_idx = sp->sp_flushed ? sp->sp_failed_idx - 1 : 0;
+
+	for (i = sp_failed_idx; i <= sp_target->idx; i++)
+	{
+		sp = sp_head[i];
+
+		if (i > sp_failed_idx)
+		{
+			sp->sp_flushed = false;
+			sp->sp_flushedthru_idx = 0;
+			vh_htbl_clear(sp->shards);
+		}
+
+		sp->owner->sp_local = sp;
+	}
+
+	txact->sp_lastflushed = sp_head[sp_failed_idx];
+	txact->sp_current = sp_target;
+
+	return false;
+}
+
 /*
  * 
  * Each connection is then issued ROLLBACK TO commands.
@@ -946,7 +1030,7 @@ xact_sp_rollbackto(SavePoint sp_target, bool xact_local)
 		if ((xact_local && sp->owner == sp_target->owner) ||
 			!xact_local)
 		{
-			if (sp->sp_flushed && !sp->sp_rolled_back)
+			if ((sp->sp_flushed || sp->sp_failed) && !sp->sp_rolled_back)
 			{
 				vh_kset_it_init(&it, sp->shards);
 
@@ -977,6 +1061,9 @@ xact_sp_rollbackto(SavePoint sp_target, bool xact_local)
 			{
 				ret = rollbackto(nconnk, sp->name);
 				sp->sp_rolled_back = ret;
+
+				if (ret)
+					sp->sp_failed = false;
 			}
 			VH_CATCH();
 			{
@@ -1309,33 +1396,7 @@ xact_putconns_cb(void *putconnsctx,
 	if (vh_pstmt_iswrite(pstmt))
 	{
 		beat_sp = nconn->be->at.savepoint;
-
-		if (!vh_kset_key(pcc->sp->shards, &sa))
-		{
-			/*
-			 * We need to bring the SavePoint up to date on the local connection
-			 * since it doesn't exist yet.
-			 */
-		
-			if (beat_sp)
-			{
-				created = beat_sp(nconn, pcc->sp->name);
-
-				if (created)
-					pcc->sp_conn_attached++;
-				else
-					pcc->sp_conn_attach_fail++;
-			}
-			else
-			{
-				pcc->sp_conn_no_support++;
-			}
-
-			/*
-			 * Check to see if the connection we were handed has two phase commit
-			 * support.  If it doesn't increment the counter.
-			 */
-		}
+		nconn->pipeline_tag = pcc->pipeline_tag;
 
 		if (from_connection_catalog)
 		{
@@ -1374,10 +1435,48 @@ xact_putconns_cb(void *putconnsctx,
 			 * Check to see if we need to start a transaction.
 			 */
 
-			created = vh_be_xact_begin(nconn);
+			if (!vh_be_conn_intx(nconn))
+			{
+				created = vh_be_xact_begin(nconn);
 
-			if (!created)
-				pcc->sp_conn_tx_begin_fail++;
+				if (!created)
+					pcc->sp_conn_tx_begin_fail++;
+			}
+		}
+
+		/*
+		 * The transaction has to be open before the SavePoint goes out, both
+		 * go ahead of the pipeline so only the statements themselves and the
+		 * SAVEPOINT are pipelined.
+		 */
+		if (pcc->pipeline)
+			vh_be_pipeline_begin(nconn);
+
+		if (!vh_kset_key(pcc->sp->shards, &sa))
+		{
+			/*
+			 * We need to bring the SavePoint up to date on the local connection
+			 * since it doesn't exist yet.
+			 */
+		
+			if (beat_sp)
+			{
+				created = beat_sp(nconn, pcc->sp->name);
+
+				if (created)
+					pcc->sp_conn_attached++;
+				else
+					pcc->sp_conn_attach_fail++;
+			}
+			else
+			{
+				pcc->sp_conn_no_support++;
+			}
+
+			/*
+			 * Check to see if the connection we were handed has two phase commit
+			 * support.  If it doesn't increment the counter.
+			 */
 		}
 	}
 	else
@@ -55,6 +55,7 @@ nsql_qsel_copy(struct NodeCopyState *cstate, Node n_source,
 
 	qsel->query.hasTemporaryTables = qsrc->query.hasTemporaryTables;
 	qsel->query.clusterPref = qsrc->query.clusterPref;
+	qsel->fetch_mode = qsrc->fetch_mode;
 
 	return (Node)qsel;
 }
@@ -231,6 +232,7 @@ vh_sqlq_sel_create(void)
 	select->orderBy = 0;
 	select->quals = 0;
 	select->result_table_selections = 0;
+	select->fetch_mode = SFM_Auto;
 
 	return select;
 }
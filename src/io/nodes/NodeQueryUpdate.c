@@ -80,6 +80,8 @@ vh_sqlq_upd_create(void)
 	nqupd->nfields = 0;
 	nqupd->nfrom = 0;
 	nqupd->nquals = 0;
+	nqupd->htp = 0;
+	nqupd->htps = 0;
 
 	return nqupd;
 }
@@ -144,6 +146,163 @@ vh_sqlq_upd_field_add(NodeQueryUpdate nq, NodeUpdateField nuf)
 	vh_nsql_child_rappend(nq->nfields, (Node)nuf);
 }
 
+void
+vh_sqlq_upd_htp(NodeQueryUpdate nq, HeapTuplePtr htp)
+{
+	nq->htp = htp;
+}
+
+void
+vh_sqlq_upd_htpl(NodeQueryUpdate nq, SList htps)
+{
+	nq->htps = htps;
+}
+
+int32_t
+vh_sqlq_upd_fields(NodeQueryUpdate nq, TableField *tfs, int32_t sz)
+{
+	Node n;
+	int32_t i = 0;
+
+	if (!nq->nfields)
+		return 0;
+
+	for (n = nq->nfields->firstChild; n; n = n->nextSibling)
+	{
+		if (n->tag != Field)
+			continue;
+
+		if (i < sz)
+			tfs[i] = ((NodeUpdateField)n)->tf;
+
+		i++;
+	}
+
+	return i;
+}
+
+bool
+vh_sqlq_upd_values_cmd(String cmd, NodeQueryUpdate nq, NodeSqlCmdContext ctx,
+					   vh_sqlq_upd_cast_cb cast)
+{
+	TableDefVer tdv;
+	TableField *tfs, tf;
+	HeapTuplePtr *htp_head, htp;
+	TypeVarSlot tvs;
+	String qname;
+	int32_t tfs_sz, nkeys, htp_sz, i, j;
+
+	if (!nq->nfrom)
+		elog(ERROR2,
+			 emsg("Missing FROM table during NodeQueryUpdate to_sql_cmd!"));
+
+	tdv = nq->nfrom->tdv;
+	nkeys = tdv->key_primary.nfields;
+	htp_sz = vh_SListIterator(nq->htps, htp_head);
+
+	if (!nkeys || !htp_sz)
+		elog(ERROR2,
+			 emsg("A batched NodeQueryUpdate requires a primary key and at least "
+				  "one HeapTuplePtr!"));
+
+	tfs_sz = vh_sqlq_upd_fields(nq, 0, 0);
+
+	if (!tfs_sz)
+		elog(ERROR2,
+			 emsg("A batched NodeQueryUpdate requires at least one field to "
+				  "update!"));
+
+	/*
+	 * Put the primary key up front, the VALUES row is laid out the same way.
+	 */
+	tfs = vhmalloc(sizeof(TableField) * (tfs_sz + nkeys));
+
+	for (i = 0; i < nkeys; i++)
+		tfs[i] = tdv->key_primary.fields[i];
+
+	vh_sqlq_upd_fields(nq, tfs + nkeys, tfs_sz);
+	tfs_sz += nkeys;
+
+	vh_str.Append(cmd, "UPDATE ");
+	vh_nsql_cmd_impl(&nq->nfrom->node, cmd, ctx, false);
+	vh_str.Append(cmd, " SET ");
+
+	for (i = nkeys; i < tfs_sz; i++)
+	{
+		if (i > nkeys)
+			vh_str.Append(cmd, ", ");
+
+		vh_str.AppendStr(cmd, tfs[i]->fname);
+		vh_str.Append(cmd, " = vh_v.");
+		vh_str.AppendStr(cmd, tfs[i]->fname);
+	}
+
+	vh_str.Append(cmd, " FROM (VALUES ");
+
+	for (i = 0; i < htp_sz; i++)
+	{
+		htp = htp_head[i];
+
+		vh_str.Append(cmd, i ? ", (" : "(");
+
+		for (j = 0; j < tfs_sz; j++)
+		{
+			tf = tfs[j];
+
+			if (j)
+				vh_str.Append(cmd, ", ");
+
+			vh_tvs_init(&tvs);
+			vh_tvs_store_htp_hf(&tvs, htp, &tf->heap);
+			vh_nsql_cmd_param_placeholder(cmd, ctx, &tvs);
+
+			if (!i && cast)
+				cast(cmd, ctx, tf);
+		}
+
+		vh_str.Append(cmd, ")");
+	}
+
+	vh_str.Append(cmd, ") AS vh_v (");
+
+	for (i = 0; i < tfs_sz; i++)
+	{
+		if (i)
+			vh_str.Append(cmd, ", ");
+
+		vh_str.AppendStr(cmd, tfs[i]->fname);
+	}
+
+	vh_str.Append(cmd, ") WHERE ");
+
+	if (nq->nfrom->alias)
+	{
+		qname = vh_str.ConstructStr(nq->nfrom->alias);
+	}
+	else
+	{
+		qname = vh_str.Convert("");
+		vh_nsql_from_append_queryname(nq->nfrom, qname);
+	}
+
+	for (i = 0; i < nkeys; i++)
+	{
+		if (i)
+			vh_str.Append(cmd, " AND ");
+
+		vh_str.AppendStr(cmd, qname);
+		vh_str.Append(cmd, ".");
+		vh_str.AppendStr(cmd, tfs[i]->fname);
+		vh_str.Append(cmd, " = vh_v.");
+		vh_str.AppendStr(cmd, tfs[i]->fname);
+	}
+
+	vh_str.Destroy(qname);
+	vhfree(tfs);
+
+	return true;
+}
+
 static bool 
 nsql_qupd_to_sql(String cmd, void *node, NodeSqlCmdContext ctx)
 {
@@ -153,6 +312,9 @@ nsql_qupd_to_sql(String cmd, void *node, NodeSqlCmdContext ctx)
 		elog(ERROR2,
 			 emsg("Missing FROM table during NodeQueryUpdate to_sql_cmd!"));
 
+	if (nqu->htps)
+		return vh_sqlq_upd_values_cmd(cmd, nqu, ctx, 0);
+
 	vh_str.Append(cmd, "UPDATE ");
 	vh_nsql_cmd_impl(&nqu->nfrom->node, cmd, ctx, false);
 	vh_str.Append(cmd, " SET ");
@@ -0,0 +1,689 @@
+/*
+ * Copyright (c) 2011-2017, Kyle A. Gearhart
+ */
+
+
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "vh.h"
+#include "io/catalog/BackEnd.h"
+#include "io/catalog/TableDef.h"
+#include "io/catalog/TableField.h"
+#include "io/catalog/TypeVarSlot.h"
+#include "io/executor/param.h"
+#include "io/nodes/NodeField.h"
+#include "io/nodes/NodeFrom.h"
+#include "io/nodes/NodeJoin.h"
+#include "io/nodes/NodeOrderBy.h"
+#include "io/nodes/NodeQual.h"
+#include "io/nodes/NodeQuerySelect.h"
+#include "io/plan/pcache.h"
+#include "io/plan/pstmt_funcs.h"
+#include "io/utils/kvmap.h"
+
+
+typedef struct PlanCacheEntryData *PlanCacheEntry;
+
+struct PlanCacheData
+{
+	MemoryContext mctx;
+	KeyValueMap entries;		/* uint64_t shape hash -> PlanCacheEntry */
+	uint32_t max_entries;
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t bypass;
+};
+
+struct PlanCacheEntryData
+{
+	unsigned char *shape;
+	size_t shape_len;
+
+	String command;
+	int32_t paramcount;
+	uint32_t prepare_id;
+
+	int32_t qrp_ntables;
+	int32_t qrp_nfields;
+	QrpTableProjection qrp_table;
+	QrpFieldProjection qrp_field;
+	QrpBackEndProjection qrp_backend;
+};
+
+/*
+ * PlanCacheShape
+ *
+ * Working state while we serialize a query's shape.  The TypeVarSlot of each
+ * parameter is collected in the same order vh_nsql_cmd hands them to the
+ * placeholder function, so on a hit we can build the ParameterList without
+ * generating the command.  |srcs| maps the NodeFrom and NodeJoin of the query
+ * to their position, since NodeField refers to its table by pointer.
+ */
+
+#define PCACHE_MAX_SRCS		32
+
+typedef struct PlanCacheShape
+{
+	unsigned char *buf;
+	size_t len;
+	size_t cap;
+
+	TypeVarSlot **params;
+	int32_t nparams;
+	int32_t params_cap;
+
+	void *srcs[PCACHE_MAX_SRCS];
+	int32_t nsrcs;
+
+	bool cacheable;
+} PlanCacheShape;
+
+static uint32_t pcache_prepare_id = 0;
+
+static void pcache_shape_init(PlanCacheShape *shape);
+static void pcache_shape_free(PlanCacheShape *shape);
+static void pcache_shape_put(PlanCacheShape *shape, const void *data, size_t sz);
+static void pcache_shape_str(PlanCacheShape *shape, String str);
+static void pcache_shape_src(PlanCacheShape *shape, void *src);
+static void pcache_shape_param(PlanCacheShape *shape, TypeVarSlot *tvs);
+static void pcache_shape_from(PlanCacheShape *shape, NodeFrom nfrom);
+static void pcache_shape_quals(PlanCacheShape *shape, Node node);
+static void pcache_shape_quals_side(PlanCacheShape *shape, NodeQualS nqs);
+static bool pcache_shape_select(PlanCacheShape *shape, NodeQuerySelect nqsel,
+								BackEnd be);
+static uint64_t pcache_shape_hash(PlanCacheShape *shape);
+
+static PlannedStmtShard pcache_pstmtshd_hit(PlanCacheEntry pce,
+											PlannedStmt pstmt,
+											PlanCacheShape *shape,
+											Shard shd, ShardAccess shda);
+static void pcache_entry_qrp(PlanCacheEntry pce, PlannedStmt pstmt);
+
+
+PlanCache
+vh_pcache_create(MemoryContext mctx_parent, uint32_t max_entries)
+{
+	MemoryContext mctx, mctx_old;
+	PlanCache pc;
+
+	mctx = vh_MemoryPoolCreate(mctx_parent, 8192, "Plan cache");
+	mctx_old = vh_mctx_switch(mctx);
+
+	pc = vhmalloc(sizeof(struct PlanCacheData));
+	memset(pc, 0, sizeof(struct PlanCacheData));
+
+	pc->mctx = mctx;
+	pc->max_entries = max_entries ? max_entries : VH_PCACHE_MAX_ENTRIES;
+	pc->entries = vh_kvmap_create_impl(sizeof(uint64_t),
+									   sizeof(PlanCacheEntry),
+									   vh_htbl_hash_int64,
+									   vh_htbl_comp_int64,
+									   mctx);
+
+	vh_mctx_switch(mctx_old);
+
+	return pc;
+}
+
+void
+vh_pcache_destroy(PlanCache pc)
+{
+	vh_pcache_reset(pc);
+	vh_mctx_destroy(pc->mctx);
+}
+
+PlanCache
+vh_pcache(void)
+{
+	CatalogContext cc = vh_ctx();
+
+	if (!cc)
+		return 0;
+
+	if (!cc->planCache)
+		cc->planCache = vh_pcache_create(cc->memoryTop, 0);
+
+	return cc->planCache;
+}
+
+/*
+ * vh_pcache_reset
+ *
+ * The entries are allocated one by one in the cache's MemoryContext, we
+ * release each of them and leave the context itself for the next entries.
+ * The tam formatters hanging off the backend projections have to be destroyed
+ * by their Type, so we let vh_plan_qrp_be_finalize take care of that.
+ */
+void
+vh_pcache_reset(PlanCache pc)
+{
+	KeyValueMapIterator it;
+	PlanCacheEntry *pce_val, pce;
+	uint64_t key;
+	int32_t i;
+
+	vh_kvmap_it_init(&it, pc->entries);
+
+	while (vh_kvmap_it_next(&it, &key, &pce_val))
+	{
+		pce = *pce_val;
+
+		if (pce->qrp_field && pce->qrp_backend)
+		{
+			for (i = 0; i < pce->qrp_nfields; i++)
+				vh_plan_qrp_be_finalize(&pce->qrp_field[i], &pce->qrp_backend[i]);
+
+			vhfree(pce->qrp_field);
+			vhfree(pce->qrp_backend);
+		}
+
+		if (pce->qrp_table)
+			vhfree(pce->qrp_table);
+
+		if (pce->command)
+			vh_str.Destroy(pce->command);
+
+		vhfree(pce->shape);
+		vhfree(pce);
+	}
+
+	vh_htbl_clear(pc->entries);
+}
+
+void
+vh_pcache_stats(PlanCache pc, PlanCacheStats *stats)
+{
+	stats->hits = pc->hits;
+	stats->misses = pc->misses;
+	stats->bypass = pc->bypass;
+	stats->entries = (uint32_t) vh_htbl_count(pc->entries);
+}
+
+void
+vh_pcache_prepname(uint32_t prepare_id, char *buffer, size_t len)
+{
+	snprintf(buffer, len, "vhp_%u", prepare_id);
+}
+
+PlannedStmtShard
+vh_pcache_pstmtshd(PlannedStmt pstmt, Shard shd, ShardAccess shda)
+{
+	PlanCache pc = vh_pcache();
+	PlanCacheShape shape;
+	PlanCacheEntry pce, *pce_val;
+	PlannedStmtShard pstmtshd = 0;
+	MemoryContext mctx_old;
+	uint64_t hash;
+	bool cacheable = false;
+
+	pcache_shape_init(&shape);
+
+	if (pc && pstmt->nquery && pstmt->nquery->action == Select)
+		cacheable = pcache_shape_select(&shape,
+										(NodeQuerySelect)pstmt->nquery,
+										pstmt->be);
+
+	if (!cacheable)
+	{
+		if (pc)
+			pc->bypass++;
+
+		pcache_shape_free(&shape);
+
+		pstmtshd = vh_pstmtshd_generate(pstmt, shd, shda);
+
+		return vh_pstmt_qrp(pstmt) ? 0 : pstmtshd;
+	}
+
+	hash = pcache_shape_hash(&shape);
+	pce_val = vh_kvmap_find(pc->entries, &hash);
+
+	if (pce_val)
+	{
+		pce = *pce_val;
+
+		if (pce->shape_len == shape.len &&
+			memcmp(pce->shape, shape.buf, shape.len) == 0)
+		{
+			pc->hits++;
+			pstmtshd = pcache_pstmtshd_hit(pce, pstmt, &shape, shd, shda);
+			pcache_shape_free(&shape);
+
+			return pstmtshd;
+		}
+
+		/*
+		 * Two shapes landed on the same hash.  The first one keeps the slot,
+		 * this one gets planned the long way every time.
+		 */
+		pc->bypass++;
+		pcache_shape_free(&shape);
+
+		pstmtshd = vh_pstmtshd_generate(pstmt, shd, shda);
+
+		return vh_pstmt_qrp(pstmt) ? 0 : pstmtshd;
+	}
+
+	pc->misses++;
+	pstmtshd = vh_pstmtshd_generate(pstmt, shd, shda);
+
+	/*
+	 * The parameters we collected have to line up with the ones the back
+	 * end's command generator found, otherwise a hit would bind the wrong
+	 * values.  If they don't, or the cache is full, plan normally.
+	 */
+	if (pstmtshd->paramcount != shape.nparams ||
+		vh_htbl_count(pc->entries) >= pc->max_entries)
+	{
+		pc->bypass++;
+		pcache_shape_free(&shape);
+
+		return vh_pstmt_qrp(pstmt) ? 0 : pstmtshd;
+	}
+
+	mctx_old = vh_mctx_switch(pc->mctx);
+
+	if (vh_pstmt_qrp(pstmt))
+	{
+		vh_mctx_switch(mctx_old);
+		pcache_shape_free(&shape);
+
+		return 0;
+	}
+
+	pce = vhmalloc(sizeof(struct PlanCacheEntryData));
+	pce->shape = vhmalloc(shape.len);
+	pce->shape_len = shape.len;
+	memcpy(pce->shape, shape.buf, shape.len);
+
+	pce->command = vh_str.ConstructStr(pstmtshd->command);
+	pce->paramcount = pstmtshd->paramcount;
+	pce->prepare_id = __atomic_add_fetch(&pcache_prepare_id, 1, __ATOMIC_RELAXED);
+
+	pce->qrp_ntables = pstmt->qrp_ntables;
+	pce->qrp_nfields = pstmt->qrp_nfields;
+	pce->qrp_table = pstmt->qrp_table;
+	pce->qrp_field = pstmt->qrp_field;
+	pce->qrp_backend = pstmt->qrp_backend;
+
+	/* We probed for this hash above and missed, so the slot is ours. */
+	vh_kvmap_value(pc->entries, &hash, pce_val);
+	*pce_val = pce;
+
+	vh_mctx_switch(mctx_old);
+
+	pstmt->qrp_shared = true;
+	pstmtshd->prepare_id = pce->prepare_id;
+
+	pcache_shape_free(&shape);
+
+	return pstmtshd;
+}
+
+/*
+ * pcache_pstmtshd_hit
+ *
+ * Forms the PlannedStmtShard from a cache entry.  The parameters go thru the
+ * back end's param function exactly as vh_pstmtshd_generate would have.
+ */
+static PlannedStmtShard
+pcache_pstmtshd_hit(PlanCacheEntry pce, PlannedStmt pstmt,
+					PlanCacheShape *shape, Shard shd, ShardAccess shda)
+{
+	PlannedStmtShard pstmtshd;
+	Parameter param;
+	int32_t i;
+
+	pstmtshd = vhmalloc(sizeof(struct PlannedStmtShardData));
+	vh_pstmtshard_init(pstmtshd);
+
+	pstmtshd->shard = shd;
+	pstmtshd->sharda = shda;
+	pstmtshd->command = pce->command;
+	pstmtshd->paramcount = pce->paramcount;
+	pstmtshd->prepare_id = pce->prepare_id;
+
+	if (pstmtshd->paramcount)
+		pstmtshd->parameters = vh_param_createlist();
+
+	for (i = 0; i < shape->nparams; i++)
+	{
+		if (vh_be_param(pstmt->be,
+						pstmtshd->parameters,
+						shape->params[i],
+						&param))
+		{
+			vh_param_add(pstmtshd->parameters, param);
+		}
+	}
+
+	pcache_entry_qrp(pce, pstmt);
+
+	return pstmtshd;
+}
+
+static void
+pcache_entry_qrp(PlanCacheEntry pce, PlannedStmt pstmt)
+{
+	pstmt->qrp_ntables = pce->qrp_ntables;
+	pstmt->qrp_nfields = pce->qrp_nfields;
+	pstmt->qrp_table = pce->qrp_table;
+	pstmt->qrp_field = pce->qrp_field;
+	pstmt->qrp_backend = pce->qrp_backend;
+	pstmt->qrp_shared = true;
+}
+
+
+/*
+ * Shape serialization
+ */
+
+static void
+pcache_shape_init(PlanCacheShape *shape)
+{
+	memset(shape, 0, sizeof(PlanCacheShape));
+	shape->cacheable = true;
+}
+
+static void
+pcache_shape_free(PlanCacheShape *shape)
+{
+	if (shape->buf)
+		vhfree(shape->buf);
+
+	if (shape->params)
+		vhfree(shape->params);
+
+	shape->buf = 0;
+	shape->params = 0;
+}
+
+static void
+pcache_shape_put(PlanCacheShape *shape, const void *data, size_t sz)
+{
+	if (shape->len + sz > shape->cap)
+	{
+		shape->cap = shape->cap ? shape->cap * 2 : 256;
+
+		while (shape->len + sz > shape->cap)
+			shape->cap *= 2;
+
+		shape->buf = shape->buf ?
+			vhrealloc(shape->buf, shape->cap) :
+			vhmalloc(shape->cap);
+	}
+
+	memcpy(shape->buf + shape->len, data, sz);
+	shape->len += sz;
+}
+
+#define pcache_shape_putv(shape, v)		pcache_shape_put((shape), &(v), sizeof(v))
+
+static void
+pcache_shape_str(PlanCacheShape *shape, String str)
+{
+	uint32_t len = str ? vh_strlen(str) : (uint32_t) -1;
+
+	pcache_shape_putv(shape, len);
+
+	if (str)
+		pcache_shape_put(shape, vh_str_buffer(str), len);
+}
+
+/*
+ * NodeField refers to its NodeFrom or NodeJoin by pointer, which changes from
+ * one query to the next.  We write the table's position instead.
+ */
+static void
+pcache_shape_src(PlanCacheShape *shape, void *src)
+{
+	int32_t i, idx = -1;
+
+	if (src)
+	{
+		for (i = 0; i < shape->nsrcs; i++)
+		{
+			if (shape->srcs[i] == src)
+			{
+				idx = i;
+				break;
+			}
+		}
+
+		if (idx < 0)
+			shape->cacheable = false;
+	}
+
+	pcache_shape_putv(shape, idx);
+}
+
+static void
+pcache_shape_param(PlanCacheShape *shape, TypeVarSlot *tvs)
+{
+	if (shape->nparams == shape->params_cap)
+	{
+		shape->params_cap = shape->params_cap ? shape->params_cap * 2 : 8;
+		shape->params = shape->params ?
+			vhrealloc(shape->params, sizeof(TypeVarSlot*) * shape->params_cap) :
+			vhmalloc(sizeof(TypeVarSlot*) * shape->params_cap);
+	}
+
+	shape->params[shape->nparams++] = tvs;
+	pcache_shape_put(shape, &tvs->tags[0], sizeof(tvs->tags));
+}
+
+static void
+pcache_shape_from(PlanCacheShape *shape, NodeFrom nfrom)
+{
+	TableDef td = nfrom->tdv ? nfrom->tdv->td : 0;
+
+	pcache_shape_putv(shape, nfrom->node.tag);
+	pcache_shape_putv(shape, td);
+	pcache_shape_putv(shape, nfrom->tdv);
+	pcache_shape_str(shape, nfrom->alias);
+	pcache_shape_putv(shape, nfrom->lock_level);
+	pcache_shape_putv(shape, nfrom->lock_mode);
+	pcache_shape_putv(shape, nfrom->result_index);
+	pcache_shape_putv(shape, nfrom->transient);
+	pcache_shape_putv(shape, nfrom->temporary);
+	pcache_shape_putv(shape, nfrom->result);
+
+	if (nfrom->transient)
+	{
+		pcache_shape_str(shape, nfrom->transient_schema);
+		pcache_shape_str(shape, nfrom->transient_table);
+	}
+}
+
+/*
+ * pcache_shape_quals
+ *
+ * Walks a QualList in the same pre-order vh_nsql_cmd_impl emits it, so the
+ * parameters come out in placeholder order.
+ */
+static void
+pcache_shape_quals(PlanCacheShape *shape, Node node)
+{
+	NodeQual nqual;
+	Node child;
+
+	pcache_shape_putv(shape, node->tag);
+
+	switch (node->tag)
+	{
+	case Qual:
+		nqual = (NodeQual)node;
+
+		pcache_shape_putv(shape, nqual->cm);
+		pcache_shape_quals_side(shape, &nqual->lhs);
+		pcache_shape_putv(shape, nqual->oper);
+		pcache_shape_quals_side(shape, &nqual->rhs);
+		break;
+
+	case QualList:
+		break;
+
+	default:
+		shape->cacheable = false;
+		return;
+	}
+
+	child = node->firstChild;
+
+	while (child)
+	{
+		pcache_shape_quals(shape, child);
+		child = child->nextSibling;
+	}
+}
+
+static void
+pcache_shape_quals_side(PlanCacheShape *shape, NodeQualS nqs)
+{
+	int32_t fmt = vh_nsql_qual_fmt(nqs);
+
+	pcache_shape_putv(shape, fmt);
+
+	switch (fmt)
+	{
+	case VH_NQUAL_FMT_TVSLIST:
+		/*
+		 * The whole list goes to the back end as a single array parameter,
+		 * so its length doesn't change the command.
+		 */
+		pcache_shape_param(shape, vh_nsql_quals_tvslist(nqs));
+		break;
+
+	case VH_NQUAL_FMT_TF:
+		pcache_shape_putv(shape, nqs->tf);
+		break;
+
+	case VH_NQUAL_FMT_NF:
+		pcache_shape_putv(shape, nqs->nf->tf);
+		break;
+
+	case VH_NQUAL_FMT_TVS:
+		pcache_shape_param(shape, vh_nsql_quals_tvs(nqs));
+		break;
+
+	default:
+		/*
+		 * Functions are written to the command as text, leave them alone.
+		 */
+		shape->cacheable = false;
+		break;
+	}
+}
+
+static bool
+pcache_shape_select(PlanCacheShape *shape, NodeQuerySelect nqsel, BackEnd be)
+{
+	NodeField nfield;
+	NodeOrderBy norder;
+	NodeJoin njoin;
+	Node node, qual;
+
+	pcache_shape_putv(shape, be);
+	pcache_shape_putv(shape, nqsel->query.action);
+	pcache_shape_putv(shape, nqsel->query.hasTemporaryTables);
+	pcache_shape_putv(shape, nqsel->limit);
+	pcache_shape_putv(shape, nqsel->offset);
+	pcache_shape_putv(shape, nqsel->result_table_selections);
+
+	if (nqsel->from)
+	{
+		for (node = nqsel->from->firstChild; node; node = node->nextSibling)
+		{
+			if (node->tag != From || shape->nsrcs == PCACHE_MAX_SRCS)
+				return false;
+
+			shape->srcs[shape->nsrcs++] = node;
+			pcache_shape_from(shape, (NodeFrom)node);
+		}
+	}
+
+	if (nqsel->joins)
+	{
+		for (node = nqsel->joins->firstChild; node; node = node->nextSibling)
+		{
+			if (node->tag != Join || shape->nsrcs == PCACHE_MAX_SRCS)
+				return false;
+
+			njoin = (NodeJoin)node;
+			shape->srcs[shape->nsrcs++] = njoin;
+
+			pcache_shape_putv(shape, njoin->join_type);
+			pcache_shape_from(shape, &njoin->join_table);
+
+			for (qual = njoin->quals.firstChild; qual; qual = qual->nextSibling)
+				pcache_shape_quals(shape, qual);
+		}
+	}
+
+	pcache_shape_putv(shape, shape->nsrcs);
+
+	if (nqsel->fields)
+	{
+		for (node = nqsel->fields->firstChild; node; node = node->nextSibling)
+		{
+			if (node->tag != Field)
+				return false;
+
+			nfield = (NodeField)node;
+
+			pcache_shape_putv(shape, nfield->tf);
+			pcache_shape_src(shape, nfield->nfrom);
+			pcache_shape_str(shape, nfield->alias);
+			pcache_shape_putv(shape, nfield->wildcard);
+			pcache_shape_putv(shape, nfield->isjoin);
+		}
+	}
+
+	if (nqsel->quals)
+		pcache_shape_quals(shape, nqsel->quals);
+
+	if (nqsel->orderBy)
+	{
+		for (node = nqsel->orderBy->firstChild; node; node = node->nextSibling)
+		{
+			if (node->tag != OrderBy)
+				return false;
+
+			norder = (NodeOrderBy)node;
+
+			pcache_shape_putv(shape, norder->tfield);
+			pcache_shape_putv(shape, norder->oop);
+			pcache_shape_putv(shape, norder->orflags);
+
+			if (norder->nfield)
+			{
+				pcache_shape_putv(shape, norder->nfield->tf);
+				pcache_shape_src(shape, norder->nfield->nfrom);
+			}
+		}
+	}
+
+	return shape->cacheable;
+}
+
+/*
+ * FNV-1a over the serialized shape.
+ */
+static uint64_t
+pcache_shape_hash(PlanCacheShape *shape)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < shape->len; i++)
+	{
+		hash ^= shape->buf[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
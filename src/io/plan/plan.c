@@ -22,6 +22,7 @@
 #include "io/nodes/NodeUpdateField.h"
 #include "io/plan/esg.h"
 #include "io/plan/flatten.h"
+#include "io/plan/pcache.h"
 #include "io/plan/plan.h"
 #include "io/plan/pstmt_funcs.h"
 #include "io/shard/Shard.h"
@@ -62,6 +63,7 @@ void (*plan_esg)(PlannerState pstate, NodeQuery nq) = plan_esg_simple;
 
 static bool plan_insert(ExecPlan ep, Shard shard, NodeQueryInsert nq,
 						HeapBufferNo hbno);
+static bool plan_select_bulk(NodeQuerySelect nq);
 static bool plan_select(ExecPlan ep, Shard shard, NodeQuerySelect nq,
 						HeapBufferNo hbno);
 static bool plan_update(ExecPlan ep, Shard shard, NodeQueryUpdate nq,
@@ -272,7 +274,7 @@ plan_insert(ExecPlan ep, Shard shard, NodeQueryInsert nq,
 		for (i = 0; i < htp_sz; i++)
 		{
 			htp = htp_head[i];
-			ht = vh_htp(htp);
+			ht = vh_htp_read(htp);
 
 			/*
 			 * If there's only one record scheduled for insert, then we can just
@@ -507,6 +509,42 @@ plan_update(ExecPlan ep, Shard shard, NodeQueryUpdate nq,
 	return true;
 }
 
+/*
+ * plan_select_bulk
+ *
+ * Decides if the result of |nq| should be streamed in bulk, see 
+ * SelectFetchMode.  Without a hint from the caller, only a full extract of
+ * a single table qualifies: no quals, joins, LIMIT, OFFSET or row locks.
+ */
+static bool
+plan_select_bulk(NodeQuerySelect nq)
+{
+	Node n;
+
+	switch (nq->fetch_mode)
+	{
+	case SFM_Row:
+		return false;
+
+	case SFM_Bulk:
+		return true;
+
+	default:
+		break;
+	}
+
+	if (nq->quals || nq->joins || nq->limit > 0 || nq->offset > 0 ||
+		!nq->from || vh_nsql_child_count(nq->from) != 1)
+		return false;
+
+	n = nq->from->firstChild;
+
+	if (n->tag != From || ((NodeFrom)n)->lock_level != LL_None)
+		return false;
+
+	return true;
+}
+
 static bool
 plan_select(ExecPlan ep, Shard shard, NodeQuerySelect nq,
 			HeapBufferNo hbno)
@@ -521,11 +559,32 @@ plan_select(ExecPlan ep, Shard shard, NodeQuerySelect nq,
 	
 	esf->hbno = hbno;
 	esf->pstmt = vh_pstmt_generate_from_query((NodeQuery)nq, be);
-	esf->pstmtshd = vh_pstmtshd_generate(esf->pstmt, shard, shard->access[0]);
 	esf->indexed = false;
 	esf->returning = false;
 
-	if (vh_pstmt_qrp(esf->pstmt))
+	if (plan_select_bulk(nq))
+	{
+		/*
+		 * Bulk statements are wrapped by the back end at execution, keep
+		 * them out of the PlanCache so they're never prepared.  Most bulk
+		 * paths can't take parameters, fall back to the row path if the
+		 * command has any.
+		 */
+		esf->pstmtshd = vh_pstmtshd_generate(esf->pstmt, shard, 
+											 shard->access[0]);
+
+		if (vh_pstmt_qrp(esf->pstmt))
+			return false;
+
+		esf->pstmt->bulk = !esf->pstmtshd->paramcount &&
+						   !vh_pstmt_is_lb(esf->pstmt);
+	}
+	else
+	{
+		esf->pstmtshd = vh_pcache_pstmtshd(esf->pstmt, shard, shard->access[0]);
+	}
+
+	if (!esf->pstmtshd)
 		return false;
 
 	vh_SListPush(ep->shards, shard->access[0]);
@@ -16,6 +16,18 @@ vh_pstmt_finalize(PlannedStmt pstmt)
 	QrpFieldProjection qrpf;
 	QrpBackEndProjection qrpbe;
 
+	/*
+	 * The PlanCache owns shared projections, just let go of them.
+	 */
+	if (pstmt->qrp_shared)
+	{
+		pstmt->qrp_table = 0;
+		pstmt->qrp_field = 0;
+		pstmt->qrp_backend = 0;
+
+		return;
+	}
+
 	qrpt = pstmt->qrp_table;
 	qrpf = pstmt->qrp_field;
 	qrpbe = pstmt->qrp_backend;
@@ -29,6 +29,15 @@ vh_pstmt_generate_from_query(NodeQuery nq, BackEnd be)
 	pstmt->be = be;
 	pstmt->latebinding = false;
 	pstmt->latebindingset = false;
+	pstmt->bulk = false;
+	pstmt->finalize_qrp = false;
+	pstmt->qrp_shared = false;
+	pstmt->qrp_ntables = 0;
+	pstmt->qrp_nfields = 0;
+	pstmt->qrp_table = 0;
+	pstmt->qrp_field = 0;
+	pstmt->qrp_backend = 0;
+	pstmt->xact = 0;
 
 	return pstmt;
 }
@@ -48,6 +57,7 @@ vh_pstmtshd_generate(PlannedStmt pstmt,
 	pstmtshd->sharda = shda;
 	pstmtshd->paramcount = 0;
 	pstmtshd->parameters = 0;
+	pstmtshd->prepare_id = 0;
 	pstmtshd->nconn = 0;
 
 	be = pstmt->be;
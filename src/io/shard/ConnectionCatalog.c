@@ -5,6 +5,7 @@
 
 
 #include <assert.h>
+#include <uv.h>
 
 #include "vh.h"
 #include "io/catalog/BackEnd.h"
@@ -13,39 +14,84 @@
 #include "io/utils/kvmap.h"
 
 /*
- * Open Issues
- * 		1)	Concurrency on all structures
- * 		2)	Shutdown procedure
- * 		3)	Connection timeout
+ * Locking
+ *
+ * A single catalog lock protects the ShardAccess and connection maps, the
+ * idle lists, the counters and the catalog's MemoryContext.  The lock is never
+ * held across a call into the back end that talks to the server (connect,
+ * ping, disconnect) and never held when we elog, since an ERROR would unwind
+ * past the unlock.
+ *
+ * A checkout that finds the pool exhausted waits on the ShardAccessEntry's
+ * condition variable, which is signaled whenever a connection is returned or
+ * a slot frees up.
  */
 
+typedef struct ShardAccessEntryData *ShardAccessEntry;
+typedef struct PooledConnectionData *PooledConnection;
 
+typedef struct PooledConnectionData
+{
+	BackEndConnection nconn;
+	ShardAccessEntry saentry;
+	MemoryContext mctx;
+	PooledConnection next;			/* Idle list */
+	uint64_t idle_since;
+	bool out;
+} PooledConnectionData;
 
 typedef struct ShardAccessEntryData
 {
 	ShardAccess shardam;
-	BackEndConnection connlist[10];
-	uint16_t cl_out;
+	ConnectionPoolOpts opts;
+	ConnectionPoolStats stats;
+
+	PooledConnection idle;			/* Most recently returned first */
+	uint32_t total;					/* Includes connections being spawned */
+	uint32_t nidle;
+	uint32_t waiting;
 
-	uint16_t total;
-	uint16_t available;
-} ShardAccessEntryData, *ShardAccessEntry;
+	uv_cond_t cond;
+	uint64_t created;
+} ShardAccessEntryData;
 
 struct ConnectionCatalogData
 {
 	MemoryContext mctx;
-	KeyValueMap htbl_sa;
+	KeyValueMap htbl_sa;			/* ShardAccess -> ShardAccessEntry */
+	KeyValueMap htbl_conn;			/* BackEndConnection -> PooledConnection */
 	uint32_t total;
 
+	ConnectionPoolOpts opts_def;
+	uv_mutex_t lock;
+	uint64_t last_reap;
+	bool shutdown;
+
 	Shard shard_def;
 };
 
+#define VH_CONNPOOL_NS_PER_MS		(1000 * 1000)
+
 
-static void CheckoutConnection(ConnectionCatalog catalog, 
-							   BackEndConnection nconn, 
-							   ShardAccessEntry saentry);
-static BackEndConnection SpawnConnection(ConnectionCatalog catalog, 
-									  ShardAccessEntry saentry);
+static BackEndConnection GetConnection(ConnectionCatalog catalog,
+									   ShardAccess shardam,
+									   bool override_timeout,
+									   int64_t timeout_ms);
+static ShardAccessEntry GetShardAccessEntry(ConnectionCatalog catalog,
+											ShardAccess shardam,
+											bool create);
+static void CheckoutConnection(ShardAccessEntry saentry, uint64_t wait_start);
+static BackEndConnection SpawnConnection(ConnectionCatalog catalog,
+										 ShardAccessEntry saentry,
+										 uint64_t wait_start,
+										 bool checkout);
+static bool ValidateConnection(ConnectionCatalog catalog,
+							   PooledConnection pc,
+							   uint64_t wait_start);
+static void DetachConnection(ConnectionCatalog catalog, PooledConnection pc);
+static void CloseConnection(ConnectionCatalog catalog, PooledConnection pc);
+static void AddStats(ConnectionPoolStats *stats, ShardAccessEntry saentry,
+					 uint64_t now);
 
 
 
@@ -60,16 +106,34 @@ vh_ConnectionCatalogCreate(void)
 		catalog = (ConnectionCatalog)vhmalloc(sizeof(ConnectionCatalogData));
 		catalog->total = 0;
 		catalog->shard_def = 0;
-		catalog->mctx = vh_MemoryPoolCreate(cc->memoryTop, 
-											1028, 
+		catalog->last_reap = uv_hrtime();
+		catalog->shutdown = false;
+		catalog->mctx = vh_MemoryPoolCreate(cc->memoryTop,
+											1028,
 											"Back End Connection Catalog");
 
+		catalog->opts_def.min = 0;
+		catalog->opts_def.max = 0;
+		catalog->opts_def.checkout_timeout_ms = VH_CONNPOOL_DEFAULT_CHECKOUT_MS;
+		catalog->opts_def.idle_timeout_ms = VH_CONNPOOL_DEFAULT_IDLE_MS;
+		catalog->opts_def.validate_after_ms = VH_CONNPOOL_DEFAULT_VALIDATE_MS;
+
+		if (uv_mutex_init(&catalog->lock))
+			elog(FATAL,
+				 emsg("Unable to initialize the connection catalog lock!"));
+
 		catalog->htbl_sa = vh_kvmap_create_impl(sizeof(ShardAccess),
-												sizeof(ShardAccessEntryData),
+												sizeof(ShardAccessEntry),
 												vh_htbl_hash_ptr,
 												vh_htbl_comp_ptr,
 												catalog->mctx);
 
+		catalog->htbl_conn = vh_kvmap_create_impl(sizeof(BackEndConnection),
+												  sizeof(PooledConnection),
+												  vh_htbl_hash_ptr,
+												  vh_htbl_comp_ptr,
+												  catalog->mctx);
+
 		return catalog;
 	}
 	else
@@ -82,7 +146,7 @@ vh_ConnectionCatalogCreate(void)
 	return 0;
 }
 
-void 
+void
 vh_ConnectionCatalogSetDefault(ConnectionCatalog cc, Shard shd)
 {
 	cc->shard_def = shd;
@@ -94,274 +158,764 @@ vh_ConnectionCatalogGetDefault(ConnectionCatalog cc)
 	return cc->shard_def;
 }
 
+void
+vh_ConnectionCatalogSetOpts(ConnectionCatalog catalog, ShardAccess shardam,
+							const ConnectionPoolOpts *opts)
+{
+	ShardAccessEntry saentry;
+
+	uv_mutex_lock(&catalog->lock);
+
+	if (shardam)
+	{
+		saentry = GetShardAccessEntry(catalog, shardam, true);
+		saentry->opts = *opts;
+
+		/*
+		 * Waiters may be able to spawn now if |max| went up.
+		 */
+		uv_cond_broadcast(&saentry->cond);
+	}
+	else
+	{
+		catalog->opts_def = *opts;
+	}
+
+	uv_mutex_unlock(&catalog->lock);
+}
+
+void
+vh_ConnectionCatalogGetOpts(ConnectionCatalog catalog, ShardAccess shardam,
+							ConnectionPoolOpts *opts)
+{
+	ShardAccessEntry saentry;
+
+	uv_mutex_lock(&catalog->lock);
+
+	saentry = shardam ? GetShardAccessEntry(catalog, shardam, false) : 0;
+	*opts = saentry ? saentry->opts : catalog->opts_def;
+
+	uv_mutex_unlock(&catalog->lock);
+}
+
 BackEndConnection
 vh_ConnectionGet(ConnectionCatalog catalog, ShardAccess shardam)
 {
-	MemoryContext mctx_old;
+	return GetConnection(catalog, shardam, false, 0);
+}
+
+BackEndConnection
+vh_ConnectionGetWait(ConnectionCatalog catalog, ShardAccess shardam,
+					 int64_t timeout_ms)
+{
+	return GetConnection(catalog, shardam, true, timeout_ms);
+}
+
+void
+vh_ConnectionReturn(ConnectionCatalog catalog,
+					BackEndConnection nconn)
+{
 	ShardAccessEntry saentry;
-	BackEndConnection nconn = 0;
-	uint16_t i;
+	PooledConnection *pc_slot, pc;
+	uint64_t now;
+	bool reap;
+
+	uv_mutex_lock(&catalog->lock);
 
-	mctx_old = vh_mctx_switch(catalog->mctx);
+	pc_slot = vh_kvmap_find(catalog->htbl_conn, &nconn);
 
-	if (vh_kvmap_value(catalog->htbl_sa, &shardam, saentry))
+	if (!pc_slot || !(*pc_slot)->out)
 	{
-		if (saentry->available)
-		{
-			/*
-			 * Scan the availability list for a free connection, the totals
-			 * indicate one should be available.
-			 */
+		uv_mutex_unlock(&catalog->lock);
 
-			for (i = 0; i < saentry->total; i++)
-			{
-				if (saentry->cl_out & ( 1 << (i + 1)))
-				   continue;
+		elog(ERROR2,
+			 emsg("ConnectionCatalog does not have a record for the desired "
+				  "BackEndConnection located at %p",
+				  nconn));
 
-				assert(saentry->connlist[i]);	
-				nconn = saentry->connlist[i];
-				break;	
-			}
-		}
-		else
-		{
-			nconn = SpawnConnection(catalog, saentry);
+		return;
+	}
+
+	pc = *pc_slot;
+	saentry = pc->saentry;
+
+	pc->out = false;
+	saentry->stats.returns++;
 
-			if (!nconn)
-				saentry = 0;
+	if (catalog->shutdown)
+	{
+		DetachConnection(catalog, pc);
+		uv_mutex_unlock(&catalog->lock);
+
+		CloseConnection(catalog, pc);
+
+		return;
+	}
+
+	now = uv_hrtime();
+
+	pc->idle_since = now;
+	pc->next = saentry->idle;
+	saentry->idle = pc;
+	saentry->nidle++;
+
+	uv_cond_signal(&saentry->cond);
+
+	reap = now - catalog->last_reap >=
+		(uint64_t)VH_CONNPOOL_REAP_INTERVAL_MS * VH_CONNPOOL_NS_PER_MS;
+
+	uv_mutex_unlock(&catalog->lock);
+
+	if (reap)
+		vh_ConnectionCatalogReap(catalog);
+}
+
+int32_t
+vh_ConnectionCatalogWarm(ConnectionCatalog catalog, ShardAccess shardam)
+{
+	ShardAccessEntry saentry;
+	BackEndConnection nconn;
+	int32_t opened = 0;
+
+	while (1)
+	{
+		uv_mutex_lock(&catalog->lock);
+
+		saentry = GetShardAccessEntry(catalog, shardam, true);
+
+		if (catalog->shutdown ||
+			saentry->total >= saentry->opts.min ||
+			(saentry->opts.max && saentry->total >= saentry->opts.max))
+		{
+			uv_mutex_unlock(&catalog->lock);
+			break;
 		}
+
+		saentry->total++;
+		uv_mutex_unlock(&catalog->lock);
+
+		nconn = SpawnConnection(catalog, saentry, 0, false);
+		vh_ConnectionReturn(catalog, nconn);
+
+		opened++;
 	}
-	else
+
+	return opened;
+}
+
+int32_t
+vh_ConnectionCatalogReap(ConnectionCatalog catalog)
+{
+	ShardAccessEntry *saentry_slot, saentry;
+	PooledConnection reaped = 0, pc, *link;
+	KeyValueMapIterator it;
+	ShardAccess sa;
+	uint64_t now, idle_ns;
+	int32_t closed = 0;
+
+	uv_mutex_lock(&catalog->lock);
+
+	now = uv_hrtime();
+	catalog->last_reap = now;
+
+	vh_kvmap_it_init(&it, catalog->htbl_sa);
+
+	while (vh_kvmap_it_next(&it, &sa, &saentry_slot))
 	{
-		saentry->total = 0;
-		saentry->available = 0;
-		saentry->shardam = shardam;
-		saentry->cl_out = 0;
+		saentry = *saentry_slot;
 
-		memset(saentry->connlist, 0, sizeof(BackEndConnection) * 10);
+		if (saentry->opts.idle_timeout_ms < 0)
+			continue;
 
-		nconn = SpawnConnection(catalog, saentry);
+		idle_ns = (uint64_t)saentry->opts.idle_timeout_ms *
+			VH_CONNPOOL_NS_PER_MS;
+		link = &saentry->idle;
 
-		if (!nconn)
+		/*
+		 * The idle list is ordered most recently returned first, so the
+		 * connections that have been sitting longest are at the tail.
+		 */
+		while ((pc = *link) && saentry->total > saentry->opts.min)
 		{
-			vh_kvmap_remove(catalog->htbl_sa, &shardam);
-			saentry = 0;
+			if (now - pc->idle_since >= idle_ns)
+			{
+				*link = pc->next;
+				saentry->nidle--;
+				saentry->stats.reaped++;
+
+				DetachConnection(catalog, pc);
+
+				pc->next = reaped;
+				reaped = pc;
+				closed++;
+			}
+			else
+			{
+				link = &pc->next;
+			}
 		}
 	}
 
-	if (saentry)
+	uv_mutex_unlock(&catalog->lock);
+
+	while ((pc = reaped))
 	{
-		CheckoutConnection(catalog, nconn, saentry);
+		reaped = pc->next;
+		CloseConnection(catalog, pc);
 	}
 
-	vh_mctx_switch(mctx_old);
-	
-	return nconn;
+	return closed;
 }
 
 void
-vh_ConnectionCatalogShutDown(ConnectionCatalog cc)
+vh_ConnectionCatalogStats(ConnectionCatalog catalog, ShardAccess shardam,
+						  ConnectionPoolStats *stats)
 {
-	ShardAccessEntry sae;
+	ShardAccessEntry *saentry_slot, saentry;
+	KeyValueMapIterator it;
 	ShardAccess sa;
-	BackEndConnection nconn;
-	uint16_t j = 0;
-	BackEnd be;
-	vh_beat_disconnect beat_disconnect;
-	vh_beat_freeconn beat_free;
+	uint64_t now;
+
+	memset(stats, 0, sizeof(ConnectionPoolStats));
+
+	uv_mutex_lock(&catalog->lock);
+
+	now = uv_hrtime();
+
+	if (shardam)
+	{
+		saentry = GetShardAccessEntry(catalog, shardam, false);
+
+		if (saentry)
+			AddStats(stats, saentry, now);
+	}
+	else
+	{
+		vh_kvmap_it_init(&it, catalog->htbl_sa);
+
+		while (vh_kvmap_it_next(&it, &sa, &saentry_slot))
+			AddStats(stats, *saentry_slot, now);
+	}
+
+	uv_mutex_unlock(&catalog->lock);
+}
+
+void
+vh_ConnectionCatalogShutDown(ConnectionCatalog cc)
+{
+	ShardAccessEntry *saentry_slot, saentry;
+	PooledConnection closing = 0, pc;
 	KeyValueMapIterator it;
+	ShardAccess sa;
 
 	/*
-	 * This really needs to take a global lock to prevent connections from being
-	 * taken.  We'll first iterate the cc->shard AVL tree to release all
-	 * connections there.  Then we'll need to wait on the in process connections
-	 * to release.  In the future we should probably pass a force flag to the
-	 * ShutDown call.  If it's force, we'll wait briefly on outsanding connections
-	 * to release and then kill it.
+	 * Close everything sitting idle and wake anyone waiting so they can
+	 * error out.  Connections still checked out are closed as they're
+	 * returned.
 	 */
+	uv_mutex_lock(&cc->lock);
+
+	cc->shutdown = true;
 
 	vh_kvmap_it_init(&it, cc->htbl_sa);
 
-	while (vh_kvmap_it_next(&it, &sa, &sae))
+	while (vh_kvmap_it_next(&it, &sa, &saentry_slot))
 	{
-		for (j = 0; j < sae->total; j++)
+		saentry = *saentry_slot;
+
+		while ((pc = saentry->idle))
 		{
-			nconn = sae->connlist[j];
-			assert(nconn);
+			saentry->idle = pc->next;
+			saentry->nidle--;
 
-			be = nconn->be;
-			assert(be);
+			DetachConnection(cc, pc);
 
-			beat_disconnect = be->at.disconnect;
-			beat_free = be->at.freeconn;
+			pc->next = closing;
+			closing = pc;
+		}
 
-			if (beat_disconnect)
-				beat_disconnect(nconn);
+		uv_cond_broadcast(&saentry->cond);
+	}
 
-			if (beat_free)
-				beat_free(nconn);
+	uv_mutex_unlock(&cc->lock);
 
-			sae->connlist[j] = 0;
-		}		
+	while ((pc = closing))
+	{
+		closing = pc->next;
+		CloseConnection(cc, pc);
 	}
-
-	vh_kvmap_destroy(cc->htbl_sa);
 }
 
 void
-vh_ConnectionReturn(ConnectionCatalog catalog, 
-					BackEndConnection nconn)
+vh_ConnectionCatalogDestroy(ConnectionCatalog catalog)
 {
-
-	ShardAccessEntry sae;
-	ShardAccess sa;
+	ShardAccessEntry *saentry_slot;
 	KeyValueMapIterator it;
-	uint16_t j = 0;
-	bool found = false;
+	ShardAccess sa;
+
+	if (!catalog->shutdown)
+		vh_ConnectionCatalogShutDown(catalog);
+
+	if (catalog->total)
+		elog(WARNING,
+			 emsg("The connection catalog is being destroyed with %u "
+				  "connections still checked out!",
+				  catalog->total));
 
-	/*
-	 * Loops thru all of the outstanding ShardAccess entries and tries to
-	 * find the connection.
-	 */
 	vh_kvmap_it_init(&it, catalog->htbl_sa);
-	while (vh_kvmap_it_next(&it, &sa, &sae))
+
+	while (vh_kvmap_it_next(&it, &sa, &saentry_slot))
+		uv_cond_destroy(&(*saentry_slot)->cond);
+
+	vh_kvmap_destroy(catalog->htbl_sa);
+	vh_kvmap_destroy(catalog->htbl_conn);
+
+	uv_mutex_destroy(&catalog->lock);
+	vh_mctx_destroy(catalog->mctx);
+
+	vhfree(catalog);
+}
+
+
+/*
+ * GetConnection
+ *
+ * Checkout for vh_ConnectionGet and vh_ConnectionGetWait.  Hands out the most
+ * recently returned idle connection, spawns one when the pool has room and
+ * otherwise waits on the ShardAccessEntry until |timeout_ms| runs out.
+ */
+static BackEndConnection
+GetConnection(ConnectionCatalog catalog, ShardAccess shardam,
+			  bool override_timeout, int64_t timeout_ms)
+{
+	ShardAccessEntry saentry;
+	PooledConnection pc;
+	uint64_t now, wait_start = 0, deadline = 0;
+	bool validate;
+
+	if (!shardam)
+		elog(ERROR2,
+			 emsg("Corrupt connection catalog request, a null ShardAccess "
+				  "pointer was passed to vh_ConnectionGet!"));
+
+	uv_mutex_lock(&catalog->lock);
+	saentry = GetShardAccessEntry(catalog, shardam, true);
+
+	if (!override_timeout)
+		timeout_ms = saentry->opts.checkout_timeout_ms;
+
+	while (1)
 	{
-		if (sae->total == sae->available)
-			continue;
-		
-		for (j = 0; j < sae->total; j++)
+		if (catalog->shutdown)
 		{
-			if (sae->connlist[j] == nconn)
+			uv_mutex_unlock(&catalog->lock);
+
+			elog(ERROR2,
+				 emsg("The connection catalog has been shut down, no new "
+					  "connections may be checked out."));
+
+			return 0;
+		}
+
+		if ((pc = saentry->idle))
+		{
+			saentry->idle = pc->next;
+			saentry->nidle--;
+
+			pc->next = 0;
+			pc->out = true;
+
+			now = uv_hrtime();
+			validate = saentry->opts.validate_after_ms >= 0 &&
+					   shardam->be->at.ping &&
+					   now - pc->idle_since >=
+					   		(uint64_t)saentry->opts.validate_after_ms *
+					   		VH_CONNPOOL_NS_PER_MS;
+
+			if (!validate)
 			{
-				sae->cl_out &= ~( 1 << (j + 1));
-				sae->available++;
+				CheckoutConnection(saentry, wait_start);
+				uv_mutex_unlock(&catalog->lock);
+
+				return pc->nconn;
+			}
+
+			uv_mutex_unlock(&catalog->lock);
+
+			if (ValidateConnection(catalog, pc, wait_start))
+				return pc->nconn;
+
+			/*
+			 * The connection was closed and its slot released, go around
+			 * again for another idle connection or a fresh one.
+			 */
+			uv_mutex_lock(&catalog->lock);
+			continue;
+		}
+
+		if (!saentry->opts.max || saentry->total < saentry->opts.max)
+		{
+			/*
+			 * Reserve the slot so concurrent checkouts can't push the pool
+			 * past |max| while we connect.
+			 */
+			saentry->total++;
+			uv_mutex_unlock(&catalog->lock);
+
+			return SpawnConnection(catalog, saentry, wait_start, true);
+		}
+
+		/*
+		 * The pool is exhausted, wait for a connection to come back.
+		 */
+		now = uv_hrtime();
 
-				found = true;
+		if (!wait_start)
+		{
+			if (timeout_ms == 0)
+			{
+				saentry->stats.timeouts++;
+				uv_mutex_unlock(&catalog->lock);
 
-				break;
+				return 0;
 			}
+
+			wait_start = now;
+			deadline = timeout_ms > 0 ?
+				now + (uint64_t)timeout_ms * VH_CONNPOOL_NS_PER_MS : 0;
+
+			saentry->stats.waits++;
+		}
+		else if (deadline && now >= deadline)
+		{
+			saentry->stats.timeouts++;
+			saentry->stats.wait_ns += now - wait_start;
+
+			if (now - wait_start > saentry->stats.wait_ns_max)
+				saentry->stats.wait_ns_max = now - wait_start;
+
+			uv_mutex_unlock(&catalog->lock);
+
+			elog(DEBUG2,
+				 emsg("Timed out after %lld ms waiting for a connection, "
+					  "%u connections are checked out",
+					  (long long)timeout_ms,
+					  saentry->total));
+
+			return 0;
 		}
 
-		if (found)
-			break;
+		saentry->waiting++;
+
+		if (deadline)
+			uv_cond_timedwait(&saentry->cond, &catalog->lock, deadline - now);
+		else
+			uv_cond_wait(&saentry->cond, &catalog->lock);
+
+		saentry->waiting--;
 	}
 
-	if (!found)
+	return 0;
+}
+
+/*
+ * GetShardAccessEntry
+ *
+ * Must be called with the catalog lock held.  The entries are allocated
+ * separately from the map so their addresses (and condition variables) stay
+ * put when the map grows.
+ */
+static ShardAccessEntry
+GetShardAccessEntry(ConnectionCatalog catalog, ShardAccess shardam,
+					bool create)
+{
+	ShardAccessEntry *saentry_slot, saentry;
+
+	if (!create)
 	{
-		elog(ERROR2,
-			 emsg("ConnectionCatalog does not have a record for the desired "
-				  "BackEndConnection located at %p",
-				  nconn));
+		saentry_slot = vh_kvmap_find(catalog->htbl_sa, &shardam);
+
+		return saentry_slot ? *saentry_slot : 0;
 	}
-}
 
+	if (vh_kvmap_value(catalog->htbl_sa, &shardam, saentry_slot))
+		return *saentry_slot;
+
+	saentry = vhmalloc_ctx(catalog->mctx, sizeof(ShardAccessEntryData));
+	memset(saentry, 0, sizeof(ShardAccessEntryData));
+
+	saentry->shardam = shardam;
+	saentry->opts = catalog->opts_def;
+	saentry->created = uv_hrtime();
+	uv_cond_init(&saentry->cond);
+
+	*saentry_slot = saentry;
 
+	return saentry;
+}
 
+/*
+ * CheckoutConnection
+ *
+ * Records a successful checkout, must be called with the catalog lock held.
+ */
 static void
-CheckoutConnection(ConnectionCatalog catalog, 
-				   BackEndConnection nconn, 
-				   ShardAccessEntry saentry)
+CheckoutConnection(ShardAccessEntry saentry, uint64_t wait_start)
 {
-	uint16_t i;
-	bool slot_set = false;
+	uint64_t waited;
 
-	for (i = 0; i < saentry->total; i++)
-	{
-		if (saentry->connlist[i] == nconn)
-		{
-			slot_set = true;
-			break;
-		}
-	}
+	saentry->stats.checkouts++;
 
-	if (slot_set)
-	{
-		saentry->cl_out |= (1 << (i + 1));
-		saentry->available--;
-	}
-	else
+	if (wait_start)
 	{
-		elog(ERROR2,
-			 emsg("ConnectionCatalog CheckoutConnection slot could not find BackEndConnection "
-				  "%p",
-				  nconn));
+		waited = uv_hrtime() - wait_start;
+		saentry->stats.wait_ns += waited;
+
+		if (waited > saentry->stats.wait_ns_max)
+			saentry->stats.wait_ns_max = waited;
 	}
 }
 
-static BackEndConnection 
-SpawnConnection(ConnectionCatalog catalog, 
-				ShardAccessEntry saentry)
+/*
+ * SpawnConnection
+ *
+ * Opens a new connection for a slot the caller already reserved by bumping
+ * |saentry->total|.  Called without the catalog lock.  When the connection
+ * can't be established, the slot is released before the error is thrown.
+ */
+static BackEndConnection
+SpawnConnection(ConnectionCatalog catalog,
+				ShardAccessEntry saentry,
+				uint64_t wait_start,
+				bool checkout)
 {
-	BackEndConnection nconn;
+	BackEndConnection nconn = 0;
 	BackEnd be;
 	BackEndCredentialVal becredval;
 	ShardAccess sa;
+	PooledConnection pc, *pc_slot;
+	MemoryContext mctx_old, mctx_conn = 0;
 	vh_beat_createconn beat_createconn;
 	vh_beat_connect beat_connect;
+	vh_beat_freeconn beat_free;
+	char hostname[sizeof(becredval.hostname)];
+	char hostport[sizeof(becredval.hostport)];
+	bool connected = false;
+
+	hostname[0] = '\0';
+	hostport[0] = '\0';
 
 	sa = saentry->shardam;
+	be = sa ? sa->be : 0;
 
-	if (!sa)
-		elog(ERROR2,
-			 emsg("Corrupt connection catalog, ShardAccessEntry does not have a valid "
-				  "ShardAccess pointer!"));
+	beat_createconn = be ? be->at.createconn : 0;
+	beat_connect = be ? be->at.connect : 0;
+	beat_free = be ? be->at.freeconn : 0;
+
+	if (beat_createconn)
+	{
+		uv_mutex_lock(&catalog->lock);
+		mctx_conn = vh_MemoryPoolCreate(catalog->mctx, 1024,
+										"Back end connection");
+		mctx_old = vh_mctx_switch(mctx_conn);
+		nconn = beat_createconn();
+		vh_mctx_switch(mctx_old);
+		uv_mutex_unlock(&catalog->lock);
+
+		becredval = vh_be_cred_retrieve(sa->becred);
+
+		mctx_old = vh_mctx_switch(mctx_conn);
+		connected = beat_connect && beat_connect(nconn, &becredval, sa->database);
+		vh_mctx_switch(mctx_old);
+
+		snprintf(hostname, sizeof(hostname), "%s", becredval.hostname);
+		snprintf(hostport, sizeof(hostport), "%s", becredval.hostport);
+
+		vh_be_cred_wipe(becredval);
+	}
+
+	if (connected)
+	{
+		uv_mutex_lock(&catalog->lock);
+
+		pc = vhmalloc_ctx(catalog->mctx, sizeof(PooledConnectionData));
+		pc->nconn = nconn;
+		pc->saentry = saentry;
+		pc->mctx = mctx_conn;
+		pc->next = 0;
+		pc->idle_since = 0;
+		pc->out = true;
+
+		vh_kvmap_value(catalog->htbl_conn, &nconn, pc_slot);
+		*pc_slot = pc;
+
+		catalog->total++;
+		saentry->stats.spawned++;
+
+		if (checkout)
+			CheckoutConnection(saentry, wait_start);
+
+		uv_mutex_unlock(&catalog->lock);
+
+		elog(DEBUG2, emsg("The shard connection catalog has created a new connection"
+			" for host %s on port %s; %d total with %d available"
+			, &hostname[0]
+			, &hostport[0]
+			, saentry->total
+			, saentry->nidle));
+
+		return nconn;
+	}
+
+	if (nconn && beat_free)
+		beat_free(nconn);
+
+	uv_mutex_lock(&catalog->lock);
+
+	if (mctx_conn)
+		vh_mctx_destroy(mctx_conn);
 
-	be = sa->be;
+	saentry->total--;
+	saentry->stats.spawn_failed++;
+	uv_cond_signal(&saentry->cond);
+
+	uv_mutex_unlock(&catalog->lock);
 
 	if (!be)
 		elog(ERROR2,
 			 emsg("Corrupt back end connection catalog; no back end referenced for the ShardAccess "
 				  "entry requested!"));
 
-	beat_createconn = be->at.createconn;
-	beat_connect = be->at.connect;
+	if (!beat_createconn)
+		elog(ERROR2,
+			 emsg("The back end %s does not define a createconn action, the "
+				  "connection catalog is unable to spawn a connection!",
+				  be->name));
 
-	if (beat_createconn)
-	{
-		nconn = beat_createconn();
-		becredval = vh_be_cred_retrieve(sa->becred);
-		
-		if (beat_connect && beat_connect(nconn, &becredval, sa->database))
-		{
-			saentry->connlist[saentry->total] = nconn;
-			
-			/*
-			 * Clear the out flag
-			 */
-			saentry->cl_out &= ~( 1 << (saentry->total + 1));
+	elog(ERROR2, emsg("Could not establish a connection in the shard"
+		" connection catalog for host %s port %s"
+		, &hostname[0]
+		, &hostport[0]));
 
-			saentry->total++;
-			saentry->available++;
-
-			elog(DEBUG2, emsg("The shard connection catalog has created a new connection"
-				" for host %s on port %s; %d total with %d available"
-				, &becredval.hostname[0]
-				, &becredval.hostport[0]
-				, saentry->total
-				, saentry->available));
-			
-			vh_be_cred_wipe(becredval);
-
-			return nconn;
-		}
-		else
-		{
-			/*
-			 * this should really throw an error/log file to indicate
-			 * a connection could not be made
-			 */
+	return 0;
+}
 
-			elog(ERROR2, emsg("Could not establish a connection in the shard"
-				" connection catalog for host %s port %s"
-				, &becredval.hostname[0]
-				, &becredval.hostport[0]));
+/*
+ * ValidateConnection
+ *
+ * Pings a connection that's been idle past |validate_after_ms|.  The caller
+ * has already taken it off the idle list.  On failure the connection is
+ * closed and its slot released.
+ */
+static bool
+ValidateConnection(ConnectionCatalog catalog, PooledConnection pc,
+				   uint64_t wait_start)
+{
+	ShardAccessEntry saentry = pc->saentry;
+	vh_beat_ping beat_ping = saentry->shardam->be->at.ping;
+	MemoryContext mctx_old;
+	bool alive;
 
-			vh_be_cred_wipe(becredval);
+	mctx_old = vh_mctx_switch(pc->mctx);
+	alive = beat_ping(pc->nconn);
+	vh_mctx_switch(mctx_old);
 
-			vhfree(nconn);
-		}
+	uv_mutex_lock(&catalog->lock);
+
+	saentry->stats.validated++;
+
+	if (alive)
+	{
+		CheckoutConnection(saentry, wait_start);
+		uv_mutex_unlock(&catalog->lock);
+
+		return true;
 	}
 
-	return 0;
+	saentry->stats.validate_failed++;
+
+	pc->out = false;
+	DetachConnection(catalog, pc);
+
+	uv_mutex_unlock(&catalog->lock);
+
+	elog(DEBUG2,
+		 emsg("Connection %p failed validation after sitting idle, it will "
+			  "be replaced",
+			  pc->nconn));
+
+	CloseConnection(catalog, pc);
+
+	return false;
+}
+
+/*
+ * DetachConnection
+ *
+ * Drops a connection from the pool's bookkeeping, must be called with the
+ * catalog lock held.  The caller has already unlinked it from the idle list.
+ * CloseConnection finishes the job once the lock is released.
+ */
+static void
+DetachConnection(ConnectionCatalog catalog, PooledConnection pc)
+{
+	ShardAccessEntry saentry = pc->saentry;
+
+	vh_kvmap_remove(catalog->htbl_conn, &pc->nconn);
+
+	saentry->total--;
+	catalog->total--;
+
+	uv_cond_signal(&saentry->cond);
+}
+
+static void
+CloseConnection(ConnectionCatalog catalog, PooledConnection pc)
+{
+	BackEnd be = pc->nconn->be;
+	vh_beat_disconnect beat_disconnect = be ? be->at.disconnect : 0;
+	vh_beat_freeconn beat_free = be ? be->at.freeconn : 0;
+
+	if (beat_disconnect)
+		beat_disconnect(pc->nconn);
+
+	if (beat_free)
+		beat_free(pc->nconn);
+
+	uv_mutex_lock(&catalog->lock);
+	vh_mctx_destroy(pc->mctx);
+	vhfree(pc);
+	uv_mutex_unlock(&catalog->lock);
+}
+
+static void
+AddStats(ConnectionPoolStats *stats, ShardAccessEntry saentry, uint64_t now)
+{
+	const ConnectionPoolStats *s = &saentry->stats;
+	double secs;
+
+	stats->checkouts += s->checkouts;
+	stats->returns += s->returns;
+	stats->spawned += s->spawned;
+	stats->spawn_failed += s->spawn_failed;
+	stats->reaped += s->reaped;
+	stats->validated += s->validated;
+	stats->validate_failed += s->validate_failed;
+
+	stats->waits += s->waits;
+	stats->timeouts += s->timeouts;
+	stats->wait_ns += s->wait_ns;
+
+	if (s->wait_ns_max > stats->wait_ns_max)
+		stats->wait_ns_max = s->wait_ns_max;
+
+	secs = (double)(now - saentry->created) / 1e9;
+
+	if (secs > 0)
+		stats->spawn_rate += (double)s->spawned / secs;
+
+	stats->total += saentry->total;
+	stats->idle += saentry->nidle;
+	stats->waiting += saentry->waiting;
 }
 
@@ -91,7 +91,7 @@ inline int c99_vsnprintf(char* str, size_t size, const char* format, va_list ap)
 #endif // _MSC_VER
 
 
-sigjmp_buf *vh_exception_stack = 0;
+VH_ERR_TLS sigjmp_buf *vh_exception_stack = 0;
 
 
 const char*
@@ -94,6 +94,13 @@ struct btRootData
 	btKeyColumn cols;
 
 	int32_t leaves;
+	int32_t n_entries;
+
+	/*
+	 * Capped trees, see vh_bt_create_capped.
+	 */
+	int32_t cap;
+	bool cap_keep_largest;
 
 	int16_t ncols;
 	int16_t depth;
@@ -142,6 +149,17 @@ struct btNodeData
 
 #define bt_ni_flag_null		(0x8000)
 
+/*
+ * When the tree allows nulls, the last bitmap_sz bytes of the key area hold
+ * the null bitmap, one bit per column starting from the high bit.  It lives
+ * inside the t_info length so it travels with the key when an item is copied
+ * between nodes.
+ */
+#define bt_ni_nullbitmap(r, item)	(((unsigned char*)((item) + 1)) +			\
+									 ((item)->t_info & ~bt_ni_flag_null) -		\
+									 (r)->bitmap_sz)
+#define bt_ni_isnull(bm, i)			(((bm)[(i) >> 3] >> (7 - ((i) & 7))) & 1)
+
 struct btNodeItemData
 {
 	btNode ptr;
@@ -266,6 +284,16 @@ static int32_t bt_delete_node(struct btRootData *root,
 							  struct btStackData *stack,
 							  struct btNodeData *node);
 
+static void bt_node_remove_item(struct btRootData *root,
+								struct btNodeData *node,
+								uint16_t itemoffset);
+
+static bool bt_cap_admit(struct btRootData *root,
+						 void **values,
+						 bool *nulls,
+						 void **idx_values);
+static void bt_cap_evict(struct btRootData *root);
+
 static void bt_node_deform(struct btRootData *root,
 						   struct btNodeData *node,
 						   uint16_t itemidx,
@@ -376,11 +404,34 @@ vh_bt_create(MemoryContext mctx, bool unique)
 	return root;
 }
 
+btRoot
+vh_bt_create_capped(MemoryContext mctx, bool unique,
+					int32_t cap, bool keep_largest)
+{
+	btRoot root;
+
+	root = vh_bt_create(mctx, unique);
+
+	if (root)
+	{
+		root->cap = cap > 0 ? cap : 0;
+		root->cap_keep_largest = keep_largest;
+	}
+
+	return root;
+}
+
 void
 vh_bt_destroy(btRoot root)
 {
 }
 
+int32_t
+vh_bt_count(btRoot root)
+{
+	return root->n_entries;
+}
+
 bool
 vh_bt_add_column(struct btRootData *root,
 	   			 TableDefVer tdv,
@@ -765,9 +816,10 @@ vh_bt_insert_tvs(btRoot root, TypeVarSlot **datas, int32_t n_datas,
 	{
 		res = bt_search(root, sks, &node, &pos, &match, true, false);
 
-		if (res < 0)
+		if (res)
 		{
 			inserted = false;
+			*value = 0;
 		}
 		else if (node)
 		{
@@ -874,6 +926,15 @@ vh_bt_insert_htp(btRoot root, HeapTuplePtr htp,
 
 			error = true;
 		}
+		else if (res > 0)
+		{
+			/*
+			 * A capped tree rejected the key.
+			 */
+
+			*value = 0;
+			error = true;
+		}
 		else if (node)
 		{
 			*value = bt_node_valuepointer(root, node, pos);
@@ -939,6 +1000,7 @@ vh_bt_trim(struct btRootData *root, int32_t entries, bool forward)
 
 			bt_delete_node(root, stack, node);
 			trimmed += max_keys;
+			root->n_entries -= max_keys;
 		}
 		else
 		{
@@ -981,6 +1043,7 @@ vh_bt_trim(struct btRootData *root, int32_t entries, bool forward)
 			copy->left = node->left;
 			copy->right = node->right;
 
+			root->n_entries -= bt_n_items(node) - bt_n_items(copy);
 			memcpy(node, copy, root->node_sz);
 
 			vhfree(copy);
@@ -1585,7 +1648,7 @@ bt_search(struct btRootData *root,
 				else
 				{		
 					htp = *((HeapTuplePtr*)vh_tvs_value(&scankeys[i].tvs));
-					ht = vh_htp(htp);
+					ht = vh_htp_read(htp);
 
 					if (!ht)
 					{
@@ -1608,6 +1671,27 @@ bt_search(struct btRootData *root,
 	}
 
 
+	/*
+	 * A full capped tree only takes keys that beat the boundary key, which
+	 * we can check from the edge leaf without searching for the key.  The
+	 * eviction happens before the insert so the value pointer we hand back
+	 * can't be moved by it.
+	 */
+	if (do_insert && root->cap && root->n_entries >= root->cap)
+	{
+		if (!bt_cap_admit(root, comp_values, nulls, idx_values))
+		{
+			*node = 0;
+			*key_match = false;
+
+			bt_col_destroy_var(root, idx_values);
+
+			return 1;
+		}
+
+		bt_cap_evict(root);
+	}
+
 	stack = vhmalloc(sizeof(struct btStackData) * (root->depth + 1));
 	stack->parent = 0;
 	stack->keyidx = -1;
@@ -1633,6 +1717,7 @@ bt_search(struct btRootData *root,
 					ioffset = bt_insert(root, istack, &n, 
 										comp_values, ins_values, idx_values,
 										nulls, ioffset);
+					root->n_entries++;
 				}
 				
 				/*
@@ -1657,6 +1742,7 @@ bt_search(struct btRootData *root,
 					if (do_delete)
 					{
 						bt_delete(root, istack, n, ioffset);
+						root->n_entries--;
 					}
 				}
 				else
@@ -1913,6 +1999,7 @@ bt_node_split(struct btRootData *root,
 	btNode sibling, parent, altparent, nodecopy;
 	size_t downlink_sz;
 	uint16_t mid, right, i, j, pmid, ppos;
+	bool prightmost;
 
 
 	if (node == root->root)
@@ -1973,6 +2060,7 @@ bt_node_split(struct btRootData *root,
 		bt_node_downpointer(parent, BT_FIRSTDATAKEY(parent)) = node;
 		bt_node_downpointer(parent, BT_FIRSTDATAKEY(parent) + 1) = sibling;
 
+		vhfree(nodecopy);
 
 		root->leaves++;
 		root->depth++;
@@ -1996,7 +2084,12 @@ bt_node_split(struct btRootData *root,
 		parent = stack->parent;
 		ppos = stack->keyidx;
 
-		pmid = bt_n_items(parent) / 2;
+		/*
+		 * Remember where a split of the parent will cut it, this mirrors the
+		 * mid calculation below.
+		 */
+		prightmost = BT_RIGHTMOST(parent);
+		pmid = bt_n_items(parent) / 2 + (prightmost ? 1 : 2);
 
 		mid = bt_n_items(node) / 2;
 		right = bt_n_items(node);
@@ -2056,41 +2149,32 @@ bt_node_split(struct btRootData *root,
 
 		/*
 		 * If the parent was split, then altparent will be populated.  If so, then
-		 * we'll need to figure out where the keys to our two sibling nodes now live.
-		 *
-		 * It's possible the LHS downlink and RHS downlink both end up on the altparent,
-		 * which is the right hand parent.
+		 * we'll need to figure out where the downlink to our node now lives.
+		 * Downlinks past the cut moved to the altparent, which is the right hand
+		 * parent.  Those that stayed shifted right by one if the parent picked
+		 * up a high key in the split.
 		 */
 
 		if (altparent)
 		{
 			if (ppos >= pmid)
 			{
-				/* Put both keys on the left hand parent. */
-
-				ppos = ppos - pmid;
-				bt_node_copyoff(root, sibling, altparent, BT_FIRSTDATAKEY(sibling), ppos);
-				bt_node_downpointer(altparent, ppos) = node;
-				bt_node_downpointer(altparent, ppos + 1) = sibling;
+				ppos = ppos - pmid + BT_FIRSTDATAKEY(altparent);
+				parent = altparent;
 			}
-			else
+			else if (prightmost)
 			{
-				/* Put both keys on the right hand parent. */
-				bt_node_copyoff(root, sibling, parent, BT_FIRSTDATAKEY(sibling), ppos);
-				bt_node_downpointer(parent, ppos) = node;
-				bt_node_downpointer(parent, ppos + 1) = sibling;
+				ppos++;
 			}
 		}
-		else
-		{
-			/*
-			 * The parent was not split and our right most key now has the
-			 * wrong downpointer, because this was on the left.
-			 */
-			bt_node_copyoff(root, sibling, parent, BT_FIRSTDATAKEY(sibling), ppos);
-			bt_node_downpointer(parent, ppos) = node;
-			bt_node_downpointer(parent, ppos + 1) = sibling;
-		}
+
+		/*
+		 * The downlink at ppos still covers our node, the sibling's first key
+		 * goes in right after it to point at the sibling.
+		 */
+		bt_node_copyoff(root, sibling, parent, BT_FIRSTDATAKEY(sibling), ppos + 1);
+		bt_node_downpointer(parent, ppos) = node;
+		bt_node_downpointer(parent, ppos + 1) = sibling;
 
 		memcpy(node, nodecopy, root->node_sz);
 		vhfree(nodecopy);
@@ -2128,7 +2212,7 @@ bt_node_copyoff(struct btRootData *root,
 
 		c = bt_n_items(tgt);
 
-		if (c && tgt_off < c)
+		if (c && tgt_off <= c)
 		{
 			memmove(&tgt->items[tgt_off],
 					&tgt->items[tgt_off - 1],
@@ -2205,7 +2289,8 @@ bt_node_deform(struct btRootData *root,
 	int16_t i, *len;
 	int32_t *htp_slot, htp_sz;
 	int8_t alignments[BT_MAX_COLUMNS], padding;
-	bool has_nulls, is_null, *null_flags;
+	bool has_nulls, is_null;
+	unsigned char *null_flags;
 	HeapTuplePtr *htp_head;
 	HeapTuple ht;
 
@@ -2213,7 +2298,7 @@ bt_node_deform(struct btRootData *root,
 
 	has_nulls = root->hasnulls;
 	item = (btNodeItem)bt_node_itemptr(node, itemoff);
-	null_flags = ((bool*)(item + 1)) + (item->t_info & ~bt_ni_flag_null);
+	null_flags = bt_ni_nullbitmap(root, item);
 
 	cursor = (unsigned char*)(item + 1);
 
@@ -2221,7 +2306,7 @@ bt_node_deform(struct btRootData *root,
 	{
 		if (has_nulls)
 		{
-			is_null = null_flags[0] >> (7 - i);
+			is_null = bt_ni_isnull(null_flags, i);
 			nulls[i] = is_null;
 		}
 		else
@@ -2315,7 +2400,7 @@ bt_node_deform(struct btRootData *root,
 					{
 						if (*htp_head)
 						{
-							ht = vh_htp(*htp_head);
+							ht = vh_htp_read(*htp_head);
 
 							if (!ht)
 							{
@@ -2371,7 +2456,7 @@ bt_node_deform(struct btRootData *root,
 
 					if (detoast)
 					{
-						ht = vh_htp(htp_head[*htp_slot]);
+						ht = vh_htp_read(htp_head[*htp_slot]);
 						assert(ht);
 
 						values[i] = vh_ht_field(ht, cols[i].hf);
@@ -2386,9 +2471,6 @@ bt_node_deform(struct btRootData *root,
 					break;
 			}
 		}
-
-		if (has_nulls && i > 0 && i % 7 == 0)
-			null_flags++;
 	}
 }
 
@@ -2411,7 +2493,8 @@ bt_node_deform_tvs(struct btRootData *root,
 	int32_t *htp_slot, htp_sz;
 	int8_t alignments[BT_MAX_COLUMNS], padding;
 	Type tys[VH_TAMS_MAX_DEPTH];
-	bool has_nulls, is_null, *null_flags;
+	bool has_nulls, is_null;
+	unsigned char *null_flags;
 	HeapTuplePtr *htp_head;
 	void *value;
 
@@ -2419,7 +2502,7 @@ bt_node_deform_tvs(struct btRootData *root,
 
 	has_nulls = root->hasnulls;
 	item = (btNodeItem)bt_node_itemptr(node, itemoff);
-	null_flags = ((bool*)(item + 1)) + (item->t_info & ~bt_ni_flag_null);
+	null_flags = bt_ni_nullbitmap(root, item);
 
 	cursor = (unsigned char*)(item + 1);
 
@@ -2430,7 +2513,7 @@ bt_node_deform_tvs(struct btRootData *root,
 
 		if (has_nulls)
 		{
-			is_null = null_flags[0] >> (7 - i);
+			is_null = bt_ni_isnull(null_flags, i);
 		}
 		else
 		{
@@ -2559,9 +2642,6 @@ bt_node_deform_tvs(struct btRootData *root,
 					break;
 			}
 		}
-
-		if (has_nulls && i > 0 && i % 7 == 0)
-			null_flags++;
 	}
 }
 
@@ -2590,6 +2670,7 @@ bt_node_form(struct btRootData *root,
 
 	cols = root->cols;
 	cursor = (unsigned char*)(item + 1);
+	item->t_info = 0;
 
 	for (i = 0; i < root->ncols; i++)
 	{
@@ -2625,6 +2706,13 @@ bt_node_form(struct btRootData *root,
 										cursor,
 										&tam_length,
 										&tam_cursor);
+
+					/*
+					 * bt_node_deform expects the length word followed by the
+					 * data, count both so the null bitmap lands after them.
+					 */
+					cursor += *lenword;
+					val_sz += sizeof(uint16_t);
 				}
 				else
 				{
@@ -2714,6 +2802,16 @@ bt_node_form(struct btRootData *root,
 		val_sz += (sizeof(uintptr_t) - align_diff);
 
 	item->t_info |= val_sz;
+
+	if (has_nulls)
+	{
+		cursor = bt_ni_nullbitmap(root, item);
+		memset(cursor, 0, root->bitmap_sz);
+
+		for (i = 0; i < root->ncols; i++)
+			if (nulls[i])
+				cursor[i >> 3] |= 1 << (7 - (i & 7));
+	}
 }
 
 static uint16_t
@@ -2977,8 +3075,7 @@ bt_delete(struct btRootData *root,
 		  struct btNodeData *node,
 		  uint16_t itemoffset)
 {
-	btNode copy;
-	int32_t max_keys = bt_n_items(node), i, j;
+	int32_t max_keys = bt_n_items(node);
 
 	if (max_keys == BT_FIRSTDATAKEY(node))
 	{
@@ -2993,27 +3090,108 @@ bt_delete(struct btRootData *root,
 	}
 	else
 	{
-		copy = bt_node_create(root);
-		
-		for (i = BT_HIGHKEY, j = BT_HIGHKEY; i <= max_keys; i++)
-		{
-			if (i == itemoffset)
-				continue;
+		bt_node_remove_item(root, node, itemoffset);
+	}
 
-			bt_node_copyoff(root, node, copy, i, j);
-			j++;
-		}
+	return 0;
+}
 
-		copy->flags = node->flags;
-		copy->left = node->left;
-		copy->right = node->right;
+/*
+ * bt_node_remove_item
+ *
+ * Rebuilds the page without the item at |itemoffset|.
+ */
+static void
+bt_node_remove_item(struct btRootData *root,
+					struct btNodeData *node,
+					uint16_t itemoffset)
+{
+	btNode copy;
+	int32_t max_keys = bt_n_items(node), i, j;
 
-		memcpy(node, copy, root->node_sz);
+	copy = bt_node_create(root);
+	
+	for (i = BT_HIGHKEY, j = BT_HIGHKEY; i <= max_keys; i++)
+	{
+		if (i == itemoffset)
+			continue;
 
-		vhfree(copy);
+		bt_node_copyoff(root, node, copy, i, j);
+		j++;
 	}
 
-	return 0;
+	copy->flags = node->flags;
+	copy->left = node->left;
+	copy->right = node->right;
+
+	memcpy(node, copy, root->node_sz);
+
+	vhfree(copy);
+}
+
+/*
+ * bt_cap_admit
+ *
+ * Returns true if the key in |values| belongs in a full capped tree.  Ties
+ * with the boundary key are rejected, the entry already in the tree wins.
+ */
+static bool
+bt_cap_admit(struct btRootData *root,
+			 void **values,
+			 bool *nulls,
+			 void **idx_values)
+{
+	btNode leaf = 0;
+	int32_t comp;
+	uint16_t pos;
+
+	if (!bt_traverse_leaf(root, &leaf, !root->cap_keep_largest) || !leaf)
+		return true;
+
+	if (bt_n_items(leaf) < BT_FIRSTDATAKEY(leaf))
+		return true;
+
+	pos = root->cap_keep_largest ? BT_FIRSTDATAKEY(leaf) : bt_n_items(leaf);
+	comp = bt_compare(root, leaf, values, nulls, idx_values, pos);
+
+	return root->cap_keep_largest ? comp > 0 : comp < 0;
+}
+
+/*
+ * bt_cap_evict
+ *
+ * Removes the boundary entry from a capped tree.  We only drop the whole leaf
+ * when it's down to its last entry and isn't the root.
+ */
+static void
+bt_cap_evict(struct btRootData *root)
+{
+	struct btStackData *stack_head, *stack = 0;
+	btNode leaf = 0;
+	int32_t n_data;
+
+	stack_head = bt_traverse_leaf_stack(root, &leaf, &stack,
+										!root->cap_keep_largest);
+
+	if (!stack_head)
+		return;
+
+	n_data = bt_n_items(leaf) - BT_FIRSTDATAKEY(leaf) + 1;
+
+	if (n_data > 0)
+	{
+		if (n_data == 1 && leaf != root->root && stack)
+			bt_delete_node(root, stack, leaf);
+		else
+			bt_node_remove_item(root, leaf,
+								root->cap_keep_largest ? 
+									BT_FIRSTDATAKEY(leaf) : 
+									bt_n_items(leaf));
+
+		root->n_entries--;
+	}
+
+	vhfree(stack_head);
 }
 
 static int32_t
@@ -4,55 +4,65 @@
 
 
 
-
-
-/* The MIT License
-
-   Copyright (c) 2008, 2009, 2011 by Attractive Chaos <attractor@live.co.uk>
-
-   Permission is hereby granted, free of charge, to any person obtaining
-   a copy of this software and associated documentation files (the
-   "Software"), to deal in the Software without restriction, including
-   without limitation the rights to use, copy, modify, merge, publish,
-   distribute, sublicense, and/or sell copies of the Software, and to
-   permit persons to whom the Software is furnished to do so, subject to
-   the following conditions:
-
-   The above copyright notice and this permission notice shall be
-   included in all copies or substantial portions of the Software.
-
-   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
-   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
-   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
-   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
-   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
-   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
-   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
-   SOFTWARE.
-*/
-
 #include <assert.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "vh.h"
 #include "io/utils/htbl.h"
 #include "io/utils/SList.h"
 
-#define __ac_isempty(flag, i) ((flag[i>>4]>>((i&0xfU)<<1))&2)
-#define __ac_isdel(flag, i) ((flag[i>>4]>>((i&0xfU)<<1))&1)
-#define __ac_iseither(flag, i) ((flag[i>>4]>>((i&0xfU)<<1))&3)
-#define __ac_set_isdel_false(flag, i) (flag[i>>4]&=~(1ul<<((i&0xfU)<<1)))
-#define __ac_set_isempty_false(flag, i) (flag[i>>4]&=~(2ul<<((i&0xfU)<<1)))
-#define __ac_set_isboth_false(flag, i) (flag[i>>4]&=~(3ul<<((i&0xfU)<<1)))
-#define __ac_set_isdel_true(flag, i) (flag[i>>4]|=1ul<<((i&0xfU)<<1))
-
-#define __ac_fsize(m) ((m) < 16? 1 : (m)>>4)
+/*
+ * Open addressing hash table with group probing.
+ *
+ * Every bucket has a control byte in |ctrl|.  The high bit is set for an
+ * empty or deleted bucket, otherwise the low seven bits hold the bottom
+ * seven bits of the key's hash (H2).  A probe loads HTBL_GROUP control
+ * bytes at once and compares them against H2 in parallel, with SSE2 when
+ * the compiler has it and eight bytes in a general purpose register when it
+ * doesn't.  Only buckets whose H2 matches get their key compared.  The rest
+ * of the hash (H1) picks where the probe starts, and probes then move in
+ * triangular steps of whole groups.
+ *
+ * The first HTBL_GROUP control bytes are cloned past the end of |ctrl|, so a
+ * group can be loaded at any bucket without wrapping.  That's also why the
+ * table is never smaller than a single group.
+ *
+ * The full hash of every key is stored in |hashes|.  A probe checks it
+ * before calling the comparison and a resize never needs to rehash a key.
+ *
+ * Tables built with the stock int32, int64, pointer or string hash and
+ * comparison functions get a specialized probe loop with the comparison
+ * inlined.  Anything else calls |func_hash| once per operation and
+ * |func_compare| only on a full hash match.
+ *
+ * Deleted buckets become tombstones.  They count against the load factor
+ * until the next resize, which drops them.  A resize keeps the same
+ * capacity if tombstones are the only reason we ran out of room.
+ *
+ * The control bytes, hashes, keys and values all share a single
+ * allocation.  Keys and values stay in separate arrays, so the bucket index
+ * handed out by vh_htbl_iter stays meaningful.
+ */
 
-#define kroundup32(x)					(--(x), (x)|=(x)>>1, (x)|=(x)>>2, (x)|=(x)>>4,	\
-										 (x)|=(x)>>8, (x)|=(x)>>16, ++(x))
+#define HTBL_CTRL_EMPTY			((int8_t)-128)
+#define HTBL_CTRL_DELETED		((int8_t)-2)
 
-static const double __ac_HASH_UPPER = 0.77;
+#define htbl_h1(hash)			((hash) >> 7)
+#define htbl_h2(hash)			((int8_t)((hash) & 0x7f))
+#define htbl_isfull(htbl, i)	((htbl)->ctrl[(i)] >= 0)
 
+#define htbl_align8(sz)			(((sz) + 7) & ~((size_t)7))
 
+typedef enum
+{
+	HTBL_KIND_GENERIC,
+	HTBL_KIND_INT32,
+	HTBL_KIND_INT64,
+	HTBL_KIND_STR
+} HashTableKind;
 
 typedef struct HashTableData
 {
@@ -63,28 +73,251 @@ typedef struct HashTableData
 	size_t key_sz;
 	size_t value_sz;
 
-	int32_t *flags;
+	int8_t *ctrl;
+	uint32_t *hashes;
 	void *keys;
 	void *values;
 
 	int32_t n_buckets;
-	int32_t n_occupied;
-	int32_t upper_bound;
 	int32_t size;
+	int32_t growth_left;
 
+	HashTableKind kind;
 	bool is_map;
 	bool key_by_val;
 } HashTableData;
 
+
+/*
+ * Group operations
+ *
+ * htbl_group_match returns a mask with a bit for every control byte equal
+ * to |h2|, htbl_group_first turns the lowest bit into a bucket offset and
+ * htbl_group_next clears it.
+ */
+#if defined(__SSE2__)
+
+#define HTBL_GROUP				16
+
+typedef uint32_t htbl_group_mask;
+
+static inline htbl_group_mask
+htbl_group_match(const int8_t *ctrl, int8_t h2)
+{
+	__m128i g = _mm_loadu_si128((const __m128i*)ctrl);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), g));
+}
+
+static inline htbl_group_mask
+htbl_group_match_empty(const int8_t *ctrl)
+{
+	return htbl_group_match(ctrl, HTBL_CTRL_EMPTY);
+}
+
+static inline htbl_group_mask
+htbl_group_match_free(const int8_t *ctrl)
+{
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+}
+
+#define htbl_group_first(m)		((uint32_t)__builtin_ctz(m))
+
+#else
+
+#define HTBL_GROUP				8
+
+typedef uint64_t htbl_group_mask;
+
+#define HTBL_GROUP_LSBS			0x0101010101010101ull
+#define HTBL_GROUP_MSBS			0x8080808080808080ull
+
+static inline uint64_t
+htbl_group_load(const int8_t *ctrl)
+{
+	uint64_t g;
+
+	memcpy(&g, ctrl, sizeof(g));
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	g = __builtin_bswap64(g);
+#endif
+
+	return g;
+}
+
+/*
+ * May report a false positive on the byte after a true match, the stored
+ * hash check in the probe loop takes care of it.
+ */
+static inline htbl_group_mask
+htbl_group_match(const int8_t *ctrl, int8_t h2)
+{
+	uint64_t x = htbl_group_load(ctrl) ^ (HTBL_GROUP_LSBS * (uint8_t)h2);
+
+	return (x - HTBL_GROUP_LSBS) & ~x & HTBL_GROUP_MSBS;
+}
+
+static inline htbl_group_mask
+htbl_group_match_empty(const int8_t *ctrl)
+{
+	uint64_t g = htbl_group_load(ctrl);
+
+	return g & ~(g << 6) & HTBL_GROUP_MSBS;
+}
+
+static inline htbl_group_mask
+htbl_group_match_free(const int8_t *ctrl)
+{
+	return htbl_group_load(ctrl) & HTBL_GROUP_MSBS;
+}
+
+#define htbl_group_first(m)		((uint32_t)__builtin_ctzll(m) >> 3)
+
+#endif
+
+#define htbl_group_next(m)		((m) & ((m) - 1))
+
+#define htbl_key_at(htbl, i)		(((unsigned char*)(htbl)->keys) + ((htbl)->key_sz * (i)))
+#define htbl_value_at(htbl, i)		(((unsigned char*)(htbl)->values) + ((htbl)->value_sz * (i)))
+#define htbl_max_load(n_buckets)	((n_buckets) - ((n_buckets) >> 3))
+
 static int32_t htbl_resize(HashTable htbl, int32_t new_n_buckets);
-static int32_t htbl_bucket(HashTable htbl, const void *key);
+static int32_t htbl_find_free(HashTable htbl, uint32_t hash);
+static void htbl_set_ctrl(HashTable htbl, int32_t i, int8_t h);
 
 static void htbl_copy(size_t sz, bool byval, const void *src, void *tgt);
-#define htbl_copy_key(htbl, src, tgt)	htbl_copy((htbl)->key_sz, false, (src), (tgt))
-#define htbl_copy_value(htbl, src, tgt)	htbl_copy((htbl)->value_sz, false, (src), (tgt))
 
-#define htbl_key_at(htbl, i)		(((unsigned char*)htbl->keys) + (htbl->key_sz * i))
-#define htbl_value_at(htbl, i)		(((unsigned char*)htbl->values) + (htbl->value_sz * i))
+
+/*
+ * Hash mixing
+ *
+ * The public hash functions are allowed to be weak (vh_htbl_hash_int32 is
+ * the identity), so every hash is run through a finalizer before we split
+ * it into H1 and H2.
+ */
+static inline uint32_t
+htbl_mix32(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static inline uint32_t
+htbl_mix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdull;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ull;
+	k ^= k >> 33;
+
+	return (uint32_t)k;
+}
+
+static inline uint32_t
+htbl_fnv1a_str(const char *str)
+{
+	uint32_t h = 2166136261u;
+
+	while (*str)
+	{
+		h ^= (unsigned char)*str++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static inline uint32_t
+htbl_hash(HashTable htbl, const void *key)
+{
+	switch (htbl->kind)
+	{
+		case HTBL_KIND_INT32:
+			return htbl_mix32(*(const uint32_t*)key);
+
+		case HTBL_KIND_INT64:
+			return htbl_mix64(*(const uint64_t*)key);
+
+		case HTBL_KIND_STR:
+			return htbl_mix32(htbl_fnv1a_str(key));
+
+		default:
+			return htbl_mix32((uint32_t)htbl->func_hash(htbl, key));
+	}
+}
+
+/*
+ * HTBL_DEFINE_FIND
+ *
+ * Stamps out a probe loop with the key comparison |EQ| inlined.  |EQ| sees
+ * the bucket's key as |slot| and the caller's key as |key|.  Returns the
+ * bucket or -1 when the key isn't in the table.
+ */
+#define HTBL_DEFINE_FIND(kind, EQ)													\
+	static inline int32_t															\
+	htbl_find_##kind(HashTable htbl, const void *key, uint32_t hash)				\
+	{																				\
+		const unsigned char *slot;													\
+		htbl_group_mask match;														\
+		uint32_t pos, stride = 0, mask = htbl->n_buckets - 1;						\
+		int32_t i;																	\
+																					\
+		pos = htbl_h1(hash) & mask;													\
+																					\
+		while (1)																	\
+		{																			\
+			match = htbl_group_match(htbl->ctrl + pos, htbl_h2(hash));				\
+																					\
+			while (match)															\
+			{																		\
+				i = (pos + htbl_group_first(match)) & mask;							\
+				slot = htbl_key_at(htbl, i);										\
+																					\
+				if (htbl->hashes[i] == hash && (EQ))								\
+					return i;														\
+																					\
+				match = htbl_group_next(match);										\
+			}																		\
+																					\
+			if (htbl_group_match_empty(htbl->ctrl + pos))							\
+				return -1;															\
+																					\
+			stride += HTBL_GROUP;													\
+			pos = (pos + stride) & mask;											\
+		}																			\
+	}
+
+HTBL_DEFINE_FIND(int32, *(const int32_t*)slot == *(const int32_t*)key)
+HTBL_DEFINE_FIND(int64, *(const int64_t*)slot == *(const int64_t*)key)
+HTBL_DEFINE_FIND(str, *(const char* const*)slot &&
+					  strcmp(*(const char* const*)slot, key) == 0)
+HTBL_DEFINE_FIND(generic, htbl->func_compare(htbl, slot, key))
+
+static inline int32_t
+htbl_find(HashTable htbl, const void *key, uint32_t hash)
+{
+	switch (htbl->kind)
+	{
+		case HTBL_KIND_INT32:
+			return htbl_find_int32(htbl, key, hash);
+
+		case HTBL_KIND_INT64:
+			return htbl_find_int64(htbl, key, hash);
+
+		case HTBL_KIND_STR:
+			return htbl_find_str(htbl, key, hash);
+
+		default:
+			return htbl_find_generic(htbl, key, hash);
+	}
+}
 
 
 HashTable
@@ -120,7 +353,7 @@ vh_htbl_create(HashTableOpts *opts, int32_t flags)
 	else
 		htbl->value_sz = sizeof(void*);
 
-	
+
 	if (flags & VH_HTBL_OPT_HASHFUNC)
 	{
 		htbl->func_hash = opts->func_hash;
@@ -137,27 +370,46 @@ vh_htbl_create(HashTableOpts *opts, int32_t flags)
 		htbl->key_by_val = false;
 	}
 
-	
+
 	if (flags & VH_HTBL_OPT_COMPFUNC)
 		htbl->func_compare = opts->func_compare;
 	else
 		htbl->func_compare = vh_htbl_comp_int64;
 
-	
+
 	if (flags & VH_HTBL_OPT_MAP)
 		htbl->is_map = opts->is_map;
 	else
 		htbl->is_map = true;
 
 	/*
-	 * Set all of our members required by the khash algorithm to be zero.
+	 * Pick the specialized probe loop when the caller is using one of our
+	 * stock hash and comparison pairs.
+	 */
+	htbl->kind = HTBL_KIND_GENERIC;
+
+	if (htbl->func_hash == vh_htbl_hash_int32 &&
+		htbl->func_compare == vh_htbl_comp_int32 &&
+		htbl->key_sz == sizeof(int32_t))
+		htbl->kind = HTBL_KIND_INT32;
+	else if (htbl->func_hash == vh_htbl_hash_int64 &&
+			 htbl->func_compare == vh_htbl_comp_int64 &&
+			 htbl->key_sz == sizeof(int64_t))
+		htbl->kind = HTBL_KIND_INT64;
+	else if (htbl->func_hash == vh_htbl_hash_str &&
+			 htbl->func_compare == vh_htbl_comp_str &&
+			 htbl->key_sz == sizeof(const char*))
+		htbl->kind = HTBL_KIND_STR;
+
+	/*
+	 * The buckets are allocated on the first put.
 	 */
 
 	htbl->n_buckets = 0;
-	htbl->n_occupied = 0;
 	htbl->size = 0;
-	htbl->upper_bound = 0;
-	htbl->flags = 0;
+	htbl->growth_left = 0;
+	htbl->ctrl = 0;
+	htbl->hashes = 0;
 	htbl->keys = 0;
 	htbl->values = 0;
 
@@ -174,7 +426,7 @@ vh_htbl_create(HashTableOpts *opts, int32_t flags)
 size_t
 vh_htbl_count(HashTable htbl)
 {
-	return htbl->n_occupied;
+	return htbl->size;
 }
 
 MemoryContext
@@ -188,14 +440,8 @@ vh_htbl_destroy(HashTable htbl)
 {
 	if (htbl)
 	{
-		if (htbl->keys)
-			vhfree(htbl->keys);
-
-		if (htbl->flags)
-			vhfree(htbl->flags);
-
-		if (htbl->is_map && htbl->values)
-			vhfree(htbl->values);
+		if (htbl->ctrl)
+			vhfree(htbl->ctrl);
 
 		vhfree(htbl);
 	}
@@ -204,15 +450,15 @@ vh_htbl_destroy(HashTable htbl)
 void
 vh_htbl_clear(HashTable htbl)
 {
-	if (htbl && htbl->flags)
+	if (htbl && htbl->ctrl)
 	{
-		memset(htbl->flags, 0xaa, __ac_fsize(htbl->n_buckets) * sizeof(int32_t));
+		memset(htbl->ctrl, HTBL_CTRL_EMPTY, htbl->n_buckets + HTBL_GROUP);
 		htbl->size = 0;
-		htbl->n_occupied = 0;
+		htbl->growth_left = htbl_max_load(htbl->n_buckets);
 	}
 }
 
-int32_t 
+int32_t
 vh_htbl_iter(HashTable htbl, int32_t idx, void *key, void *value)
 {
 	int32_t i = idx;
@@ -221,7 +467,7 @@ vh_htbl_iter(HashTable htbl, int32_t idx, void *key, void *value)
 		i < 0)
 		return -1;
 
-	while (__ac_iseither(htbl->flags, i) && i != htbl->n_buckets)
+	while (i < htbl->n_buckets && !htbl_isfull(htbl, i))
 		i++;
 
 	if (i == htbl->n_buckets)
@@ -235,16 +481,15 @@ vh_htbl_iter(HashTable htbl, int32_t idx, void *key, void *value)
 	return i;
 }
 
-int32_t 
+int32_t
 vh_htbl_iter_last(HashTable htbl, void *key, void *value)
 {
 	int32_t i = htbl->n_buckets - 1;
 
-	if (i >= htbl->n_buckets ||
-		i < 0)
+	if (i < 0)
 		return -1;
 
-	while (__ac_iseither(htbl->flags, i) && i >= 0)
+	while (i >= 0 && !htbl_isfull(htbl, i))
 		i--;
 
 	if (i == -1)
@@ -258,41 +503,17 @@ vh_htbl_iter_last(HashTable htbl, void *key, void *value)
 	return i;
 }
 
-static int32_t
-htbl_bucket(HashTable htbl, const void *key)
-{
-	int32_t k, i, last, mask, step = 0;
-
-	if (htbl->n_buckets)
-	{
-		mask = htbl->n_buckets - 1;
-		k = htbl->func_hash(htbl, key);
-		i = k & mask;
-		last = i;
-
-		while (!__ac_isempty(htbl->flags, i) &&
-			   (__ac_isdel(htbl->flags, i) ||
-				!(htbl->func_compare(htbl, htbl_key_at(htbl, i), key))))
-		{
-			i = (i + (++step)) & mask;
-			
-			if (i == last)
-				return htbl->n_buckets;
-		}
-
-		return __ac_iseither(htbl->flags, i) ? htbl->n_buckets : i;
-	}
-
-	return 0;
-}
-
 void*
 vh_htbl_get(HashTable htbl, const void *key)
 {
-	int32_t bucket = htbl_bucket(htbl, key);
+	int32_t bucket;
 
-	if (bucket != htbl->n_buckets &&
-		!__ac_iseither(htbl->flags, bucket))
+	if (!htbl->size)
+		return 0;
+
+	bucket = htbl_find(htbl, key, htbl_hash(htbl, key));
+
+	if (bucket >= 0)
 	{
 		if (htbl->is_map)
 			return htbl_value_at(htbl, bucket);
@@ -307,118 +528,90 @@ vh_htbl_get(HashTable htbl, const void *key)
  * vh_htbl_put
  *
  * Puts a key into the table and returns the value, if the HashTable is
- * also a map.  Otherwise the return value will not be a valid pointer.
+ * also a map.  For a set the return value points at the key's bucket.
  *
  * The |ret| parameter indicates the action taken.
  * 	-1	Fatal error
  * 	0	Already exists
  * 	1	Inserted succesfully
- * 	2	Previously deleted, but re-inserted
+ * 	2	Inserted into a previously deleted bucket
  */
 
 void*
-vh_htbl_put(HashTable htbl, 
-			const void *key,  
+vh_htbl_put(HashTable htbl,
+			const void *key,
 			int32_t *ret)
 {
-	int32_t x, i, k, site, last, mask, step;
+	uint32_t hash = htbl_hash(htbl, key);
+	int32_t i, result;
 
-	if (htbl->n_occupied >= htbl->upper_bound)
+	if (htbl->size && (i = htbl_find(htbl, key, hash)) >= 0)
 	{
-		if (htbl->n_occupied > (htbl->size<<1))
-		{
-			if (htbl_resize(htbl, htbl->n_buckets - 1) < 0)
-			{
-				if (ret)
-					*ret = -1;
-
-				return 0;
-			}
-		}
-		else if (htbl_resize(htbl, htbl->n_buckets + 1) < 0)
-		{
-			if (ret)
-				*ret = -1;
+		if (ret)
+			*ret = 0;
 
-			return 0;
-		}
+		return htbl->is_map ? htbl_value_at(htbl, i) : htbl_key_at(htbl, i);
 	}
 
-	mask = htbl->n_buckets - 1;
-	step = 0;
-	x = site = htbl->n_buckets;
-	k = htbl->func_hash(htbl, key);
-	i = k & mask;
+	i = htbl->n_buckets ? htbl_find_free(htbl, hash) : -1;
 
-	if (__ac_isempty(htbl->flags, i))
-		x = i;
-	else
+	if (i < 0 || (!htbl->growth_left && htbl->ctrl[i] == HTBL_CTRL_EMPTY))
 	{
-		last = i;
-		while (!__ac_isempty(htbl->flags, i) &&
-			   (__ac_isdel(htbl->flags, i) || 
-				!(htbl->func_compare(htbl, htbl_key_at(htbl, i), key))))
-		{
-			if (__ac_isdel(htbl->flags, i))
-				site = i;
+		/*
+		 * Out of room.  If tombstones are holding more than half of the
+		 * load we can take, rebuild at the same size to clear them out.
+		 */
+		if (htbl->n_buckets && htbl->size < htbl_max_load(htbl->n_buckets) / 2)
+			result = htbl_resize(htbl, htbl->n_buckets);
+		else
+			result = htbl_resize(htbl, htbl->n_buckets ?
+									   htbl->n_buckets << 1 : HTBL_GROUP);
 
-			i = (i + (++step)) & mask;
+		if (result < 0)
+		{
+			if (ret)
+				*ret = -1;
 
-			if (i == last)
-			{
-				x = site;
-				break;
-			}
+			return 0;
 		}
 
-		if (x == htbl->n_buckets)
-		{
-			if (__ac_isempty(htbl->flags, i) &&
-				site != htbl->n_buckets)
-				x = site;
-			else
-				x = i;
-		}
+		i = htbl_find_free(htbl, hash);
 	}
 
-	if (__ac_isempty(htbl->flags, x))
+	if (htbl->ctrl[i] == HTBL_CTRL_EMPTY)
 	{
-		htbl_copy(htbl->key_sz, htbl->key_by_val, key, htbl_key_at(htbl, x));
-	
-		__ac_set_isboth_false(htbl->flags, x);
-		++htbl->size;
-		++htbl->n_occupied;
-		
+		htbl->growth_left--;
+
 		if (ret)
 			*ret = 1;
 	}
-	else if (__ac_isdel(htbl->flags, x))
+	else if (ret)
 	{
-		htbl_copy(htbl->key_sz, htbl->key_by_val, key, htbl_key_at(htbl, x));
+		*ret = 2;
+	}
 
-		__ac_set_isboth_false(htbl->flags, x);
-		++htbl->size;
+	htbl_set_ctrl(htbl, i, htbl_h2(hash));
+	htbl->hashes[i] = hash;
+	htbl->size++;
 
-		if (ret)
-			*ret = 2;
-	}
-	else
-	{
-		if (ret)
-			*ret = 0;
-	}
+	htbl_copy(htbl->key_sz, htbl->key_by_val, key, htbl_key_at(htbl, i));
 
-	return htbl_value_at(htbl, x);
+	return htbl->is_map ? htbl_value_at(htbl, i) : htbl_key_at(htbl, i);
 }
 
 void
 vh_htbl_del(HashTable htbl, const void *key)
 {
-	int32_t bucket = htbl_bucket(htbl, key);
+	int32_t bucket;
+
+	if (!htbl->size)
+		return;
+
+	bucket = htbl_find(htbl, key, htbl_hash(htbl, key));
 
-	if (bucket != htbl->n_buckets && !__ac_iseither(htbl->flags, bucket))
+	if (bucket >= 0)
 	{
-		__ac_set_isdel_true(htbl->flags, bucket);
+		htbl_set_ctrl(htbl, bucket, HTBL_CTRL_DELETED);
 		--htbl->size;
 	}
 }
@@ -431,16 +624,12 @@ vh_htbl_to_slist(HashTable htbl)
 
 	list = vh_SListCreate();
 
-	for (i = 0; i != htbl->n_buckets; i++)
+	for (i = 0; i < htbl->n_buckets; i++)
 	{
-		if (__ac_iseither(htbl->flags, i))
+		if (!htbl_isfull(htbl, i))
 			continue;
 
-		if (htbl->is_map)
-			vh_SListPush(list, htbl_key_at(htbl, i));
-		else
-			vh_SListPush(list, htbl_value_at(htbl, i));
-
+		vh_SListPush(list, htbl_key_at(htbl, i));
 	}
 
 	return list;
@@ -453,182 +642,92 @@ vh_htbl_to_slist(HashTable htbl)
  * ============================================================================
  */
 
-static int32_t 
+/*
+ * Builds a new set of buckets and moves every live key over using its
+ * stored hash.  Keys are never compared here, they're already unique.
+ */
+static int32_t
 htbl_resize(HashTable htbl, int32_t new_n_buckets)
 {
-	MemoryContext mctx_old;
-	int32_t *new_flags = 0;
-	int32_t j = 1, new_mask, k, i, step;
-	void **new_keys, *new_vals;
-	unsigned char *val, *key, *tmp_key, *tmp_value;
+	HashTableData old = *htbl;
+	size_t ctrl_sz, hashes_sz, keys_sz, values_sz;
+	unsigned char *block;
+	int32_t i, j;
 
-	mctx_old = vh_mctx_switch(htbl->mctx);
+	assert(new_n_buckets >= HTBL_GROUP);
+	assert((new_n_buckets & (new_n_buckets - 1)) == 0);
 
-	kroundup32(new_n_buckets);
+	ctrl_sz = htbl_align8(new_n_buckets + HTBL_GROUP);
+	hashes_sz = htbl_align8(sizeof(uint32_t) * new_n_buckets);
+	keys_sz = htbl_align8(htbl->key_sz * new_n_buckets);
+	values_sz = htbl->is_map ? htbl->value_sz * new_n_buckets : 0;
 
-	if (new_n_buckets < 4)
-		new_n_buckets = 4;
+	block = vhmalloc_ctx(htbl->mctx, ctrl_sz + hashes_sz + keys_sz + values_sz);
 
-	if (htbl->size >= (int32_t)(new_n_buckets * __ac_HASH_UPPER + 0.5))
-	{
-		j = 0;
-	}
-	else
-	{
-		new_flags = vhmalloc( __ac_fsize(new_n_buckets) * sizeof(int32_t));
-
-		if (!new_flags)
-		{
-			vh_mctx_switch(mctx_old);
-			return -1;
-		}
+	if (!block)
+		return -1;
 
-		memset(new_flags, 0xaa, __ac_fsize(new_n_buckets) * sizeof(int32_t));
+	htbl->ctrl = (int8_t*)block;
+	htbl->hashes = (uint32_t*)(block + ctrl_sz);
+	htbl->keys = block + ctrl_sz + hashes_sz;
+	htbl->values = htbl->is_map ? block + ctrl_sz + hashes_sz + keys_sz : 0;
+	htbl->n_buckets = new_n_buckets;
+	htbl->growth_left = htbl_max_load(new_n_buckets) - old.size;
 
-		if (htbl->n_buckets < new_n_buckets)
-		{
-			if (htbl->keys)
-				new_keys = vhrealloc(htbl->keys, new_n_buckets * htbl->key_sz);
-			else
-				new_keys = vhmalloc(new_n_buckets * htbl->key_sz);
-		
-			if (!new_keys)
-			{
-				vhfree(new_flags);
-				vh_mctx_switch(mctx_old);
-				return -1;
-			}
-
-			htbl->keys = new_keys;
-
-			if (htbl->is_map)
-			{
-				if (htbl->values)
-					new_vals = vhrealloc(htbl->values, new_n_buckets * htbl->value_sz);
-				else
-					new_vals = vhmalloc(new_n_buckets * htbl->value_sz);
-
-				if (!new_vals)
-				{
-					vhfree(new_keys);
-					vhfree(new_flags);
-					vh_mctx_switch(mctx_old);
-					
-					return -1;
-				}
-
-				htbl->values = new_vals;
-			}
-		}
-	}
+	memset(htbl->ctrl, HTBL_CTRL_EMPTY, new_n_buckets + HTBL_GROUP);
 
-	if (j)
+	for (i = 0; i < old.n_buckets; i++)
 	{
-		key = vhmalloc(htbl->key_sz * 2);
-		tmp_key = ((unsigned char*)key) + htbl->key_sz;
-
-		if (!key)
-		{
-			vh_mctx_switch(mctx_old);
-			return -2;
-		}
-
-		if (htbl->is_map)
-			tmp_value = vhmalloc(htbl->value_sz);
+		if (!htbl_isfull(&old, i))
+			continue;
 
+		j = htbl_find_free(htbl, old.hashes[i]);
 
-		if (!tmp_value)
-		{
-			vh_mctx_switch(mctx_old);
-			return -2;
-		}
-
-		for (j = 0; j != htbl->n_buckets; ++j)
-		{
-			if (__ac_iseither(htbl->flags, j) == 0)
-			{
-				htbl_copy_key(htbl, htbl_key_at(htbl, j), key);
-				new_mask = new_n_buckets - 1;
-
-				if (htbl->is_map)
-					val = htbl_value_at(htbl, j);
-
-				__ac_set_isdel_true(htbl->flags, j);
-
-				while (1)
-				{
-					step = 0;
-
-					if (htbl->key_by_val)
-						k = htbl->func_hash(htbl, *((const char**)key));
-					else
-						k = htbl->func_hash(htbl, key);
-					
-					i = k & new_mask;
-
-					while (!__ac_isempty(new_flags, i))
-						i = (i + (++step)) & new_mask;
-
-					__ac_set_isempty_false(new_flags, i);
-
-					if (i < htbl->n_buckets && __ac_iseither(htbl->flags, i) == 0)
-					{
-						{				
-							htbl_copy_key(htbl, htbl_key_at(htbl, i), tmp_key);
-							htbl_copy_key(htbl, key, htbl_key_at(htbl, i));
-							htbl_copy_key(htbl, tmp_key, key);
-						}
-
-						if (htbl->is_map)
-						{
-							htbl_copy_value(htbl, htbl_value_at(htbl, i), tmp_value);
-							htbl_copy_value(htbl, val, htbl_value_at(htbl, i));
-							htbl_copy_value(htbl, tmp_value, val);
-						}
-						
-						__ac_set_isdel_true(htbl->flags, i);
-					}
-					else
-					{
-						htbl_copy_key(htbl, key, htbl_key_at(htbl, i));
-
-						if (htbl->is_map)
-							htbl_copy_value(htbl, val, htbl_value_at(htbl, i));
-
-						break;
-					}
-				}
-			}
-		}
-		
-		vhfree(key);
+		htbl_set_ctrl(htbl, j, old.ctrl[i]);
+		htbl->hashes[j] = old.hashes[i];
+		htbl_copy(htbl->key_sz, false, htbl_key_at(&old, i), htbl_key_at(htbl, j));
 
 		if (htbl->is_map)
-			vhfree(tmp_value);
+			memcpy(htbl_value_at(htbl, j), htbl_value_at(&old, i), htbl->value_sz);
+	}
 
-		/*
-		 * Test if we need to shrink
-		 */
-		if (htbl->n_buckets > new_n_buckets)
-		{
-			htbl->keys = vhrealloc(htbl->keys, new_n_buckets * htbl->key_sz);
+	if (old.ctrl)
+		vhfree(old.ctrl);
 
-			if (htbl->is_map)
-				htbl->values = vhrealloc(htbl->values, new_n_buckets * htbl->value_sz);
-		}
+	return 0;
+}
 
-		if (htbl->flags)
-			vhfree(htbl->flags);
+/*
+ * Returns the first empty or deleted bucket on |hash|'s probe sequence.  The
+ * load factor guarantees there always is one.
+ */
+static int32_t
+htbl_find_free(HashTable htbl, uint32_t hash)
+{
+	htbl_group_mask match;
+	uint32_t pos, stride = 0, mask = htbl->n_buckets - 1;
+
+	pos = htbl_h1(hash) & mask;
 
-		htbl->flags = new_flags;
-		htbl->n_buckets = new_n_buckets;
-		htbl->n_occupied = htbl->size;
-		htbl->upper_bound = (int32_t)(htbl->n_buckets * __ac_HASH_UPPER + 0.5);
+	while (!(match = htbl_group_match_free(htbl->ctrl + pos)))
+	{
+		stride += HTBL_GROUP;
+		pos = (pos + stride) & mask;
 	}
 
-	vh_mctx_switch(mctx_old);
+	return (pos + htbl_group_first(match)) & mask;
+}
 
-	return 0;
+/*
+ * Keeps the clone of the first group at the end of |ctrl| in sync.
+ */
+static void
+htbl_set_ctrl(HashTable htbl, int32_t i, int8_t h)
+{
+	htbl->ctrl[i] = h;
+
+	if (i < HTBL_GROUP)
+		htbl->ctrl[htbl->n_buckets + i] = h;
 }
 
 
@@ -665,7 +764,7 @@ vh_htbl_comp_int32(HashTable htbl, const void *lhs, const void *rhs)
 int32_t
 vh_htbl_hash_int64(HashTable htbl, const void *key)
 {
-	int64_t k = *((int64_t*)key);	
+	int64_t k = *((int64_t*)key);
 	return (int32_t)(k>>33^k^k<<11);
 }
 
@@ -678,16 +777,7 @@ vh_htbl_comp_int64(HashTable htbl, const void *lhs, const void *rhs)
 int32_t
 vh_htbl_hash_str(HashTable htbl, const void *key)
 {
-	const char *str = key;
-	int32_t h = *str;
-
-	if (h)
-	{
-		for (++str; *str; ++str)
-			h = (h << 5) - h + (int32_t)*str;
-	}
-
-	return h;
+	return (int32_t)htbl_fnv1a_str(key);
 }
 
 int32_t
@@ -706,7 +796,7 @@ int32_t
 vh_htbl_comp_bin(HashTable htbl, const void *lhs, const void *rhs)
 {
 	if (lhs)
-		return memcmp(lhs, rhs, htbl->key_sz);
+		return memcmp(lhs, rhs, htbl->key_sz) == 0;
 
 	return 0;
 }
@@ -714,16 +804,17 @@ vh_htbl_comp_bin(HashTable htbl, const void *lhs, const void *rhs)
 int32_t
 vh_htbl_hash_bin(HashTable htbl, const void *key)
 {
-	const char *str = key;
-	int32_t h = *str, i;
+	const unsigned char *bin = key;
+	uint32_t h = 2166136261u;
+	size_t i;
 
-	if (h)
+	for (i = 0; i < htbl->key_sz; i++)
 	{
-		for (i = 0; i < htbl->key_sz; i++)
-			h = (h << 5) - h + (int32_t*)str[i];
+		h ^= bin[i];
+		h *= 16777619u;
 	}
 
-	return h;
+	return (int32_t)h;
 }
 
 /*
@@ -733,7 +824,7 @@ vh_htbl_hash_bin(HashTable htbl, const void *key)
  * be copied is less than or equal to eight (8) bytes then we'll use a union
  * to assign the value rather than doing a memcpy.
  */
-static void 
+static void
 htbl_copy(size_t sz, bool by_val, const void *source, void *target)
 {
 	union { char a; int16_t b; int32_t c; int64_t d; } const *src = source;
@@ -754,7 +845,7 @@ htbl_copy(size_t sz, bool by_val, const void *source, void *target)
 			case 4:
 				tgt->c = (const int32_t)((const uintptr_t)source);
 				break;
-			
+
 			case 8:
 #if VHB_SIZEOF_VOID == 8
 				tgt->d = (const int64_t)source;
@@ -800,9 +891,9 @@ vh_htbl_iterate_set(HashTable htbl, vh_htbl_iterate_set_cb cb, void *data)
 	int32_t i;
 	bool cb_ret;
 
-	for (i = 0; i != htbl->n_buckets; i++)
+	for (i = 0; i < htbl->n_buckets; i++)
 	{
-		if (__ac_iseither(htbl->flags, i))
+		if (!htbl_isfull(htbl, i))
 			continue;
 
 		cb_ret = cb(htbl, htbl_key_at(htbl, i), data);
@@ -818,9 +909,9 @@ vh_htbl_iterate_map(HashTable htbl, vh_htbl_iterate_map_cb cb, void *data)
 	int32_t i;
 	bool cb_ret;
 
-	for (i = 0; i != htbl->n_buckets; i++)
+	for (i = 0; i < htbl->n_buckets; i++)
 	{
-		if (__ac_iseither(htbl->flags, i))
+		if (!htbl_isfull(htbl, i))
 			continue;
 
 		cb_ret = cb(htbl, htbl_key_at(htbl, i), htbl_value_at(htbl, i), data);
@@ -829,4 +920,3 @@ vh_htbl_iterate_map(HashTable htbl, vh_htbl_iterate_map_cb cb, void *data)
 			break;
 	}
 }
-
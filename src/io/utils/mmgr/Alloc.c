@@ -29,9 +29,13 @@ void
 vhfree(void *pointer)
 {
 	MemoryChunkHeader chunk;
+	MemoryContext mem;
 
 	chunk = (MemoryChunkHeader)pointer - 1;
-	chunk->context->ops->free(chunk->context, pointer);
+	mem = vh_mchdr_is_superblock(chunk) ?
+		vh_mctx_from_pointer(pointer) : chunk->context;
+
+	mem->ops->free(mem, pointer);
 }
 
 
@@ -42,7 +46,8 @@ vhrealloc(void *ptr, size_t size)
 	MemoryChunkHeader chunk = ptr;
 
 	chunk -= 1;
-	mem = chunk->context;
+	mem = vh_mchdr_is_superblock(chunk) ?
+		vh_mctx_from_pointer(ptr) : chunk->context;
 
 	return mem->ops->realloc(mem, ptr, size);
 }
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2011-2017, Kyle A. Gearhart
+ */
+
+
+
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "vh.h"
+#include "io/utils/mmgr/Arena.h"
+
+/*
+ * ArenaBlocks are allocated directly by malloc and carved from the front by
+ * bumping |freeptr|.  Only the head of |block| is ever bumped, when it runs
+ * out of room we push a new block twice the size of the last one, up to
+ * VH_ARENA_MAXBLOCKSZ.
+ *
+ * Requests larger than a quarter of the current block size get a block of
+ * their own.  It goes in behind the head so the space left in the head
+ * isn't wasted.
+ *
+ * Each chunk still carries a MemoryChunkHeader so vhfree and vhrealloc can
+ * find the arena.
+ */
+
+typedef struct ArenaBlockData *ArenaBlock;
+typedef struct MemoryChunkHeaderData MemoryChunkHeaderData;
+
+struct ArenaBlockData
+{
+	ArenaBlock next;
+	char *freeptr;
+	char *endptr;
+};
+
+typedef struct MemoryArenaData
+{
+	MemoryContextData header;
+	ArenaBlock block;
+	ArenaBlock keeper;
+	size_t blockSize;
+	size_t nextBlockSize;
+} MemoryArenaData, *MemoryArena;
+
+#define VH_ARENA_MAXBLOCKSZ		(1024 * 1024)
+
+#define arena_align(sz)			(((sz) + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1))
+#define arena_block_start(blk)	((char*)((blk) + 1))
+
+static void* MemArena_Alloc(void *context, size_t size);
+static void* MemArena_ReAlloc(void *context, void *pointer, size_t size);
+static void MemArena_Free(void *context, void *pointer);
+static void MemArena_Destroy(void *context);
+static void MemArena_Reset(void *context);
+
+static ArenaBlock arena_block_create(size_t size);
+
+static MemoryContextOpsTable MemoryArenaOpsTable = {
+	MemArena_Alloc,
+	MemArena_ReAlloc,
+	MemArena_Free,
+	MemArena_Destroy,
+	MemArena_Reset
+};
+
+MemoryContext
+vh_MemoryArenaCreate(MemoryContext parent, uint32_t blockSize,
+					 const char *name)
+{
+	MemoryContext mctx;
+	MemoryArena arena;
+
+	assert(blockSize > 0);
+
+	arena = (MemoryArena)vh_mctx_create(parent,
+										sizeof(MemoryArenaData),
+										&MemoryArenaOpsTable,
+										name);
+
+	mctx = (MemoryContext)arena;
+	mctx->tag = MT_Arena;
+
+	arena->blockSize = arena_align(blockSize);
+	arena->nextBlockSize = arena->blockSize;
+	arena->keeper = arena->block = arena_block_create(arena->blockSize);
+
+	mctx->stats.blocks++;
+	mctx->stats.freespace = arena->blockSize;
+
+	return mctx;
+}
+
+static void*
+MemArena_Alloc(void *context, size_t size)
+{
+	MemoryArena arena = context;
+	ArenaBlock block = arena->block, large;
+	MemoryChunkHeader chunk;
+	size_t allocsz;
+
+	allocsz = arena_align(size + sizeof(MemoryChunkHeaderData));
+
+	if ((size_t)(block->endptr - block->freeptr) < allocsz)
+	{
+		if (allocsz > arena->nextBlockSize / 4)
+		{
+			large = arena_block_create(allocsz);
+			large->next = block->next;
+			block->next = large;
+
+			chunk = (MemoryChunkHeader)large->freeptr;
+			large->freeptr += allocsz;
+
+			arena->header.stats.blocks++;
+			arena->header.stats.chunks++;
+			arena->header.stats.allocs++;
+			arena->header.stats.space += allocsz;
+
+			chunk->context = context;
+			chunk->size = allocsz;
+
+			return chunk + 1;
+		}
+
+		if (arena->nextBlockSize < VH_ARENA_MAXBLOCKSZ)
+			arena->nextBlockSize <<= 1;
+
+		block = arena_block_create(arena->nextBlockSize);
+		block->next = arena->block;
+		arena->block = block;
+
+		arena->header.stats.blocks++;
+		arena->header.stats.freespace += arena->nextBlockSize;
+	}
+
+	chunk = (MemoryChunkHeader)block->freeptr;
+	block->freeptr += allocsz;
+
+	chunk->context = context;
+	chunk->size = allocsz;
+
+	arena->header.stats.allocs++;
+	arena->header.stats.space += allocsz;
+	arena->header.stats.freespace -= allocsz;
+
+	return chunk + 1;
+}
+
+/*
+ * The last chunk handed out from the head block can grow in place, which
+ * covers the common case of an array being built up one element at a time.
+ */
+static void*
+MemArena_ReAlloc(void *context, void *pointer, size_t size)
+{
+	MemoryArena arena = context;
+	ArenaBlock block = arena->block;
+	MemoryChunkHeader chunk = ((MemoryChunkHeader)pointer) - 1;
+	size_t allocsz;
+	void *nptr;
+
+	allocsz = arena_align(size + sizeof(MemoryChunkHeaderData));
+
+	if (allocsz <= chunk->size)
+		return pointer;
+
+	if ((char*)chunk + chunk->size == block->freeptr &&
+		(size_t)(block->endptr - (char*)chunk) >= allocsz)
+	{
+		block->freeptr = (char*)chunk + allocsz;
+
+		arena->header.stats.space += allocsz - chunk->size;
+		arena->header.stats.freespace -= allocsz - chunk->size;
+		chunk->size = allocsz;
+
+		return pointer;
+	}
+
+	nptr = MemArena_Alloc(context, size);
+	memcpy(nptr, pointer, chunk->size - sizeof(MemoryChunkHeaderData));
+
+	return nptr;
+}
+
+static void
+MemArena_Free(void *context, void *pointer)
+{
+	MemoryArena arena = context;
+	ArenaBlock block = arena->block;
+	MemoryChunkHeader chunk = ((MemoryChunkHeader)pointer) - 1;
+
+	arena->header.stats.frees++;
+
+	if ((char*)chunk + chunk->size == block->freeptr)
+	{
+		block->freeptr = (char*)chunk;
+
+		arena->header.stats.space -= chunk->size;
+		arena->header.stats.freespace += chunk->size;
+	}
+}
+
+static void
+MemArena_Reset(void *context)
+{
+	MemoryArena arena = context;
+	ArenaBlock block, next;
+
+	block = arena->block;
+
+	while (block)
+	{
+		next = block->next;
+
+		if (block != arena->keeper)
+			free(block);
+
+		block = next;
+	}
+
+	arena->block = arena->keeper;
+	arena->block->next = 0;
+	arena->block->freeptr = arena_block_start(arena->block);
+	arena->nextBlockSize = arena->blockSize;
+
+	arena->header.stats.blocks = 1;
+	arena->header.stats.chunks = 0;
+	arena->header.stats.space = 0;
+	arena->header.stats.freespace = arena->blockSize;
+}
+
+static void
+MemArena_Destroy(void *context)
+{
+	MemoryArena arena = context;
+	ArenaBlock block, next;
+
+	block = arena->block;
+
+	while (block)
+	{
+		next = block->next;
+		free(block);
+		block = next;
+	}
+
+	free(context);
+}
+
+static ArenaBlock
+arena_block_create(size_t size)
+{
+	ArenaBlock block;
+
+	block = malloc(sizeof(struct ArenaBlockData) + size);
+	block->next = 0;
+	block->freeptr = arena_block_start(block);
+	block->endptr = block->freeptr + size;
+
+	return block;
+}
+
@@ -7,6 +7,7 @@
 #include <stdio.h>
 
 #include "vh.h"
+#include "io/utils/mmgr/sharedctx.h"
 
 static void MemoryContextDestroyImpl(MemoryContext context);
 static void	MemoryContextDestroyChildren(MemoryContext context, MemoryContext top);
@@ -119,13 +120,23 @@ MemoryContext
 vh_mctx_from_pointer(void *pointer)
 {
 	MemoryChunkHeader chunk = pointer;
+	struct MemorySuperBlockData *super;
 
 	chunk -= 1;
 
 	if (vh_mchdr_is_superblock(chunk))
 	{
+		super = vh_mchdr_superblock(chunk);
+
+		if (super->magic == VH_MCTX_SUPERBLOCK_MAGIC &&
+			super->tag == VH_MCTX_SUPERBLOCK_TAG_SHARED)
+			return vh_mctx_shared_from_superblock(super);
+
 		elog(ERROR2,
-				emsg("Not implemented!"));
+				emsg("Unable to resolve the MemoryContext for pointer %p, the "
+					 "super block is corrupt or its tag %d is unknown",
+					 pointer,
+					 super->magic == VH_MCTX_SUPERBLOCK_MAGIC ? super->tag : -1));
 	}
 	else
 	{
@@ -275,6 +286,22 @@ vh_mctx_destroy_children(MemoryContext context)
 	MemoryContextDestroyChildren(context, context);
 }
 
+void
+vh_mctx_reset(MemoryContext context)
+{
+	if (!context->ops->reset)
+	{
+		elog(ERROR2,
+			 emsg("MemoryContext %s does not support reset",
+				  context->name));
+
+		return;
+	}
+
+	MemoryContextDestroyChildren(context, context);
+	context->ops->reset(context);
+}
+
 static void
 MemoryContextDestroyChildren(MemoryContext context, MemoryContext top)
 {
@@ -58,7 +58,8 @@ static MemoryContextOpsTable MemoryPoolOpsTable = {
 	MemPool_Alloc,
 	MemPool_ReAlloc,
 	MemPool_Free,
-	MemPool_Destroy
+	MemPool_Destroy,
+	0
 };
 
 #define VH_MALLOC_BLOCKSZ(req)	(sizeof(struct MemoryBlockData) + \
@@ -0,0 +1,431 @@
+/*
+ * Copyright (c) 2011-2017, Kyle A. Gearhart
+ */
+
+
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vh.h"
+#include "io/utils/mmgr/Slab.h"
+
+/*
+ * Every size class keeps a doubly linked list of slabs.  A slab is a single
+ * |slabSize| allocation aligned to |slabSize|, so a chunk finds its slab by
+ * masking off the low bits of its address.  The slab header is followed by
+ * a bitmap with a set bit for every free chunk and then the chunks
+ * themselves.
+ *
+ * Slabs with a free chunk are kept at the front of the list, so we only ever
+ * look at the head to allocate.  A slab that fills up moves to the back and
+ * one that gets a chunk back moves to the front.  Once a slab is entirely
+ * free we hand it back to malloc, unless it's the last slab in the class.
+ *
+ * Chunks larger than VH_SLAB_MAXCHUNK are malloc'd individually and kept on
+ * |large| so destroy and reset can find them.  The size in the chunk header
+ * tells the two apart.
+ */
+
+typedef struct SlabData *Slab;
+typedef struct SlabLargeData *SlabLarge;
+typedef struct MemoryChunkHeaderData MemoryChunkHeaderData;
+
+#define VH_SLAB_CLASSES			(VH_SLAB_MAXCHUNK / 16)
+
+struct SlabData
+{
+	Slab next, prev;
+	uint32_t nfree;
+	uint32_t hint;
+	uint64_t bitmap[];
+};
+
+struct SlabLargeData
+{
+	SlabLarge next, prev;
+};
+
+struct SlabClassData
+{
+	Slab head, tail;
+	uint32_t chunk_sz;
+	uint32_t nchunks;
+	uint32_t nwords;
+	uint32_t offset;
+};
+
+typedef struct MemorySlabData
+{
+	MemoryContextData header;
+	size_t slabSize;
+	SlabLarge large;
+	struct SlabClassData classes[VH_SLAB_CLASSES];
+} MemorySlabData, *MemorySlab;
+
+#define slab_class(allocsz)		((((allocsz) + 15) >> 4) - 1)
+#define slab_align16(sz)		(((sz) + 15) & ~((size_t)15))
+#define slab_from_chunk(ms, ch)	((Slab)((uintptr_t)(ch) & ~((uintptr_t)(ms)->slabSize - 1)))
+
+static void* MemSlab_Alloc(void *context, size_t size);
+static void* MemSlab_ReAlloc(void *context, void *pointer, size_t size);
+static void MemSlab_Free(void *context, void *pointer);
+static void MemSlab_Destroy(void *context);
+static void MemSlab_Reset(void *context);
+
+static Slab slab_create(MemorySlab ms, struct SlabClassData *sc);
+static void slab_unlink(struct SlabClassData *sc, Slab slab);
+static void slab_push_head(struct SlabClassData *sc, Slab slab);
+static void slab_push_tail(struct SlabClassData *sc, Slab slab);
+static void slab_release_all(MemorySlab ms);
+
+static MemoryContextOpsTable MemorySlabOpsTable = {
+	MemSlab_Alloc,
+	MemSlab_ReAlloc,
+	MemSlab_Free,
+	MemSlab_Destroy,
+	MemSlab_Reset
+};
+
+MemoryContext
+vh_MemorySlabCreate(MemoryContext parent, uint32_t slabSize, const char *name)
+{
+	MemoryContext mctx;
+	MemorySlab ms;
+	struct SlabClassData *sc;
+	size_t n, offset;
+	int32_t i;
+
+	if (!slabSize)
+		slabSize = VH_SLAB_DEFAULTSIZE;
+
+	if (slabSize < VH_SLAB_MINSIZE || (slabSize & (slabSize - 1)))
+	{
+		elog(ERROR1,
+			 emsg("Slab size %u is invalid, it must be a power of two no "
+				  "smaller than %d",
+				  slabSize,
+				  VH_SLAB_MINSIZE));
+
+		return 0;
+	}
+
+	ms = (MemorySlab)vh_mctx_create(parent,
+									sizeof(MemorySlabData),
+									&MemorySlabOpsTable,
+									name);
+
+	mctx = (MemoryContext)ms;
+	mctx->tag = MT_Slab;
+
+	ms->slabSize = slabSize;
+	ms->large = 0;
+
+	/*
+	 * Lay out each class up front: as many chunks as fit behind the header
+	 * and a bitmap big enough to cover them.
+	 */
+	for (i = 0; i < VH_SLAB_CLASSES; i++)
+	{
+		sc = &ms->classes[i];
+		sc->head = sc->tail = 0;
+		sc->chunk_sz = (i + 1) * 16;
+
+		n = (slabSize - sizeof(struct SlabData)) / sc->chunk_sz;
+
+		do
+		{
+			offset = slab_align16(sizeof(struct SlabData) +
+								  sizeof(uint64_t) * ((n + 63) / 64));
+		} while (offset + n * sc->chunk_sz > slabSize && n--);
+
+		sc->nchunks = n;
+		sc->nwords = (n + 63) / 64;
+		sc->offset = offset;
+	}
+
+	return mctx;
+}
+
+static void*
+MemSlab_Alloc(void *context, size_t size)
+{
+	MemorySlab ms = context;
+	struct SlabClassData *sc;
+	MemoryChunkHeader chunk;
+	SlabLarge large;
+	Slab slab;
+	size_t allocsz;
+	uint32_t w, bit;
+
+	allocsz = size + sizeof(MemoryChunkHeaderData);
+
+	if (allocsz > VH_SLAB_MAXCHUNK)
+	{
+		large = malloc(sizeof(struct SlabLargeData) + allocsz);
+		large->prev = 0;
+		large->next = ms->large;
+
+		if (ms->large)
+			ms->large->prev = large;
+
+		ms->large = large;
+
+		chunk = (MemoryChunkHeader)(large + 1);
+		chunk->context = context;
+		chunk->size = allocsz;
+
+		ms->header.stats.allocs++;
+		ms->header.stats.chunks++;
+		ms->header.stats.space += allocsz;
+
+		return chunk + 1;
+	}
+
+	sc = &ms->classes[slab_class(allocsz)];
+	slab = sc->head;
+
+	if (!slab || !slab->nfree)
+		slab = slab_create(ms, sc);
+
+	w = slab->hint;
+
+	while (!slab->bitmap[w])
+		w++;
+
+	bit = __builtin_ctzll(slab->bitmap[w]);
+	slab->bitmap[w] &= ~(1ull << bit);
+	slab->hint = w;
+
+	if (!--slab->nfree && slab != sc->tail)
+	{
+		slab_unlink(sc, slab);
+		slab_push_tail(sc, slab);
+	}
+
+	chunk = (MemoryChunkHeader)((char*)slab + sc->offset +
+								((w << 6) + bit) * sc->chunk_sz);
+	chunk->context = context;
+	chunk->size = sc->chunk_sz;
+
+	ms->header.stats.allocs++;
+	ms->header.stats.space += sc->chunk_sz;
+	ms->header.stats.freespace -= sc->chunk_sz;
+
+	return chunk + 1;
+}
+
+static void*
+MemSlab_ReAlloc(void *context, void *pointer, size_t size)
+{
+	MemoryChunkHeader chunk = ((MemoryChunkHeader)pointer) - 1;
+	size_t oldsz = chunk->size - sizeof(MemoryChunkHeaderData);
+	void *nptr;
+
+	if (size <= oldsz)
+		return pointer;
+
+	nptr = MemSlab_Alloc(context, size);
+	memcpy(nptr, pointer, oldsz);
+	MemSlab_Free(context, pointer);
+
+	return nptr;
+}
+
+static void
+MemSlab_Free(void *context, void *pointer)
+{
+	MemorySlab ms = context;
+	MemoryChunkHeader chunk = ((MemoryChunkHeader)pointer) - 1;
+	struct SlabClassData *sc;
+	SlabLarge large;
+	Slab slab;
+	uint32_t idx, w;
+
+	ms->header.stats.frees++;
+	ms->header.stats.space -= chunk->size;
+
+	if (chunk->size > VH_SLAB_MAXCHUNK)
+	{
+		large = ((SlabLarge)chunk) - 1;
+
+		if (large->prev)
+			large->prev->next = large->next;
+		else
+			ms->large = large->next;
+
+		if (large->next)
+			large->next->prev = large->prev;
+
+		ms->header.stats.chunks--;
+		free(large);
+
+		return;
+	}
+
+	sc = &ms->classes[slab_class(chunk->size)];
+	slab = slab_from_chunk(ms, chunk);
+	idx = ((char*)chunk - ((char*)slab + sc->offset)) / sc->chunk_sz;
+	w = idx >> 6;
+
+	assert(idx < sc->nchunks);
+	assert(!(slab->bitmap[w] & (1ull << (idx & 63))));
+
+	slab->bitmap[w] |= 1ull << (idx & 63);
+	ms->header.stats.freespace += sc->chunk_sz;
+
+	if (w < slab->hint)
+		slab->hint = w;
+
+	if (++slab->nfree == 1)
+	{
+		if (slab != sc->head)
+		{
+			slab_unlink(sc, slab);
+			slab_push_head(sc, slab);
+		}
+	}
+	else if (slab->nfree == sc->nchunks && sc->head != sc->tail)
+	{
+		slab_unlink(sc, slab);
+		free(slab);
+
+		ms->header.stats.blocks--;
+		ms->header.stats.freespace -= (size_t)sc->nchunks * sc->chunk_sz;
+	}
+}
+
+static void
+MemSlab_Reset(void *context)
+{
+	MemorySlab ms = context;
+
+	slab_release_all(ms);
+
+	ms->header.stats.blocks = 0;
+	ms->header.stats.chunks = 0;
+	ms->header.stats.space = 0;
+	ms->header.stats.freespace = 0;
+}
+
+static void
+MemSlab_Destroy(void *context)
+{
+	slab_release_all(context);
+	free(context);
+}
+
+static Slab
+slab_create(MemorySlab ms, struct SlabClassData *sc)
+{
+	Slab slab;
+	uint32_t i;
+	void *ptr;
+
+	if (posix_memalign(&ptr, ms->slabSize, ms->slabSize))
+	{
+		elog(ERROR2,
+			 emsg("Unable to allocate a %lu byte slab for MemoryContext %s",
+				  ms->slabSize,
+				  ms->header.name));
+
+		return 0;
+	}
+
+	slab = ptr;
+	slab->nfree = sc->nchunks;
+	slab->hint = 0;
+
+	for (i = 0; i < sc->nwords; i++)
+		slab->bitmap[i] = ~0ull;
+
+	if (sc->nchunks & 63)
+		slab->bitmap[sc->nwords - 1] = (1ull << (sc->nchunks & 63)) - 1;
+
+	slab_push_head(sc, slab);
+
+	ms->header.stats.blocks++;
+	ms->header.stats.freespace += (size_t)sc->nchunks * sc->chunk_sz;
+
+	return slab;
+}
+
+static void
+slab_unlink(struct SlabClassData *sc, Slab slab)
+{
+	if (slab->prev)
+		slab->prev->next = slab->next;
+	else
+		sc->head = slab->next;
+
+	if (slab->next)
+		slab->next->prev = slab->prev;
+	else
+		sc->tail = slab->prev;
+
+	slab->next = slab->prev = 0;
+}
+
+static void
+slab_push_head(struct SlabClassData *sc, Slab slab)
+{
+	slab->prev = 0;
+	slab->next = sc->head;
+
+	if (sc->head)
+		sc->head->prev = slab;
+	else
+		sc->tail = slab;
+
+	sc->head = slab;
+}
+
+static void
+slab_push_tail(struct SlabClassData *sc, Slab slab)
+{
+	slab->next = 0;
+	slab->prev = sc->tail;
+
+	if (sc->tail)
+		sc->tail->next = slab;
+	else
+		sc->head = slab;
+
+	sc->tail = slab;
+}
+
+static void
+slab_release_all(MemorySlab ms)
+{
+	SlabLarge large, large_next;
+	Slab slab, slab_next;
+	int32_t i;
+
+	for (i = 0; i < VH_SLAB_CLASSES; i++)
+	{
+		slab = ms->classes[i].head;
+
+		while (slab)
+		{
+			slab_next = slab->next;
+			free(slab);
+			slab = slab_next;
+		}
+
+		ms->classes[i].head = ms->classes[i].tail = 0;
+	}
+
+	large = ms->large;
+
+	while (large)
+	{
+		large_next = large->next;
+		free(large);
+		large = large_next;
+	}
+
+	ms->large = 0;
+}
+
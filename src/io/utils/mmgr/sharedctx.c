@@ -5,7 +5,640 @@
 
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <uv.h>
 
 #include "vh.h"
+#include "io/utils/mmgr/sharedctx.h"
 
+/*
+ * Every SharedMemoryContext mapped into this process is kept in
+ * |shm_registry| so a chunk can be walked back to its super block and the
+ * super block's identifier resolved to the local handle.  Writers hold
+ * |shm_lock|, vh_mctx_shared_from_superblock only does acquire loads since
+ * it sits on the vhfree path.
+ */
+#define VH_SHM_MAXSEGMENTS		32
+
+/*
+ * When growth is allowed we reserve this many times the minimum size up
+ * front.  The segment lives on tmpfs, so pages nobody touches are never
+ * backed, and the segment can't move without breaking every pointer in it.
+ */
+#define VH_SHM_GROWTH_FACTOR	16
+
+#define VH_SHM_MINCLASS			32
+
+static uv_once_t shm_once = UV_ONCE_INIT;
+static uv_mutex_t shm_lock;
+static SharedMemoryContext shm_registry[VH_SHM_MAXSEGMENTS];
+
+static void shm_registry_init(void);
+static bool shm_registry_add(SharedMemoryContext smc);
+static void shm_registry_remove(SharedMemoryContext smc);
+static SharedMemoryContext shm_handle_create(struct MemorySuperBlockId ident,
+											 char *addr, size_t sz,
+											 int32_t fd, bool creator,
+											 const char *name);
+static void shm_name(struct MemorySuperBlockId *ident, char *buffer,
+					 size_t buffer_sz);
+static int32_t shm_class(size_t sz, size_t *class_sz);
+
+static void* SharedCtx_Alloc(void *context, size_t size);
+static void* SharedCtx_ReAlloc(void *context, void *pointer, size_t size);
+static void SharedCtx_Free(void *context, void *pointer);
+static void SharedCtx_Destroy(void *context);
+
+static MemoryContextOpsTable SharedMemoryOpsTable = {
+	SharedCtx_Alloc,
+	SharedCtx_ReAlloc,
+	SharedCtx_Free,
+	SharedCtx_Destroy,
+	0
+};
+
+#define shm_block(smc)			((struct SharedMemoryBlock*)(smc)->mapped_address_space)
+
+
+/*
+ * vh_mctx_shared_create
+ *
+ * Creates a new shared memory segment named by |ident| and maps it into
+ * this process.  The segment is at least |minimum_size| bytes, rounded up
+ * to a multiple of |block_size|.  Fails if a segment with the same name
+ * already exists.
+ */
+MemoryContext
+vh_mctx_shared_create(struct MemorySuperBlockId ident,
+					  size_t block_size,
+					  size_t minimum_size,
+					  bool allow_growth,
+					  const char *name)
+{
+	SharedMemoryContext smc;
+	struct SharedMemoryBlock *smb;
+	char shm_path[VH_MCTX_SUPERBLOCK_ID_SZ + 8];
+	size_t page_sz, sz;
+	int32_t fd, i;
+	char *addr;
+
+	uv_once(&shm_once, shm_registry_init);
+
+	page_sz = (size_t)sysconf(_SC_PAGESIZE);
+
+	if (block_size < page_sz)
+		block_size = page_sz;
+	else if (block_size % page_sz)
+		block_size += page_sz - (block_size % page_sz);
+
+	sz = minimum_size > sizeof(struct SharedMemoryBlock) ?
+		minimum_size : sizeof(struct SharedMemoryBlock);
+
+	if (allow_growth)
+		sz *= VH_SHM_GROWTH_FACTOR;
+
+	if (sz % block_size)
+		sz += block_size - (sz % block_size);
+
+	if (sz > VH_SHM_MAXSIZE)
+	{
+		elog(ERROR1,
+			 emsg("Shared memory segment of %lu bytes requested, the maximum "
+				  "segment size is %lu bytes",
+				  sz,
+				  VH_SHM_MAXSIZE));
+
+		return 0;
+	}
+
+	shm_name(&ident, shm_path, sizeof(shm_path));
+	fd = shm_open(shm_path, O_CREAT | O_EXCL | O_RDWR, 0600);
+
+	if (fd < 0)
+	{
+		elog(ERROR1,
+			 emsg("Unable to create shared memory segment %s: %s",
+				  shm_path,
+				  strerror(errno)));
+
+		return 0;
+	}
+
+	if (ftruncate(fd, (off_t)sz))
+	{
+		elog(ERROR1,
+			 emsg("Unable to size shared memory segment %s to %lu bytes: %s",
+				  shm_path,
+				  sz,
+				  strerror(errno)));
+
+		close(fd);
+		shm_unlink(shm_path);
+
+		return 0;
+	}
+
+	addr = mmap(0, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (addr == MAP_FAILED)
+	{
+		elog(ERROR1,
+			 emsg("Unable to map shared memory segment %s: %s",
+				  shm_path,
+				  strerror(errno)));
+
+		close(fd);
+		shm_unlink(shm_path);
+
+		return 0;
+	}
+
+	smb = (struct SharedMemoryBlock*)addr;
+	smb->super.magic = VH_MCTX_SUPERBLOCK_MAGIC;
+	smb->super.tag = VH_MCTX_SUPERBLOCK_TAG_SHARED;
+	memcpy(smb->super.identifier, ident.id, VH_MCTX_SUPERBLOCK_ID_SZ);
+
+	smb->block_size = block_size;
+	smb->min_size = minimum_size;
+	smb->size = sz;
+	smb->cursor = sizeof(struct SharedMemoryBlock);
+	smb->cursor += (16 - (smb->cursor % 16)) % 16;
+	smb->base = (uintptr_t)addr;
+	smb->root = 0;
+	smb->ref_count = 1;
+
+	for (i = 0; i < VH_SHM_FREELISTS; i++)
+		smb->freelists[i] = 0;
+
+	smc = shm_handle_create(ident, addr, sz, fd, true, name);
+
+	if (!smc)
+	{
+		shm_unlink(shm_path);
+
+		return 0;
+	}
+
+	return &smc->mctx;
+}
+
+/*
+ * vh_mctx_shared_attach
+ *
+ * Maps an existing segment into this process.  We try to map the segment
+ * at the same address the creator did, since that's the only way pointers
+ * stored in the segment remain valid.  If the address is taken we still
+ * map the segment, but vh_mctx_shared_samebase will return false and the
+ * root won't be handed out.
+ */
+MemoryContext
+vh_mctx_shared_attach(struct MemorySuperBlockId ident)
+{
+	SharedMemoryContext smc;
+	struct SharedMemoryBlock *smb;
+	char shm_path[VH_MCTX_SUPERBLOCK_ID_SZ + 8];
+	char name_buffer[VH_MCTX_SUPERBLOCK_ID_SZ + 32];
+	uintptr_t base;
+	size_t sz;
+	int32_t fd, flags;
+	char *addr;
+
+	uv_once(&shm_once, shm_registry_init);
+
+	shm_name(&ident, shm_path, sizeof(shm_path));
+	fd = shm_open(shm_path, O_RDWR, 0600);
+
+	if (fd < 0)
+	{
+		elog(ERROR1,
+			 emsg("Unable to open shared memory segment %s: %s",
+				  shm_path,
+				  strerror(errno)));
+
+		return 0;
+	}
+
+	/*
+	 * Peek at the header to learn where the creator mapped the segment and
+	 * how big it is.
+	 */
+	smb = mmap(0, sizeof(struct SharedMemoryBlock), PROT_READ, MAP_SHARED,
+			   fd, 0);
+
+	if (smb == MAP_FAILED)
+	{
+		elog(ERROR1,
+			 emsg("Unable to map shared memory segment %s header: %s",
+				  shm_path,
+				  strerror(errno)));
+
+		close(fd);
+
+		return 0;
+	}
+
+	if (smb->super.magic != VH_MCTX_SUPERBLOCK_MAGIC ||
+		smb->super.tag != VH_MCTX_SUPERBLOCK_TAG_SHARED)
+	{
+		elog(ERROR1,
+			 emsg("Shared memory segment %s is not a shared MemoryContext",
+				  shm_path));
+
+		munmap(smb, sizeof(struct SharedMemoryBlock));
+		close(fd);
+
+		return 0;
+	}
+
+	base = smb->base;
+	sz = smb->size;
+	munmap(smb, sizeof(struct SharedMemoryBlock));
+
+	flags = MAP_SHARED;
+#ifdef MAP_FIXED_NOREPLACE
+	flags |= MAP_FIXED_NOREPLACE;
+#endif
+
+	addr = mmap((void*)base, sz, PROT_READ | PROT_WRITE, flags, fd, 0);
+
+	if (addr == MAP_FAILED)
+		addr = mmap(0, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (addr == MAP_FAILED)
+	{
+		elog(ERROR1,
+			 emsg("Unable to map shared memory segment %s: %s",
+				  shm_path,
+				  strerror(errno)));
+
+		close(fd);
+
+		return 0;
+	}
+
+	__atomic_add_fetch(&((struct SharedMemoryBlock*)addr)->ref_count, 1,
+					   __ATOMIC_ACQ_REL);
+
+	snprintf(name_buffer, sizeof(name_buffer), "Shared %s context", shm_path);
+	smc = shm_handle_create(ident, addr, sz, fd, false, name_buffer);
+
+	return smc ? &smc->mctx : 0;
+}
+
+/*
+ * vh_mctx_shared_unlink
+ *
+ * Removes the segment's name, processes that already have it mapped are
+ * unaffected.
+ */
+bool
+vh_mctx_shared_unlink(struct MemorySuperBlockId ident)
+{
+	char shm_path[VH_MCTX_SUPERBLOCK_ID_SZ + 8];
+
+	shm_name(&ident, shm_path, sizeof(shm_path));
+
+	return shm_unlink(shm_path) == 0;
+}
+
+void*
+vh_mctx_shared_root(MemoryContext mctx)
+{
+	SharedMemoryContext smc = (SharedMemoryContext)mctx;
+
+	assert(mctx->ops == &SharedMemoryOpsTable);
+
+	if (!vh_mctx_shared_samebase(mctx))
+		return 0;
+
+	return __atomic_load_n(&shm_block(smc)->root, __ATOMIC_ACQUIRE);
+}
+
+void
+vh_mctx_shared_set_root(MemoryContext mctx, void *root)
+{
+	SharedMemoryContext smc = (SharedMemoryContext)mctx;
+
+	assert(mctx->ops == &SharedMemoryOpsTable);
+
+	__atomic_store_n(&shm_block(smc)->root, root, __ATOMIC_RELEASE);
+}
+
+bool
+vh_mctx_shared_samebase(MemoryContext mctx)
+{
+	SharedMemoryContext smc = (SharedMemoryContext)mctx;
+
+	return shm_block(smc)->base == (uintptr_t)smc->mapped_address_space;
+}
+
+/*
+ * vh_mctx_shared_from_superblock
+ *
+ * Resolves a super block to the handle this process mapped it with.
+ */
+MemoryContext
+vh_mctx_shared_from_superblock(void *super)
+{
+	struct MemorySuperBlockData *msb = super;
+	SharedMemoryContext smc;
+	int32_t i;
+
+	for (i = 0; i < VH_SHM_MAXSEGMENTS; i++)
+	{
+		smc = __atomic_load_n(&shm_registry[i], __ATOMIC_ACQUIRE);
+
+		if (smc && memcmp(smc->ident.id, msb->identifier,
+						  VH_MCTX_SUPERBLOCK_ID_SZ) == 0)
+			return &smc->mctx;
+	}
+
+	elog(ERROR2,
+		 emsg("Shared memory segment %.*s is not mapped in this process",
+			  VH_MCTX_SUPERBLOCK_ID_SZ,
+			  msb->identifier));
+
+	return 0;
+}
+
+static void*
+SharedCtx_Alloc(void *context, size_t size)
+{
+	SharedMemoryContext smc = context;
+	struct SharedMemoryBlock *smb = shm_block(smc);
+	MemoryChunkHeader chunk;
+	uint64_t head, next;
+	size_t class_sz, offset;
+	int32_t cls;
+
+	cls = shm_class(size + sizeof(struct MemoryChunkHeaderData), &class_sz);
+
+	if (cls >= VH_SHM_FREELISTS)
+	{
+		elog(ERROR1,
+			 emsg("Allocation of %lu bytes is too large for shared memory "
+				  "context %s",
+				  size,
+				  smc->mctx.name));
+
+		return 0;
+	}
+
+	/*
+	 * Try the free list first.  The chunk we read the next link from may
+	 * be popped by another process out from under us, but the segment is
+	 * never unmapped while we hold it so the read is safe and the tag makes
+	 * the swap fail.
+	 */
+	head = __atomic_load_n(&smb->freelists[cls], __ATOMIC_ACQUIRE);
+
+	while ((offset = (size_t)(head & UINT32_MAX) << 3))
+	{
+		chunk = (MemoryChunkHeader)(smc->mapped_address_space + offset);
+		next = *(volatile uint64_t*)(chunk + 1);
+		next |= ((head >> 32) + 1) << 32;
+
+		if (__atomic_compare_exchange_n(&smb->freelists[cls], &head, next,
+										false, __ATOMIC_ACQ_REL,
+										__ATOMIC_ACQUIRE))
+		{
+			smc->mctx.stats.allocs_from_list++;
+			break;
+		}
+	}
+
+	if (!offset)
+	{
+		offset = __atomic_load_n(&smb->cursor, __ATOMIC_RELAXED);
+
+		do
+		{
+			if (offset + class_sz > smb->size)
+			{
+				elog(ERROR1,
+					 emsg("Shared memory context %s is out of space, unable "
+						  "to allocate %lu bytes",
+						  smc->mctx.name,
+						  size));
+
+				return 0;
+			}
+		} while (!__atomic_compare_exchange_n(&smb->cursor, &offset,
+											  offset + class_sz, false,
+											  __ATOMIC_RELAXED,
+											  __ATOMIC_RELAXED));
+
+		chunk = (MemoryChunkHeader)(smc->mapped_address_space + offset);
+	}
+
+	chunk->offset = offset;
+	vh_mchdr_set_size(chunk, class_sz);
+	vh_mchdr_make_superblock(chunk);
+
+	smc->mctx.stats.allocs++;
+	smc->mctx.stats.space += class_sz;
+
+	return chunk + 1;
+}
+
+static void*
+SharedCtx_ReAlloc(void *context, void *pointer, size_t size)
+{
+	MemoryChunkHeader chunk = ((MemoryChunkHeader)pointer) - 1;
+	size_t class_sz = vh_mchdr_size(chunk);
+	void *ptr;
+
+	if (size + sizeof(struct MemoryChunkHeaderData) <= class_sz)
+		return pointer;
+
+	ptr = SharedCtx_Alloc(context, size);
+
+	if (ptr)
+	{
+		memcpy(ptr, pointer, class_sz - sizeof(struct MemoryChunkHeaderData));
+		SharedCtx_Free(context, pointer);
+	}
+
+	return ptr;
+}
+
+static void
+SharedCtx_Free(void *context, void *pointer)
+{
+	SharedMemoryContext smc = context;
+	struct SharedMemoryBlock *smb = shm_block(smc);
+	MemoryChunkHeader chunk = ((MemoryChunkHeader)pointer) - 1;
+	uint64_t head, next;
+	size_t class_sz;
+	int32_t cls;
+
+	assert(vh_mchdr_is_superblock(chunk));
+	assert(vh_mchdr_superblock(chunk) == (void*)smb);
+
+	cls = shm_class(vh_mchdr_size(chunk), &class_sz);
+	assert(class_sz == vh_mchdr_size(chunk));
+
+	head = __atomic_load_n(&smb->freelists[cls], __ATOMIC_RELAXED);
+
+	do
+	{
+		*(volatile uint64_t*)pointer = head & UINT32_MAX;
+		next = (((head >> 32) + 1) << 32) | (chunk->offset >> 3);
+	} while (!__atomic_compare_exchange_n(&smb->freelists[cls], &head, next,
+										  false, __ATOMIC_RELEASE,
+										  __ATOMIC_RELAXED));
+
+	smc->mctx.stats.frees++;
+	smc->mctx.stats.space -= class_sz;
+}
+
+/*
+ * Drops this process's mapping.  The last process out doesn't remove the
+ * name, that's left to the creator with vh_mctx_shared_unlink so a worker
+ * that attaches late can still find the segment.
+ */
+static void
+SharedCtx_Destroy(void *context)
+{
+	SharedMemoryContext smc = context;
+
+	shm_registry_remove(smc);
+
+	__atomic_sub_fetch(&shm_block(smc)->ref_count, 1, __ATOMIC_ACQ_REL);
+
+	munmap(smc->mapped_address_space, smc->mapped_sz);
+	close(smc->fd);
+
+	free(context);
+}
+
+static SharedMemoryContext
+shm_handle_create(struct MemorySuperBlockId ident, char *addr, size_t sz,
+				  int32_t fd, bool creator, const char *name)
+{
+	SharedMemoryContext smc;
+	MemoryContext parent;
+
+	parent = vh_ctx() ? vh_mctx_current() : 0;
+	smc = vh_mctx_create(parent,
+						 sizeof(struct SharedMemoryContextData),
+						 &SharedMemoryOpsTable,
+						 name);
+
+	smc->ident = ident;
+	smc->mapped_address_space = addr;
+	smc->mapped_sz = sz;
+	smc->fd = fd;
+	smc->creator = creator;
+	smc->mctx.stats.blocks = 1;
+	smc->mctx.stats.freespace = sz;
+
+	if (!shm_registry_add(smc))
+	{
+		elog(ERROR1,
+			 emsg("Unable to map shared memory context %s, all %d shared "
+				  "memory segments are in use by this process",
+				  name,
+				  VH_SHM_MAXSEGMENTS));
+
+		/*
+		 * Our destroy routine drops the mapping and the reference the
+		 * caller took.
+		 */
+		vh_mctx_destroy(&smc->mctx);
+
+		return 0;
+	}
+
+	return smc;
+}
+
+static void
+shm_registry_init(void)
+{
+	uv_mutex_init(&shm_lock);
+	memset(shm_registry, 0, sizeof(shm_registry));
+}
+
+static bool
+shm_registry_add(SharedMemoryContext smc)
+{
+	int32_t i;
+
+	uv_mutex_lock(&shm_lock);
+
+	for (i = 0; i < VH_SHM_MAXSEGMENTS; i++)
+	{
+		if (!shm_registry[i])
+		{
+			__atomic_store_n(&shm_registry[i], smc, __ATOMIC_RELEASE);
+			uv_mutex_unlock(&shm_lock);
+
+			return true;
+		}
+	}
+
+	uv_mutex_unlock(&shm_lock);
+
+	return false;
+}
+
+static void
+shm_registry_remove(SharedMemoryContext smc)
+{
+	int32_t i;
+
+	uv_mutex_lock(&shm_lock);
+
+	for (i = 0; i < VH_SHM_MAXSEGMENTS; i++)
+	{
+		if (shm_registry[i] == smc)
+		{
+			__atomic_store_n(&shm_registry[i], 0, __ATOMIC_RELEASE);
+			break;
+		}
+	}
+
+	uv_mutex_unlock(&shm_lock);
+}
+
+static void
+shm_name(struct MemorySuperBlockId *ident, char *buffer, size_t buffer_sz)
+{
+	snprintf(buffer, buffer_sz, "/vh_%.*s",
+			 (int)strnlen(ident->id, VH_MCTX_SUPERBLOCK_ID_SZ),
+			 ident->id);
+}
+
+/*
+ * Size classes start at VH_SHM_MINCLASS and step four times per power of
+ * two, i.e. 32, 40, 48, 56, 64, 80, 96, 112, 128, 160...
+ */
+static int32_t
+shm_class(size_t sz, size_t *class_sz)
+{
+	size_t n;
+	int32_t msb, shift, step;
+
+	if (sz <= VH_SHM_MINCLASS)
+	{
+		*class_sz = VH_SHM_MINCLASS;
+		return 0;
+	}
+
+	n = sz - 1;
+	msb = 63 - __builtin_clzll(n);
+	shift = msb - 2;
+	step = (n >> shift) & 3;
+
+	*class_sz = ((size_t)(5 + step)) << shift;
+
+	return 1 + (msb - 5) * 4 + step;
+}
 
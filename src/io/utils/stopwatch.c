@@ -8,6 +8,7 @@
 #include "io/utils/stopwatch.h"
 
 #define NANOSECONDS_PER_MS 		(1000000)
+#define NANOSECONDS_PER_SEC		(1000000000l)
 #define MILLISECONDS_PER_SEC 	(1000)
 
 void
@@ -30,7 +31,8 @@ int64_t
 vh_stopwatch_ns(struct vh_stopwatch *watch)
 {
 	if (watch->finished)
-		return watch->t_end.tv_nsec - watch->t_start.tv_nsec;
+		return (watch->t_end.tv_nsec - watch->t_start.tv_nsec) +
+			   ((watch->t_end.tv_sec - watch->t_start.tv_sec) * NANOSECONDS_PER_SEC);
 
 	return 0;
 }
@@ -7,6 +7,8 @@
 #include <assert.h>
 
 #include "vh.h"
+#include "io/buffer/HeapBuffer.h"
+#include "io/catalog/HeapField.h"
 #include "io/catalog/HeapTuple.h"
 #include "io/catalog/TableCatalog.h"
 #include "io/catalog/TableDef.h"
@@ -16,6 +18,7 @@
 #include "io/nodes/NodeQual.h"
 #include "io/nodes/NodeQueryInsert.h"
 #include "io/nodes/NodeQueryUpdate.h"
+#include "io/nodes/NodeUpdateField.h"
 #include "io/utils/kvlist.h"
 #include "io/utils/SList.h"
 
@@ -38,6 +41,25 @@ static bool sync_htps_impl(SyncContext sc, SList htps);
 static bool sync_fill_context(SyncContext sc, SList htps);
 static bool sync_query(SyncContext sc);
 static bool sync_query_update(SyncContext sc, TableDefVer tdv, SList htps);
+static bool sync_query_update_htp(SyncContext sc, TableDefVer tdv,
+								  HeapTuplePtr htp);
+static bool sync_query_update_batch(SyncContext sc, TableDefVer tdv,
+									HeapTuplePtr *htps, int32_t htps_sz,
+									const unsigned char *changed);
+static bool sync_htp_changed(HeapTuplePtr htp);
+
+/*
+ * Dirty tuples with the same TableDefVer and the same set of changed fields
+ * are written with a single UPDATE statement.  Postgres takes at most 65535
+ * parameters per statement, we stay well under that.
+ */
+#define VH_SYNC_UPDATE_MAX_PARAMS		32767
+
+typedef struct SyncUpdateGroupData
+{
+	unsigned char *changed;		/* Bitmap by heapord */
+	SList htps;
+} SyncUpdateGroupData, *SyncUpdateGroup;
 
 
 static HeapTuplePtr create_heaptupleptr(CatalogContext cc, TableDefVer tdv);
@@ -191,7 +213,7 @@ sync_fill_context(SyncContext sc, SList htps)
 	for (i = 0; i < htp_sz; i++)
 	{
 		htp = htp_head[i];
-		ht = vh_htp(htp);
+		ht = vh_htp_read(htp);
 		tdv = (TableDefVer) ht->htd;
 
 		if (!(vh_ht_flags(ht) & VH_HT_FLAG_FETCHED))
@@ -267,56 +289,243 @@ sync_query(SyncContext sc)
 	return query_queued;
 }
 
+/*
+ * sync_query_update
+ *
+ * Groups |htps| by the fields that changed and sends each group as a single
+ * batched UPDATE.  Tables without a primary key, groups of a single tuple
+ * and groups that change the primary key itself are updated one tuple at a
+ * time.  Tuples with no changes are skipped on every path.
+ */
 static bool
 sync_query_update(SyncContext sc, TableDefVer tdv, SList htps)
 {
-	NodeQueryUpdate nq_upd;
-	NodeQual nq_upd_qual;
-	HeapTuplePtr htp, *htp_head;
-	TableDef td;
-	ExecResult er;
-	int32_t htp_sz, i, j;
+	SList groups;
+	SyncUpdateGroup *grp_head, grp;
+	HeapTuplePtr htp, *htp_head, *grp_htps;
+	HeapField *hf_head, hf;
+	HeapTuple ht;
+	unsigned char *changed;
+	size_t changed_sz;
+	int32_t htp_sz, hf_sz, grp_sz, grp_htps_sz, nchanged, batch_sz, i, j;
+	bool key_changed, res = true;
 
-	td = tdv->td;
 	htp_sz = vh_SListIterator(htps, htp_head);
 
+	if (!tdv->key_primary.nfields || htp_sz == 1)
+	{
+		for (i = 0; i < htp_sz; i++)
+			if (!sync_query_update_htp(sc, tdv, htp_head[i]))
+				return false;
+
+		return true;
+	}
+
+	hf_sz = vh_SListIterator(tdv->heap.fields, hf_head);
+	changed_sz = (hf_sz + 7) / 8;
+	groups = vh_SListCreate();
+	changed = vhmalloc(changed_sz);
+
 	for (i = 0; i < htp_sz; i++)
 	{
 		htp = htp_head[i];
 
-		nq_upd = vh_sqlq_upd_create();
-		(void)vh_sqlq_upd_from(nq_upd, td);
+		if (!sync_htp_changed(htp))
+			continue;
 
-		nq_upd->htp = htp;
+		ht = vh_htp(htp);
+		memset(changed, 0, changed_sz);
 
-		/*
-		 * Add the WHERE clause based on the Primary Key
-		 */
-		if (tdv->key_primary.nfields)
+		for (j = 0; j < hf_sz; j++)
 		{
-			for (j = 0; j < tdv->key_primary.nfields; j++)
-			{
-				nq_upd_qual = vh_nsql_qual_create(And, Eq);
+			hf = hf_head[j];
 
-				vh_nsql_qual_lhs_tf_set(nq_upd_qual, tdv->key_primary.fields[j]);
-				vh_nsql_qual_rhs_tvs_set(nq_upd_qual);
+			if (vh_htf_flags(ht, hf) & VH_HTF_FLAG_CHANGED)
+				changed[hf->heapord / 8] |= 1 << (hf->heapord % 8);
+		}
 
-				vh_tvs_store_htp_hf(vh_nsql_qual_rhs_tvs(nq_upd_qual),
-									htp,
-									(HeapField)tdv->key_primary.fields[j]);
+		grp_sz = vh_SListIterator(groups, grp_head);
+		grp = 0;
 
-				vh_sqlq_upd_qual_add(nq_upd, nq_upd_qual);
+		for (j = 0; j < grp_sz; j++)
+		{
+			if (!memcmp(grp_head[j]->changed, changed, changed_sz))
+			{
+				grp = grp_head[j];
+				break;
 			}
 		}
 
-		if (!vh_xact_node(sc->xact, (NodeQuery)nq_upd, &er))
+		if (!grp)
 		{
-			//vh_nsql_destroytree((Node)nq_upd, 0);
+			grp = vhmalloc(sizeof(SyncUpdateGroupData));
+			grp->changed = vhmalloc(changed_sz);
+			memcpy(grp->changed, changed, changed_sz);
+			vh_htp_SListCreate(grp->htps);
 
-			return false;
+			vh_SListPush(groups, grp);
 		}
+
+		vh_htp_SListPush(grp->htps, htp);
 	}
 
-	return true;
+	grp_sz = vh_SListIterator(groups, grp_head);
+
+	for (i = 0; i < grp_sz && res; i++)
+	{
+		grp = grp_head[i];
+		grp_htps_sz = vh_SListIterator(grp->htps, grp_htps);
+
+		key_changed = false;
+
+		for (j = 0; j < tdv->key_primary.nfields; j++)
+		{
+			hf = (HeapField)tdv->key_primary.fields[j];
+
+			if (grp->changed[hf->heapord / 8] & (1 << (hf->heapord % 8)))
+				key_changed = true;
+		}
+
+		if (grp_htps_sz == 1 || key_changed)
+		{
+			for (j = 0; j < grp_htps_sz && res; j++)
+				res = sync_query_update_htp(sc, tdv, grp_htps[j]);
+
+			continue;
+		}
+
+		nchanged = 0;
+
+		for (j = 0; j < hf_sz; j++)
+			if (grp->changed[hf_head[j]->heapord / 8] & 
+				(1 << (hf_head[j]->heapord % 8)))
+				nchanged++;
+
+		batch_sz = VH_SYNC_UPDATE_MAX_PARAMS / 
+				   (nchanged + tdv->key_primary.nfields);
+
+		for (j = 0; j < grp_htps_sz && res; j += batch_sz)
+			res = sync_query_update_batch(sc, tdv, &grp_htps[j], 
+										  grp_htps_sz - j < batch_sz ?
+										  grp_htps_sz - j : batch_sz,
+										  grp->changed);
+	}
+
+	for (i = 0; i < grp_sz; i++)
+	{
+		grp = grp_head[i];
+
+		vh_SListDestroy(grp->htps);
+		vhfree(grp->changed);
+		vhfree(grp);
+	}
+
+	vh_SListDestroy(groups);
+	vhfree(changed);
+
+	return res;
 }
 
+/*
+ * sync_htp_changed
+ *
+ * Same as plan_update: flag the changed fields by comparing against the
+ * immutable copy.  There's nothing to write when none changed.
+ */
+static bool
+sync_htp_changed(HeapTuplePtr htp)
+{
+	HeapTuple ht, hti;
+
+	ht = vh_htp(htp);
+	hti = vh_htp_immutable(htp);
+
+	return vh_ht_compare(hti, ht, true) != 0;
+}
+
+static bool
+sync_query_update_batch(SyncContext sc, TableDefVer tdv, 
+						HeapTuplePtr *htps, int32_t htps_sz,
+						const unsigned char *changed)
+{
+	NodeQueryUpdate nq_upd;
+	NodeUpdateField nuf;
+	HeapField *hf_head, hf;
+	SList htpl;
+	ExecResult er;
+	int32_t hf_sz, i;
+
+	nq_upd = vh_sqlq_upd_create();
+	(void)vh_sqlq_upd_from(nq_upd, tdv->td);
+
+	hf_sz = vh_SListIterator(tdv->heap.fields, hf_head);
+
+	for (i = 0; i < hf_sz; i++)
+	{
+		hf = hf_head[i];
+
+		if (changed[hf->heapord / 8] & (1 << (hf->heapord % 8)))
+		{
+			nuf = vh_nsql_updfield_create((TableField)hf, htps[0]);
+			vh_sqlq_upd_field_add(nq_upd, nuf);
+		}
+	}
+
+	vh_htp_SListCreate(htpl);
+
+	for (i = 0; i < htps_sz; i++)
+		vh_htp_SListPush(htpl, htps[i]);
+
+	vh_sqlq_upd_htpl(nq_upd, htpl);
+
+	return vh_xact_node(sc->xact, (NodeQuery)nq_upd, &er);
+}
+
+static bool
+sync_query_update_htp(SyncContext sc, TableDefVer tdv, HeapTuplePtr htp)
+{
+	NodeQueryUpdate nq_upd;
+	NodeQual nq_upd_qual;
+	TableDef td;
+	ExecResult er;
+	int32_t j;
+
+	if (!sync_htp_changed(htp))
+		return true;
+
+	td = tdv->td;
+
+	nq_upd = vh_sqlq_upd_create();
+	(void)vh_sqlq_upd_from(nq_upd, td);
+
+	nq_upd->htp = htp;
+
+	/*
+	 * Add the WHERE clause based on the Primary Key
+	 */
+	if (tdv->key_primary.nfields)
+	{
+		for (j = 0; j < tdv->key_primary.nfields; j++)
+		{
+			nq_upd_qual = vh_nsql_qual_create(And, Eq);
+
+			vh_nsql_qual_lhs_tf_set(nq_upd_qual, tdv->key_primary.fields[j]);
+			vh_nsql_qual_rhs_tvs_set(nq_upd_qual);
+
+			vh_tvs_store_htp_hf(vh_nsql_qual_rhs_tvs(nq_upd_qual),
+								htp,
+								(HeapField)tdv->key_primary.fields[j]);
+
+			vh_sqlq_upd_qual_add(nq_upd, nq_upd_qual);
+		}
+	}
+
+	if (!vh_xact_node(sc->xact, (NodeQuery)nq_upd, &er))
+	{
+		//vh_nsql_destroytree((Node)nq_upd, 0);
+
+		return false;
+	}
+
+	return true;
+}
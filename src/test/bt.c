@@ -46,6 +46,7 @@ static void populate_bt2(void);
 static void populate_bt3(void);
 
 static void scan_bt(void);
+static void capped_bt(void);
 
 typedef struct btTestVal16Data *btTestVal16;
 
@@ -86,6 +87,8 @@ test_bt_entry(void)
 	populate_bt3();
 
 	scan_bt();
+
+	capped_bt();
 }
 
 static void
@@ -557,3 +560,62 @@ scan_bt(void)
 	printf("\nbt_scan count %d\n", count);
 }
 
+
+/*
+ * capped_bt
+ *
+ * Keeps the 50 largest of 5000 keys inserted out of order, then makes sure
+ * the boundary rejects a key that's too small.
+ */
+static void
+capped_bt(void)
+{
+	btRoot btc;
+	btScan scan;
+	TypeVarSlot tvs, *tvs_key, *keys;
+	void *val;
+	int32_t i, key, count;
+	bool res;
+
+	btc = vh_bt_create_capped(vh_mctx_current(), true, 50, true);
+	vh_bt_add_column_tys(btc, tys_int32, false);
+
+	vh_tvs_init(&tvs);
+	tvs_key = &tvs;
+
+	/* Create the root page */
+	vh_bt_find_tvs(btc, &tvs_key, 1, &val);
+
+	for (i = 0; i < 5000; i++)
+	{
+		vh_tvs_store_i32(&tvs, (i * 7919) % 5000);
+		vh_bt_insert_tvs(btc, &tvs_key, 1, &val);
+	}
+
+	assert(vh_bt_count(btc) == 50);
+
+	vh_tvs_store_i32(&tvs, 10);
+	res = vh_bt_insert_tvs(btc, &tvs_key, 1, &val);
+	assert(!res);
+	assert(!val);
+	assert(vh_bt_count(btc) == 50);
+
+	scan = vh_bt_scan_begin(btc, 0);
+	count = 0;
+
+	if (vh_bt_scan_first(scan, 0, 0, true))
+	{
+		vh_bt_scan_get(scan, &keys, &val);
+		vh_tvs_i32(&keys[0], &key);
+		assert(key == 4950);
+		count++;
+
+		while (vh_bt_scan_next(scan, true))
+			count++;
+	}
+
+	vh_bt_scan_end(scan);
+
+	assert(count == 50);
+	printf("\ncapped_bt count: %d, boundary: %d\n", count, key);
+}
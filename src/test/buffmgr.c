@@ -0,0 +1,900 @@
+/*
+ * Copyright (c) 2011-2017, Kyle A. Gearhart
+ */
+
+
+
+#include <assert.h>
+#include <locale.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <uv.h>
+
+#include "vh.h"
+#include "io/buffer/BuffMgr.h"
+#include "io/buffer/HeapPage.h"
+#include "io/catalog/HeapTuple.h"
+#include "io/catalog/TableDef.h"
+#include "io/catalog/TableField.h"
+#include "io/catalog/Type.h"
+#include "io/utils/kvmap.h"
+#include "io/utils/mmgr/sharedctx.h"
+#include "io/utils/stopwatch.h"
+
+#include "test.h"
+
+/*
+ * Each worker attaches a CatalogContext which opens its own general
+ * HeapBuffer, so we need to stay under the default registry size.
+ */
+#define BUFFMGR_THREADS			8
+#define BUFFMGR_TUPS			10000
+#define BUFFMGR_REOPENS			20
+#define BUFFMGR_RESOLVES		1000000
+#define BUFFMGR_BENCH_TUPS		200000
+#define BUFFMGR_BENCH_LOOPS		10
+#define BUFFMGR_SHARED_TUPS		50000
+
+struct BuffMgrWorker
+{
+	uv_thread_t thread;
+	HeapTuplePtr *htps;
+	int64_t resolves;
+	int64_t resolve_ms;
+	int32_t stale_detected;
+	bool failed;
+};
+
+static TableDef td_buffmgr = 0;
+static TableField tf_buffmgr = 0;
+
+static void buffmgr_setup_td(void);
+static void buffmgr_stress(void);
+static void buffmgr_worker(void *arg);
+static bool buffmgr_fill(struct BuffMgrWorker *w, HeapBufferNo hbno);
+static bool buffmgr_verify(struct BuffMgrWorker *w);
+static void buffmgr_resolve(struct BuffMgrWorker *w);
+static void buffmgr_blkdir_bench(void);
+static void buffmgr_allocht_n(void);
+static void buffmgr_pax(void);
+static void buffmgr_forread(void);
+static void buffmgr_shared(void);
+static bool buffmgr_shared_child(int32_t fd, struct MemorySuperBlockId ident);
+static int64_t buffmgr_pax_colsum(HeapTuple *hts, uint32_t n, HeapField hf);
+static uintptr_t buffmgr_blkdir_bench_dir(HeapBuffer hb, HeapTuplePtr *htps,
+										  const char *pattern);
+static uintptr_t buffmgr_blkdir_bench_kvmap(KeyValueMap blocks,
+											HeapTuplePtr *htps,
+											const char *pattern);
+
+static Type tys_int32[] = { &vh_type_int32, 0 };
+static Type tys_string[] = { &vh_type_String, 0 };
+
+void test_buffmgr_entry(void)
+{
+	setlocale(LC_NUMERIC, "");
+	printf("\n########################################################################"
+		   "\nENTERING BUFFER MANAGER TESTS"
+		   "\n########################################################################"
+		   "\n");
+
+	buffmgr_setup_td();
+	buffmgr_stress();
+	buffmgr_blkdir_bench();
+	buffmgr_allocht_n();
+	buffmgr_pax();
+	buffmgr_forread();
+	buffmgr_shared();
+
+	printf("\n#######################################################################"
+		   "\nEXITING BUFFER MANAGER TESTS"
+		   "\n#######################################################################"
+		   "\n\n");
+}
+
+static void
+buffmgr_setup_td(void)
+{
+	td_buffmgr = vh_td_create(false);
+	tf_buffmgr = vh_td_tf_add(td_buffmgr, tys_int32, "value");
+}
+
+/*
+ * Runs the workers twice: once by themselves to get a single thread baseline
+ * for HeapTuplePtr resolution and then all at once while they churn their
+ * HeapBuffers open and closed.
+ */
+static void
+buffmgr_stress(void)
+{
+	struct BuffMgrWorker workers[BUFFMGR_THREADS] = { };
+	struct vh_stopwatch watch;
+	int64_t resolves = 0;
+	int32_t i;
+
+	printf("\nResolving %'d HeapTuplePtr on a single worker thread...",
+		   BUFFMGR_RESOLVES);
+	uv_thread_create(&workers[0].thread, buffmgr_worker, &workers[0]);
+	uv_thread_join(&workers[0].thread);
+	assert(!workers[0].failed);
+	printf("complete in %'ld ms", workers[0].resolve_ms);
+
+	memset(workers, 0, sizeof(workers));
+
+	printf("\nRunning %d worker threads with %d HeapBuffer reopens each...",
+		   BUFFMGR_THREADS, BUFFMGR_REOPENS);
+	vh_stopwatch_start(&watch);
+
+	for (i = 0; i < BUFFMGR_THREADS; i++)
+		uv_thread_create(&workers[i].thread, buffmgr_worker, &workers[i]);
+
+	for (i = 0; i < BUFFMGR_THREADS; i++)
+	{
+		uv_thread_join(&workers[i].thread);
+		assert(!workers[i].failed);
+		assert(workers[i].stale_detected == BUFFMGR_REOPENS);
+
+		resolves += workers[i].resolves;
+	}
+
+	vh_stopwatch_end(&watch);
+	printf("complete in %'ld ms", vh_stopwatch_ms(&watch));
+
+	for (i = 0; i < BUFFMGR_THREADS; i++)
+		printf("\n\tworker %d resolved %'ld HeapTuplePtr in %'ld ms",
+			   i, workers[i].resolves, workers[i].resolve_ms);
+
+	printf("\n\t%'ld HeapTuplePtr resolved across all workers", resolves);
+}
+
+static void
+buffmgr_worker(void *arg)
+{
+	struct BuffMgrWorker *w = arg;
+	CatalogContext cc;
+	HeapBufferNo hbno;
+	HeapBuffer hb;
+	HeapTuplePtr stale;
+	int32_t i;
+
+	cc = vh_ctx_thread_attach(ctx_catalog);
+
+	if (!cc)
+	{
+		w->failed = true;
+		return;
+	}
+
+	w->htps = vhmalloc(sizeof(HeapTuplePtr) * BUFFMGR_TUPS);
+
+	if (!buffmgr_fill(w, cc->hbno_general) || !buffmgr_verify(w))
+		w->failed = true;
+
+	buffmgr_resolve(w);
+
+	/*
+	 * Churn our HeapBuffer while the other workers do the same.  Every
+	 * HeapTuplePtr formed against the closed buffer must fail to resolve,
+	 * even if the slot was recycled for someone else.
+	 */
+	for (i = 0; i < BUFFMGR_REOPENS && !w->failed; i++)
+	{
+		stale = w->htps[0];
+
+		vh_hb_close(cc->hbno_general);
+		cc->hbno_general = hbno = vh_hb_open(cc->memoryTop);
+
+		hb = vh_hb(vh_HTP_BUFF(stale));
+
+		if (!hb || hb->xid != vh_HTP_XID(stale))
+			w->stale_detected++;
+
+		if (!buffmgr_fill(w, hbno) || !buffmgr_verify(w))
+			w->failed = true;
+	}
+
+	vhfree(w->htps);
+	vh_ctx_thread_detach();
+}
+
+static bool
+buffmgr_fill(struct BuffMgrWorker *w, HeapBufferNo hbno)
+{
+	HeapBuffer hb = vh_hb(hbno);
+	HeapTupleDef htd = &vh_td_tdv_lead(td_buffmgr)->heap;
+	HeapTuple ht;
+	int32_t i;
+
+	for (i = 0; i < BUFFMGR_TUPS; i++)
+	{
+		w->htps[i] = vh_hb_allocht(hb, htd, &ht);
+
+		if (!w->htps[i])
+			return false;
+
+		*((int32_t*)vh_ht_get(ht, tf_buffmgr)) = i;
+	}
+
+	return true;
+}
+
+static bool
+buffmgr_verify(struct BuffMgrWorker *w)
+{
+	HeapTuple ht;
+	int32_t i;
+
+	for (i = 0; i < BUFFMGR_TUPS; i++)
+	{
+		ht = vh_htp_immutable(w->htps[i]);
+
+		if (!ht || *((int32_t*)vh_ht_get(ht, tf_buffmgr)) != i)
+			return false;
+	}
+
+	return true;
+}
+
+static void
+buffmgr_resolve(struct BuffMgrWorker *w)
+{
+	struct vh_stopwatch watch;
+	HeapTuple ht;
+	int64_t sum = 0;
+	int32_t i;
+
+	vh_stopwatch_start(&watch);
+
+	for (i = 0; i < BUFFMGR_RESOLVES; i++)
+	{
+		ht = vh_htp_immutable(w->htps[i % BUFFMGR_TUPS]);
+		sum += *((int32_t*)vh_ht_get(ht, tf_buffmgr));
+	}
+
+	vh_stopwatch_end(&watch);
+
+	w->resolves = BUFFMGR_RESOLVES;
+	w->resolve_ms = vh_stopwatch_ms(&watch);
+
+	if (sum != ((int64_t)BUFFMGR_RESOLVES / BUFFMGR_TUPS) *
+			   ((int64_t)BUFFMGR_TUPS * (BUFFMGR_TUPS - 1) / 2))
+		w->failed = true;
+}
+
+/*
+ * Compares the block directory behind vh_htp with the KeyValueMap it replaced
+ * for both sequential and random HeapTuplePtr access patterns.  The
+ * KeyValueMap is keyed exactly how the HeapBuffer used to key it, by
+ * BufferBlockNo, and holds the same Block pointers as the directory so both
+ * sides time only the BufferBlockNo to Block lookup.
+ */
+static void
+buffmgr_blkdir_bench(void)
+{
+	HeapBuffer hb = vh_hb(ctx_catalog->hbno_general);
+	HeapTupleDef htd = &vh_td_tdv_lead(td_buffmgr)->heap;
+	HeapTuplePtr *htps, *shuffled, swap;
+	KeyValueMap blocks;
+	BufferBlockNo blockno;
+	HeapTuple ht;
+	void **value;
+	uintptr_t sum_kv, sum_dir;
+	int32_t i, j;
+
+	htps = vhmalloc(sizeof(HeapTuplePtr) * BUFFMGR_BENCH_TUPS);
+	shuffled = vhmalloc(sizeof(HeapTuplePtr) * BUFFMGR_BENCH_TUPS);
+
+	blocks = vh_kvmap_create_impl(sizeof(BufferBlockNo),
+								  sizeof(void*),
+								  vh_htbl_hash_int32,
+								  vh_htbl_comp_int32,
+								  vh_mctx_current());
+
+	for (i = 0; i < BUFFMGR_BENCH_TUPS; i++)
+	{
+		htps[i] = vh_hb_allocht(hb, htd, &ht);
+		assert(htps[i]);
+
+		*((int32_t*)vh_ht_get(ht, tf_buffmgr)) = i;
+		shuffled[i] = htps[i];
+	}
+
+	for (i = 0; i < BUFFMGR_BENCH_TUPS; i++)
+	{
+		blockno = vh_HTP_BLOCKNO(htps[i]);
+
+		if (!vh_kvmap_value(blocks, &blockno, value))
+			*value = hb->blocks[blockno >> VH_HB_BLKDIR_LEAFSHIFT]
+							   [blockno & VH_HB_BLKDIR_LEAFMASK];
+	}
+
+	for (i = BUFFMGR_BENCH_TUPS - 1; i > 0; i--)
+	{
+		j = rand() % (i + 1);
+		swap = shuffled[i];
+		shuffled[i] = shuffled[j];
+		shuffled[j] = swap;
+	}
+
+	printf("\nBlock directory vs KeyValueMap with %'d HeapTuplePtr across %d "
+		   "blocks:", BUFFMGR_BENCH_TUPS, hb->nblocks);
+
+	sum_kv = buffmgr_blkdir_bench_kvmap(blocks, htps, "sequential");
+	sum_dir = buffmgr_blkdir_bench_dir(hb, htps, "sequential");
+	assert(sum_kv == sum_dir);
+	sum_kv = buffmgr_blkdir_bench_kvmap(blocks, shuffled, "random");
+	sum_dir = buffmgr_blkdir_bench_dir(hb, shuffled, "random");
+	assert(sum_kv == sum_dir);
+
+	for (i = 0; i < BUFFMGR_BENCH_TUPS; i++)
+		vh_htp_free(htps[i]);
+
+	vh_kvmap_destroy(blocks);
+	vhfree(shuffled);
+	vhfree(htps);
+}
+
+/*
+ * Same lookup hb_fetch does, without the LRU bookkeeping.
+ */
+static uintptr_t
+buffmgr_blkdir_bench_dir(HeapBuffer hb, HeapTuplePtr *htps, const char *pattern)
+{
+	struct vh_stopwatch watch;
+	BufferBlockNo blockno;
+	uint32_t leaf;
+	uintptr_t sum = 0;
+	int32_t i, j, found = 0;
+
+	vh_stopwatch_start(&watch);
+
+	for (j = 0; j < BUFFMGR_BENCH_LOOPS; j++)
+	{
+		for (i = 0; i < BUFFMGR_BENCH_TUPS; i++)
+		{
+			blockno = vh_HTP_BLOCKNO(htps[i]);
+			leaf = blockno >> VH_HB_BLKDIR_LEAFSHIFT;
+
+			if (leaf < hb->nleaves && hb->blocks[leaf])
+			{
+				sum += (uintptr_t)hb->blocks[leaf][blockno & VH_HB_BLKDIR_LEAFMASK];
+				found++;
+			}
+		}
+	}
+
+	vh_stopwatch_end(&watch);
+
+	assert(found == BUFFMGR_BENCH_TUPS * BUFFMGR_BENCH_LOOPS);
+
+	printf("\n\tblock lookup %s (block directory):\t%'d lookups in %'ld ms",
+		   pattern, BUFFMGR_BENCH_TUPS * BUFFMGR_BENCH_LOOPS,
+		   vh_stopwatch_ms(&watch));
+
+	return sum;
+}
+
+static uintptr_t
+buffmgr_blkdir_bench_kvmap(KeyValueMap blocks, HeapTuplePtr *htps,
+						   const char *pattern)
+{
+	struct vh_stopwatch watch;
+	BufferBlockNo blockno;
+	void **value;
+	uintptr_t sum = 0;
+	int32_t i, j, found = 0;
+
+	vh_stopwatch_start(&watch);
+
+	for (j = 0; j < BUFFMGR_BENCH_LOOPS; j++)
+	{
+		for (i = 0; i < BUFFMGR_BENCH_TUPS; i++)
+		{
+			blockno = vh_HTP_BLOCKNO(htps[i]);
+			value = vh_kvmap_find(blocks, &blockno);
+
+			if (value)
+			{
+				sum += (uintptr_t)*value;
+				found++;
+			}
+		}
+	}
+
+	vh_stopwatch_end(&watch);
+
+	assert(found == BUFFMGR_BENCH_TUPS * BUFFMGR_BENCH_LOOPS);
+
+	printf("\n\tblock lookup %s (KeyValueMap):\t%'d lookups in %'ld ms",
+		   pattern, BUFFMGR_BENCH_TUPS * BUFFMGR_BENCH_LOOPS,
+		   vh_stopwatch_ms(&watch));
+
+	return sum;
+}
+
+/*
+ * Checks vh_hb_allocht_n hands back HeapTuplePtr which resolve to the
+ * HeapTuple it reported and times it against the one at a time path.
+ */
+static void
+buffmgr_allocht_n(void)
+{
+	HeapBuffer hb = vh_hb(ctx_catalog->hbno_general);
+	HeapTupleDef htd = &vh_td_tdv_lead(td_buffmgr)->heap;
+	struct vh_stopwatch watch;
+	HeapBufferBatchData batch;
+	HeapTuplePtr *htps;
+	HeapTuple *hts, ht;
+	uint32_t i, nalloc;
+
+	htps = vhmalloc(sizeof(HeapTuplePtr) * BUFFMGR_BENCH_TUPS);
+	hts = vhmalloc(sizeof(HeapTuple) * BUFFMGR_BENCH_TUPS);
+
+	printf("\nAllocating %'d HeapTuple one at a time...", BUFFMGR_BENCH_TUPS);
+	vh_stopwatch_start(&watch);
+
+	for (i = 0; i < BUFFMGR_BENCH_TUPS; i++)
+		htps[i] = vh_hb_allocht(hb, htd, &hts[i]);
+
+	vh_stopwatch_end(&watch);
+	printf("complete in %'ld ms", vh_stopwatch_ms(&watch));
+
+	for (i = 0; i < BUFFMGR_BENCH_TUPS; i++)
+		vh_htp_free(htps[i]);
+
+	printf("\nAllocating %'d HeapTuple with vh_hb_allocht_n...", BUFFMGR_BENCH_TUPS);
+	vh_stopwatch_start(&watch);
+
+	nalloc = vh_hb_allocht_n(hb, htd, BUFFMGR_BENCH_TUPS, htps, hts);
+
+	vh_stopwatch_end(&watch);
+	printf("complete in %'ld ms", vh_stopwatch_ms(&watch));
+
+	assert(nalloc == BUFFMGR_BENCH_TUPS);
+
+	for (i = 0; i < nalloc; i++)
+	{
+		assert(hts[i]->htd == htd);
+		assert(vh_htf_isnull(hts[i], tf_buffmgr));
+
+		*((int32_t*)vh_ht_get(hts[i], tf_buffmgr)) = i;
+	}
+
+	for (i = 0; i < nalloc; i++)
+	{
+		ht = vh_htp_immutable(htps[i]);
+		assert(ht == hts[i]);
+		assert(*((int32_t*)vh_ht_get(ht, tf_buffmgr)) == i);
+
+		vh_htp_free(htps[i]);
+	}
+
+	/*
+	 * Run a batch a few tuples past its size and make sure the leftovers
+	 * get released.
+	 */
+	vh_hb_batch_init(&batch, hb, htd, 16, vh_mctx_current());
+
+	for (i = 0; i < 20; i++)
+	{
+		htps[i] = vh_hb_batch_next(&batch, &ht);
+		assert(htps[i] && ht->htd == htd);
+		assert(vh_htp_immutable(htps[i]) == ht);
+	}
+
+	assert(batch.navail - batch.next == 12);
+	vh_hb_batch_release(&batch);
+
+	for (i = 0; i < 20; i++)
+		vh_htp_free(htps[i]);
+
+	vhfree(hts);
+	vhfree(htps);
+}
+
+/*
+ * Forms the same tuples with the row and PAX layouts, checks the PAX tuples
+ * behave thru the usual HeapTuple API and then times a single column sum
+ * against each.
+ */
+static void
+buffmgr_pax(void)
+{
+	HeapBuffer hb = vh_hb(ctx_catalog->hbno_general);
+	TableDef td_row, td_pax;
+	TableField tfr_a, tfr_b, tfp_a, tfp_b, tfp_name;
+	HeapTupleDef htd_row, htd_pax;
+	struct vh_stopwatch watch;
+	HeapTuplePtr *htps_row, *htps_pax, htp;
+	HeapTuple *hts_row, *hts_pax, ht, ht_m;
+	HeapPage hp;
+	unsigned char *nbm;
+	int64_t expected = 0, sum;
+	uint32_t i, j, nalloc;
+
+	td_row = vh_td_create(false);
+	tfr_a = vh_td_tf_add(td_row, tys_int32, "a");
+	tfr_b = vh_td_tf_add(td_row, tys_int32, "b");
+	vh_td_tf_add(td_row, tys_string, "name");
+
+	td_pax = vh_td_create(false);
+	tfp_a = vh_td_tf_add(td_pax, tys_int32, "a");
+	tfp_b = vh_td_tf_add(td_pax, tys_int32, "b");
+	tfp_name = vh_td_tf_add(td_pax, tys_string, "name");
+
+	htd_row = &vh_td_tdv_lead(td_row)->heap;
+	htd_pax = &vh_td_tdv_lead(td_pax)->heap;
+
+	assert(vh_htd_set_pax(htd_pax, true));
+	assert(vh_htd_ispax(htd_pax));
+	assert(!vh_htd_ispax(htd_row));
+
+	printf("\nPAX layout holds %d tuples per page", htd_pax->paxcap);
+
+	htps_row = vhmalloc(sizeof(HeapTuplePtr) * BUFFMGR_BENCH_TUPS);
+	htps_pax = vhmalloc(sizeof(HeapTuplePtr) * BUFFMGR_BENCH_TUPS);
+	hts_row = vhmalloc(sizeof(HeapTuple) * BUFFMGR_BENCH_TUPS);
+	hts_pax = vhmalloc(sizeof(HeapTuple) * BUFFMGR_BENCH_TUPS);
+
+	nalloc = vh_hb_allocht_n(hb, htd_row, BUFFMGR_BENCH_TUPS, htps_row, hts_row);
+	assert(nalloc == BUFFMGR_BENCH_TUPS);
+
+	/*
+	 * Mix the single and batch allocation paths on the PAX side.
+	 */
+	for (i = 0; i < 100; i++)
+		htps_pax[i] = vh_hb_allocht(hb, htd_pax, &hts_pax[i]);
+
+	nalloc = vh_hb_allocht_n(hb, htd_pax, BUFFMGR_BENCH_TUPS - 100,
+							 htps_pax + 100, hts_pax + 100);
+	assert(nalloc == BUFFMGR_BENCH_TUPS - 100);
+
+	for (i = 0; i < BUFFMGR_BENCH_TUPS; i++)
+	{
+		ht = hts_pax[i];
+
+		assert(ht->htd == htd_pax);
+		assert(vh_ht_flags(ht) & VH_HT_FLAG_PAX);
+		assert(vh_htf_isnull(ht, tfp_a));
+		assert(vh_ht_nbm_isnull(vh_ht_pax_nbm(ht, tfp_a), vh_ht_pax_slot(ht)));
+
+		*((int32_t*)vh_ht_get(ht, tfp_a)) = i;
+		vh_htf_clearnull(ht, tfp_a);
+
+		*((int32_t*)vh_ht_get(hts_row[i], tfr_a)) = i;
+		vh_htf_clearnull(hts_row[i], tfr_a);
+
+		if (i % 2)
+		{
+			*((int32_t*)vh_ht_get(ht, tfp_b)) = -((int32_t)i);
+			vh_htf_clearnull(ht, tfp_b);
+
+			*((int32_t*)vh_ht_get(hts_row[i], tfr_b)) = -((int32_t)i);
+			vh_htf_clearnull(hts_row[i], tfr_b);
+		}
+
+		expected += i;
+	}
+
+	for (i = 0; i < BUFFMGR_BENCH_TUPS; i += 1000)
+	{
+		vh_strappd((String)vh_ht_get(hts_pax[i], tfp_name), "pax");
+		vh_htf_clearnull(hts_pax[i], tfp_name);
+	}
+
+	for (i = 0; i < BUFFMGR_BENCH_TUPS; i++)
+	{
+		ht = vh_htp_immutable(htps_pax[i]);
+
+		assert(ht == hts_pax[i]);
+		assert(*((int32_t*)vh_ht_get(ht, tfp_a)) == i);
+		assert(!vh_ht_nbm_isnull(vh_ht_pax_nbm(ht, tfp_a), vh_ht_pax_slot(ht)));
+
+		if (i % 2)
+			assert(*((int32_t*)vh_ht_get(ht, tfp_b)) == -((int32_t)i));
+		else
+			assert(vh_htf_isnull(ht, tfp_b) &&
+				   vh_ht_nbm_isnull(vh_ht_pax_nbm(ht, tfp_b), 
+									vh_ht_pax_slot(ht)));
+
+		if (i % 1000 == 0)
+			assert(strcmp(vh_str_buffer((String)vh_ht_get(ht, tfp_name)),
+						  "pax") == 0);
+	}
+
+	sum = buffmgr_pax_colsum(hts_pax, BUFFMGR_BENCH_TUPS, &tfp_a->heap);
+	assert(sum == expected);
+
+	printf("\nSumming a column of %'d HeapTuple %d times:", 
+		   BUFFMGR_BENCH_TUPS, BUFFMGR_BENCH_LOOPS);
+
+	vh_stopwatch_start(&watch);
+
+	for (j = 0; j < BUFFMGR_BENCH_LOOPS; j++)
+	{
+		sum = 0;
+
+		for (i = 0; i < BUFFMGR_BENCH_TUPS; i++)
+		{
+			ht = vh_htp_immutable(htps_row[i]);
+
+			if (!vh_htf_isnull(ht, tfr_a))
+				sum += *((int32_t*)vh_ht_get(ht, tfr_a));
+		}
+	}
+
+	vh_stopwatch_end(&watch);
+	assert(sum == expected);
+	printf("\n\trow layout thru vh_htp:\t\t%'ld ms", vh_stopwatch_ms(&watch));
+
+	vh_stopwatch_start(&watch);
+
+	for (j = 0; j < BUFFMGR_BENCH_LOOPS; j++)
+	{
+		sum = 0;
+
+		for (i = 0; i < BUFFMGR_BENCH_TUPS; i++)
+		{
+			ht = vh_htp_immutable(htps_pax[i]);
+
+			if (!vh_htf_isnull(ht, tfp_a))
+				sum += *((int32_t*)vh_ht_get(ht, tfp_a));
+		}
+	}
+
+	vh_stopwatch_end(&watch);
+	assert(sum == expected);
+	printf("\n\tPAX layout thru vh_htp:\t\t%'ld ms", vh_stopwatch_ms(&watch));
+
+	vh_stopwatch_start(&watch);
+
+	for (j = 0; j < BUFFMGR_BENCH_LOOPS; j++)
+		sum = buffmgr_pax_colsum(hts_pax, BUFFMGR_BENCH_TUPS, &tfp_a->heap);
+
+	vh_stopwatch_end(&watch);
+	assert(sum == expected);
+	printf("\n\tPAX layout minipage scan:\t%'ld ms", vh_stopwatch_ms(&watch));
+
+	/*
+	 * Freed slots show up as null in the minipage bitmaps.
+	 */
+	ht = hts_pax[10];
+	hp = (HeapPage)vh_ht_pax_page(ht);
+	j = vh_HTP_ITEMNO(htps_pax[10]);
+
+	vh_htp_free(htps_pax[10]);
+	htps_pax[10] = 0;
+	hts_pax[10] = hts_pax[9];
+
+	vh_hp_pax_column(hp, &tfp_a->heap, &nbm);
+	assert(vh_ht_nbm_isnull(nbm, j));
+	assert(buffmgr_pax_colsum(hts_pax, BUFFMGR_BENCH_TUPS, &tfp_a->heap) == 
+		   expected - 10);
+
+	/*
+	 * A mutable copy is formed on a PAX page as well and leaves the
+	 * immutable values alone.
+	 */
+	ht_m = vh_htp(htps_pax[5]);
+	assert(ht_m != hts_pax[5]);
+	assert(vh_ht_flags(ht_m) & VH_HT_FLAG_PAX);
+	assert(vh_ht_flags(ht_m) & VH_HT_FLAG_MUTABLE);
+	assert(*((int32_t*)vh_ht_get(ht_m, tfp_a)) == 5);
+	assert(*((int32_t*)vh_ht_get(ht_m, tfp_b)) == -5);
+
+	*((int32_t*)vh_ht_get(ht_m, tfp_a)) = 500;
+	assert(*((int32_t*)vh_ht_get(hts_pax[5], tfp_a)) == 5);
+
+	for (i = 0; i < BUFFMGR_BENCH_TUPS; i++)
+	{
+		vh_htp_free(htps_row[i]);
+
+		if (htps_pax[i])
+			vh_htp_free(htps_pax[i]);
+	}
+
+	htp = vh_hb_allocht(hb, htd_row, &ht);
+	assert(!(vh_ht_flags(ht) & VH_HT_FLAG_PAX));
+	vh_htp_free(htp);
+
+	vhfree(hts_pax);
+	vhfree(hts_row);
+	vhfree(htps_pax);
+	vhfree(htps_row);
+}
+
+/*
+ * vh_htp_read hands back the immutable copy until someone asks for the
+ * mutable one and the mutable copy after that, without ever forming one.
+ * Edits made to the mutable copy since the last vh_htp must be visible
+ * through vh_htp_read, including the field no longer being null.
+ */
+static void
+buffmgr_forread(void)
+{
+	HeapBuffer hb = vh_hb(ctx_catalog->hbno_general);
+	HeapTupleDef htd = &vh_td_tdv_lead(td_buffmgr)->heap;
+	HeapTuplePtr htp;
+	HeapTuple ht, ht_m;
+
+	htp = vh_hb_allocht(hb, htd, &ht);
+	assert(htp);
+	*((int32_t*)vh_ht_get(ht, tf_buffmgr)) = 1;
+
+	assert(vh_htp_read(htp) == ht);
+	assert(!ht->tupcpy);
+
+	ht_m = vh_htp(htp);
+	assert(ht_m != ht && ht->tupcpy);
+	assert(vh_htf_isnull(ht_m, tf_buffmgr));
+	*((int32_t*)vh_ht_get(ht_m, tf_buffmgr)) = 2;
+
+	assert(vh_htp_read(htp) == ht_m);
+	assert(!vh_htf_isnull(ht_m, tf_buffmgr));
+	assert(vh_htf_ischanged(ht_m, tf_buffmgr));
+	assert(*((int32_t*)vh_ht_get(ht_m, tf_buffmgr)) == 2);
+	assert(vh_htp_read(ht->tupcpy) == ht_m);
+	assert(*((int32_t*)vh_ht_get(vh_htp_immutable(htp), tf_buffmgr)) == 1);
+
+	vh_htp_free(htp);
+}
+
+/*
+ * Sums |hf| by walking each PAX page's minipage, the pages are found from
+ * the first tuple we see on them.
+ */
+static int64_t
+buffmgr_pax_colsum(HeapTuple *hts, uint32_t n, HeapField hf)
+{
+	HeapPage hp, hp_last = 0;
+	unsigned char *nbm;
+	int32_t *col;
+	int64_t sum = 0;
+	uint32_t i, j;
+
+	for (i = 0; i < n; i++)
+	{
+		hp = (HeapPage)vh_ht_pax_page(hts[i]);
+
+		if (hp == hp_last)
+			continue;
+
+		hp_last = hp;
+		col = vh_hp_pax_column(hp, hf, &nbm);
+
+		for (j = 0; j < hp->n_items; j++)
+			if (!vh_ht_nbm_isnull(nbm, j))
+				sum += col[j];
+	}
+
+	return sum;
+}
+
+/*
+ * Fills a HeapBuffer in a shared MemoryContext and has a forked process map
+ * it and read every tuple back.  The child is forked before the segment
+ * exists, so it has to attach the same way an independent worker would.
+ */
+static void
+buffmgr_shared(void)
+{
+	struct MemorySuperBlockId ident = { };
+	MemoryContext shared;
+	HeapBufferNo hbno;
+	HeapBuffer hb;
+	HeapTupleDef htd = &vh_td_tdv_lead(td_buffmgr)->heap;
+	HeapTuplePtr *htps;
+	HeapTuple ht;
+	void *p, *q;
+	int32_t fds[2], status, i;
+	ssize_t sz;
+	pid_t pid, pid_w;
+
+	snprintf(ident.id, VH_MCTX_SUPERBLOCK_ID_SZ, "bmtest%d", (int)getpid());
+
+	printf("\nSharing a HeapBuffer of %'d tuples with a forked process...",
+		   BUFFMGR_SHARED_TUPS);
+
+	status = pipe(fds);
+	assert(status == 0);
+	pid = fork();
+	assert(pid >= 0);
+
+	if (pid == 0)
+	{
+		close(fds[1]);
+		_exit(buffmgr_shared_child(fds[0], ident) ? 0 : 1);
+	}
+
+	close(fds[0]);
+
+	shared = vh_mctx_shared_create(ident, 0, 16 * 1024 * 1024, false,
+								   "buffmgr shared context");
+	assert(shared);
+	assert(vh_mctx_shared_samebase(shared));
+
+	/*
+	 * Freed chunks go back on their size class and are handed right back.
+	 */
+	p = vhmalloc_ctx(shared, 100);
+	assert(vh_mctx_from_pointer(p) == shared);
+	vhfree(p);
+	q = vhmalloc_ctx(shared, 110);
+	assert(p == q);
+	q = vhrealloc(q, 2000);
+	assert(vh_mctx_from_pointer(q) == shared);
+	vhfree(q);
+
+	hbno = vh_hb_open_shared(shared);
+	assert(hbno);
+	hb = vh_hb(hbno);
+	assert(hb && hb->shared);
+	assert(vh_mctx_shared_root(shared) == hb);
+
+	htps = vhmalloc_ctx(shared, sizeof(HeapTuplePtr) * BUFFMGR_SHARED_TUPS);
+
+	for (i = 0; i < BUFFMGR_SHARED_TUPS; i++)
+	{
+		htps[i] = vh_hb_allocht(hb, htd, &ht);
+		assert(htps[i]);
+		*((int32_t*)vh_ht_get(ht, tf_buffmgr)) = i;
+	}
+
+	/*
+	 * Hand the child the HeapTuplePtr array, it's at the same address in
+	 * the child's mapping.
+	 */
+	sz = write(fds[1], &htps, sizeof(htps));
+	assert(sz == sizeof(htps));
+	close(fds[1]);
+
+	pid_w = waitpid(pid, &status, 0);
+	assert(pid_w == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	vhfree(htps);
+	vh_hb_close(hbno);
+	vh_mctx_shared_unlink(ident);
+	vh_mctx_destroy(shared);
+
+	printf("complete");
+}
+
+static bool
+buffmgr_shared_child(int32_t fd, struct MemorySuperBlockId ident)
+{
+	MemoryContext shared;
+	HeapBufferNo hbno;
+	HeapTuplePtr *htps;
+	HeapTuple ht;
+	int32_t i;
+
+	if (read(fd, &htps, sizeof(htps)) != sizeof(htps))
+		return false;
+
+	close(fd);
+
+	if (!(shared = vh_mctx_shared_attach(ident)) ||
+		!vh_mctx_shared_samebase(shared))
+		return false;
+
+	if (!(hbno = vh_hb_attach_shared(shared)))
+		return false;
+
+	for (i = 0; i < BUFFMGR_SHARED_TUPS; i++)
+	{
+		if (vh_HTP_BUFF(htps[i]) != hbno)
+			return false;
+
+		ht = vh_htp_immutable(htps[i]);
+
+		if (!ht || *((int32_t*)vh_ht_get(ht, tf_buffmgr)) != i)
+			return false;
+	}
+
+	vh_hb_close(hbno);
+	vh_mctx_destroy(shared);
+
+	return true;
+}
@@ -17,6 +17,10 @@ HashTable htbl_map = 0;
 
 static void set_int32(void);
 static void set_int64(void);
+static void map_str(void);
+static void map_bin(void);
+static void map_growth(void);
+static void bench_int64(void);
 
 void test_hashtable(void)
 {
@@ -28,6 +32,10 @@ void test_hashtable(void)
 
 	set_int32();
 	set_int64();	
+	map_str();
+	map_bin();
+	map_growth();
+	bench_int64();
 	
 	printf("\n#######################################################################"
 		   "\nEXITING HASH TABLE TESTS"
@@ -44,7 +52,7 @@ set_int32(void)
 	static const int32_t loop_size = 10000;
 	HashTableOpts opts;
 	void *get;
-	int32_t put_ret, i, j, r, *keys;
+	int32_t put_ret, i, j, r, k, *keys;
 	bool quit, found;
 	struct vh_stopwatch watch;
 
@@ -59,30 +67,32 @@ set_int32(void)
 							  VH_HTBL_OPT_COMPFUNC |
 							  VH_HTBL_OPT_MAP);
 
-	get = vh_htbl_get(htbl_set, (void*)582124);
+	k = 582124;
+	get = vh_htbl_get(htbl_set, &k);
 	assert(!get);
 
-	get = vh_htbl_get(htbl_set, (void*)0);
+	r = 0;
+	get = vh_htbl_get(htbl_set, &r);
 	assert(!get);
 
-	vh_htbl_put(htbl_set, (void*)582124, &put_ret);
+	vh_htbl_put(htbl_set, &k, &put_ret);
 	assert(put_ret == 1);
 
-	vh_htbl_put(htbl_set, (void*)582124, &put_ret);
+	vh_htbl_put(htbl_set, &k, &put_ret);
 	assert(put_ret == 0);
 
-	get = vh_htbl_get(htbl_set, (void*)582124);
+	get = vh_htbl_get(htbl_set, &k);
 	assert(get);
 
-	vh_htbl_del(htbl_set, (void*)582124);
+	vh_htbl_del(htbl_set, &k);
 	
-	get = vh_htbl_get(htbl_set, (void*)582124);
+	get = vh_htbl_get(htbl_set, &k);
 	assert(!get);
 
-	vh_htbl_put(htbl_set, (void*)582124, &put_ret);
+	vh_htbl_put(htbl_set, &k, &put_ret);
 	assert(put_ret == 2);
 
-	get = vh_htbl_get(htbl_set, (void*)582124);
+	get = vh_htbl_get(htbl_set, &k);
 	assert(get);
 
 	keys = vhmalloc(sizeof(int32_t) * loop_size);
@@ -91,7 +101,7 @@ set_int32(void)
 		keys[i] = rand();
 
 		quit = false;
-		vh_htbl_put(htbl_set, (void*)((uintptr_t)keys[i]), &put_ret);
+		vh_htbl_put(htbl_set, &keys[i], &put_ret);
 
 		switch (put_ret)
 		{
@@ -158,14 +168,14 @@ set_int32(void)
 			break;
 		}
 
-		get = vh_htbl_get(htbl_set, (void*)((uintptr_t)keys[i]));
+		get = vh_htbl_get(htbl_set, &keys[i]);
 		assert(get);
 
 		if (keys[i] % 3 == 0)
 		{
-			vh_htbl_del(htbl_set, (void*)((uintptr_t)keys[i]));
+			vh_htbl_del(htbl_set, &keys[i]);
 
-			get = vh_htbl_get(htbl_set, (void*)((uintptr_t)keys[i]));
+			get = vh_htbl_get(htbl_set, &keys[i]);
 			assert(!get);
 		}
 	}
@@ -182,7 +192,7 @@ set_int32(void)
 	{
 		r = rand();
 
-		get = vh_htbl_get(htbl_set, (void*)((uintptr_t)r));
+		get = vh_htbl_get(htbl_set, &r);
 
 		if (get)
 		{
@@ -212,7 +222,7 @@ set_int32(void)
 	for (i = 0; i < 1000000; i++)
 	{
 		r = rand();
-		get = vh_htbl_get(htbl_set, (void*)((uintptr_t)r));
+		get = vh_htbl_get(htbl_set, &r);
 	}
 	vh_stopwatch_end(&watch);
 	printf("complete in %'ld ms", vh_stopwatch_ms(&watch));
@@ -230,8 +240,8 @@ set_int64(void)
 	static const int32_t loop_size = 10000;
 	HashTableOpts opts;
 	void *get;
-	int32_t put_ret, i, j, r;
-	int64_t *keys;
+	int32_t put_ret, i, j;
+	int64_t r, *keys;
 	bool quit, found;
 	struct vh_stopwatch watch;
 
@@ -253,7 +263,7 @@ set_int64(void)
 		keys[i] = rand() + rand();
 
 		quit = false;
-		vh_htbl_put(htbl_set, (void*)keys[i], &put_ret);
+		vh_htbl_put(htbl_set, &keys[i], &put_ret);
 
 		switch (put_ret)
 		{
@@ -320,14 +330,14 @@ set_int64(void)
 			break;
 		}
 
-		get = vh_htbl_get(htbl_set, (void*)keys[i]);
+		get = vh_htbl_get(htbl_set, &keys[i]);
 		assert(get);
 
 		if (keys[i] % 3 == 0)
 		{
-			vh_htbl_del(htbl_set, (void*)keys[i]);
+			vh_htbl_del(htbl_set, &keys[i]);
 
-			get = vh_htbl_get(htbl_set, (void*)keys[i]);
+			get = vh_htbl_get(htbl_set, &keys[i]);
 			assert(!get);
 		}
 	}
@@ -344,7 +354,7 @@ set_int64(void)
 	{
 		r = rand();
 
-		get = vh_htbl_get(htbl_set, (void*)((uintptr_t)r));
+		get = vh_htbl_get(htbl_set, &r);
 
 		if (get)
 		{
@@ -374,7 +384,7 @@ set_int64(void)
 	for (i = 0; i < 1000000; i++)
 	{
 		r = rand();
-		get = vh_htbl_get(htbl_set, (void*)((uintptr_t)r));
+		get = vh_htbl_get(htbl_set, &r);
 	}
 	vh_stopwatch_end(&watch);
 	printf("complete in %'ld ms", vh_stopwatch_ms(&watch));
@@ -383,3 +393,277 @@ set_int64(void)
 	printf("\nHashTable htbl_set with 8 byte integer key tested succesfully!");
 }
 
+
+/*
+ * Test a map with a string key, the table stores the char* itself
+ */
+static void
+map_str(void)
+{
+	static const int32_t loop_size = 5000;
+	HashTableOpts opts;
+	char **names, buf[32];
+	int32_t put_ret, i, *value;
+
+	opts.key_sz = sizeof(const char*);
+	opts.value_sz = sizeof(int32_t);
+	opts.func_hash = vh_htbl_hash_str;
+	opts.func_compare = vh_htbl_comp_str;
+	opts.is_map = true;
+
+	htbl_map = vh_htbl_create(&opts,
+							  VH_HTBL_OPT_KEYSZ |
+							  VH_HTBL_OPT_VALUESZ |
+							  VH_HTBL_OPT_HASHFUNC |
+							  VH_HTBL_OPT_COMPFUNC |
+							  VH_HTBL_OPT_MAP);
+
+	names = vhmalloc(sizeof(char*) * loop_size);
+
+	for (i = 0; i < loop_size; i++)
+	{
+		snprintf(buf, sizeof(buf), "column_%d", i);
+		names[i] = vh_cstrdup(buf);
+
+		value = vh_htbl_put(htbl_map, names[i], &put_ret);
+		assert(put_ret == 1);
+		*value = i;
+	}
+
+	assert(vh_htbl_count(htbl_map) == loop_size);
+
+	/*
+	 * Look up with a different buffer so we know the strings are compared
+	 * rather than the pointers.
+	 */
+	for (i = 0; i < loop_size; i++)
+	{
+		snprintf(buf, sizeof(buf), "column_%d", i);
+		value = vh_htbl_get(htbl_map, buf);
+		assert(value);
+		assert(*value == i);
+	}
+
+	assert(!vh_htbl_get(htbl_map, "column_"));
+	assert(!vh_htbl_get(htbl_map, ""));
+
+	for (i = 0; i < loop_size; i += 2)
+		vh_htbl_del(htbl_map, names[i]);
+
+	assert(vh_htbl_count(htbl_map) == loop_size / 2);
+
+	for (i = 0; i < loop_size; i++)
+	{
+		value = vh_htbl_get(htbl_map, names[i]);
+		assert((i % 2) ? value && *value == i : !value);
+	}
+
+	value = vh_htbl_put(htbl_map, names[0], &put_ret);
+	assert(put_ret == 1 || put_ret == 2);
+	*value = 0;
+
+	value = vh_htbl_get(htbl_map, names[0]);
+	assert(value && *value == 0);
+
+	vh_htbl_destroy(htbl_map);
+	htbl_map = 0;
+
+	for (i = 0; i < loop_size; i++)
+		vhfree(names[i]);
+
+	vhfree(names);
+
+	printf("\nHashTable htbl_map with string key tested succesfully!");
+}
+
+/*
+ * Test a map with a 6 byte binary key and the binary hash and compare
+ * functions.
+ */
+static void
+map_bin(void)
+{
+	static const int32_t loop_size = 5000;
+	HashTableOpts opts;
+	unsigned char key[6];
+	int32_t put_ret, i;
+	int64_t *value;
+
+	opts.key_sz = sizeof(key);
+	opts.value_sz = sizeof(int64_t);
+	opts.func_hash = vh_htbl_hash_bin;
+	opts.func_compare = vh_htbl_comp_bin;
+	opts.is_map = true;
+
+	htbl_map = vh_htbl_create(&opts,
+							  VH_HTBL_OPT_KEYSZ |
+							  VH_HTBL_OPT_VALUESZ |
+							  VH_HTBL_OPT_HASHFUNC |
+							  VH_HTBL_OPT_COMPFUNC |
+							  VH_HTBL_OPT_MAP);
+
+	memset(key, 0, sizeof(key));
+
+	for (i = 0; i < loop_size; i++)
+	{
+		memcpy(key + 2, &i, sizeof(i));
+		value = vh_htbl_put(htbl_map, key, &put_ret);
+		assert(put_ret == 1);
+		*value = (int64_t)i * 3;
+	}
+
+	for (i = 0; i < loop_size; i++)
+	{
+		memcpy(key + 2, &i, sizeof(i));
+		value = vh_htbl_get(htbl_map, key);
+		assert(value && *value == (int64_t)i * 3);
+
+		vh_htbl_put(htbl_map, key, &put_ret);
+		assert(put_ret == 0);
+	}
+
+	key[0] = 1;
+	assert(!vh_htbl_get(htbl_map, key));
+
+	vh_htbl_destroy(htbl_map);
+	htbl_map = 0;
+
+	printf("\nHashTable htbl_map with binary key tested succesfully!");
+}
+
+/*
+ * Grows a map from empty while deleting and reinserting, then checks that
+ * iteration visits every live entry exactly once.
+ */
+static void
+map_growth(void)
+{
+	static const int32_t loop_size = 100000;
+	HashTableOpts opts;
+	int64_t k, *key, *value;
+	int32_t put_ret, i, idx, seen;
+	bool *visited;
+
+	opts.key_sz = sizeof(int64_t);
+	opts.value_sz = sizeof(int64_t);
+	opts.func_hash = vh_htbl_hash_int64;
+	opts.func_compare = vh_htbl_comp_int64;
+	opts.is_map = true;
+
+	htbl_map = vh_htbl_create(&opts,
+							  VH_HTBL_OPT_KEYSZ |
+							  VH_HTBL_OPT_VALUESZ |
+							  VH_HTBL_OPT_HASHFUNC |
+							  VH_HTBL_OPT_COMPFUNC |
+							  VH_HTBL_OPT_MAP);
+
+	for (i = 0; i < loop_size; i++)
+	{
+		k = (int64_t)i << 20;
+		value = vh_htbl_put(htbl_map, &k, &put_ret);
+		assert(put_ret == 1 || put_ret == 2);
+		*value = i;
+
+		if (i % 4 == 0)
+		{
+			vh_htbl_del(htbl_map, &k);
+			assert(!vh_htbl_get(htbl_map, &k));
+
+			value = vh_htbl_put(htbl_map, &k, &put_ret);
+			assert(put_ret == 2);
+			*value = i;
+		}
+
+		if (i % 4 == 1)
+			vh_htbl_del(htbl_map, &k);
+	}
+
+	assert(vh_htbl_count(htbl_map) == loop_size - loop_size / 4);
+
+	visited = vhmalloc(sizeof(bool) * loop_size);
+	memset(visited, 0, sizeof(bool) * loop_size);
+
+	idx = 0;
+	seen = 0;
+
+	while ((idx = vh_htbl_iter(htbl_map, idx, &key, &value)) >= 0)
+	{
+		assert(*key == (int64_t)*value << 20);
+		assert(*value % 4 != 1);
+		assert(!visited[*value]);
+
+		visited[*value] = true;
+		seen++;
+		idx++;
+	}
+
+	assert(seen == vh_htbl_count(htbl_map));
+
+	vh_htbl_clear(htbl_map);
+	assert(vh_htbl_count(htbl_map) == 0);
+
+	k = 0;
+	assert(!vh_htbl_get(htbl_map, &k));
+	assert(vh_htbl_iter(htbl_map, 0, &key, &value) == -1);
+
+	vhfree(visited);
+	vh_htbl_destroy(htbl_map);
+	htbl_map = 0;
+
+	printf("\nHashTable htbl_map growth and iteration tested succesfully!");
+}
+
+/*
+ * Measures put and get with 8 byte keys at a 50% hit rate.
+ */
+static void
+bench_int64(void)
+{
+	static const int32_t loop_size = 1000000;
+	HashTableOpts opts;
+	struct vh_stopwatch watch;
+	int64_t k, *value;
+	int32_t put_ret, i, hits = 0;
+
+	opts.key_sz = sizeof(int64_t);
+	opts.value_sz = sizeof(int64_t);
+	opts.func_hash = vh_htbl_hash_int64;
+	opts.func_compare = vh_htbl_comp_int64;
+	opts.is_map = true;
+
+	htbl_map = vh_htbl_create(&opts,
+							  VH_HTBL_OPT_KEYSZ |
+							  VH_HTBL_OPT_VALUESZ |
+							  VH_HTBL_OPT_HASHFUNC |
+							  VH_HTBL_OPT_COMPFUNC |
+							  VH_HTBL_OPT_MAP);
+
+	printf("\nMeasuring vh_htbl_put performance with int64 key for %'d entries...", loop_size);
+	vh_stopwatch_start(&watch);
+	for (i = 0; i < loop_size; i++)
+	{
+		k = (int64_t)i * 2;
+		value = vh_htbl_put(htbl_map, &k, &put_ret);
+		*value = i;
+	}
+	vh_stopwatch_end(&watch);
+	printf("complete in %'ld ms", vh_stopwatch_ms(&watch));
+
+	printf("\nMeasuring vh_htbl_get performance with int64 key for %'d lookups...", loop_size);
+	vh_stopwatch_start(&watch);
+	for (i = 0; i < loop_size; i++)
+	{
+		k = i;
+		value = vh_htbl_get(htbl_map, &k);
+
+		if (value)
+			hits++;
+	}
+	vh_stopwatch_end(&watch);
+	printf("complete in %'ld ms", vh_stopwatch_ms(&watch));
+
+	assert(hits == loop_size / 2);
+
+	vh_htbl_destroy(htbl_map);
+	htbl_map = 0;
+}
@@ -13,6 +13,7 @@
 #include <unistd.h>
 
 #include "vh.h"
+#include "io/utils/stopwatch.h"
 
 #include "test.h"
 
@@ -21,6 +22,11 @@
 CatalogContext ctx_catalog = 0;
 
 static void test_memorycontext(void);
+static void test_memoryarena(void);
+static void test_memoryarena_bench(void);
+static int64_t memoryarena_bench_round(MemoryContext mctx);
+static void test_memoryslab(void);
+static int64_t memoryslab_bench(MemoryContext mctx);
 static void sigfault_handler(int);
 
 
@@ -32,9 +38,10 @@ int main(int argc, char** argv)
 
 
 	test_memorycontext();
+	test_buffmgr_entry();
 	test_typevar_entry();
 	test_typevaracm_entry();
-	//test_hashtable();
+	test_hashtable();
 	test_types();
 	test_operators();
 	test_new_json_entry();
@@ -73,6 +80,236 @@ static void test_memorycontext(void)
 
 	vh_mctx_switch(old);
 	vh_mctx_destroy(mctx);	
+
+	test_memoryarena();
+	test_memoryarena_bench();
+	test_memoryslab();
+}
+
+#define MEMORYARENA_ROUND_ALLOCS		10000
+#define MEMORYARENA_ROUNDS				200
+
+static void test_memoryarena(void)
+{
+	MemoryContext arena, child;
+	char *first, *ptr, *ptr2;
+
+	arena = vh_MemoryArenaCreate(vh_mctx_current(), 1024, "test arena");
+	assert(arena->tag == MT_Arena);
+
+	first = vh_mctx_alloc(arena, 64);
+	memset(first, 'a', 64);
+
+	/*
+	 * The last chunk grows in place and hands its space back when freed.
+	 */
+	ptr = vh_mctx_alloc(arena, 32);
+	ptr2 = vhrealloc(ptr, 128);
+	assert(ptr == ptr2);
+	vhfree(ptr2);
+	ptr = vh_mctx_alloc(arena, 16);
+	assert(ptr == ptr2);
+
+	/*
+	 * Spill well past the first block, then make sure a large request still
+	 * lands in a block of its own.
+	 */
+	while (arena->stats.blocks < 4)
+		vh_mctx_alloc(arena, 100);
+
+	ptr = vh_mctx_alloc(arena, 64 * 1024);
+	memset(ptr, 'b', 64 * 1024);
+	assert(vh_mctx_from_pointer(ptr) == arena);
+
+	ptr2 = vhrealloc(first, 256);
+	assert(ptr2 != first && ptr2[63] == 'a');
+
+	child = vh_MemoryPoolCreate(arena, 1024, "test arena child");
+	vh_mctx_alloc(child, 100);
+
+	/*
+	 * Reset drops the children and every block but the first, so the first
+	 * allocation after a reset is where we started.
+	 */
+	vh_mctx_reset(arena);
+	assert(!arena->firstChild);
+	assert(arena->stats.blocks == 1);
+	assert(arena->stats.space == 0);
+
+	ptr = vh_mctx_alloc(arena, 64);
+	assert(ptr == first);
+
+	vh_mctx_destroy(arena);
+}
+
+/*
+ * Times the per query pattern: allocate a round of small chunks, throw them
+ * all away and go again.  The Pool is destroyed and recreated every round,
+ * just like the executor used to, while the arena is reset.
+ */
+static void test_memoryarena_bench(void)
+{
+	struct vh_stopwatch watch;
+	MemoryContext mctx;
+	int64_t allocs = (int64_t)MEMORYARENA_ROUND_ALLOCS * MEMORYARENA_ROUNDS;
+	int64_t pool_ns = 0, arena_ns = 0, sum = 0;
+	int32_t i;
+
+	vh_stopwatch_start(&watch);
+
+	for (i = 0; i < MEMORYARENA_ROUNDS; i++)
+	{
+		mctx = vh_MemoryPoolCreate(vh_mctx_current(), 8192, "bench pool");
+		sum += memoryarena_bench_round(mctx);
+		vh_mctx_destroy(mctx);
+	}
+
+	vh_stopwatch_end(&watch);
+	pool_ns = vh_stopwatch_ns(&watch);
+
+	mctx = vh_MemoryArenaCreate(vh_mctx_current(), 8192, "bench arena");
+	vh_stopwatch_start(&watch);
+
+	for (i = 0; i < MEMORYARENA_ROUNDS; i++)
+	{
+		sum -= memoryarena_bench_round(mctx);
+		vh_mctx_reset(mctx);
+	}
+
+	vh_stopwatch_end(&watch);
+	arena_ns = vh_stopwatch_ns(&watch);
+	vh_mctx_destroy(mctx);
+
+	assert(sum == 0);
+
+	printf("\nMemory Pool: %ld allocations per second", 
+		   allocs * 1000000000l / (pool_ns ? pool_ns : 1));
+	printf("\nMemory Arena: %ld allocations per second\n",
+		   allocs * 1000000000l / (arena_ns ? arena_ns : 1));
+}
+
+static int64_t memoryarena_bench_round(MemoryContext mctx)
+{
+	int64_t sum = 0;
+	int32_t i, *ptr;
+
+	for (i = 0; i < MEMORYARENA_ROUND_ALLOCS; i++)
+	{
+		ptr = vh_mctx_alloc(mctx, 16 + (i % 16) * 16);
+		*ptr = i;
+		sum += *ptr;
+	}
+
+	return sum;
+}
+
+#define MEMORYSLAB_LIVE				10000
+#define MEMORYSLAB_OPS				200000
+
+static void test_memoryslab(void)
+{
+	struct vh_stopwatch watch;
+	MemoryContext slab, pool;
+	char *ptrs[300], *large, *ptr;
+	int64_t pool_ns, slab_ns;
+	int32_t i;
+
+	slab = vh_MemorySlabCreate(vh_mctx_current(), 0, "test slab");
+	assert(slab->tag == MT_Slab);
+
+	/*
+	 * Enough 200 byte chunks to spill into a few slabs, then free them all
+	 * and make sure only a single slab is left for the class.
+	 */
+	for (i = 0; i < 300; i++)
+	{
+		ptrs[i] = vh_mctx_alloc(slab, 200);
+		memset(ptrs[i], i, 200);
+	}
+
+	assert(slab->stats.blocks > 1);
+
+	for (i = 0; i < 300; i++)
+	{
+		assert(ptrs[i][199] == (char)i);
+		assert(vh_mctx_from_pointer(ptrs[i]) == slab);
+		vhfree(ptrs[i]);
+	}
+
+	assert(slab->stats.blocks == 1);
+	assert(slab->stats.space == 0);
+
+	/*
+	 * Freed chunks are reused before anything else in the class.
+	 */
+	ptr = vh_mctx_alloc(slab, 24);
+	vhfree(ptr);
+	assert(vh_mctx_alloc(slab, 20) == ptr);
+
+	large = vh_mctx_alloc(slab, VH_SLAB_MAXCHUNK * 4);
+	memset(large, 'x', VH_SLAB_MAXCHUNK * 4);
+	large = vhrealloc(large, VH_SLAB_MAXCHUNK * 8);
+	assert(large[VH_SLAB_MAXCHUNK * 4 - 1] == 'x');
+
+	ptr = vhrealloc(ptr, 100);
+	assert(vh_mctx_from_pointer(ptr) == slab);
+	vhfree(large);
+
+	vh_mctx_reset(slab);
+	assert(slab->stats.blocks == 0 && slab->stats.chunks == 0);
+	vh_mctx_destroy(slab);
+
+	/*
+	 * Churn a live set of small chunks in three sizes the way accumulators
+	 * do and compare with the Pool.
+	 */
+	pool = vh_MemoryPoolCreate(vh_mctx_current(), 8192, "bench pool");
+	vh_stopwatch_start(&watch);
+	memoryslab_bench(pool);
+	vh_stopwatch_end(&watch);
+	pool_ns = vh_stopwatch_ns(&watch);
+	vh_mctx_destroy(pool);
+
+	slab = vh_MemorySlabCreate(vh_mctx_current(), 0, "bench slab");
+	vh_stopwatch_start(&watch);
+	memoryslab_bench(slab);
+	vh_stopwatch_end(&watch);
+	slab_ns = vh_stopwatch_ns(&watch);
+	vh_mctx_destroy(slab);
+
+	printf("\nMemory Pool: %ld alloc/free pairs per second",
+		   (int64_t)MEMORYSLAB_OPS * 1000000000l / (pool_ns ? pool_ns : 1));
+	printf("\nMemory Slab: %ld alloc/free pairs per second\n",
+		   (int64_t)MEMORYSLAB_OPS * 1000000000l / (slab_ns ? slab_ns : 1));
+}
+
+static int64_t memoryslab_bench(MemoryContext mctx)
+{
+	static const size_t sizes[] = { 24, 40, 72 };
+	void **live;
+	uint32_t seed = 7, slot;
+	int64_t i;
+
+	live = vhmalloc(sizeof(void*) * MEMORYSLAB_LIVE);
+
+	for (i = 0; i < MEMORYSLAB_LIVE; i++)
+		live[i] = vh_mctx_alloc(mctx, sizes[i % 3]);
+
+	for (i = 0; i < MEMORYSLAB_OPS; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		slot = (seed >> 8) % MEMORYSLAB_LIVE;
+
+		vhfree(live[slot]);
+		live[slot] = vh_mctx_alloc(mctx, sizes[(seed >> 4) % 3]);
+	}
+
+	for (i = 0; i < MEMORYSLAB_LIVE; i++)
+		vhfree(live[i]);
+
+	vhfree(live);
+
+	return i;
 }
 
 static void sigfault_handler(int sig)
@@ -6,14 +6,19 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "vh.h"
+#include "io/buffer/HeapBuffer.h"
+#include "io/catalog/HeapTuple.h"
 #include "io/catalog/TableDef.h"
 #include "io/catalog/TableField.h"
 #include "io/catalog/Type.h"
 #include "io/catalog/TypeVar.h"
 #include "io/catalog/types/njson.h"
 #include "io/catalog/types/njson_parse.h"
+#include "io/catalog/types/njson_plan.h"
+#include "io/utils/stopwatch.h"
 #include "test.h"
 
 static Type tys_int32[] = { &vh_type_int32, 0 };
@@ -30,8 +35,13 @@ static void jobj(void);
 static void jarr(void);
 
 static void jparse(void);
+static void jparse_sax(void);
+static void jparse_bench(void);
 
 static void jht(void);
+static void jht_strp(void);
+static void jht_plan(void);
+static void jht_plan_bench(void);
 
 void
 test_new_json_entry(void)
@@ -46,8 +56,13 @@ test_new_json_entry(void)
 	jarr();
 
 	jparse();
+	jparse_sax();
+	jparse_bench();
 
 	jht();
+	jht_strp();
+	jht_plan();
+	jht_plan_bench();
 }
 
 static void jval_i32(void)
@@ -401,3 +416,414 @@ jht(void)
 }
 
 
+
+/*
+ * Counts the tokens the SAX parser hands us and keeps the last scalar of each
+ * kind, so we can check values survive at full precision.
+ */
+struct jsax_counts
+{
+	int32_t objects, arrays, keys, strings, ints, dbls, bools, nulls;
+	int64_t last_i;
+	double last_f;
+	char last_str[64];
+};
+
+static bool
+jsax_object_start(void *user)
+{
+	((struct jsax_counts*)user)->objects++;
+	return true;
+}
+
+static bool
+jsax_array_start(void *user)
+{
+	((struct jsax_counts*)user)->arrays++;
+	return true;
+}
+
+static bool
+jsax_key(void *user, const char *key, size_t len)
+{
+	((struct jsax_counts*)user)->keys++;
+	return true;
+}
+
+static bool
+jsax_string(void *user, const char *str, size_t len)
+{
+	struct jsax_counts *c = user;
+
+	c->strings++;
+
+	if (len < sizeof(c->last_str))
+	{
+		memcpy(c->last_str, str, len);
+		c->last_str[len] = '\0';
+	}
+
+	return true;
+}
+
+static bool
+jsax_number_i(void *user, int64_t value, const char *text, size_t len)
+{
+	struct jsax_counts *c = user;
+
+	c->ints++;
+	c->last_i = value;
+
+	return true;
+}
+
+static bool
+jsax_number_f(void *user, double value, const char *text, size_t len)
+{
+	struct jsax_counts *c = user;
+
+	c->dbls++;
+	c->last_f = value;
+
+	return true;
+}
+
+static bool
+jsax_boolean(void *user, bool value)
+{
+	((struct jsax_counts*)user)->bools++;
+	return true;
+}
+
+static bool
+jsax_null(void *user)
+{
+	((struct jsax_counts*)user)->nulls++;
+	return true;
+}
+
+static const JsonSaxCallbacks jsax_callbacks = {
+	.object_start = jsax_object_start,
+	.array_start = jsax_array_start,
+	.key = jsax_key,
+	.string = jsax_string,
+	.number_i = jsax_number_i,
+	.number_f = jsax_number_f,
+	.boolean = jsax_boolean,
+	.null = jsax_null
+};
+
+static int32_t
+jsax_run(const char *json, struct jsax_counts *c)
+{
+	memset(c, 0, sizeof(struct jsax_counts));
+
+	return vh_json_sax_parse(json, strlen(json), &jsax_callbacks, c);
+}
+
+static void
+jparse_sax(void)
+{
+	static const char *invalid[] = { "[1,]", "{\"a\":1,}", "[01]", "[1 2]",
+									 "\"abc", "tru", "", "{\"a\" 1}", "[1.]",
+									 "\"\\x\"", "\"\\ud800\"", "{} x" };
+	struct jsax_counts c;
+	char deep[VH_JSON_SAX_MAXDEPTH + 2];
+	String stringify;
+	Json root;
+	int32_t i;
+
+	assert(jsax_run("{ \"a\": [1, 2.5, \"x\", true, null], \"b\": {} }", &c) == 0);
+	assert(c.objects == 2 && c.arrays == 1 && c.keys == 2);
+	assert(c.ints == 1 && c.dbls == 1 && c.strings == 1);
+	assert(c.bools == 1 && c.nulls == 1);
+
+	assert(jsax_run("[9223372036854775807]", &c) == 0);
+	assert(c.ints == 1 && c.last_i == INT64_MAX);
+
+	assert(jsax_run("[-9223372036854775808]", &c) == 0);
+	assert(c.ints == 1 && c.last_i == INT64_MIN);
+
+	assert(jsax_run("[9223372036854775808]", &c) == 0);
+	assert(c.dbls == 1 && c.last_f == 9223372036854775808.0);
+
+	assert(jsax_run("[3.141592653589793, 0.1]", &c) == 0);
+	assert(c.dbls == 2 && c.last_f == 0.1);
+
+	assert(jsax_run("[\"tab\\there \\u00e9\\ud83d\\ude00\"]", &c) == 0);
+	assert(strcmp(c.last_str, "tab\there \xc3\xa9\xf0\x9f\x98\x80") == 0);
+
+	for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+		assert(jsax_run(invalid[i], &c) == -1);
+
+	memset(deep, '[', sizeof(deep) - 1);
+	deep[sizeof(deep) - 1] = '\0';
+	assert(jsax_run(deep, &c) == -1);
+
+	/* Only read by assert */
+	(void) c;
+
+	/*
+	 * The tree builder keeps doubles and 64-bit integers now.
+	 */
+	root = vh_json_strp_parser("{ \"big\": 9007199254740993, \"pi\": 3.14159, "
+							   "\"list\": [ { \"n\": null } ] }");
+	assert(vh_json_isa_obj(root));
+	assert(*((int64_t*)vh_jsonv_int64(root, 0, "big")) == 9007199254740993ll);
+	assert(*((double*)vh_jsonv_dbl(root, 0, "pi")) == 3.14159);
+	stringify = vh_json_stringify(root);
+	printf("\nJSON SAX Parse: %s", vh_str_buffer(stringify));
+	vh_str.Destroy(stringify);
+	vh_json_destroy(root);
+
+	assert(!vh_json_strp_parser("{ \"a\": }"));
+}
+
+/*
+ * Compares building a Json tree with a bare SAX pass over the same
+ * multi-megabyte document.
+ */
+static void
+jparse_bench(void)
+{
+	static const int32_t rows = 50000;
+	struct jsax_counts c;
+	struct vh_stopwatch watch;
+	char *json;
+	size_t len = 0, cap = 160 * rows;
+	Json root;
+	int32_t i;
+
+	json = vhmalloc(cap);
+	len += snprintf(json + len, cap - len, "[");
+
+	for (i = 0; i < rows; i++)
+		len += snprintf(json + len, cap - len,
+						"%s{ \"id\": %d, \"name\": \"customer %d\", "
+						"\"balance\": %d.%02d, \"active\": %s }",
+						i ? "," : "",
+						i, i, i * 7, i % 100, i % 2 ? "true" : "false");
+
+	len += snprintf(json + len, cap - len, "]");
+
+	vh_stopwatch_start(&watch);
+	memset(&c, 0, sizeof(c));
+	assert(vh_json_sax_parse(json, len, &jsax_callbacks, &c) == 0);
+	vh_stopwatch_end(&watch);
+	assert(c.objects == rows && c.ints == rows && c.dbls == rows);
+	printf("\nSAX parse of %'lu bytes completed in %'ld ms", len, vh_stopwatch_ms(&watch));
+
+	vh_stopwatch_start(&watch);
+	root = vh_json_strp_parsern(json, len);
+	vh_stopwatch_end(&watch);
+	assert(vh_json_arr_count(root) == rows);
+	printf("\nJson tree parse of %'lu bytes completed in %'ld ms", len, vh_stopwatch_ms(&watch));
+
+	vh_json_destroy(root);
+	vhfree(json);
+}
+
+static void
+jht_strp(void)
+{
+	static Type tys_dbl[] = { &vh_type_dbl, 0 };
+	static const char json_literal[] = "{ \"first_name\":\"Kyle\","
+									   "  \"last_name\":\"Gear\\\"hart\","
+									   "  \"nested\": { \"age\": 1 },"
+									   "  \"age\":29,"
+									   "  \"balance\": 1024.5,"
+									   "  \"unknown\": [1, 2, 3] }";
+	TableDef td;
+	HeapTuplePtr htp;
+	String stringify;
+	Json root;
+	int32_t ret;
+
+	td = vh_td_create(false);
+	vh_td_tf_add(td, tys_string, "first_name");
+	vh_td_tf_add(td, tys_string, "last_name");
+	vh_td_tf_add(td, tys_int32, "age");
+	vh_td_tf_add(td, tys_dbl, "balance");
+
+	ret = vh_json_strp_htp_tdv(vh_td_tdv_lead(td), json_literal,
+							   strlen(json_literal), &htp);
+	assert(ret == 0);
+	assert(htp);
+
+	assert(vh_GetInt32Nm(htp, "age") == 29);
+	assert(*((double*)vh_getptrnm(htp, VH_HT_FLAG_MUTABLE, "balance")) == 1024.5);
+	assert(strcmp(vh_str_buffer(vh_GetStringNm(htp, "last_name")), "Gear\"hart") == 0);
+
+	ret = vh_htp_json(htp, false, &root);
+	assert(ret == 0);
+	stringify = vh_json_stringify(root);
+	printf("\nJSON -> HTP (streaming) -> JSON: %s", vh_str_buffer(stringify));
+	vh_str.Destroy(stringify);
+	vh_json_destroy(root);
+
+	ret = vh_json_strp_htp_tdv(vh_td_tdv_lead(td), "[1]", 3, &htp);
+	assert(ret < 0);
+	assert(!htp);
+
+	/* Only read by assert */
+	(void) ret;
+}
+
+static void
+jht_plan(void)
+{
+	static Type tys_dbl[] = { &vh_type_dbl, 0 };
+	static Type tys_bool[] = { &vh_type_bool, 0 };
+	static const char expected[] = "[{\"id\":-2147483648,\"name\":\"Gear\\\"hart\\n\","
+								   "\"balance\":0.1,\"active\":true,\"total\":null},"
+								   "{\"id\":7,\"name\":null,\"balance\":null,"
+								   "\"active\":false,\"total\":-9223372036854775808}]";
+	TableDef td;
+	JsonHtpPlan plan;
+	HeapTuplePtr htps[2], htp;
+	String str;
+	FILE *tmp;
+	char buf[256];
+	ssize_t len;
+	int32_t ret;
+
+	td = vh_td_create(false);
+	vh_td_tf_add(td, tys_int32, "id");
+	vh_td_tf_add(td, tys_string, "name");
+	vh_td_tf_add(td, tys_dbl, "balance");
+	vh_td_tf_add(td, tys_bool, "active");
+	vh_td_tf_add(td, tys_int64, "total");
+
+	htps[0] = vh_allochtp_td(td);
+	vh_GetInt32Nm(htps[0], "id") = INT32_MIN;
+	vh_str.Assign(vh_GetStringNm(htps[0], "name"), "Gear\"hart\n");
+	*((double*)vh_getptrnm(htps[0], VH_HT_FLAG_MUTABLE, "balance")) = 0.1;
+	vh_GetBoolNm(htps[0], "active") = true;
+	vh_SetNullNm(htps[0], "total");
+
+	htps[1] = vh_allochtp_td(td);
+	vh_GetInt32Nm(htps[1], "id") = 7;
+	vh_GetBoolNm(htps[1], "active") = false;
+	vh_GetInt64Nm(htps[1], "total") = INT64_MIN;
+	vh_SetNullNm(htps[1], "balance");
+
+	plan = vh_json_htp_plan_create(vh_td_tdv_lead(td), 0, 0, false);
+	assert(plan);
+
+	str = vh_str.Create();
+	ret = vh_json_htp_plan_str(plan, htps, 2, str);
+	assert(ret == 0);
+	printf("\nHTP -> JSON (plan): %s", vh_str_buffer(str));
+	assert(strcmp(vh_str_buffer(str), expected) == 0);
+
+	/*
+	 * The same rows through a file descriptor should produce the same bytes.
+	 */
+	tmp = tmpfile();
+	ret = vh_json_htp_plan_fd(plan, htps, 2, fileno(tmp));
+	assert(ret == 0);
+	lseek(fileno(tmp), 0, SEEK_SET);
+	len = read(fileno(tmp), buf, sizeof(buf));
+	assert(len == (ssize_t)strlen(expected));
+	assert(memcmp(buf, expected, len) == 0);
+	fclose(tmp);
+
+	/*
+	 * A single object should parse straight back into an equivalent tuple.
+	 */
+	vh_str.Assign(str, "");
+	ret = vh_json_htp_plan_obj_str(plan, htps[0], str);
+	assert(ret == 0);
+
+	ret = vh_json_strp_htp_tdv(vh_td_tdv_lead(td), vh_str_buffer(str),
+							   vh_strlen(str), &htp);
+	assert(ret == 0);
+	assert(vh_GetInt32Nm(htp, "id") == INT32_MIN);
+	assert(*((double*)vh_getptrnm(htp, VH_HT_FLAG_MUTABLE, "balance")) == 0.1);
+	assert(strcmp(vh_str_buffer(vh_GetStringNm(htp, "name")), "Gear\"hart\n") == 0);
+
+	/* Only read by assert */
+	(void) expected;
+	(void) len;
+	(void) ret;
+
+	vh_str.Destroy(str);
+	vh_json_htp_plan_destroy(plan);
+}
+
+static void
+jht_plan_bench(void)
+{
+	static Type tys_dbl[] = { &vh_type_dbl, 0 };
+	static const int32_t rows = 50000;
+	struct jsax_counts c;
+	struct vh_stopwatch watch;
+	TableDef td;
+	JsonHtpPlan plan;
+	HeapTuplePtr *htps;
+	String str, stringify;
+	Json root, row;
+	char name[32];
+	int32_t i;
+
+	td = vh_td_create(false);
+	vh_td_tf_add(td, tys_int32, "id");
+	vh_td_tf_add(td, tys_string, "name");
+	vh_td_tf_add(td, tys_dbl, "balance");
+	vh_td_tf_add(td, tys_int64, "total");
+
+	htps = vhmalloc(sizeof(HeapTuplePtr) * rows);
+
+	/*
+	 * Keep every value non-zero, a field left at its zero value stays null
+	 * on the working copy.
+	 */
+	for (i = 0; i < rows; i++)
+	{
+		htps[i] = vh_allochtp_td(td);
+		snprintf(name, sizeof(name), "customer %d", i);
+
+		vh_GetInt32Nm(htps[i], "id") = i + 1;
+		vh_str.Assign(vh_GetStringNm(htps[i], "name"), name);
+		*((double*)vh_getptrnm(htps[i], VH_HT_FLAG_MUTABLE, "balance")) = (i + 1) * 7.25;
+		vh_GetInt64Nm(htps[i], "total") = (int64_t)(i + 1) * 1000003;
+	}
+
+	vh_stopwatch_start(&watch);
+	root = vh_json_make_array();
+
+	for (i = 0; i < rows; i++)
+	{
+		vh_htp_json(htps[i], false, &row);
+		vh_json_arr_push(root, row);
+	}
+
+	stringify = vh_json_stringify(root);
+	vh_stopwatch_end(&watch);
+	printf("\nvh_htp_json + vh_json_stringify of %d rows completed in %'ld ms",
+		   rows, vh_stopwatch_ms(&watch));
+
+	vh_json_destroy(root);
+	vh_str.Destroy(stringify);
+
+	vh_stopwatch_start(&watch);
+	plan = vh_json_htp_plan_create(vh_td_tdv_lead(td), 0, 0, false);
+	str = vh_str.Create();
+	assert(vh_json_htp_plan_str(plan, htps, rows, str) == 0);
+	vh_stopwatch_end(&watch);
+	printf("\nJSON plan of %d rows (%'lu bytes) completed in %'ld ms",
+		   rows, (unsigned long)vh_strlen(str), vh_stopwatch_ms(&watch));
+
+	memset(&c, 0, sizeof(c));
+	assert(vh_json_sax_parse(vh_str_buffer(str), vh_strlen(str),
+							 &jsax_callbacks, &c) == 0);
+	assert(c.objects == rows && c.keys == rows * 4 && c.ints + c.dbls == rows * 3);
+
+	vh_str.Destroy(str);
+	vh_json_htp_plan_destroy(plan);
+
+	for (i = 0; i < rows; i++)
+		vh_htp_free(htps[i]);
+
+	vhfree(htps);
+}
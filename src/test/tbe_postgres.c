@@ -45,6 +45,9 @@ static void attempt_query(XAct xact);
 static void attempt_query_pgclass(XAct xact);
 static void attempt_query_perf(XAct xact);
 static void attempt_ins_perf(XAct xact);
+static void bench_fetch_mode(XAct xact);
+static void bench_copyin(void);
+static void bench_pipeline(void);
 
 static void query_date(XAct xact);
 static void query_daterange(XAct xact);
@@ -79,6 +82,9 @@ void test_query(void)
 		lxact = vh_xact_create(Immediate);
 		//attempt_ins_perf(xact);
 		attempt_query_perf(lxact);
+		bench_fetch_mode(lxact);
+		bench_copyin();
+		bench_pipeline();
 		attempt_query(lxact);
 		vh_xact_rollback(lxact);
 		//vh_xact_destroy(lxact);
@@ -234,6 +240,17 @@ attempt_query(XAct xact)
 			}
 		}
 
+		for (i = 0; i < (uint32_t)eres->nshard_stats; i++)
+		{
+			assert(!eres->shard_stats[i].error);
+
+			printf("\nshard [%p]: %'d rows in %'u ms (%'u ms forming tuples)",
+				   eres->shard_stats[i].shard,
+				   eres->shard_stats[i].nrows,
+				   eres->shard_stats[i].stat_qexec,
+				   eres->shard_stats[i].stat_htform);
+		}
+
 		vh_exec_result_finalize(eres, true);
 	}
 
@@ -275,6 +292,190 @@ attempt_query_perf(XAct xact)
 	vh_xact_node(xact, (NodeQuery)nselect, &eres);
 }
 
+/*
+ * bench_fetch_mode
+ *
+ * Reads all of test_perf_int4 row by row and again with the binary COPY OUT
+ * bulk path, reporting rows per second for each.
+ */
+static int32_t
+bench_fetch_mode_run(XAct xact, TableDef td, SelectFetchMode mode, 
+					 int64_t *ms)
+{
+	NodeQuerySelect nselect;
+	ExecResult eres = 0;
+	struct vh_stopwatch sw;
+	int32_t nrows = 0;
+
+	nselect = vh_sqlq_sel_query_td(td);
+	vh_sqlq_sel_fetchmode_set(nselect, mode);
+
+	vh_stopwatch_start(&sw);
+	vh_xact_node(xact, (NodeQuery)nselect, &eres);
+	vh_stopwatch_end(&sw);
+
+	*ms = vh_stopwatch_ms(&sw);
+
+	if (eres)
+	{
+		nrows = vh_exec_result_rows(eres);
+		vh_exec_result_finalize(eres, false);
+	}
+
+	return nrows;
+}
+
+static void
+bench_fetch_mode(XAct xact)
+{
+	TableDef td_perf_int4;
+	int64_t ms_row, ms_bulk;
+	int32_t rows_row, rows_bulk;
+
+	td_perf_int4 = vh_cat_tbl_getbyname(ctx_catalog->catalogTable, 
+										"test_perf_int4");
+	assert(td_perf_int4);
+
+	rows_row = bench_fetch_mode_run(xact, td_perf_int4, SFM_Row, &ms_row);
+	rows_bulk = bench_fetch_mode_run(xact, td_perf_int4, SFM_Bulk, &ms_bulk);
+
+	assert(rows_row == rows_bulk);
+
+	printf("\nfetch %'d rows: single row mode %'ld ms (%'.0f rows/s), "
+		   "COPY OUT %'ld ms (%'.0f rows/s)",
+		   rows_row,
+		   ms_row, ms_row ? rows_row * 1000.0 / ms_row : 0.0,
+		   ms_bulk, ms_bulk ? rows_bulk * 1000.0 / ms_bulk : 0.0);
+}
+
+/*
+ * bench_copyin
+ *
+ * Bulk inserts 1M rows into test_perf_ins_int4 thru COPY IN and reports
+ * rows per second.  The transaction is rolled back so the table stays
+ * empty between runs.
+ */
+#define BENCH_COPYIN_ROWS		1000000
+
+static void
+bench_copyin(void)
+{
+	NodeQueryInsert ninsert;
+	SList tups;
+	TableDef td_perf_int4;
+	TableField tf;
+	HeapTuplePtr htp;
+	HeapTuple ht;
+	ExecResult eres = 0;
+	XAct xact;
+	struct vh_stopwatch sw;
+	int64_t ms;
+	int32_t i;
+
+	td_perf_int4 = vh_cat_tbl_getbyname(ctx_catalog->catalogTable, 
+										"test_perf_ins_int4");
+	assert(td_perf_int4);
+	tf = vh_td_tf_name(td_perf_int4, "cola");
+
+	xact = vh_xact_create(Immediate);
+
+	ninsert = vh_sqlq_ins_create();
+	vh_sqlq_ins_table(ninsert, td_perf_int4);
+
+	vh_htp_SListCreate(tups);
+
+	for (i = 0; i < BENCH_COPYIN_ROWS; i++)
+	{
+		htp = vh_xact_createht(xact, vh_td_tdv_lead(td_perf_int4));
+		ht = vh_htp_immutable(htp);
+		*((int32_t*)vh_ht_field(ht, &tf->heap)) = i;
+		vh_htf_clearnull(ht, &tf->heap);
+
+		vh_htp_SListPush(tups, htp);
+	}
+
+	vh_sqlq_ins_htp_list(ninsert, tups);
+
+	vh_stopwatch_start(&sw);
+	vh_xact_node(xact, (NodeQuery)ninsert, &eres);
+	vh_stopwatch_end(&sw);
+
+	ms = vh_stopwatch_ms(&sw);
+
+	printf("\nCOPY IN %'d rows: %'ld ms (%'.0f rows/s)",
+		   BENCH_COPYIN_ROWS, ms, ms ? BENCH_COPYIN_ROWS * 1000.0 / ms : 0.0);
+
+	vh_xact_rollback(xact);
+}
+
+/*
+ * bench_pipeline
+ *
+ * Runs single row inserts into test_perf_ins_int4 as their own statements,
+ * once in an Immediate XAct and again queued in a Serialized XAct which
+ * pipelines them on commit.
+ */
+#define BENCH_PIPELINE_ROWS		2000
+
+static int64_t
+bench_pipeline_run(XActMode mode, TableDef td, TableField tf)
+{
+	NodeQueryInsert ninsert;
+	HeapTuplePtr htp;
+	HeapTuple ht;
+	XAct xact;
+	struct vh_stopwatch sw;
+	int32_t i;
+	bool committed;
+
+	xact = vh_xact_create(mode);
+
+	vh_stopwatch_start(&sw);
+
+	for (i = 0; i < BENCH_PIPELINE_ROWS; i++)
+	{
+		htp = vh_xact_createht(xact, vh_td_tdv_lead(td));
+		ht = vh_htp_immutable(htp);
+		*((int32_t*)vh_ht_field(ht, &tf->heap)) = i;
+		vh_htf_clearnull(ht, &tf->heap);
+
+		ninsert = vh_sqlq_ins_create();
+		vh_sqlq_ins_table(ninsert, td);
+		vh_sqlq_ins_htp(ninsert, htp);
+
+		vh_xact_node(xact, (NodeQuery)ninsert, 0);
+	}
+
+	committed = vh_xact_commit(xact);
+	vh_stopwatch_end(&sw);
+
+	assert(committed);
+
+	vh_xact_destroy(xact);
+
+	return vh_stopwatch_ms(&sw);
+}
+
+static void
+bench_pipeline(void)
+{
+	TableDef td_perf_int4;
+	TableField tf;
+	int64_t ms_immediate, ms_serialized;
+
+	td_perf_int4 = vh_cat_tbl_getbyname(ctx_catalog->catalogTable, 
+										"test_perf_ins_int4");
+	assert(td_perf_int4);
+	tf = vh_td_tf_name(td_perf_int4, "cola");
+
+	ms_immediate = bench_pipeline_run(Immediate, td_perf_int4, tf);
+	ms_serialized = bench_pipeline_run(Serialized, td_perf_int4, tf);
+
+	printf("\n%'d single row inserts: Immediate %'ld ms, Serialized "
+		   "(pipelined) %'ld ms",
+		   BENCH_PIPELINE_ROWS, ms_immediate, ms_serialized);
+}
+
 static void
 attempt_ins_perf(XAct xact)
 {
@@ -6,6 +6,8 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <time.h>
+#include <uv.h>
 
 #include "vh.h"
 #include "io/be/sqlite/sqlite_be.h"
@@ -24,12 +26,15 @@
 #include "io/executor/exec.h"
 #include "io/executor/xact.h"
 #include "io/nodes/NodeFrom.h"
+#include "io/nodes/NodeQual.h"
 #include "io/nodes/NodeQuerySelect.h"
+#include "io/plan/pcache.h"
 #include "io/shard/ConnectionCatalog.h"
 #include "io/shard/Shard.h"
 #include "io/sql/InfoScheme.h"
 #include "io/sql/Query.h"
 #include "io/utils/SList.h"
+#include "io/utils/stopwatch.h"
 
 #include "test.h"
 
@@ -44,6 +49,10 @@ static void run_exec_query_td(void);
 static void run_exec_query_str(void);
 static void run_exec_query_ins(void);
 static void run_exec_query_ins_multi(void);
+static void run_exec_query_upd_multi(void);
+static void run_exec_query_pcache(void);
+static void run_bench_typed_io(void);
+static void run_conn_pool(void);
 
 void test_be_sqlite3(void)
 {
@@ -54,6 +63,10 @@ void test_be_sqlite3(void)
 	run_exec_query_td();
 	run_exec_query_ins();
 	run_exec_query_ins_multi();
+	run_exec_query_upd_multi();
+	run_exec_query_pcache();
+	run_bench_typed_io();
+	run_conn_pool();
 }
 
 static void setup_beacon(void)
@@ -311,3 +324,365 @@ run_exec_query_ins_multi(void)
 	vh_xact_destroy(xact);
 }
 
+/*
+ * run_exec_query_upd_multi
+ *
+ * Fetches a few test_dt rows, moves each date forward a day and syncs them
+ * back.  Every tuple changes the same field, so vh_sync sends them as a
+ * single batched UPDATE.
+ */
+static void
+run_exec_query_upd_multi(void)
+{
+	TableDef td_test_dt = 0;
+	NodeQuerySelect nqsel;
+	HeapTuplePtr htp;
+	ExecResult er;
+	XAct xact;
+	SList htps;
+
+	td_test_dt = vh_cat_tbl_getbyname(ctx_catalog->catalogTable,
+									  "test_dt");
+	assert(td_test_dt);
+
+	vh_htp_SListCreate(htps);
+
+	xact = vh_xact_create(Immediate);
+
+	nqsel = vh_sqlq_sel_query_td(td_test_dt);
+	vh_sqlq_sel_limit_set(nqsel, 10);
+
+	er = vh_exec_node(&nqsel->query.node);
+	assert(er);
+
+	if (vh_exec_result_iter_first(er))
+	{
+		do
+		{
+			htp = vh_exec_result_iter_htp(er, 0);
+			vh_GetDateNm(htp, "b") += 1;
+
+			vh_htp_SListPush(htps, htp);
+		} while (vh_exec_result_iter_next(er));
+	}
+
+	printf("\n\nUpdating %d test_dt records in SQLite with vh_sync",
+		   vh_SListSize(htps));
+
+	if (vh_SListSize(htps))
+		vh_sync(htps);
+
+	vh_xact_commit(xact);
+	vh_xact_destroy(xact);
+
+	vh_exec_result_finalize(er, false);
+	vh_SListDestroy(htps);
+}
+
+/*
+ * run_exec_query_pcache
+ *
+ * Runs the same point lookup with a different qual value each time.  The
+ * first run plans the query, every run after that should come out of the
+ * PlanCache and reuse the compiled statement on the connection.
+ */
+static void
+run_exec_query_pcache(void)
+{
+	TableDef td_test_int4;
+	NodeQuerySelect nqsel;
+	NodeFrom nfrom;
+	NodeQual nqual;
+	ExecResult er;
+	PlanCacheStats before, after;
+	int32_t i;
+
+	td_test_int4 = vh_cat_tbl_getbyname(ctx_catalog->catalogTable,
+										"test_int4");
+	assert(td_test_int4);
+
+	vh_pcache_stats(vh_pcache(), &before);
+
+	for (i = 0; i < 4; i++)
+	{
+		nqsel = vh_sqlq_sel_create();
+		nfrom = vh_sqlq_sel_from_add(nqsel, td_test_int4, 0);
+		vh_sqlq_sel_from_addfields(nqsel, nfrom, 0);
+
+		nqual = vh_nsql_qual_create(And, Eq);
+		vh_nsql_qual_lhs_tf_set(nqual, vh_td_tf_name(td_test_int4, "col"));
+		vh_nsql_qual_rhs_tvs_set(nqual);
+		vh_tvs_init(vh_nsql_qual_rhs_tvs(nqual));
+		vh_tvs_store_i32(vh_nsql_qual_rhs_tvs(nqual), 55 + i);
+		vh_sqlq_sel_qual_add(nqsel, 0, nqual);
+
+		er = vh_exec_node(&nqsel->query.node);
+		assert(er);
+
+		vh_exec_result_finalize(er, false);
+	}
+
+	vh_pcache_stats(vh_pcache(), &after);
+
+	printf("\nPlanCache: %llu hits, %llu misses, %llu bypassed, %u entries",
+		   (unsigned long long)(after.hits - before.hits),
+		   (unsigned long long)(after.misses - before.misses),
+		   (unsigned long long)(after.bypass - before.bypass),
+		   after.entries);
+
+	assert(after.misses - before.misses <= 1);
+	assert(after.hits - before.hits >= 3);
+}
+
+/*
+ * run_bench_typed_io
+ *
+ * Reads each column of a scratch table with the typed fetch path and again
+ * with everything going thru text, then does the same for a statement with a
+ * long list of bigint and real parameters.
+ */
+#define BENCH_TY_ROWS		100000
+#define BENCH_TY_PARAMS		256
+#define BENCH_TY_BINDRUNS	200
+
+static int64_t
+bench_typed_io_run(const char *query, TypeVarSlot *params, int32_t nparams,
+				   int32_t runs, bool typed, int32_t *nrows)
+{
+	struct vh_stopwatch watch;
+	ExecResult er;
+	int32_t i;
+
+	vh_be_sqlite3_typed_io(typed);
+	vh_stopwatch_start(&watch);
+
+	for (i = 0; i < runs; i++)
+	{
+		er = vh_exec_query_str_param(bec, query, params, nparams);
+		assert(er);
+
+		*nrows = vh_exec_result_rows(er);
+		vh_exec_result_finalize(er, false);
+	}
+
+	vh_stopwatch_end(&watch);
+	vh_be_sqlite3_typed_io(true);
+
+	return vh_stopwatch_ms(&watch);
+}
+
+static void
+bench_typed_io_binds(const char *name, const char *col, TypeVarSlot *params)
+{
+	char query[BENCH_TY_PARAMS * 2 + 128];
+	int64_t ms_typed, ms_text;
+	int32_t i, len, rows_typed, rows_text;
+
+	len = snprintf(query, sizeof(query),
+				   "SELECT count(*) FROM vh_bench_ty WHERE %s IN (?", col);
+
+	for (i = 1; i < BENCH_TY_PARAMS; i++)
+		len += snprintf(query + len, sizeof(query) - len, ",?");
+
+	snprintf(query + len, sizeof(query) - len, ");");
+
+	ms_typed = bench_typed_io_run(query, params, BENCH_TY_PARAMS,
+								  BENCH_TY_BINDRUNS, true, &rows_typed);
+	ms_text = bench_typed_io_run(query, params, BENCH_TY_PARAMS,
+								 BENCH_TY_BINDRUNS, false, &rows_text);
+
+	assert(rows_typed == rows_text);
+
+	printf("\n\t%-8s typed %'ld ms, text %'ld ms", name, ms_typed, ms_text);
+}
+
+static void
+run_bench_typed_io(void)
+{
+	static const struct
+	{
+		const char *name;
+		const char *query;
+	} cols[] = {
+		{ "integer", "SELECT i32 FROM vh_bench_ty;" },
+		{ "bigint", "SELECT i64 FROM vh_bench_ty;" },
+		{ "real", "SELECT d FROM vh_bench_ty;" },
+		{ "text", "SELECT s FROM vh_bench_ty;" },
+		{ "blob", "SELECT b FROM vh_bench_ty;" }
+	};
+	TypeVarSlot params[BENCH_TY_PARAMS];
+	char query[256];
+	int64_t ms_typed, ms_text;
+	int32_t i, rows_typed, rows_text;
+
+	bec = vh_ConnectionGet(ctx_catalog->catalogConnection, sa);
+
+	vh_exec_query_str(bec, "CREATE TEMP TABLE vh_bench_ty (i32 integer, "
+						   "i64 bigint, d real, s text, b blob);");
+
+	snprintf(query, sizeof(query),
+			 "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c "
+			 "WHERE x < %d) INSERT INTO vh_bench_ty SELECT x, x * 1000003, "
+			 "x * 0.25, 'row ' || x, randomblob(16) FROM c;",
+			 BENCH_TY_ROWS);
+	vh_exec_query_str(bec, query);
+
+	printf("\n\nSQLite typed vs text column fetch, %d rows", BENCH_TY_ROWS);
+
+	for (i = 0; i < sizeof(cols) / sizeof(cols[0]); i++)
+	{
+		ms_typed = bench_typed_io_run(cols[i].query, 0, 0, 1, true, &rows_typed);
+		ms_text = bench_typed_io_run(cols[i].query, 0, 0, 1, false, &rows_text);
+
+		assert(rows_typed == BENCH_TY_ROWS);
+		assert(rows_typed == rows_text);
+
+		printf("\n\t%-8s typed %'ld ms, text %'ld ms",
+			   cols[i].name, ms_typed, ms_text);
+	}
+
+	printf("\nSQLite typed vs text binds, %d runs of %d parameters",
+		   BENCH_TY_BINDRUNS, BENCH_TY_PARAMS);
+
+	for (i = 0; i < BENCH_TY_PARAMS; i++)
+	{
+		vh_tvs_init(&params[i]);
+		vh_tvs_store_i64(&params[i], (int64_t)i * 1000003);
+	}
+
+	bench_typed_io_binds("bigint", "i64", params);
+
+	for (i = 0; i < BENCH_TY_PARAMS; i++)
+		vh_tvs_store_double(&params[i], i * 0.25);
+
+	bench_typed_io_binds("real", "d", params);
+
+	printf("\n");
+
+	vh_exec_query_str(bec, "DROP TABLE vh_bench_ty;");
+	vh_ConnectionReturn(ctx_catalog->catalogConnection, bec);
+}
+
+/*
+ * run_conn_pool
+ *
+ * Hammers a ShardAccess capped at two connections from several threads, then
+ * checks a timed checkout gives up when the pool is exhausted.  Each worker
+ * holds its connection briefly so the others have to wait on the pool.
+ */
+#define CONNPOOL_THREADS		4
+#define CONNPOOL_CHECKOUTS		500
+#define CONNPOOL_MAX			2
+#define CONNPOOL_HOLD_NS		100000
+
+struct ConnPoolWorker
+{
+	uv_thread_t thread;
+	int32_t checkouts;
+	bool failed;
+};
+
+static int32_t connpool_in_use = 0;
+
+static void
+conn_pool_worker(void *arg)
+{
+	struct ConnPoolWorker *w = arg;
+	struct timespec hold = { .tv_sec = 0, .tv_nsec = CONNPOOL_HOLD_NS };
+	BackEndConnection nconn;
+	int32_t i, in_use;
+
+	if (!vh_ctx_thread_attach(ctx_catalog))
+	{
+		w->failed = true;
+		return;
+	}
+
+	for (i = 0; i < CONNPOOL_CHECKOUTS; i++)
+	{
+		nconn = vh_ConnectionGet(ctx_catalog->catalogConnection, sa);
+
+		if (!nconn)
+		{
+			w->failed = true;
+			break;
+		}
+
+		in_use = __atomic_add_fetch(&connpool_in_use, 1, __ATOMIC_SEQ_CST);
+
+		if (in_use > CONNPOOL_MAX)
+			w->failed = true;
+
+		nanosleep(&hold, 0);
+
+		__atomic_sub_fetch(&connpool_in_use, 1, __ATOMIC_SEQ_CST);
+
+		vh_ConnectionReturn(ctx_catalog->catalogConnection, nconn);
+		w->checkouts++;
+	}
+
+	vh_ctx_thread_detach();
+}
+
+static void
+run_conn_pool(void)
+{
+	struct ConnPoolWorker workers[CONNPOOL_THREADS] = { };
+	ConnectionCatalog cc = ctx_catalog->catalogConnection;
+	ConnectionPoolOpts opts, opts_saved;
+	ConnectionPoolStats before, after;
+	BackEndConnection held[CONNPOOL_MAX];
+	int32_t i;
+
+	/*
+	 * Earlier tests may still be holding a connection, leave room for them.
+	 */
+	vh_ConnectionCatalogGetOpts(cc, sa, &opts_saved);
+	vh_ConnectionCatalogStats(cc, sa, &before);
+
+	opts = opts_saved;
+	opts.max = before.total - before.idle + CONNPOOL_MAX;
+	opts.checkout_timeout_ms = -1;
+	vh_ConnectionCatalogSetOpts(cc, sa, &opts);
+
+	for (i = 0; i < CONNPOOL_THREADS; i++)
+		uv_thread_create(&workers[i].thread, conn_pool_worker, &workers[i]);
+
+	for (i = 0; i < CONNPOOL_THREADS; i++)
+	{
+		uv_thread_join(&workers[i].thread);
+		assert(!workers[i].failed);
+		assert(workers[i].checkouts == CONNPOOL_CHECKOUTS);
+	}
+
+	vh_ConnectionCatalogStats(cc, sa, &after);
+
+	printf("\n\nConnection pool: %llu checkouts, %llu waits (%.2f ms total, "
+		   "%.2f ms max), %llu spawned, %u open",
+		   (unsigned long long)(after.checkouts - before.checkouts),
+		   (unsigned long long)(after.waits - before.waits),
+		   (after.wait_ns - before.wait_ns) / 1e6,
+		   after.wait_ns_max / 1e6,
+		   (unsigned long long)(after.spawned - before.spawned),
+		   after.total);
+
+	assert(after.checkouts - before.checkouts == 
+		   CONNPOOL_THREADS * CONNPOOL_CHECKOUTS);
+	assert(after.waits - before.waits > 0);
+	assert(after.wait_ns_max > 0);
+	assert(after.total <= opts.max);
+
+	for (i = 0; i < CONNPOOL_MAX; i++)
+	{
+		held[i] = vh_ConnectionGetWait(cc, sa, 1000);
+		assert(held[i]);
+	}
+
+	assert(!vh_ConnectionGetWait(cc, sa, 10));
+	assert(!vh_ConnectionGetWait(cc, sa, 0));
+
+	for (i = 0; i < CONNPOOL_MAX; i++)
+		vh_ConnectionReturn(cc, held[i]);
+
+	vh_ConnectionCatalogSetOpts(cc, sa, &opts_saved);
+}
@@ -16,6 +16,7 @@
 
 void test_new_json_entry(void);
 void test_bt_entry(void);
+void test_buffmgr_entry(void);
 void test_config_entry(void);
 void test_hashtable(void);
 void test_operators(void);
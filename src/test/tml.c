@@ -131,7 +131,9 @@ test_ml_knn_abalone(void)
 	BackEndConnection bec;
 	ExecResult er;
 	HeapTuplePtr htp;
+	struct vh_stopwatch watch;
 	float test;
+	bool packed;
 	int32_t i = 0;
 
 	class = setup_sp("a");
@@ -179,6 +181,23 @@ test_ml_knn_abalone(void)
 	//test = vh_ml_test_classification(ml.ml, set_train, set_test, class);
 	printf("\n\t\tKNN Abalone Prediction Rate: %f\n", test);
 
+	/*
+	 * Packed training set, the distances run over a float64 matrix instead
+	 * of pulling every training tuple back thru the search paths.
+	 */
+	ml.ml = vh_ml_knn_create(paths, 8,
+							 class,
+							 vh_mlf_distance_euclidean, KNN_Classification);
+	packed = vh_ml_knn_pack(ml.ml, KNN_PackFloat64);
+	assert(packed);
+
+	vh_stopwatch_start(&watch);
+	test = vh_ml_test_classification(ml.ml, set_train, set_test, class);
+	vh_stopwatch_end(&watch);
+
+	printf("\n\t\tPacked KNN Abalone Prediction Rate: %f in %'ld ms\n",
+		   test, vh_stopwatch_ms(&watch));
+
 	ml.ml = vh_ml_naive_bayes_create(paths, 8, class,
 		   							 vh_mlf_probability_gaussian);
 
@@ -5,11 +5,14 @@
 
 
 #include <assert.h>
+#include <string.h>
 
 
 
 #include "vh.h"
+#include "io/analytics/nestidx.h"
 #include "io/analytics/nestlevel.h"
+#include "io/analytics/nloutput.h"
 #include "io/catalog/HeapField.h"
 #include "io/catalog/HeapTuple.h"
 #include "io/catalog/TableDef.h"
@@ -31,6 +34,15 @@ static void nest_setup_td(void);
 static void nest_setup(void);
 
 static void nest_fill(void);
+static void nest_fill_ordered(HeapTuplePtr *htps, int32_t n_htps);
+static void nest_fill_parallel(void);
+static void nest_fill_methods(void);
+
+static Nest nest_agg_create(bool ordered);
+static HeapTuplePtr* nest_agg_input(int32_t n_htps);
+static int32_t nest_agg_compare(Nest lhs, Nest rhs);
+static bool nest_agg_compare_scan(NestIdxAccess nia, void *user);
+static bool nest_sorted_scan(NestIdxAccess nia, void *user);
 
 static HeapTuplePtr nest_create_ht(TableDef td, 
 								   DateTime time, 
@@ -40,12 +52,32 @@ static Type tys_DateTime[] = { &vh_type_DateTime, 0 };
 static Type tys_int16[] = { &vh_type_int16, 0 };
 static Type tys_int32[] = { &vh_type_int32, 0 };
 
+struct NestAggCompareCtx
+{
+	Nest lhs;
+	Nest rhs;
+	NestIdxAccess nia;
+	TypeVarSlot **keys;
+	int32_t n_groups;
+	bool matches;
+};
+
+struct NestSortedCtx
+{
+	TypeVarSlot *prev;
+	int32_t n_cols;
+	int32_t n_groups;
+	bool sorted;
+};
+
 void test_nest_entry(void)
 {
 	nest_setup();
 	nest_setup_td();
 	
 	nest_fill();
+	nest_fill_parallel();
+	nest_fill_methods();
 }
 
 static void
@@ -151,6 +183,350 @@ nest_fill(void)
 	vh_stopwatch_end(&watch);
 
 	printf("complete in [%ld] ms\n", vh_stopwatch_ms(&watch));
+
+	nest_fill_ordered(htps, 6);
+}
+
+/*
+ * nest_fill_ordered
+ *
+ * Same input as nest_fill, but the level asks for ordered scans so the Nest
+ * is indexed with a BTree rather than the default hash.
+ */
+static void
+nest_fill_ordered(HeapTuplePtr *htps, int32_t n_htps)
+{
+	struct vh_stopwatch watch = { };
+	Nest nest_bt;
+	NestLevel nl_bt;
+	SearchPath sp;
+	PrepCol pc;
+	int32_t i, j;
+
+	nest_bt = vh_nest_create();
+	nl_bt = vh_nl_create();
+	vh_nl_ordered(nl_bt, true);
+
+	sp = vh_spht_tf_create("time");
+	pc = vh_pctsint_ts_create(0, 1, VH_PCTSINT_MINUTES, false);
+	vh_nl_groupby_pc_create(nl_bt, "time", sp, pc);
+
+	vh_nest_level_add(nest_bt, nl_bt);
+	assert(nest_bt->idxs[0].method == VH_NESTIDX_METH_BTREE);
+	assert(nest->idxs[0].method == VH_NESTIDX_METH_HASH);
+
+	printf("\nInputting %d HeapTuplePtr into an ordered nest...", 165000 * n_htps);
+	vh_stopwatch_start(&watch);
+
+	for (i = 0; i < 165000; i++)
+	{
+		for (j = 0; j < n_htps; j++)
+		{
+			vh_nest_input_htp(nest_bt, htps[j]);
+		}
+	}
+
+	vh_stopwatch_end(&watch);
+
+	printf("complete in [%ld] ms\n", vh_stopwatch_ms(&watch));
+}
+
+/*
+ * nest_fill_parallel
+ *
+ * Partitions the same input across several workers and checks every group
+ * comes out with the same aggregates as a serial input.
+ */
+static void
+nest_fill_parallel(void)
+{
+	struct vh_stopwatch watch = { };
+	Nest nest_serial, nest_par;
+	HeapTuplePtr *htps;
+	int32_t i, n_htps = 6000, n_groups;
+
+	htps = nest_agg_input(n_htps);
+	nest_serial = nest_agg_create(false);
+	nest_par = nest_agg_create(false);
+
+	printf("\nInputting %d HeapTuplePtr into a nest serially...", n_htps);
+	vh_stopwatch_start(&watch);
+
+	for (i = 0; i < n_htps; i++)
+		vh_nest_input_htp(nest_serial, htps[i]);
+
+	vh_stopwatch_end(&watch);
+	printf("complete in [%ld] ms\n", vh_stopwatch_ms(&watch));
+
+	printf("\nInputting %d HeapTuplePtr into a nest with 4 workers...", n_htps);
+	vh_stopwatch_start(&watch);
+
+	i = vh_nest_input_htp_parallel(nest_par, htps, n_htps, 4);
+	assert(i == 0);
+
+	vh_stopwatch_end(&watch);
+	printf("complete in [%ld] ms\n", vh_stopwatch_ms(&watch));
+
+	n_groups = nest_agg_compare(nest_serial, nest_par);
+	assert(n_groups > 0);
+	assert(nest_agg_compare(nest_par, nest_serial) == n_groups);
+
+	vhfree(htps);
+}
+
+/*
+ * nest_fill_methods
+ *
+ * The same input into a hash and a BTree nest has to produce the same groups
+ * and aggregates.  Sorted JSON output from the hash nest matches the BTree's
+ * and once sorted, the hash index scans in key order.
+ */
+static void
+nest_fill_methods(void)
+{
+	struct NestSortedCtx ctx = { };
+	Nest nest_hash, nest_btree;
+	NestIdx ni;
+	HeapTuplePtr *htps;
+	Json json_hash, json_btree;
+	String str_hash, str_btree;
+	int32_t i, n_htps = 6000, n_groups;
+
+	htps = nest_agg_input(n_htps);
+	nest_hash = nest_agg_create(false);
+	nest_btree = nest_agg_create(true);
+
+	assert(nest_hash->idxs[0].method == VH_NESTIDX_METH_HASH);
+	assert(nest_btree->idxs[0].method == VH_NESTIDX_METH_BTREE);
+
+	printf("\nInputting %d HeapTuplePtr into hash and BTree nests...", n_htps);
+
+	for (i = 0; i < n_htps; i++)
+	{
+		vh_nest_input_htp(nest_hash, htps[i]);
+		vh_nest_input_htp(nest_btree, htps[i]);
+	}
+
+	n_groups = nest_agg_compare(nest_hash, nest_btree);
+	assert(n_groups > 0);
+	assert(nest_agg_compare(nest_btree, nest_hash) == n_groups);
+
+	printf("%d groups match\n", n_groups);
+
+	/*
+	 * VH_NLO_FLAG_SORT sorts the hash index, so its output should line up with
+	 * the BTree's.
+	 */
+	json_hash = vh_nlo_json(nest_hash->ls[0], VH_NLO_FLAG_SORT);
+	json_btree = vh_nlo_json(nest_btree->ls[0], 0);
+	str_hash = vh_json_stringify(json_hash);
+	str_btree = vh_json_stringify(json_btree);
+
+	assert(strcmp(vh_str_buffer(str_hash), vh_str_buffer(str_btree)) == 0);
+
+	vh_str.Destroy(str_hash);
+	vh_str.Destroy(str_btree);
+	vh_json_destroy(json_hash);
+	vh_json_destroy(json_btree);
+
+	/*
+	 * The flag already sorted the index, sorting again has to leave it alone
+	 * and the scan must come back in key order.
+	 */
+	ni = &nest_hash->idxs[0];
+	i = vh_nestidx_sort(ni);
+	assert(i == 0);
+
+	ctx.n_cols = ni->n_cols;
+	ctx.prev = vhmalloc(sizeof(TypeVarSlot) * ctx.n_cols);
+	ctx.sorted = true;
+
+	for (i = 0; i < ctx.n_cols; i++)
+		vh_tvs_init(&ctx.prev[i]);
+
+	vh_nestidx_scan_all(ni, nest_sorted_scan, &ctx, true);
+
+	assert(ctx.sorted);
+	assert(ctx.n_groups == n_groups);
+
+	for (i = 0; i < ctx.n_cols; i++)
+		vh_tvs_reset(&ctx.prev[i]);
+
+	vhfree(ctx.prev);
+
+	vhfree(htps);
+}
+
+/*
+ * nest_agg_create
+ *
+ * Single level grouped by minute and sensor with integer aggregates on the
+ * temperature, so partial merges come out exactly the same as serial input.
+ */
+static Nest
+nest_agg_create(bool ordered)
+{
+	Nest n;
+	NestLevel nl;
+	SearchPath sp;
+	PrepCol pc;
+
+	n = vh_nest_create();
+	nl = vh_nl_create();
+	vh_nl_ordered(nl, ordered);
+
+	sp = vh_spht_tf_create("time");
+	pc = vh_pctsint_ts_create(0, 1, VH_PCTSINT_MINUTES, false);
+	vh_nl_groupby_pc_create(nl, "time", sp, pc);
+
+	sp = vh_spht_tf_create("sensorid");
+	vh_nl_groupby_create(nl, "sensor", sp);
+
+	sp = vh_spht_tf_create("temperature");
+	vh_nl_agg_create(nl, "min", sp, vh_acm_min_tys);
+	vh_nl_agg_create(nl, "max", sp, vh_acm_max_tys);
+	vh_nl_agg_create(nl, "sum", sp, vh_acm_sum_tys);
+	vh_nl_agg_create(nl, "count", sp, vh_acm_count_tys);
+
+	vh_nest_level_add(n, nl);
+
+	return n;
+}
+
+/*
+ * nest_agg_input
+ *
+ * Spreads |n_htps| readings over an hour of minutes and 7 sensors, the rows
+ * are out of key order so the unordered indexes have something to sort.
+ */
+static HeapTuplePtr*
+nest_agg_input(int32_t n_htps)
+{
+	struct DateTimeSplit dts = { };
+	HeapTuplePtr *htps;
+	int32_t i;
+
+	htps = vhmalloc(sizeof(HeapTuplePtr) * n_htps);
+
+	dts.year = 2017;
+	dts.month = 3;
+	dts.month_day = 27;
+	dts.hour = 15;
+
+	for (i = 0; i < n_htps; i++)
+	{
+		dts.minutes = (i * 37) % 60;
+		dts.seconds = i % 60;
+
+		htps[i] = nest_create_ht(td_nest, vh_ty_ts2datetime(&dts),
+								 (i * 13) % 7, (i * 31) % 101);
+	}
+
+	return htps;
+}
+
+/*
+ * nest_agg_compare
+ *
+ * Every group on |lhs| must exist on |rhs| with the same aggregate results.
+ * Returns the number of groups on |lhs|.
+ */
+static int32_t
+nest_agg_compare(Nest lhs, Nest rhs)
+{
+	struct NestAggCompareCtx ctx = { };
+	NestIdx ni = &rhs->idxs[0];
+
+	ctx.lhs = lhs;
+	ctx.rhs = rhs;
+	ctx.matches = true;
+	ctx.nia = vh_nestidx_access_create(ni);
+	ctx.keys = vhmalloc(sizeof(TypeVarSlot*) * ni->n_cols);
+
+	vh_nestidx_scan_all(&lhs->idxs[0], nest_agg_compare_scan, &ctx, true);
+
+	vh_nestidx_access_destroy(ni, ctx.nia);
+	vhfree(ctx.keys);
+
+	assert(ctx.matches);
+
+	return ctx.n_groups;
+}
+
+static bool
+nest_agg_compare_scan(NestIdxAccess nia, void *user)
+{
+	struct NestAggCompareCtx *ctx = user;
+	NestIdx ni = &ctx->rhs->idxs[0];
+	NestLevel nl_lhs = ctx->lhs->ls[0], nl_rhs = ctx->rhs->ls[0];
+	TypeVarSlot res_lhs, res_rhs;
+	int32_t i;
+
+	for (i = 0; i < ni->n_cols; i++)
+		ctx->keys[i] = &nia->keys[i];
+
+	ctx->n_groups++;
+
+	if (vh_nestidx_access(ni, ni->cols, ctx->keys, ni->n_cols,
+						  VH_NESTIDX_AM_FETCH, ctx->nia) ||
+		!ctx->nia->exists)
+	{
+		ctx->matches = false;
+		return false;
+	}
+
+	for (i = 0; i < nl_lhs->agg_n_cols; i++)
+	{
+		vh_tvs_init(&res_lhs);
+		vh_tvs_init(&res_rhs);
+
+		vh_acms_result(nl_lhs->agg_cols[i].acm,
+					   vh_nestidxv_value(nia->data, nl_lhs->idx, i),
+					   &res_lhs);
+		vh_acms_result(nl_rhs->agg_cols[i].acm,
+					   vh_nestidxv_value(ctx->nia->data, nl_rhs->idx, i),
+					   &res_rhs);
+
+		if (vh_tvs_compare(&res_lhs, &res_rhs))
+			ctx->matches = false;
+
+		vh_tvs_reset(&res_lhs);
+		vh_tvs_reset(&res_rhs);
+	}
+
+	return ctx->matches;
+}
+
+/*
+ * nest_sorted_scan
+ *
+ * Each group's keys must come strictly after the previous group's.
+ */
+static bool
+nest_sorted_scan(NestIdxAccess nia, void *user)
+{
+	struct NestSortedCtx *ctx = user;
+	int32_t i, cmp = 0;
+
+	if (ctx->n_groups++)
+	{
+		for (i = 0; i < ctx->n_cols && !cmp; i++)
+			cmp = vh_tvs_compare(&ctx->prev[i], &nia->keys[i]);
+
+		if (cmp >= 0)
+		{
+			ctx->sorted = false;
+			return false;
+		}
+	}
+
+	for (i = 0; i < ctx->n_cols; i++)
+	{
+		vh_tvs_reset(&ctx->prev[i]);
+		vh_tvs_copy(&ctx->prev[i], &nia->keys[i]);
+	}
+
+	return true;
 }
 
 static HeapTuplePtr 
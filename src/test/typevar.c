@@ -6,10 +6,13 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "vh.h"
 #include "io/catalog/Type.h"
 #include "io/catalog/TypeVar.h"
+#include "io/catalog/TypeVarSlot.h"
+#include "io/utils/stopwatch.h"
 
 struct TypeVarPointer2
 {
@@ -36,6 +39,7 @@ static void test_typecomp_int(void);
 static void test_typeop_int16(void);
 
 static void test_typeop_int64_str(void);
+static void test_typeop_spec(void);
 
 
 void test_typevar_entry(void)
@@ -46,6 +50,7 @@ void test_typevar_entry(void)
 	test_typeop_int16();
 
 	test_typeop_int64_str();
+	test_typeop_spec();
 }
 
 static void 
@@ -315,3 +320,157 @@ test_typeop_int64_str(void)
 
 }
 
+#define SPEC_BENCH_N	1000000
+
+static void
+test_typeop_spec(void)
+{
+	static Type tys_i32[] = { &vh_type_int32, 0 };
+	static Type tys_dbl[] = { &vh_type_dbl, 0 };
+	TypeVarOpSpecData spec, spec_pleq, spec_lt;
+	TypeVarOpExec tvope;
+	TypeVarSlot slhs[4], srhs[4], sret[4];
+	struct vh_stopwatch watch;
+	int32_t *ilhs, *irhs, iret, i, two[4] = { 2, 2, 2, 2 };
+	double *dlhs, *drhs, *dret, dsum;
+	bool *res, ok;
+
+	/*
+	 * Single values thru the specialization
+	 */
+	iret = 0;
+	i = 30;
+
+	ok = vh_typevar_op_spec(&spec, "+", tys_i32, tys_i32);
+	assert(ok);
+	assert(spec.kernel);
+	vh_typevar_spec_op(&spec, &i, &(int32_t){ 12 }, &iret);
+	assert(iret == 42);
+
+	ok = vh_typevar_op_spec(&spec_lt, "<", tys_i32, tys_i32);
+	assert(ok);
+	assert(vh_typevar_spec_comp(&spec_lt, &(int32_t){ 12 }, &i));
+	assert(!vh_typevar_spec_comp(&spec_lt, &i, &i));
+
+	ok = vh_typevar_op_spec(&spec_lt, "!=", tys_i32, tys_i32);
+	assert(ok);
+	assert(vh_typevar_spec_comp(&spec_lt, &iret, &i));
+	assert(!vh_typevar_spec_comp(&spec_lt, &i, &i));
+
+	ok = vh_typevar_op_spec(&spec_pleq, "+=", tys_i32, tys_i32);
+	assert(ok);
+	assert(spec_pleq.self);
+	vh_typevar_spec_op(&spec_pleq, &i, &iret, 0);
+	assert(i == 72);
+
+	ok = vh_typevar_op_spec(&spec_lt, "<", tys_i32, tys_dbl);
+	assert(!ok);
+
+	/*
+	 * TypeVarSlot batches, the second pair has a null RHS.
+	 */
+	for (i = 0; i < 4; i++)
+	{
+		vh_tvs_init(&slhs[i]);
+		vh_tvs_init(&srhs[i]);
+		vh_tvs_init(&sret[i]);
+		vh_tvs_store_i32(&slhs[i], i * 10);
+		vh_tvs_store_i32(&srhs[i], i);
+		vh_tvs_store_i32(&sret[i], 0);
+	}
+
+	vh_tvs_setnull(&srhs[1]);
+
+	vh_typevar_op_batch(&spec, slhs, srhs, sret, 0, 4);
+	assert(*(int32_t*)vh_tvs_value(&sret[3]) == 33);
+	assert(vh_tvs_isnull(&sret[1]));
+	assert(!vh_tvs_isnull(&sret[2]));
+
+	res = malloc(sizeof(bool) * 4);
+	ok = vh_typevar_op_spec(&spec_lt, ">", tys_i32, tys_i32);
+	assert(ok);
+	vh_typevar_op_batch(&spec_lt, slhs, srhs, 0, res, 4);
+	assert(!res[0] && !res[1] && res[2] && res[3]);
+
+	/*
+	 * Contiguous arrays with and without a kernel.
+	 */
+	ilhs = malloc(sizeof(int32_t) * SPEC_BENCH_N * 2);
+	irhs = ilhs + SPEC_BENCH_N;
+	dlhs = malloc(sizeof(double) * SPEC_BENCH_N * 3);
+	drhs = dlhs + SPEC_BENCH_N;
+	dret = drhs + SPEC_BENCH_N;
+	free(res);
+	res = malloc(sizeof(bool) * SPEC_BENCH_N);
+
+	for (i = 0; i < SPEC_BENCH_N; i++)
+	{
+		ilhs[i] = 0;
+		irhs[i] = i & 0xff;
+		dlhs[i] = i * 0.5;
+		drhs[i] = 2.0;
+	}
+
+	ok = vh_typevar_op_spec(&spec, "/", tys_dbl, tys_dbl);
+	assert(ok);
+	assert(spec.kernel);
+	vh_typevar_op_array(&spec, dlhs, drhs, dret, SPEC_BENCH_N);
+	assert(dret[1000] == 250.0);
+
+	ok = vh_typevar_op_spec(&spec, "/", tys_i32, tys_i32);
+	assert(ok);
+	assert(!spec.kernel);
+	vh_typevar_op_array(&spec, irhs, two, ilhs, 4);
+	assert(ilhs[3] == 1);
+
+	ok = vh_typevar_op_spec(&spec_lt, ">=", tys_dbl, tys_dbl);
+	assert(ok);
+	vh_typevar_op_array(&spec_lt, dlhs, drhs, res, SPEC_BENCH_N);
+	assert(!res[3] && res[4] && res[SPEC_BENCH_N - 1]);
+
+	/*
+	 * Sum an int32 array with the fast path operator, the specialization
+	 * and the array kernel.
+	 */
+	tvope = vh_typevar_op_init_tys("+=", tys_i32, tys_i32, 0);
+	assert(tvope);
+
+	printf("\ntest_typeop_spec: int32 += over %d values", SPEC_BENCH_N);
+
+	for (i = 0; i < SPEC_BENCH_N; i++)
+		ilhs[i] = 0;
+
+	vh_stopwatch_start(&watch);
+	for (i = 0; i < SPEC_BENCH_N; i++)
+		vh_typevar_op_fp(tvope, &ilhs[i], &irhs[i]);
+	vh_stopwatch_end(&watch);
+	printf("\n\tvh_typevar_op_fp:    %'ld ns", vh_stopwatch_ns(&watch));
+
+	vh_stopwatch_start(&watch);
+	for (i = 0; i < SPEC_BENCH_N; i++)
+		vh_typevar_spec_op(&spec_pleq, &ilhs[i], &irhs[i], 0);
+	vh_stopwatch_end(&watch);
+	printf("\n\tvh_typevar_spec_op:  %'ld ns", vh_stopwatch_ns(&watch));
+
+	vh_stopwatch_start(&watch);
+	vh_typevar_op_array(&spec_pleq, ilhs, irhs, 0, SPEC_BENCH_N);
+	vh_stopwatch_end(&watch);
+	printf("\n\tvh_typevar_op_array: %'ld ns", vh_stopwatch_ns(&watch));
+
+	for (i = 0; i < SPEC_BENCH_N; i++)
+		assert(ilhs[i] == 3 * irhs[i]);
+
+	dsum = 0;
+	for (i = 0; i < SPEC_BENCH_N; i++)
+		dsum += dret[i];
+
+	printf("\n\tdouble / checksum:   %f\n", dsum);
+
+	/* Only read by assert */
+	(void) ok;
+
+	vh_typevar_op_destroy(tvope);
+	free(ilhs);
+	free(dlhs);
+	free(res);
+}
@@ -18,6 +18,7 @@ static void test_acm_min(void);
 static void test_acm_sum(void);
 
 static void test_acm_vars(void);
+static void test_acm_merge(void);
 
 static Type tys_int16[] = { &vh_type_int16, 0 };
 static Type tys_int32[] = { &vh_type_int32, 0 };
@@ -31,6 +32,7 @@ void test_typevaracm_entry(void)
 	test_acm_min();
 
 	test_acm_vars();
+	test_acm_merge();
 }
 
 static void
@@ -280,3 +282,87 @@ test_acm_vars(void)
 }
 
 
+
+/*
+ * Splits the inputs across two states and merges them, the results should
+ * match feeding a single state.
+ */
+static void
+test_acm_merge(void)
+{
+	int16_t *input16 = vh_makevar1(short), *res16;
+	int32_t *input32 = vh_makevar1(int), *res32;
+	int32_t vals[] = { 10, 20, 30, 80, 50, 60, 75, 72, 76 };
+	int32_t i, n_vals = sizeof(vals) / sizeof(int32_t);
+	TypeVarAcm acm_avg, acm_max, acm_vars;
+	TypeVarAcmState lhs, rhs;
+	TypeVarSlot slot, result;
+
+	vh_tvs_init(&slot);
+	vh_tvs_init(&result);
+
+	/* avg (int16) */
+	vh_tvs_store_var(&slot, input16, 0);
+	acm_avg = vh_acm_avg_tys(tys_int16);
+	lhs = vh_acms_create(acm_avg);
+	rhs = vh_acms_create(acm_avg);
+
+	*input16 = 10;
+	vh_acms_input(acm_avg, lhs, &slot);
+	vh_acms_input(acm_avg, lhs, &slot);
+	vh_acms_input(acm_avg, lhs, &slot);
+	vh_acms_input(acm_avg, rhs, &slot);
+	vh_acms_input(acm_avg, rhs, &slot);
+
+	*input16 = 50;
+	vh_acms_input(acm_avg, rhs, &slot);
+
+	assert(!vh_acms_merge(acm_avg, lhs, rhs));
+	vh_acms_result(acm_avg, lhs, &result);
+	res16 = vh_tvs_value(&result);
+	assert(res16);
+	assert(*res16 == 16);
+	printf("\ntest_acm_merge avg (int16): %d == 16", *res16);
+	vh_tvs_reset(&result);
+
+	/* max (int16) */
+	acm_max = vh_acm_max_tys(tys_int16);
+	lhs = vh_acms_create(acm_max);
+	rhs = vh_acms_create(acm_max);
+
+	*input16 = 25;
+	vh_acms_input(acm_max, lhs, &slot);
+	*input16 = 101;
+	vh_acms_input(acm_max, rhs, &slot);
+	*input16 = 30;
+	vh_acms_input(acm_max, rhs, &slot);
+
+	assert(!vh_acms_merge(acm_max, lhs, rhs));
+	vh_acms_result(acm_max, lhs, &result);
+	res16 = vh_tvs_value(&result);
+	assert(res16);
+	assert(*res16 == 101);
+	printf("\ntest_acm_merge max (int16): %d == 101", *res16);
+	vh_tvs_reset(&result);
+
+	/* vars (int32) */
+	vh_tvs_reset(&slot);
+	vh_tvs_store_var(&slot, input32, 0);
+	acm_vars = vh_acm_vars_tys(tys_int32);
+	lhs = vh_acms_create(acm_vars);
+	rhs = vh_acms_create(acm_vars);
+
+	for (i = 0; i < n_vals; i++)
+	{
+		*input32 = vals[i];
+		vh_acms_input(acm_vars, i < 4 ? lhs : rhs, &slot);
+	}
+
+	assert(!vh_acms_merge(acm_vars, lhs, rhs));
+	vh_acms_result(acm_vars, lhs, &result);
+	res32 = vh_tvs_value(&result);
+	assert(res32);
+	assert(*res32 == 703);
+	printf("\ntest_acm_merge vars (int32): %d == 703\n", *res32);
+	vh_tvs_reset(&result);
+}